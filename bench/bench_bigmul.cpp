@@ -0,0 +1,84 @@
+/**
+ * @file bench_bigmul.cpp
+ * @brief Microbenchmark of the host time one 4096-bit BIGMUL takes, per engine and diagonal-sum kernel.
+ */
+
+#include "vm/bigmul_kernels.h"
+#include "vm/bigmul_unit.h"
+#include "../test/bigmul_test_utils.h"
+
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+constexpr int kIterations = 2000;
+
+struct Measurement {
+  double ns_per_bigmul = 0;
+  uint64_t cycles = 0;
+  uint64_t checksum = 0;
+};
+
+Measurement RunBigmuls(vm_config::BigmulEngine engine, const std::vector<uint64_t> &a,
+                       const std::vector<uint64_t> &b) {
+  Measurement measurement;
+  BigmulUnit unit;
+  unit.SetEngine(engine);
+  auto start = std::chrono::steady_clock::now();
+  for (int it = 0; it < kIterations; ++it) {
+    // Back-to-back BIGMULs on operands LDBM already loaded
+    unit.reset();
+    unit.cacheA = a;
+    unit.cacheB = b;
+    unit.LdbmLoaded();
+    unit.bigmul_done_ = false;
+    while (unit.GetWriteDone()) {
+      unit.executeBigmul();
+    }
+    measurement.checksum += unit.resultCache[it % unit.resultCache.size()];
+  }
+  auto end = std::chrono::steady_clock::now();
+  measurement.ns_per_bigmul = std::chrono::duration<double>(end - start).count() * 1e9 / kIterations;
+  measurement.cycles = unit.GetStats().compute_cycles;
+  return measurement;
+}
+
+} // namespace
+
+int main() {
+  std::vector<uint64_t> a = RandomDwords(BigmulUnit::kDefaultCacheDwords, 0x243f6a8885a308d3ULL);
+  std::vector<uint64_t> b = RandomDwords(BigmulUnit::kDefaultCacheDwords, 0x85a308d3243f6a88ULL);
+
+  bool mismatch = false;
+  std::cout << std::fixed << std::setprecision(1);
+  for (vm_config::BigmulEngine engine : {vm_config::BigmulEngine::SINGLECYCLE, vm_config::BigmulEngine::CSA_ONLY,
+                                         vm_config::BigmulEngine::SYSTOLIC}) {
+    bigmul_kernels::SetKernel(bigmul_kernels::Kernel::SCALAR);
+    Measurement scalar = RunBigmuls(engine, a, b);
+    std::cout << std::left << std::setw(12) << vm_config::bigmulEngineName(engine)
+              << std::setw(8) << "scalar" << std::right << std::setw(10) << scalar.ns_per_bigmul
+              << " ns/bigmul  " << scalar.cycles << " cycles\n";
+
+    for (bigmul_kernels::Kernel kernel : {bigmul_kernels::Kernel::AVX2, bigmul_kernels::Kernel::AVX512}) {
+      if (!bigmul_kernels::Supported(kernel)) {
+        continue;
+      }
+      bigmul_kernels::SetKernel(kernel);
+      Measurement simd = RunBigmuls(engine, a, b);
+      std::cout << std::left << std::setw(12) << vm_config::bigmulEngineName(engine)
+                << std::setw(8) << bigmul_kernels::KernelName(kernel) << std::right << std::setw(10)
+                << simd.ns_per_bigmul << " ns/bigmul  " << simd.cycles << " cycles  "
+                << std::setprecision(2) << scalar.ns_per_bigmul / simd.ns_per_bigmul << "x"
+                << std::setprecision(1) << "\n";
+      if (simd.checksum != scalar.checksum || simd.cycles != scalar.cycles) {
+        std::cerr << "Mismatch between scalar and " << bigmul_kernels::KernelName(kernel) << "\n";
+        mismatch = true;
+      }
+    }
+  }
+  return mismatch ? 1 : 0;
+}
@@ -0,0 +1,112 @@
+/**
+ * @file bench_memory.cpp
+ * @brief Microbenchmark comparing the page table backed Memory with the former per-byte hash map store.
+ * @author Vishank Singh, https://github.com/VishankSingh
+ */
+
+#include "vm/main_memory.h"
+
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+/**
+ * @brief Replica of the former Memory backing store: one hash lookup per byte.
+ */
+class MapMemory {
+ private:
+  std::unordered_map<uint64_t, std::vector<uint8_t>> blocks_;
+  unsigned int block_size_ = 1024;
+
+ public:
+  uint8_t Read(uint64_t address) {
+    auto it = blocks_.find(address/block_size_);
+    if (it == blocks_.end()) {
+      return 0;
+    }
+    return it->second[address%block_size_];
+  }
+
+  void Write(uint64_t address, uint8_t value) {
+    auto it = blocks_.find(address/block_size_);
+    if (it == blocks_.end()) {
+      it = blocks_.emplace(address/block_size_, std::vector<uint8_t>(block_size_, 0)).first;
+    }
+    it->second[address%block_size_] = value;
+  }
+
+  uint64_t ReadDoubleWord(uint64_t address) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < sizeof(uint64_t); ++i) {
+      value |= static_cast<uint64_t>(Read(address + i)) << (8*i);
+    }
+    return value;
+  }
+
+  void WriteDoubleWord(uint64_t address, uint64_t value) {
+    for (size_t i = 0; i < sizeof(uint64_t); ++i) {
+      Write(address + i, static_cast<uint8_t>(value >> (8*i)));
+    }
+  }
+
+  uint32_t ReadWord(uint64_t address) {
+    uint32_t value = 0;
+    for (size_t i = 0; i < sizeof(uint32_t); ++i) {
+      value |= static_cast<uint32_t>(Read(address + i)) << (8*i);
+    }
+    return value;
+  }
+};
+
+constexpr uint64_t kTextBase = 0x0;
+constexpr uint64_t kDataBase = 0x10000000;
+constexpr uint64_t kWorkingSet = 64*1024; // bytes touched by the data loop
+constexpr int kIterations = 200;
+
+template<typename Mem>
+double RunWorkload(Mem &memory, uint64_t &checksum) {
+  auto start = std::chrono::steady_clock::now();
+  for (uint64_t addr = 0; addr < kWorkingSet; addr += 8) {
+    memory.WriteDoubleWord(kDataBase + addr, addr*0x9e3779b97f4a7c15ULL);
+  }
+  for (int it = 0; it < kIterations; ++it) {
+    for (uint64_t addr = 0; addr < kWorkingSet; addr += 8) {
+      checksum += memory.ReadWord(kTextBase + (addr & 0xfff)); // instruction fetch
+      checksum += memory.ReadDoubleWord(kDataBase + addr);     // ld
+    }
+  }
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double>(end - start).count();
+}
+
+} // namespace
+
+int main() {
+  uint64_t accesses = 2*(kWorkingSet/8)*kIterations;
+
+  MapMemory map_memory;
+  uint64_t map_checksum = 0;
+  double map_seconds = RunWorkload(map_memory, map_checksum);
+
+  Memory page_table_memory;
+  uint64_t page_table_checksum = 0;
+  double page_table_seconds = RunWorkload(page_table_memory, page_table_checksum);
+
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << "accesses:           " << accesses << "\n";
+  std::cout << "unordered_map:      " << map_seconds*1e9/accesses << " ns/access\n";
+  std::cout << "page table:         " << page_table_seconds*1e9/accesses << " ns/access\n";
+  std::cout << "speedup:            " << map_seconds/page_table_seconds << "x\n";
+
+  if (map_checksum != page_table_checksum) {
+    std::cerr << "Checksum mismatch: " << map_checksum << " != " << page_table_checksum << "\n";
+    return 1;
+  }
+  return 0;
+}
@@ -16,6 +16,8 @@
 #include "code_generator.h"
 #include "vm_asm_mw.h"
 
+#include <filesystem>
+
 /**
  * @brief Assembles the intermediate code into machine code.
  * 
@@ -29,4 +31,20 @@
  */
 AssembledProgram assemble(const std::string &filename);
 
+/**
+ * @brief Assembles a file, dumping its disassembly and errors into the given directory instead of vm_state.
+ *
+ * @param filename The assembly file.
+ * @param output_directory The directory receiving disassembly.txt and errors_dump.json.
+ * @return The assembled program.
+ */
+AssembledProgram assemble(const std::string &filename, const std::filesystem::path &output_directory);
+
+/**
+ * @brief Assembles a file, dumping its disassembly and errors to the given files.
+ */
+AssembledProgram assemble(const std::string &filename,
+                          const std::filesystem::path &disassembly_file_path,
+                          const std::filesystem::path &errors_dump_file_path);
+
 #endif // ASSEMBLER_H
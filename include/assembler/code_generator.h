@@ -286,6 +286,14 @@ uint32_t generateJTypeMachineCode(const ICUnit &block);
 uint32_t generateCSRRTypeMachineCode(const ICUnit &block);
 uint32_t generateCSRITypeMachineCode(const ICUnit &block);
 
+/**
+ * @brief Generates machine code for an A extension instruction, with its aq and rl bits.
+ *
+ * @param block The ICUnit representing the instruction.
+ * @return The machine code bitset<32>.
+ */
+uint32_t generateATypeMachineCode(const ICUnit &block);
+
 uint32_t generateFDRTypeMachineCode(const ICUnit &block);
 uint32_t generateFDR1TypeMachineCode(const ICUnit &block);
 uint32_t generateFDR2TypeMachineCode(const ICUnit &block);
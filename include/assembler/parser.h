@@ -148,6 +148,9 @@ class Parser {
   bool parse_O_GPR_C_FPR_C_FPR();
   bool parse_O_FPR_C_I_LP_GPR_RP();
 
+  bool parse_O_GPR_C_GPR_C_LP_GPR_RP();
+  bool parse_O_GPR_C_LP_GPR_RP();
+
   /**
    * @brief Parses a data directive.
    */
@@ -0,0 +1,125 @@
+/**
+ * @file batch_runner.h
+ * @brief Headless runner that assembles and runs many programs in parallel, one isolated VM per program.
+ */
+
+#ifndef BATCH_RUNNER_H
+#define BATCH_RUNNER_H
+
+#include "config.h"
+#include "vm/bigmul_unit.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace batch_runner {
+
+/**
+ * @brief Outcome of running one program of a batch.
+ */
+struct BatchResult {
+  std::filesystem::path program; ///< The assembly file.
+  std::filesystem::path output_directory; ///< Where the program's dumps, console log and result.json were written.
+  std::string status; ///< VM_PROGRAM_END, VM_EXIT, VM_EXECUTION_LIMIT, VM_PARSE_ERROR or VM_RUNTIME_ERROR.
+  std::string error; ///< The error message for VM_PARSE_ERROR and VM_RUNTIME_ERROR.
+  bool exited = false; ///< Whether the program made the exit syscall.
+  uint64_t exit_code = 0; ///< a0 at the exit syscall.
+  uint64_t instructions_retired = 0;
+  uint64_t cycles = 0;
+  double host_seconds = 0; ///< Wall time spent assembling and running the program.
+  std::vector<uint64_t> gp_registers; ///< Final x0..x31.
+
+  /**
+   * @brief Whether the program ran to its end or exited on its own.
+   */
+  [[nodiscard]] bool Succeeded() const {
+    return status == "VM_PROGRAM_END" || status == "VM_EXIT";
+  }
+};
+
+/**
+ * @brief Lists the programs of a batch.
+ * @param source A directory, whose .s files are taken in name order, or a list file naming one program
+ *        per line. Empty lines and lines starting with '#' are skipped; relative paths are resolved
+ *        against the list file's directory.
+ * @return The program paths.
+ * @throws std::runtime_error If the source does not exist or cannot be read.
+ */
+std::vector<std::filesystem::path> CollectPrograms(const std::filesystem::path &source);
+
+/**
+ * @brief Assembles and runs one program on a fresh VM whose dumps all go to output_directory.
+ *
+ * The run is silent, program output is written to console.log, stdin is closed and the exit syscall
+ * ends the run instead of the process. The result is also dumped to output_directory/result.json.
+ */
+BatchResult RunProgram(const std::filesystem::path &program, const std::filesystem::path &output_directory,
+                       vm_config::VmTypes vm_type);
+
+/**
+ * @brief Runs every program across a pool of worker threads.
+ * @param programs The programs to run.
+ * @param output_directory Each program gets a subdirectory named after it; summary.json goes here.
+ * @param jobs The number of worker threads; 0 uses the hardware concurrency.
+ * @param vm_type The VM engine every program runs on.
+ * @return The results, in the order of programs.
+ */
+std::vector<BatchResult> RunBatch(const std::vector<std::filesystem::path> &programs,
+                                  const std::filesystem::path &output_directory,
+                                  unsigned int jobs,
+                                  vm_config::VmTypes vm_type);
+
+/**
+ * @brief Every BIGMUL engine, singlecycle first.
+ */
+inline constexpr vm_config::BigmulEngine kBigmulEngines[] = {
+    vm_config::BigmulEngine::SINGLECYCLE,
+    vm_config::BigmulEngine::CSA_ONLY,
+    vm_config::BigmulEngine::STAGED3,
+    vm_config::BigmulEngine::STAGED7,
+    vm_config::BigmulEngine::SYSTOLIC,
+};
+
+/**
+ * @brief Outcome of running a program with one BIGMUL engine.
+ */
+struct BigmulEngineResult {
+  vm_config::BigmulEngine engine = vm_config::BigmulEngine::SINGLECYCLE;
+  BatchResult run;
+  uint64_t stall_cycles = 0; ///< Cycles that retired no instruction, spent in LDBM, BIGMUL compute or writeback.
+  std::vector<uint64_t> bigmul_result; ///< The result cache after the run, i.e. the last BIGMUL product.
+  BigmulUnit::BigmulStats bigmul_stats; ///< Cycle, throughput and stage occupancy counts of the last BIGMUL.
+  bool matches_reference = false; ///< Whether the run succeeded with the same product and registers as singlecycle.
+};
+
+/**
+ * @brief Runs one program once per BIGMUL engine, each on a fresh VM, and compares them with singlecycle.
+ * @param output_directory Each engine's run gets a subdirectory named after the engine.
+ * @return One result per engine, in the order of kBigmulEngines.
+ */
+std::vector<BigmulEngineResult> RunBigmulEngineReport(const std::filesystem::path &program,
+                                                      const std::filesystem::path &output_directory,
+                                                      vm_config::VmTypes vm_type);
+
+/**
+ * @brief Prints a table of stall cycles, total cycles, throughput and result equality, one row per engine,
+ *        followed by the stage occupancy of the pipelined engines.
+ */
+void PrintBigmulEngineReport(std::ostream &out, const std::vector<BigmulEngineResult> &results);
+
+void DumpBatchResult(const std::filesystem::path &filename, const BatchResult &result);
+
+void DumpBatchSummary(const std::filesystem::path &filename, const std::vector<BatchResult> &results,
+                      double host_seconds);
+
+/**
+ * @brief Prints one VM_BATCH_RESULT line per program followed by a VM_BATCH_SUMMARY line.
+ */
+void PrintBatchReport(std::ostream &out, const std::vector<BatchResult> &results, double host_seconds);
+
+} // namespace batch_runner
+
+#endif // BATCH_RUNNER_H
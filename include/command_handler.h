@@ -16,11 +16,17 @@ enum class CommandType {
   MODIFY_CONFIG,
   LOAD,
   RUN,
+  TURBO_RUN,
   STOP,
   DEBUG_RUN,
   STEP,
   UNDO,
   REDO,
+  HISTORY_STATS,
+  REVERSE_STEP,
+  REVERSE_CONTINUE,
+  SNAPSHOT,
+  RESTORE,
   RESET,
   MODIFY_REGISTER,
   GET_REGISTER,
@@ -29,6 +35,7 @@ enum class CommandType {
   PRINT_MEMORY,
   GET_MEMORY_POINT,
   DUMP_CACHE,
+  DUMP_BRANCH_STATS,
   ADD_BREAKPOINT,
   REMOVE_BREAKPOINT,
   VM_STDIN,
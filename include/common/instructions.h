@@ -33,6 +33,7 @@ enum Instruction {
   kRLtype,
   
   kCsrType, // CSR type instructions
+  kAtomicType, // A extension
 
 
   // Real instructions
@@ -205,6 +206,30 @@ enum Instruction {
   kfcvt_d_lu, 
   kfmv_d_x,
 
+  // A extension
+  klr_w,
+  klr_d,
+  ksc_w,
+  ksc_d,
+  kamoswap_w,
+  kamoswap_d,
+  kamoadd_w,
+  kamoadd_d,
+  kamoxor_w,
+  kamoxor_d,
+  kamoand_w,
+  kamoand_d,
+  kamoor_w,
+  kamoor_d,
+  kamomin_w,
+  kamomin_d,
+  kamomax_w,
+  kamomax_d,
+  kamominu_w,
+  kamominu_d,
+  kamomaxu_w,
+  kamomaxu_d,
+
   INVALID,
 
   COUNT // sentinel for length
@@ -241,6 +266,7 @@ inline constexpr std::array<InstructionEncoding, static_cast<size_t>(Instruction
   InstructionEncoding(Instruction::kRLtype,     0b0101010, -1, -1, -1, -1, -1), // kRLtype
 
   InstructionEncoding(Instruction::kCsrType,  0b1110011, -1, -1, -1, -1, -1), // kCsrType
+  InstructionEncoding(Instruction::kAtomicType, 0b0101111, -1, -1, -1, -1, -1), // kAtomicType
 
   InstructionEncoding(Instruction::kadd,        0b0110011, -1, 0b000, -1, -1, 0b0000000), // kadd
   InstructionEncoding(Instruction::ksub,        0b0110011, -1, 0b000, -1, -1, 0b0100000), // ksub
@@ -416,6 +442,30 @@ inline constexpr std::array<InstructionEncoding, static_cast<size_t>(Instruction
   InstructionEncoding(Instruction::kfnmsub_d, 0b1001011, 0b01, -1, -1, -1, -1), // kfnmsub_d
   InstructionEncoding(Instruction::kfnmadd_d, 0b1001111, 0b01, -1, -1, -1, -1), // kfnmadd_d
 
+  // A extension, funct5 in bits 31:27; bits 26:25 hold the aq and rl ordering bits
+  InstructionEncoding(Instruction::klr_w,       0b0101111, -1, 0b010, 0b00010, -1, -1), // klr_w
+  InstructionEncoding(Instruction::ksc_w,       0b0101111, -1, 0b010, 0b00011, -1, -1), // ksc_w
+  InstructionEncoding(Instruction::kamoswap_w,  0b0101111, -1, 0b010, 0b00001, -1, -1), // kamoswap_w
+  InstructionEncoding(Instruction::kamoadd_w,   0b0101111, -1, 0b010, 0b00000, -1, -1), // kamoadd_w
+  InstructionEncoding(Instruction::kamoxor_w,   0b0101111, -1, 0b010, 0b00100, -1, -1), // kamoxor_w
+  InstructionEncoding(Instruction::kamoand_w,   0b0101111, -1, 0b010, 0b01100, -1, -1), // kamoand_w
+  InstructionEncoding(Instruction::kamoor_w,    0b0101111, -1, 0b010, 0b01000, -1, -1), // kamoor_w
+  InstructionEncoding(Instruction::kamomin_w,   0b0101111, -1, 0b010, 0b10000, -1, -1), // kamomin_w
+  InstructionEncoding(Instruction::kamomax_w,   0b0101111, -1, 0b010, 0b10100, -1, -1), // kamomax_w
+  InstructionEncoding(Instruction::kamominu_w,  0b0101111, -1, 0b010, 0b11000, -1, -1), // kamominu_w
+  InstructionEncoding(Instruction::kamomaxu_w,  0b0101111, -1, 0b010, 0b11100, -1, -1), // kamomaxu_w
+  InstructionEncoding(Instruction::klr_d,       0b0101111, -1, 0b011, 0b00010, -1, -1), // klr_d
+  InstructionEncoding(Instruction::ksc_d,       0b0101111, -1, 0b011, 0b00011, -1, -1), // ksc_d
+  InstructionEncoding(Instruction::kamoswap_d,  0b0101111, -1, 0b011, 0b00001, -1, -1), // kamoswap_d
+  InstructionEncoding(Instruction::kamoadd_d,   0b0101111, -1, 0b011, 0b00000, -1, -1), // kamoadd_d
+  InstructionEncoding(Instruction::kamoxor_d,   0b0101111, -1, 0b011, 0b00100, -1, -1), // kamoxor_d
+  InstructionEncoding(Instruction::kamoand_d,   0b0101111, -1, 0b011, 0b01100, -1, -1), // kamoand_d
+  InstructionEncoding(Instruction::kamoor_d,    0b0101111, -1, 0b011, 0b01000, -1, -1), // kamoor_d
+  InstructionEncoding(Instruction::kamomin_d,   0b0101111, -1, 0b011, 0b10000, -1, -1), // kamomin_d
+  InstructionEncoding(Instruction::kamomax_d,   0b0101111, -1, 0b011, 0b10100, -1, -1), // kamomax_d
+  InstructionEncoding(Instruction::kamominu_d,  0b0101111, -1, 0b011, 0b11000, -1, -1), // kamominu_d
+  InstructionEncoding(Instruction::kamomaxu_d,  0b0101111, -1, 0b011, 0b11100, -1, -1), // kamomaxu_d
+
 
 }};
 
@@ -554,6 +604,18 @@ struct CSR_ITypeInstructionEncoding {
       : opcode(opcode), funct3(funct3) {}
 };
 
+struct ATypeInstructionEncoding {
+  std::bitset<7> opcode;
+  std::bitset<3> funct3;
+  std::bitset<5> funct5;
+  std::bitset<1> aq;
+  std::bitset<1> rl;
+
+  ATypeInstructionEncoding(unsigned int opcode, unsigned int funct3, unsigned int funct5, unsigned int aq,
+                           unsigned int rl)
+      : opcode(opcode), funct3(funct3), funct5(funct5), aq(aq), rl(rl) {}
+};
+
 // Fextension instructions===========================================================================
 
 struct FDRTypeInstructionEncoding { // fsgnj
@@ -648,6 +710,9 @@ enum class SyntaxType {
   O_GPR_C_FPR_C_RM,       ///< Opcode general-register , floating-point-register , rounding_mode
   O_GPR_C_FPR_C_FPR,       ///< Opcode general-register , floating-point-register , floating-point-register
   O_FPR_C_I_LP_GPR_RP,    ///< Opcode floating-point-register , immediate , lparen ( general-register ) rparen
+
+  O_GPR_C_GPR_C_LP_GPR_RP, ///< Opcode general-register , general-register , lparen ( general-register ) rparen
+  O_GPR_C_LP_GPR_RP,      ///< Opcode general-register , lparen ( general-register ) rparen
 };
 
 extern std::unordered_map<std::string, RTypeInstructionEncoding> R_type_instruction_encoding_map;
@@ -660,6 +725,7 @@ extern std::unordered_map<std::string, UTypeInstructionEncoding> U_type_instruct
 extern std::unordered_map<std::string, JTypeInstructionEncoding> J_type_instruction_encoding_map;
 extern std::unordered_map<std::string, CSR_RTypeInstructionEncoding> CSR_R_type_instruction_encoding_map;
 extern std::unordered_map<std::string, CSR_ITypeInstructionEncoding> CSR_I_type_instruction_encoding_map;
+extern std::unordered_map<std::string, ATypeInstructionEncoding> A_type_instruction_encoding_map;
 
 //custom
 extern std::unordered_map<std::string, RLTypeInstructionEncoding> RL_type_instruction_encoding_map;
@@ -706,6 +772,12 @@ bool isValidCSRRTypeInstruction(const std::string &instruction);
 bool isValidCSRITypeInstruction(const std::string &instruction);
 bool isValidCSRInstruction(const std::string &instruction);
 
+/**
+ * @brief Whether the name is an A extension instruction: lr, sc or an amo, of either width, with
+ *        or without one of the .aq, .rl and .aqrl ordering suffixes.
+ */
+bool isValidATypeInstruction(const std::string &instruction);
+
 bool isValidFDRTypeInstruction(const std::string &instruction);
 bool isValidFDR1TypeInstruction(const std::string &instruction);
 bool isValidFDR2TypeInstruction(const std::string &instruction);
@@ -7,6 +7,9 @@
 #define CONFIG_H
 
 #include "globals.h"
+#include "vm/cache/cache.h"
+#include "vm/branch_prediction/branch_predictor.h"
+#include "vm/ooo/ooo_core.h"
 #include <string>
 #include <iostream>
 #include <stdexcept>
@@ -21,9 +24,81 @@
 namespace vm_config {
 enum class VmTypes {
   SINGLE_STAGE,
-  MULTI_STAGE
+  SINGLE_STAGE_THREADED,
+  MULTI_STAGE,
+  OUT_OF_ORDER
 };
 
+enum class BigmulAlgorithm {
+  SCHOOLBOOK,
+  KARATSUBA
+};
+
+enum class BigmulEngine {
+  SINGLECYCLE,
+  CSA_ONLY,
+  STAGED3,
+  STAGED7,
+  SYSTOLIC
+};
+
+/**
+ * @brief The config value naming a BIGMUL engine, e.g. "staged7".
+ */
+inline std::string bigmulEngineName(BigmulEngine engine) {
+  switch (engine) {
+    case BigmulEngine::SINGLECYCLE: return "singlecycle";
+    case BigmulEngine::CSA_ONLY: return "csa_only";
+    case BigmulEngine::STAGED3: return "staged3";
+    case BigmulEngine::STAGED7: return "staged7";
+    case BigmulEngine::SYSTOLIC: return "systolic";
+  }
+  return "unknown";
+}
+
+/**
+ * @brief Parses a config value naming a BIGMUL engine.
+ * @throws std::invalid_argument If the name is not one of singlecycle, csa_only, staged3, staged7, systolic.
+ */
+inline BigmulEngine parseBigmulEngine(const std::string &name) {
+  for (BigmulEngine engine : {BigmulEngine::SINGLECYCLE, BigmulEngine::CSA_ONLY, BigmulEngine::STAGED3,
+                              BigmulEngine::STAGED7, BigmulEngine::SYSTOLIC}) {
+    if (bigmulEngineName(engine) == name) {
+      return engine;
+    }
+  }
+  throw std::invalid_argument("Unknown BIGMUL engine: " + name);
+}
+
+/**
+ * @brief How the harts of a multi-hart machine take turns, see multi_hart::Machine.
+ */
+enum class HartSchedule {
+  ROUND_ROBIN, // one host thread runs each hart for a quantum in turn: reproducible
+  PARALLEL     // one host thread per hart, meeting after every quantum
+};
+
+inline std::string hartScheduleName(HartSchedule schedule) {
+  switch (schedule) {
+    case HartSchedule::ROUND_ROBIN: return "round_robin";
+    case HartSchedule::PARALLEL: return "parallel";
+  }
+  return "unknown";
+}
+
+/**
+ * @brief Parses a config value naming a hart schedule.
+ * @throws std::invalid_argument If the name is not round_robin or parallel.
+ */
+inline HartSchedule parseHartSchedule(const std::string &name) {
+  for (HartSchedule schedule : {HartSchedule::ROUND_ROBIN, HartSchedule::PARALLEL}) {
+    if (hartScheduleName(schedule) == name) {
+      return schedule;
+    }
+  }
+  throw std::invalid_argument("Unknown hart schedule: " + name);
+}
+
 struct VmConfig {
   VmTypes vm_type = VmTypes::SINGLE_STAGE;
   uint64_t run_step_delay = 300;
@@ -34,6 +109,28 @@ struct VmConfig {
   uint64_t bss_section_start = 0x11000000; // Default start address for BSS section
 
   uint64_t instruction_execution_limit = 1000000;
+  uint64_t undo_history_size = 1000; // steps kept for undo/redo, 0 disables undo
+  uint64_t checkpoint_interval = 10000; // instructions between reverse-execution checkpoints, 0 disables them
+  uint64_t checkpoint_limit = 64; // checkpoints kept, the oldest is dropped first
+
+  uint64_t hart_count = 1; // harts sharing one memory, each with its own registers and mhartid
+  uint64_t hart_quantum = 1000; // instructions a hart runs before the harts synchronize
+  HartSchedule hart_schedule = HartSchedule::ROUND_ROBIN;
+
+  uint64_t bigmul_cache_dwords = 64; // BIGMUL operand cache (tile) size, 4096 bits
+  BigmulAlgorithm bigmul_algorithm = BigmulAlgorithm::SCHOOLBOOK;
+  BigmulEngine bigmul_engine = BigmulEngine::SINGLECYCLE; // microarchitecture the schoolbook product runs on
+  uint64_t bigmul_karatsuba_threshold = 64; // operands this long (doublewords) or shorter use schoolbook
+
+  bool cache_enabled = false; // L1 instruction and data caches in front of memory
+  cache::CacheConfig l1_cache_config; // shared by the L1 instruction and data caches
+  bool l2_cache_enabled = false; // unified L2 behind both L1 caches
+  cache::CacheConfig l2_cache_config{.size = 256 * 1024, .block_size = 64, .associativity = 8, .hit_latency = 10};
+  uint64_t memory_latency = 100; // cycles to read a line from memory on a last-level miss
+
+  branch_prediction::PredictorConfig branch_predictor_config;
+
+  ooo::CoreConfig ooo_core_config; // the out_of_order processor's widths, queue sizes, units and latencies
 
   bool m_extension_enabled = true;
   bool f_extension_enabled = true;
@@ -60,6 +157,9 @@ struct VmConfig {
     return memory_size;
   }
   void setMemoryBlockSize(uint64_t size) {
+    if (size == 0 || (size & (size - 1)) != 0) {
+      throw std::invalid_argument("Memory block size must be a power of two: " + std::to_string(size));
+    }
     memory_block_size = size;
   }
   uint64_t getMemoryBlockSize() const {
@@ -96,6 +196,162 @@ struct VmConfig {
     return instruction_execution_limit;
   }
 
+  void setUndoHistorySize(uint64_t steps) {
+    undo_history_size = steps;
+  }
+
+  uint64_t getUndoHistorySize() const {
+    return undo_history_size;
+  }
+
+  void setCheckpointInterval(uint64_t instructions) {
+    checkpoint_interval = instructions;
+  }
+
+  uint64_t getCheckpointInterval() const {
+    return checkpoint_interval;
+  }
+
+  void setCheckpointLimit(uint64_t checkpoints) {
+    if (checkpoints == 0) {
+      throw std::invalid_argument("Checkpoint limit must be at least 1");
+    }
+    checkpoint_limit = checkpoints;
+  }
+
+  uint64_t getCheckpointLimit() const {
+    return checkpoint_limit;
+  }
+
+  void setHartCount(uint64_t harts) {
+    if (harts == 0) {
+      throw std::invalid_argument("Hart count must be at least 1");
+    }
+    hart_count = harts;
+  }
+
+  uint64_t getHartCount() const {
+    return hart_count;
+  }
+
+  void setHartQuantum(uint64_t instructions) {
+    if (instructions == 0) {
+      throw std::invalid_argument("Hart quantum must be at least 1");
+    }
+    hart_quantum = instructions;
+  }
+
+  uint64_t getHartQuantum() const {
+    return hart_quantum;
+  }
+
+  void setHartSchedule(HartSchedule schedule) {
+    hart_schedule = schedule;
+  }
+
+  HartSchedule getHartSchedule() const {
+    return hart_schedule;
+  }
+
+  void setBigmulCacheDwords(uint64_t dwords) {
+    if (dwords == 0 || dwords % 8 != 0) {
+      throw std::invalid_argument("BIGMUL cache size must be a nonzero multiple of 8 doublewords: "
+                                  + std::to_string(dwords));
+    }
+    bigmul_cache_dwords = dwords;
+  }
+
+  uint64_t getBigmulCacheDwords() const {
+    return bigmul_cache_dwords;
+  }
+
+  void setBigmulAlgorithm(BigmulAlgorithm algorithm) {
+    bigmul_algorithm = algorithm;
+  }
+
+  BigmulAlgorithm getBigmulAlgorithm() const {
+    return bigmul_algorithm;
+  }
+
+  void setBigmulEngine(BigmulEngine engine) {
+    bigmul_engine = engine;
+  }
+
+  BigmulEngine getBigmulEngine() const {
+    return bigmul_engine;
+  }
+
+  void setBigmulKaratsubaThreshold(uint64_t dwords) {
+    if (dwords == 0) {
+      throw std::invalid_argument("BIGMUL Karatsuba threshold must be at least 1 doubleword");
+    }
+    bigmul_karatsuba_threshold = dwords;
+  }
+
+  uint64_t getBigmulKaratsubaThreshold() const {
+    return bigmul_karatsuba_threshold;
+  }
+
+  void setCacheEnabled(bool enabled) {
+    cache_enabled = enabled;
+  }
+
+  bool getCacheEnabled() const {
+    return cache_enabled;
+  }
+
+  void setL1CacheConfig(const cache::CacheConfig &cache_config) {
+    cache_config.Validate();
+    l1_cache_config = cache_config;
+  }
+
+  const cache::CacheConfig &getL1CacheConfig() const {
+    return l1_cache_config;
+  }
+
+  void setL2CacheEnabled(bool enabled) {
+    l2_cache_enabled = enabled;
+  }
+
+  bool getL2CacheEnabled() const {
+    return l2_cache_enabled;
+  }
+
+  void setL2CacheConfig(const cache::CacheConfig &cache_config) {
+    cache_config.Validate();
+    l2_cache_config = cache_config;
+  }
+
+  const cache::CacheConfig &getL2CacheConfig() const {
+    return l2_cache_config;
+  }
+
+  void setMemoryLatency(uint64_t latency) {
+    memory_latency = latency;
+  }
+
+  uint64_t getMemoryLatency() const {
+    return memory_latency;
+  }
+
+  void setBranchPredictorConfig(const branch_prediction::PredictorConfig &predictor_config) {
+    predictor_config.Validate();
+    branch_predictor_config = predictor_config;
+  }
+
+  const branch_prediction::PredictorConfig &getBranchPredictorConfig() const {
+    return branch_predictor_config;
+  }
+
+  void setOooCoreConfig(const ooo::CoreConfig &core_config) {
+    core_config.Validate();
+    ooo_core_config = core_config;
+  }
+
+  const ooo::CoreConfig &getOooCoreConfig() const {
+    return ooo_core_config;
+  }
+
   void setMExtensionEnabled(bool enabled) {
     m_extension_enabled = enabled;
   }
@@ -125,8 +381,12 @@ struct VmConfig {
       if (key == "processor_type") {
         if (value == "single_stage") {
           setVmType(VmTypes::SINGLE_STAGE);
+        } else if (value == "single_stage_threaded") {
+          setVmType(VmTypes::SINGLE_STAGE_THREADED);
         } else if (value == "multi_stage") {
           setVmType(VmTypes::MULTI_STAGE);
+        } else if (value == "out_of_order") {
+          setVmType(VmTypes::OUT_OF_ORDER);
         } else {
           throw std::invalid_argument("Unknown VM type: " + value);
         }
@@ -134,6 +394,32 @@ struct VmConfig {
         setRunStepDelay(std::stoull(value));
       } else if (key == "instruction_execution_limit") {
         setInstructionExecutionLimit(std::stoull(value));
+      } else if (key == "undo_history_size") {
+        setUndoHistorySize(std::stoull(value));
+      } else if (key == "checkpoint_interval") {
+        setCheckpointInterval(std::stoull(value));
+      } else if (key == "checkpoint_limit") {
+        setCheckpointLimit(std::stoull(value));
+      } else if (key == "hart_count") {
+        setHartCount(std::stoull(value));
+      } else if (key == "hart_quantum") {
+        setHartQuantum(std::stoull(value));
+      } else if (key == "hart_schedule") {
+        setHartSchedule(parseHartSchedule(value));
+      } else if (key == "bigmul_cache_dwords") {
+        setBigmulCacheDwords(std::stoull(value));
+      } else if (key == "bigmul_algorithm") {
+        if (value == "schoolbook") {
+          setBigmulAlgorithm(BigmulAlgorithm::SCHOOLBOOK);
+        } else if (value == "karatsuba") {
+          setBigmulAlgorithm(BigmulAlgorithm::KARATSUBA);
+        } else {
+          throw std::invalid_argument("Unknown BIGMUL algorithm: " + value);
+        }
+      } else if (key == "bigmul_engine") {
+        setBigmulEngine(parseBigmulEngine(value));
+      } else if (key == "bigmul_karatsuba_threshold") {
+        setBigmulKaratsubaThreshold(std::stoull(value));
       }
       
       else {
@@ -159,6 +445,108 @@ struct VmConfig {
       }
     } 
 
+    else if (section == "Cache") {
+      if (key == "memory_latency") {
+        setMemoryLatency(std::stoull(value));
+        return;
+      }
+      // Keys without the l2_ prefix configure both L1 caches
+      bool l2 = key.rfind("l2_", 0) == 0;
+      std::string l1_key = l2 ? key.substr(3) : key;
+      if (l1_key == "cache_enabled") {
+        if (value != "true" && value != "false") {
+          throw std::invalid_argument("Unknown value: " + value);
+        }
+        l2 ? setL2CacheEnabled(value == "true") : setCacheEnabled(value == "true");
+        return;
+      }
+      if (l1_key == "cache_read_miss_policy" && !l2) {
+        if (value != "read_allocate") {
+          throw std::invalid_argument("Unknown cache read miss policy: " + value);
+        }
+        return;
+      }
+      cache::CacheConfig cache_config = l2 ? getL2CacheConfig() : getL1CacheConfig();
+      if (l1_key == "cache_size") {
+        cache_config.size = std::stoull(value);
+      } else if (l1_key == "cache_block_size") {
+        cache_config.block_size = std::stoull(value);
+      } else if (l1_key == "cache_associativity") {
+        cache_config.associativity = std::stoull(value);
+      } else if (l1_key == "cache_replacement_policy") {
+        cache_config.replacement_policy = cache::parseReplacementPolicy(value);
+      } else if (l1_key == "cache_write_hit_policy") {
+        cache_config.write_hit_policy = cache::parseWriteHitPolicy(value);
+      } else if (l1_key == "cache_write_miss_policy") {
+        cache_config.write_miss_policy = cache::parseWriteMissPolicy(value);
+      } else if (l1_key == "cache_hit_latency") {
+        cache_config.hit_latency = std::stoull(value);
+      } else {
+        throw std::invalid_argument("Unknown key: " + key);
+      }
+      l2 ? setL2CacheConfig(cache_config) : setL1CacheConfig(cache_config);
+    }
+
+    else if (section == "BranchPrediction") {
+      branch_prediction::PredictorConfig predictor_config = getBranchPredictorConfig();
+      if (key == "branch_prediction_type") {
+        predictor_config.type = branch_prediction::parsePredictorType(value);
+      } else if (key == "branch_prediction_table_size") {
+        predictor_config.table_size = std::stoull(value);
+      } else if (key == "branch_history_bits") {
+        predictor_config.history_bits = std::stoull(value);
+      } else if (key == "btb_size") {
+        predictor_config.btb_size = std::stoull(value);
+      } else if (key == "btb_associativity") {
+        predictor_config.btb_associativity = std::stoull(value);
+      } else if (key == "ras_depth") {
+        predictor_config.ras_depth = std::stoull(value);
+      } else {
+        throw std::invalid_argument("Unknown key: " + key);
+      }
+      setBranchPredictorConfig(predictor_config);
+    }
+
+    else if (section == "OutOfOrder") {
+      ooo::CoreConfig core_config = getOooCoreConfig();
+      if (key == "width") {
+        core_config.width = std::stoull(value);
+      } else if (key == "frontend_depth") {
+        core_config.frontend_depth = std::stoull(value);
+      } else if (key == "rob_size") {
+        core_config.rob_size = std::stoull(value);
+      } else if (key == "rs_size") {
+        core_config.rs_size = std::stoull(value);
+      } else if (key == "lsq_size") {
+        core_config.lsq_size = std::stoull(value);
+      } else if (key == "alu_units") {
+        core_config.alu_units = std::stoull(value);
+      } else if (key == "muldiv_units") {
+        core_config.muldiv_units = std::stoull(value);
+      } else if (key == "fp_units") {
+        core_config.fp_units = std::stoull(value);
+      } else if (key == "mem_ports") {
+        core_config.mem_ports = std::stoull(value);
+      } else if (key == "alu_latency") {
+        core_config.alu_latency = std::stoull(value);
+      } else if (key == "mul_latency") {
+        core_config.mul_latency = std::stoull(value);
+      } else if (key == "div_latency") {
+        core_config.div_latency = std::stoull(value);
+      } else if (key == "load_latency") {
+        core_config.load_latency = std::stoull(value);
+      } else if (key == "fp_latency") {
+        core_config.fp_latency = std::stoull(value);
+      } else if (key == "fp_div_latency") {
+        core_config.fp_div_latency = std::stoull(value);
+      } else if (key == "redirect_penalty") {
+        core_config.redirect_penalty = std::stoull(value);
+      } else {
+        throw std::invalid_argument("Unknown key: " + key);
+      }
+      setOooCoreConfig(core_config);
+    }
+
     else if (section == "Assembler") {
       if (key == "m_extension_enabled") {
         if (value == "true") {
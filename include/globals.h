@@ -17,6 +17,7 @@ extern std::filesystem::path errors_dump_file_path;
 extern std::filesystem::path registers_dump_file_path;
 extern std::filesystem::path memory_dump_file_path;
 extern std::filesystem::path cache_dump_file_path;
+extern std::filesystem::path branch_stats_dump_file_path;
 extern std::filesystem::path vm_state_dump_file_path;
 //extern std::string output_file;
 
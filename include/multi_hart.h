@@ -0,0 +1,110 @@
+/**
+ * @file multi_hart.h
+ * @brief A machine of several harts sharing one memory, run in quanta on one or one-per-hart host threads.
+ */
+
+#ifndef MULTI_HART_H
+#define MULTI_HART_H
+
+#include "config.h"
+#include "vm_asm_mw.h"
+#include "vm/rvss/rvss_vm.h"
+
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace multi_hart {
+
+/**
+ * @brief Harts of one engine sharing one memory, each with its own registers, PC, caches and mhartid.
+ *
+ * Every hart runs the same program from PC 0 with the same registers, except mhartid, which is the
+ * hart's index. The harts take turns in quanta of instructions: the round_robin schedule runs each one
+ * for a quantum in hart order on the calling thread, so a run is reproducible; the parallel schedule
+ * runs each on its own host thread and makes them wait for one another after every quantum. Program
+ * output is collected per hart and written in hart order after every quantum.
+ *
+ * Within a quantum the parallel harts' plain loads and stores happen in no particular order; programs
+ * that communicate through memory should synchronise with the A extension's LR/SC and AMOs, which are
+ * host atomics, or only rely on what the round_robin schedule guarantees. A hart's decoded
+ * instructions are not invalidated by the other harts' stores. The exit syscall ends its own hart only.
+ * Shared memory takes no snapshots or checkpoints, so harts cannot run in reverse. Stdin is closed.
+ */
+class Machine {
+ public:
+  /**
+   * @param vm_type The engine every hart runs on.
+   * @param hart_count The number of harts, at least 1.
+   * @param output_directory Hart 0 dumps its registers and state here, hart i to the subdirectory hart<i>.
+   * @param console Receives the status lines and the program output.
+   * @throws std::invalid_argument If hart_count is 0.
+   */
+  Machine(vm_config::VmTypes vm_type, uint64_t hart_count, const std::filesystem::path &output_directory,
+          std::ostream &console = std::cout);
+
+  /**
+   * @brief Loads the program into the shared memory and points every hart at it.
+   */
+  void LoadProgram(const AssembledProgram &program);
+
+  /**
+   * @brief Runs every hart until it ends, exits or executes instruction_execution_limit instructions,
+   *        then prints the VM_HART_STATS lines and dumps every hart.
+   * @param quantum Instructions each hart runs between synchronizations, at least 1.
+   * @param schedule Whether the harts take turns on this thread or run on one thread each.
+   * @throws std::invalid_argument If quantum is 0.
+   * @throws std::exception The first error a hart raised, once every hart has stopped.
+   */
+  void Run(uint64_t quantum, vm_config::HartSchedule schedule);
+
+  [[nodiscard]] size_t GetHartCount() const {
+    return harts_.size();
+  }
+
+  [[nodiscard]] RVSSVM &GetHart(size_t index) {
+    return *harts_.at(index)->vm;
+  }
+
+  /**
+   * @brief Prints one VM_HART_STATS line per hart: its status, instructions retired and cycles.
+   */
+  void PrintStats(std::ostream &os) const;
+
+ private:
+  struct Hart {
+    std::unique_ptr<RVSSVM> vm;
+    std::ostringstream console; ///< The hart's status lines and program output, until forwarded.
+    uint64_t budget = 0; ///< Instructions the hart may still run in this Run().
+    bool running = false;
+    std::exception_ptr error;
+  };
+
+  std::vector<std::unique_ptr<Hart>> harts_;
+  std::ostream *console_;
+
+  /**
+   * @brief Runs a hart for up to quantum instructions and stops it once it ends, exits, errs or
+   *        runs out of budget.
+   */
+  static void RunQuantum(Hart &hart, uint64_t quantum);
+
+  /**
+   * @brief Writes what every hart printed since the last call to the console, in hart order.
+   */
+  void ForwardOutput();
+};
+
+/**
+ * @brief The status a run left a hart in: VM_EXIT, VM_PROGRAM_END or VM_EXECUTION_LIMIT.
+ */
+std::string HartStatus(const RVSSVM &hart);
+
+} // namespace multi_hart
+
+#endif // MULTI_HART_H
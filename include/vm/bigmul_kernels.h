@@ -0,0 +1,67 @@
+/**
+ * @file bigmul_kernels.h
+ * @brief Host kernels summing the partial products of one BIGMUL diagonal, scalar and SIMD.
+ */
+#ifndef BIGMUL_KERNELS_H
+#define BIGMUL_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace bigmul_kernels {
+
+/**
+ * @brief The host instruction sets a diagonal sum can run on.
+ *
+ * The SIMD kernels split every 64x64-bit product into four 32x32-bit products (vpmuludq) and sum them
+ * column by column, so they return exactly what the scalar kernel returns.
+ */
+enum class Kernel {
+  SCALAR,
+  AVX2,
+  AVX512,
+};
+
+/**
+ * @brief A 192-bit sum of partial products, low limb first.
+ */
+struct Sum192 {
+  uint64_t lo = 0;
+  uint64_t mid = 0;
+  uint64_t hi = 0;
+};
+
+/**
+ * @brief Sums a[i] * b[diagonal - i] for i in [first, first + count).
+ *
+ * Runs on the kernel selected with SetKernel(), by default the widest one the host supports.
+ */
+Sum192 DiagonalSum(const uint64_t *a, const uint64_t *b, size_t diagonal, size_t first, size_t count);
+
+/**
+ * @brief DiagonalSum() on a given kernel, which must be supported by the host.
+ */
+Sum192 DiagonalSum(Kernel kernel, const uint64_t *a, const uint64_t *b, size_t diagonal, size_t first,
+                   size_t count);
+
+[[nodiscard]] bool Supported(Kernel kernel);
+
+/**
+ * @brief The widest kernel the host supports.
+ */
+[[nodiscard]] Kernel Best();
+
+/**
+ * @brief Selects the kernel DiagonalSum() runs on, for every BIGMUL unit in the process.
+ * @throws std::invalid_argument If the host does not support the kernel.
+ */
+void SetKernel(Kernel kernel);
+
+[[nodiscard]] Kernel GetKernel();
+
+[[nodiscard]] std::string KernelName(Kernel kernel);
+
+} // namespace bigmul_kernels
+
+#endif // BIGMUL_KERNELS_H
@@ -4,36 +4,49 @@
 #include <vector>
 #include <cstddef>
 #include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <span>
 
-namespace bigmul_unit {
-    extern bool bigmul_done_;
-    extern bool ldbm_done_;
-    extern size_t ldbm_offset;
-    extern size_t bigmul_prog;
-    extern size_t write_offset;
-    extern bool write_done;
-    extern uint64_t base_addr_A;
-    extern uint64_t base_addr_B;
-    extern uint64_t base_addr_res;
-    extern uint64_t cacheA[64];
-    extern uint64_t cacheB[64];
-    extern uint64_t resultCache[128];
-    extern uint64_t size_of_operand;
+#include "config.h"
 
-    void reset();
-    [[nodiscard]] bool GetBigmulDone();
-    [[nodiscard]] bool GetLdbmDone();
-    [[nodiscard]] bool GetWriteDone();
+/**
+ * @brief The LDBM/BIGMUL coprocessor: operand caches, result cache and the multiplier pipelines.
+ *
+ * Each VM owns its own unit, so several VMs can run bignum programs in one process at once.
+ *
+ * Operands may be longer than the operand caches. The product is then computed one tile pair at a
+ * time: the unit refills cacheA/cacheB with the next tile of each operand (8 doublewords per cycle,
+ * like LDBM), runs the diagonal engine on that tile pair and adds the partial product into
+ * resultCache at its offset (8 doublewords per cycle). Operands that fit in one tile take exactly the
+ * LDBM + compute + writeback cycles they always did.
+ *
+ * With the Karatsuba algorithm selected the product is computed recursively on the host instead, and
+ * the unit stalls for the cycles a Karatsuba datapath built around the schoolbook unit would take.
+ */
+class BigmulUnit {
+ public:
+    static constexpr size_t kDefaultCacheDwords = 64; ///< 4096-bit operand caches.
+    static constexpr size_t kMaxOperandDwords = 4096; ///< Largest operand BIGMUL accepts (262144 bits).
+    static constexpr size_t kTransferDwords = 8; ///< Doublewords moved per cycle by LDBM, tile fills and writeback.
+    static constexpr int kNoTile = -1;
+    static constexpr int kCsaStages = 4; ///< Levels of the staged7 carry-save tree, enough for a 25-product batch.
 
-    // void loadcache(const std::vector<uint8_t>& bufA, const std::vector<uint8_t>& bufB);
-    void start_bigmul();
-    void singlecycle();
-    void staged3pipeline();
-    void staged7pipeline();
-    void systolicmultiply();
-    void executeBigmul();
-    // [[nodiscard]] std::size_t getResultSize();
-    // void invalidateCaches();
+    bool bigmul_done_ = true;
+    bool ldbm_done_ = true;
+    size_t ldbm_offset = 0;
+    size_t bigmul_prog = 0;
+    size_t write_offset = 0;
+    bool write_done = true;
+    uint64_t base_addr_A = 0;
+    uint64_t base_addr_B = 0;
+    uint64_t base_addr_res = 0;
+    std::vector<uint64_t> cacheA; ///< The resident tile of A, cache_dwords long.
+    std::vector<uint64_t> cacheB; ///< The resident tile of B, cache_dwords long.
+    std::vector<uint64_t> resultCache; ///< The full product, 2 * size_of_operand long.
+    uint64_t size_of_operand = 64; // in Dwords (default 512 bytes = 64 doublewords)
+    int resident_tile_A = kNoTile; ///< Which tile of A is in cacheA.
+    int resident_tile_B = kNoTile; ///< Which tile of B is in cacheB.
 
     struct BigmulState {
         bool bigmul_done;
@@ -45,14 +58,223 @@ namespace bigmul_unit {
         uint64_t base_addr_A;
         uint64_t base_addr_B;
         uint64_t base_addr_res;
+        uint64_t size_of_operand;
+        int resident_tile_A;
+        int resident_tile_B;
 
-        uint64_t cacheA[64];
-        uint64_t cacheB[64];
-        uint64_t resultCache[128];
+        std::vector<uint64_t> cacheA;
+        std::vector<uint64_t> cacheB;
+        std::vector<uint64_t> resultCache;
     };
 
-    BigmulState snapshot();
+    /**
+     * @brief How often one stage of a pipelined engine held a batch.
+     */
+    struct StageStats {
+        const char *name = ""; ///< GEN, LOAD, MUL or CSA1..CSA4.
+        uint64_t busy_cycles = 0; ///< Compute cycles the stage held a batch.
+        uint64_t bubble_cycles = 0; ///< Compute cycles the stage was empty.
+
+        [[nodiscard]] double Occupancy() const {
+            uint64_t cycles = busy_cycles + bubble_cycles;
+            return cycles == 0 ? 0.0 : (double)busy_cycles / (double)cycles;
+        }
+    };
+
+    /**
+     * @brief Cycle counts of the last BIGMUL, split by what the unit was doing.
+     */
+    struct BigmulStats {
+        uint64_t tiles = 0; ///< Tile pairs multiplied.
+        uint64_t tile_fill_cycles = 0; ///< Cycles refilling cacheA/cacheB from memory.
+        uint64_t compute_cycles = 0; ///< Cycles spent in the diagonal engine.
+        uint64_t accumulate_cycles = 0; ///< Cycles adding tile products into resultCache.
+        uint64_t partial_products = 0; ///< 64x64-bit products the diagonal engine formed.
+        std::vector<StageStats> stages; ///< Per-stage occupancy of staged3 (GEN..MUL) and staged7 (GEN..CSA4).
+
+        /**
+         * @brief Partial products per compute cycle.
+         */
+        [[nodiscard]] double Throughput() const {
+            return compute_cycles == 0 ? 0.0 : (double)partial_products / (double)compute_cycles;
+        }
+    };
+
+    explicit BigmulUnit(size_t cache_dwords = kDefaultCacheDwords);
+
+    void reset();
+    [[nodiscard]] bool GetBigmulDone() const;
+    [[nodiscard]] bool GetLdbmDone() const;
+    [[nodiscard]] bool GetWriteDone() const;
+
+    /**
+     * @brief Sets the operand cache (tile) size; takes effect from the next reset().
+     * @throws std::invalid_argument If the size is not a nonzero multiple of kTransferDwords.
+     */
+    void SetCacheDwords(size_t cache_dwords);
+    [[nodiscard]] size_t GetCacheDwords() const {
+        return cache_dwords_;
+    }
+
+    /**
+     * @brief Sets how tile fills read memory: the reader fills a span with the doublewords starting at an address.
+     */
+    void SetOperandReader(std::function<void(uint64_t, std::span<uint64_t>)> reader) {
+        read_operand_ = std::move(reader);
+    }
+
+    /**
+     * @brief Sets the operand length, in doublewords, of the next BIGMUL.
+     * @return False, leaving the length unchanged, if it is 0 or above kMaxOperandDwords.
+     */
+    bool SetOperandDwords(uint64_t dwords);
+
+    /**
+     * @brief Records that LDBM finished loading the first tile of both operands.
+     */
+    void LdbmLoaded();
+
+    [[nodiscard]] const BigmulStats &GetStats() const {
+        return stats_;
+    }
+
+    void SetAlgorithm(vm_config::BigmulAlgorithm algorithm) {
+        algorithm_ = algorithm;
+    }
+    [[nodiscard]] vm_config::BigmulAlgorithm GetAlgorithm() const {
+        return algorithm_;
+    }
+
+    /**
+     * @brief Selects the engine executeBigmul() steps the schoolbook product with.
+     */
+    void SetEngine(vm_config::BigmulEngine engine) {
+        engine_ = engine;
+    }
+    [[nodiscard]] vm_config::BigmulEngine GetEngine() const {
+        return engine_;
+    }
+
+    /**
+     * @brief Sets the operand length, in doublewords, at or below which Karatsuba multiplies directly.
+     * @throws std::invalid_argument If the threshold is 0.
+     */
+    void SetKaratsubaThreshold(size_t dwords);
+
+    /**
+     * @brief Cycles singlecycle() takes to multiply two operands of the given length held in the caches.
+     */
+    [[nodiscard]] static uint64_t SchoolbookCycles(uint64_t dwords);
+
+    /**
+     * @brief Cycles the Karatsuba datapath takes to multiply two operands of the given length.
+     *
+     * Each level splits the operands in half, forms the two half sums, makes three recursive products
+     * and combines them. Additions and subtractions go through an 8-doubleword adder, one pass per cycle.
+     * Pieces at or below the threshold go to the schoolbook unit.
+     */
+    [[nodiscard]] uint64_t KaratsubaCycles(uint64_t dwords) const;
+
+    void start_bigmul();
+    void singlecycle();
+    void csa_only_pipeline();
+    void staged3pipeline();
+    void staged7pipeline();
+    void systolicmultiply();
+    void executeBigmul();
+
+    [[nodiscard]] BigmulState snapshot() const;
     void restore(const BigmulState &s);
-}
+
+ private:
+    struct GenBatch {
+        int  count;
+        int  i[25];
+        int  j[25];
+        bool valid;
+    };
+
+    struct LoadBatch {
+        int       count;
+        uint64_t  Ai[25];
+        uint64_t  Bj[25];
+        bool      valid;
+    };
+
+    struct MulBatch {
+        uint64_t lo;    // low 64 bits of batch sum
+        uint64_t hi;    // high 64 bits of batch sum
+        uint64_t hi2;
+        bool     valid;
+    };
+
+    struct DelayItem {
+        MulBatch mb;    // value to retire to accumulator
+        int      remain; // number of CSA "stages" still to wait
+        bool     valid;
+    };
+
+    struct Acc {
+        uint64_t a0, a1, a2;
+    };
+
+    size_t cache_dwords_ = kDefaultCacheDwords;
+    std::function<void(uint64_t, std::span<uint64_t>)> read_operand_;
+    vm_config::BigmulAlgorithm algorithm_ = vm_config::BigmulAlgorithm::SCHOOLBOOK;
+    vm_config::BigmulEngine engine_ = vm_config::BigmulEngine::SINGLECYCLE;
+    size_t karatsuba_threshold_ = 64;
+
+    // tile schedule of the running BIGMUL
+    size_t tile_count_ = 1;       // tiles per operand
+    size_t tile_index_ = 0;       // position in the tile-pair schedule
+    int tile_A_ = 0, tile_B_ = 0; // tile pair being multiplied
+    int len_A_ = 64, len_B_ = 64; // doublewords in those tiles
+    uint64_t stall_cycles_ = 0;   // fill/accumulate cycles still to spend
+    bool finish_after_stall_ = false;
+    std::vector<uint64_t> tileResult; // product of the current tile pair
+    BigmulStats stats_;
+
+    int s_diag = 0;          // current diagonal 0..len_A_+len_B_-2
+    int i_min = 0, i_max = 0;    // bounds for s_diag
+    int k_iter = 0;          // next i to generate in this diagonal
+    bool gen_done_this_diag = false;
+
+    GenBatch  pGEN{};
+    LoadBatch pLOAD{};
+    MulBatch  pMUL{};
+    DelayItem dq[5]{};
+    int dq_len = 0;
+
+    uint64_t acc0 = 0, acc1 = 0, acc2 = 0;
+
+    int pending_depth_for_pMUL = 0;
+
+    Acc accum[4]{};
+    bool accum_valid[4] = {false};
+
+    static GenBatch  make_empty_gen();
+    static LoadBatch make_empty_load();
+    static MulBatch  make_empty_mul();
+    static DelayItem make_empty_item();
+
+    void acc_clear();
+    void acc_add_u128(uint64_t lo, uint64_t hi);
+    void acc_add_u192(uint64_t lo, uint64_t hi, uint64_t hi2);
+    void acc_shr_64();
+    [[nodiscard]] uint64_t acc_low64() const;
+    void dq_pop_front();
+    void dq_push(const MulBatch &mb, int remain);
+
+    void clear_pipeline();
+    void sample_stages(std::initializer_list<bool> busy);
+    void sample_csa_stages();
+    void start_tile();
+    void start_karatsuba();
+    std::vector<uint64_t> load_operand(const std::vector<uint64_t> &cache, int resident_tile, uint64_t base);
+    void fill_tile(std::vector<uint64_t> &cache, uint64_t base, int tile);
+    bool finish_diagonal();
+    void finish_tile();
+    void finish_bigmul();
+};
 
 #endif // BIGMUL_UNIT_H
@@ -0,0 +1,391 @@
+/**
+ * @file branch_predictor.h
+ * @brief Branch direction predictors, the branch target buffer and return address stack, and the
+ *        per-branch statistics of how well they did.
+ */
+#ifndef BRANCH_PREDICTOR_H
+#define BRANCH_PREDICTOR_H
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace branch_prediction {
+
+enum class PredictorType {
+  AlwaysNotTaken, ///< Every conditional branch falls through
+  Btfn,           ///< Backward branches taken, forward branches not taken
+  Bimodal,        ///< A 2-bit counter per branch address
+  Gshare,         ///< 2-bit counters indexed by the branch address xor the global history
+  Tage            ///< A bimodal base and tagged tables of geometrically longer histories
+};
+
+/**
+ * @brief The config value naming a predictor, e.g. "gshare".
+ */
+inline std::string predictorTypeName(PredictorType type) {
+  switch (type) {
+    case PredictorType::AlwaysNotTaken: return "always_not_taken";
+    case PredictorType::Btfn: return "btfn";
+    case PredictorType::Bimodal: return "bimodal";
+    case PredictorType::Gshare: return "gshare";
+    case PredictorType::Tage: return "tage";
+  }
+  return "unknown";
+}
+
+/**
+ * @brief Parses a config value naming a predictor.
+ * @throws std::invalid_argument If the name is not one of always_not_taken, btfn, bimodal, gshare, tage.
+ */
+inline PredictorType parsePredictorType(const std::string &name) {
+  for (PredictorType type : {PredictorType::AlwaysNotTaken, PredictorType::Btfn, PredictorType::Bimodal,
+                             PredictorType::Gshare, PredictorType::Tage}) {
+    if (predictorTypeName(type) == name) {
+      return type;
+    }
+  }
+  throw std::invalid_argument("Unknown branch predictor: " + name);
+}
+
+enum class BranchKind : uint8_t {
+  Conditional, ///< beq, bne, blt, bge, bltu, bgeu
+  Jump,        ///< jal without a link register
+  Call,        ///< jal or jalr writing x1 or x5
+  Return,      ///< jalr through x1 or x5 that links nothing
+  Indirect     ///< Any other jalr
+};
+
+inline std::string branchKindName(BranchKind kind) {
+  switch (kind) {
+    case BranchKind::Conditional: return "branch";
+    case BranchKind::Jump: return "jump";
+    case BranchKind::Call: return "call";
+    case BranchKind::Return: return "return";
+    case BranchKind::Indirect: return "indirect";
+  }
+  return "unknown";
+}
+
+/**
+ * @brief Classifies a jal or jalr by the RISC-V link register hints.
+ */
+inline BranchKind ClassifyJump(bool is_jalr, uint8_t rd, uint8_t rs1) {
+  auto is_link = [](uint8_t reg) { return reg == 1 || reg == 5; };
+  if (is_link(rd)) {
+    return BranchKind::Call;
+  }
+  if (!is_jalr) {
+    return BranchKind::Jump;
+  }
+  return is_link(rs1) ? BranchKind::Return : BranchKind::Indirect;
+}
+
+struct PredictorConfig {
+  PredictorType type = PredictorType::AlwaysNotTaken;
+  uint64_t table_size = 4096; ///< Entries of the bimodal and gshare tables, and of each TAGE table; a power of two
+  uint64_t history_bits = 16; ///< Global history gshare uses, and the longest TAGE history; at most 64
+  uint64_t btb_size = 512; ///< Branch target buffer entries
+  uint64_t btb_associativity = 4; ///< BTB entries per set
+  uint64_t ras_depth = 16; ///< Return address stack entries
+
+  /**
+   * @brief Checks that the tables are powers of two and the history fits.
+   * @throws std::invalid_argument If they are not.
+   */
+  void Validate() const;
+};
+
+/**
+ * @brief Predicts whether conditional branches are taken.
+ */
+class DirectionPredictor {
+ public:
+  virtual ~DirectionPredictor() = default;
+
+  /**
+   * @param pc Address of the branch.
+   * @param target Where the branch goes if taken.
+   */
+  [[nodiscard]] virtual bool Predict(uint64_t pc, uint64_t target) const = 0;
+
+  /**
+   * @brief Trains the predictor with the outcome of the branch at pc, and shifts it into any history.
+   */
+  virtual void Update(uint64_t pc, uint64_t target, bool taken) = 0;
+
+  /**
+   * @return A copy of this predictor, tables and history included.
+   */
+  [[nodiscard]] virtual std::unique_ptr<DirectionPredictor> Clone() const = 0;
+};
+
+class StaticPredictor : public DirectionPredictor {
+ public:
+  /**
+   * @param backward_taken Predict backward branches taken (BTFN) rather than every branch not taken.
+   */
+  explicit StaticPredictor(bool backward_taken) : backward_taken_(backward_taken) {}
+
+  [[nodiscard]] bool Predict(uint64_t pc, uint64_t target) const override {
+    return backward_taken_ && target <= pc;
+  }
+
+  void Update(uint64_t, uint64_t, bool) override {}
+
+  [[nodiscard]] std::unique_ptr<DirectionPredictor> Clone() const override {
+    return std::make_unique<StaticPredictor>(*this);
+  }
+
+ private:
+  bool backward_taken_;
+};
+
+class BimodalPredictor : public DirectionPredictor {
+ public:
+  explicit BimodalPredictor(uint64_t table_size);
+
+  [[nodiscard]] bool Predict(uint64_t pc, uint64_t target) const override;
+  void Update(uint64_t pc, uint64_t target, bool taken) override;
+
+  [[nodiscard]] std::unique_ptr<DirectionPredictor> Clone() const override {
+    return std::make_unique<BimodalPredictor>(*this);
+  }
+
+ private:
+  std::vector<uint8_t> counters_; ///< 2-bit saturating counters, weakly not taken at first
+  uint64_t mask_;
+};
+
+class GsharePredictor : public DirectionPredictor {
+ public:
+  GsharePredictor(uint64_t table_size, uint64_t history_bits);
+
+  [[nodiscard]] bool Predict(uint64_t pc, uint64_t target) const override;
+  void Update(uint64_t pc, uint64_t target, bool taken) override;
+
+  [[nodiscard]] std::unique_ptr<DirectionPredictor> Clone() const override {
+    return std::make_unique<GsharePredictor>(*this);
+  }
+
+ private:
+  std::vector<uint8_t> counters_;
+  uint64_t mask_;
+  unsigned int index_bits_;
+  uint64_t history_ = 0;
+  uint64_t history_mask_;
+
+  [[nodiscard]] uint64_t Index(uint64_t pc) const;
+};
+
+/**
+ * @brief A small TAGE: a bimodal base predictor and four tagged tables using the last
+ *        history_bits / 8, / 4, / 2 and history_bits outcomes.
+ *
+ * The longest-history table whose tag matches provides the prediction. A misprediction allocates an
+ * entry in a longer table, taking one whose useful counter is zero; useful counters are aged every
+ * 256K updates so stale entries can be replaced.
+ */
+class TagePredictor : public DirectionPredictor {
+ public:
+  static constexpr size_t kTables = 4;
+
+  TagePredictor(uint64_t table_size, uint64_t history_bits);
+
+  [[nodiscard]] bool Predict(uint64_t pc, uint64_t target) const override;
+  void Update(uint64_t pc, uint64_t target, bool taken) override;
+
+  [[nodiscard]] std::unique_ptr<DirectionPredictor> Clone() const override {
+    return std::make_unique<TagePredictor>(*this);
+  }
+
+ private:
+  struct Entry {
+    uint16_t tag = 0;
+    int8_t counter = 0; ///< 3-bit signed: taken when >= 0
+    uint8_t useful = 0; ///< 2-bit
+    bool valid = false;
+  };
+
+  struct Lookup {
+    int provider = -1; ///< Table giving the prediction, or -1 for the base predictor
+    int alternate = -1; ///< Next-longest matching table, or -1 for the base predictor
+    std::array<uint64_t, kTables> index{};
+    std::array<uint16_t, kTables> tag{};
+  };
+
+  BimodalPredictor base_;
+  std::array<std::vector<Entry>, kTables> tables_;
+  std::array<unsigned int, kTables> history_lengths_{};
+  uint64_t mask_;
+  unsigned int index_bits_;
+  uint64_t history_ = 0;
+  uint64_t updates_ = 0;
+
+  [[nodiscard]] Lookup Find(uint64_t pc) const;
+  [[nodiscard]] bool PredictionOf(const Lookup &lookup, int table, uint64_t pc) const;
+};
+
+/**
+ * @brief A set-associative cache of the targets of taken control transfers, with LRU replacement.
+ */
+class BranchTargetBuffer {
+ public:
+  BranchTargetBuffer(uint64_t size, uint64_t associativity);
+
+  [[nodiscard]] std::optional<uint64_t> Lookup(uint64_t pc) const;
+  void Update(uint64_t pc, uint64_t target);
+
+ private:
+  struct Entry {
+    bool valid = false;
+    uint64_t pc = 0;
+    uint64_t target = 0;
+    uint64_t last_used = 0;
+  };
+
+  std::vector<Entry> entries_;
+  uint64_t associativity_;
+  uint64_t set_mask_;
+  uint64_t access_count_ = 0;
+};
+
+/**
+ * @brief A fixed-depth stack of return addresses; a push onto a full stack drops the oldest.
+ */
+class ReturnAddressStack {
+ public:
+  explicit ReturnAddressStack(uint64_t depth) : entries_(depth) {}
+
+  void Push(uint64_t address);
+  std::optional<uint64_t> Pop();
+
+  [[nodiscard]] std::optional<uint64_t> Top() const {
+    if (count_ == 0) {
+      return std::nullopt;
+    }
+    return entries_[(top_ + entries_.size() - 1) % entries_.size()];
+  }
+
+ private:
+  std::vector<uint64_t> entries_;
+  size_t top_ = 0; ///< Where the next push goes
+  size_t count_ = 0;
+};
+
+/**
+ * @brief How one control transfer instruction fared.
+ */
+struct BranchSiteStats {
+  BranchKind kind = BranchKind::Conditional;
+  uint64_t executed = 0;
+  uint64_t taken = 0;
+  uint64_t mispredicted = 0;
+
+  [[nodiscard]] double Accuracy() const {
+    return executed == 0 ? 0.0 : 1.0 - static_cast<double>(mispredicted) / static_cast<double>(executed);
+  }
+};
+
+/**
+ * @brief Predicts the next PC after a control transfer, as a fetch stage would, and learns from the
+ *        actual outcome.
+ *
+ * Conditional branches take their direction from the configured DirectionPredictor. The target of a
+ * predicted-taken branch, jump or call comes from the BTB, and of a return from the return address
+ * stack; without one, fetch can only fall through. Predict() changes nothing, so a pipeline may ask
+ * it for instructions it later squashes; Update() trains the tables, the history and the stack in
+ * program order, as the transfers resolve.
+ */
+class BranchPredictor {
+ public:
+  BranchPredictor() : BranchPredictor(PredictorConfig()) {}
+
+  /**
+   * @throws std::invalid_argument If the configuration fails PredictorConfig::Validate().
+   */
+  explicit BranchPredictor(const PredictorConfig &config);
+
+  /**
+   * @brief Copies the trained tables, history, return address stack and statistics, as checkpoints do.
+   */
+  BranchPredictor(const BranchPredictor &other);
+  BranchPredictor &operator=(const BranchPredictor &other);
+  BranchPredictor(BranchPredictor &&) = default;
+  BranchPredictor &operator=(BranchPredictor &&) = default;
+
+  /**
+   * @param pc Address of the control transfer.
+   * @param direct_target pc plus the offset of a branch or jal; ignored for jalr.
+   * @return The predicted next PC.
+   */
+  [[nodiscard]] uint64_t Predict(uint64_t pc, BranchKind kind, uint64_t direct_target) const;
+
+  /**
+   * @brief Resolves a control transfer: trains the predictor and counts the outcome against pc.
+   * @param next_pc Where the transfer actually went.
+   * @param predicted_pc What Predict() said when the transfer was fetched.
+   * @return Whether it was mispredicted.
+   */
+  bool Update(uint64_t pc, BranchKind kind, uint64_t direct_target, uint64_t next_pc, uint64_t predicted_pc);
+
+  /**
+   * @brief Predicts and resolves at once, for cores that fetch the next instruction only after this one.
+   * @return Whether it was mispredicted.
+   */
+  bool Resolve(uint64_t pc, BranchKind kind, uint64_t direct_target, uint64_t next_pc) {
+    return Update(pc, kind, direct_target, next_pc, Predict(pc, kind, direct_target));
+  }
+
+  [[nodiscard]] const PredictorConfig &GetConfig() const {
+    return config_;
+  }
+
+  /**
+   * @return The statistics of the control transfer at pc, or null if it never executed.
+   */
+  [[nodiscard]] const BranchSiteStats *GetSiteStats(uint64_t pc) const {
+    uint64_t slot = pc >> 2;
+    return slot < sites_.size() && sites_[slot].executed != 0 ? &sites_[slot] : nullptr;
+  }
+
+  [[nodiscard]] uint64_t GetBranches() const {
+    return branches_;
+  }
+
+  [[nodiscard]] uint64_t GetMispredictions() const {
+    return mispredictions_;
+  }
+
+  /**
+   * @brief Prints the totals and one line per branch site, worst first, with its accuracy and
+   *        mispredictions per thousand instructions.
+   */
+  void PrintReport(std::ostream &os, uint64_t instructions) const;
+
+  /**
+   * @brief Writes the configuration, totals and per-site statistics as JSON.
+   */
+  void Dump(const std::filesystem::path &filename, uint64_t instructions) const;
+
+ private:
+  PredictorConfig config_;
+  std::unique_ptr<DirectionPredictor> direction_;
+  BranchTargetBuffer btb_;
+  ReturnAddressStack ras_;
+  std::vector<BranchSiteStats> sites_; ///< Indexed by pc / 4: control transfers only execute from the text section
+  uint64_t branches_ = 0;
+  uint64_t mispredictions_ = 0;
+
+  [[nodiscard]] std::vector<std::pair<uint64_t, const BranchSiteStats *>> SitesByMispredictions() const;
+};
+
+} // namespace branch_prediction
+
+#endif // BRANCH_PREDICTOR_H
@@ -7,6 +7,12 @@
 #define CACHE_H
 
 #include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <ostream>
+#include <random>
+#include <stdexcept>
+#include <string>
 #include <vector>
 
 namespace cache {
@@ -19,7 +25,8 @@ enum class ReplacementPolicy {
 
 enum class CacheType {
   Instruction, ///< Cache for instructions
-  Data         ///< Cache for data
+  Data,        ///< Cache for data
+  Unified      ///< Cache for both, behind the instruction and data caches
 };
 
 enum class CacheLineState {
@@ -38,53 +45,263 @@ enum class WriteMissPolicy {
   WriteAllocate    ///< Allocate on write miss
 };
 
+/**
+ * @brief The config value naming a replacement policy, e.g. "LRU".
+ */
+inline std::string replacementPolicyName(ReplacementPolicy policy) {
+  switch (policy) {
+    case ReplacementPolicy::LRU: return "LRU";
+    case ReplacementPolicy::FIFO: return "FIFO";
+    case ReplacementPolicy::Random: return "Random";
+  }
+  return "unknown";
+}
+
+/**
+ * @brief Parses a config value naming a replacement policy.
+ * @throws std::invalid_argument If the name is not one of LRU, FIFO, Random.
+ */
+inline ReplacementPolicy parseReplacementPolicy(const std::string &name) {
+  for (ReplacementPolicy policy : {ReplacementPolicy::LRU, ReplacementPolicy::FIFO, ReplacementPolicy::Random}) {
+    if (replacementPolicyName(policy) == name) {
+      return policy;
+    }
+  }
+  throw std::invalid_argument("Unknown cache replacement policy: " + name);
+}
+
+inline std::string writeHitPolicyName(WriteHitPolicy policy) {
+  return policy == WriteHitPolicy::WriteBack ? "write_back" : "write_through";
+}
+
+/**
+ * @throws std::invalid_argument If the name is not write_back or write_through.
+ */
+inline WriteHitPolicy parseWriteHitPolicy(const std::string &name) {
+  if (name == "write_back") {
+    return WriteHitPolicy::WriteBack;
+  } else if (name == "write_through") {
+    return WriteHitPolicy::WriteThrough;
+  }
+  throw std::invalid_argument("Unknown cache write hit policy: " + name);
+}
+
+inline std::string writeMissPolicyName(WriteMissPolicy policy) {
+  return policy == WriteMissPolicy::WriteAllocate ? "write_allocate" : "no_write_allocate";
+}
+
+/**
+ * @throws std::invalid_argument If the name is not write_allocate or no_write_allocate.
+ */
+inline WriteMissPolicy parseWriteMissPolicy(const std::string &name) {
+  if (name == "write_allocate") {
+    return WriteMissPolicy::WriteAllocate;
+  } else if (name == "no_write_allocate") {
+    return WriteMissPolicy::NoWriteAllocate;
+  }
+  throw std::invalid_argument("Unknown cache write miss policy: " + name);
+}
+
 struct CacheConfig {
-  unsigned long lines = 0;  ///< Number of lines in the cache
-  unsigned long associativity = 0; ///< Associativity of the cache
-  unsigned long words_per_line = 0; ///< Number of words per line in the cache
+  uint64_t size = 16 * 1024; ///< Size of the cache in bytes
+  uint64_t block_size = 64; ///< Size of a cache line in bytes, a power of two
+  uint64_t associativity = 4; ///< Lines per set; size / block_size makes the cache fully associative
   ReplacementPolicy replacement_policy = ReplacementPolicy::LRU; ///< Replacement policy for the cache
-  CacheType cache_type = CacheType::Data; ///< Type of cache (instruction or data)
   WriteHitPolicy write_hit_policy = WriteHitPolicy::WriteBack; ///< Write hit policy
-  WriteMissPolicy write_miss_policy = WriteMissPolicy::NoWriteAllocate; ///< Write miss policy
-  unsigned long size = 0;   ///< Size of the cache in bytes
+  WriteMissPolicy write_miss_policy = WriteMissPolicy::WriteAllocate; ///< Write miss policy
+  uint64_t hit_latency = 1; ///< Cycles to serve a hit; a miss adds the latency of the next level
+
+  /**
+   * @brief Checks that the geometry describes a power-of-two number of sets of whole lines.
+   * @throws std::invalid_argument If it does not.
+   */
+  void Validate() const;
 };
 
 struct CacheLine {
   CacheLineState state = CacheLineState::Invalid; ///< State of the cache line
-  unsigned long tag = 0;    ///< Tag for the cache line
-  std::vector<uint8_t> data; ///< Data stored in the cache line
-  
+  uint64_t tag = 0;    ///< Tag for the cache line
+  uint64_t last_used = 0; ///< Access number of the last hit or fill, for LRU
+  uint64_t filled = 0; ///< Access number of the fill, for FIFO
 };
 
 struct CacheStats {
-  unsigned long accesses; ///< Total number of accesses to the cache
-  unsigned long hits;     ///< Total number of hits in the cache
-  unsigned long misses;   ///< Total number of misses in the cache
-
+  uint64_t accesses = 0; ///< Total number of accesses to the cache
+  uint64_t hits = 0;     ///< Total number of hits in the cache
+  uint64_t misses = 0;   ///< Total number of misses in the cache
+  uint64_t reads = 0;
+  uint64_t writes = 0;
+  uint64_t read_misses = 0;
+  uint64_t write_misses = 0;
+  uint64_t evictions = 0; ///< Valid lines replaced by a fill
+  uint64_t writebacks = 0; ///< Dirty lines written to the next level on eviction
 
+  [[nodiscard]] double HitRate() const {
+    return accesses == 0 ? 0.0 : static_cast<double>(hits) / static_cast<double>(accesses);
+  }
 };
 
 struct CacheSet {
-  unsigned long associativity; ///< Associativity of the cache set
   std::vector<CacheLine> lines; ///< Lines in the cache set
 
-  CacheSet(unsigned long assoc)
-    : associativity(assoc), lines(assoc) {}
+  explicit CacheSet(uint64_t assoc)
+    : lines(assoc) {}
 };
 
+/**
+ * @brief What one access did to a cache, and so what it asks of the next level.
+ */
+struct CacheAccess {
+  bool hit = false;
+  bool fill = false; ///< The line was read from the next level.
+  bool write_through = false; ///< The write goes on to the next level.
+  std::optional<uint64_t> writeback; ///< Address of a dirty line evicted to the next level.
+};
+
+/**
+ * @brief A set-associative cache of tags and line states.
+ *
+ * The cache models which lines are resident and dirty, not their contents: Memory stays the
+ * backing store and always holds the current bytes, so enabling caches changes statistics and
+ * timing, never what the program computes.
+ */
 class Cache {
-  bool enabled; ///< Flag to indicate if the cache is enabled
-  CacheType type; ///< Type of cache (instruction or data)
-  CacheConfig config; ///< Configuration of the cache
-  CacheStats stats; ///< Statistics for the cache
+ public:
+  /**
+   * @throws std::invalid_argument If the configuration fails CacheConfig::Validate().
+   */
+  Cache(CacheType type, const CacheConfig &config);
 
+  /**
+   * @brief Looks up the line holding address, filling or evicting as the policies say.
+   * @param address Any address within the line.
+   * @param is_write Whether the access writes the line.
+   */
+  CacheAccess Access(uint64_t address, bool is_write);
 
+  /**
+   * @brief Invalidates every line and clears the statistics.
+   */
+  void Reset();
+
+  [[nodiscard]] CacheType GetType() const {
+    return type_;
+  }
+
+  [[nodiscard]] const CacheConfig &GetConfig() const {
+    return config_;
+  }
+
+  [[nodiscard]] const CacheStats &GetStats() const {
+    return stats_;
+  }
+
+ private:
+  CacheType type_; ///< Type of cache (instruction, data or unified)
+  CacheConfig config_; ///< Configuration of the cache
+  CacheStats stats_; ///< Statistics for the cache
+  std::vector<CacheSet> sets_;
+  unsigned int offset_bits_ = 0; ///< log2 of the line size.
+  uint64_t set_mask_ = 0; ///< Number of sets minus one.
+  uint64_t access_count_ = 0; ///< Numbers accesses for LRU and FIFO.
+  std::minstd_rand random_; ///< Picks Random victims; fixed seed, so runs repeat.
+
+  CacheLine &Victim(CacheSet &set);
 };
 
+/**
+ * @brief Split L1 instruction and data caches with an optional unified L2 in front of memory.
+ */
+class CacheHierarchy {
+ public:
+  /**
+   * @param l1 Geometry and policies of both the L1 instruction and L1 data cache.
+   * @param l2 Geometry and policies of the L2, or nullopt for none.
+   * @param memory_latency Cycles to read a line from memory.
+   * @throws std::invalid_argument If a configuration fails CacheConfig::Validate().
+   */
+  CacheHierarchy(const CacheConfig &l1, const std::optional<CacheConfig> &l2, uint64_t memory_latency = 100);
 
+  /**
+   * @brief An instruction fetch of size bytes, touching every line it spans.
+   * @return The cycles the fetch takes.
+   */
+  uint64_t Fetch(uint64_t address, uint64_t size) {
+    return Access(l1i_, address, size, false);
+  }
 
-} // namespace cache
+  /**
+   * @return The cycles the read takes.
+   */
+  uint64_t Read(uint64_t address, uint64_t size) {
+    return Access(l1d_, address, size, false);
+  }
+
+  /**
+   * @return The cycles the write takes.
+   */
+  uint64_t Write(uint64_t address, uint64_t size) {
+    return Access(l1d_, address, size, true);
+  }
+
+  void Reset();
+
+  [[nodiscard]] const Cache &GetL1InstructionCache() const {
+    return l1i_;
+  }
 
+  [[nodiscard]] const Cache &GetL1DataCache() const {
+    return l1d_;
+  }
 
+  [[nodiscard]] const std::optional<Cache> &GetL2Cache() const {
+    return l2_;
+  }
+
+  [[nodiscard]] uint64_t GetMemoryLatency() const {
+    return memory_latency_;
+  }
+
+  [[nodiscard]] uint64_t GetMemoryReads() const {
+    return memory_reads_;
+  }
+
+  [[nodiscard]] uint64_t GetMemoryWrites() const {
+    return memory_writes_;
+  }
+
+  /**
+   * @brief Prints one line of statistics per cache.
+   */
+  void PrintStatus(std::ostream &os) const;
+
+  /**
+   * @brief Writes the configuration and statistics of every cache as JSON.
+   */
+  void Dump(const std::filesystem::path &filename) const;
+
+ private:
+  Cache l1i_;
+  Cache l1d_;
+  std::optional<Cache> l2_;
+  uint64_t memory_latency_;
+  uint64_t memory_reads_ = 0; ///< Lines read from memory.
+  uint64_t memory_writes_ = 0; ///< Lines or write-through stores that reached memory.
+
+  /**
+   * @brief Accesses every L1 line in [address, address + size) and what their misses ask of the levels below.
+   * @return The cycles taken: each line's hit latency plus the latency of any fill. Writebacks and
+   *         write-throughs drain through a write buffer and take none.
+   */
+  uint64_t Access(Cache &l1, uint64_t address, uint64_t size, bool is_write);
+
+  /**
+   * @brief Passes a line fill, eviction or write-through of an L1 on to the L2, or to memory without one.
+   * @return The cycles a fill takes; 0 for writes.
+   */
+  uint64_t AccessNextLevel(uint64_t address, uint64_t size, bool is_write);
+};
+
+} // namespace cache
 
-#endif // CACHE_H
\ No newline at end of file
+#endif // CACHE_H
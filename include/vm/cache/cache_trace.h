@@ -0,0 +1,167 @@
+/**
+ * @file cache_trace.h
+ * @brief Binary memory-access traces, and the sweep that replays one trace through many cache configurations.
+ */
+#ifndef CACHE_TRACE_H
+#define CACHE_TRACE_H
+
+#include "vm/cache/cache.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace cache {
+
+enum class AccessKind : uint8_t {
+  Fetch, ///< Instruction fetch
+  Read,  ///< Data read
+  Write  ///< Data write
+};
+
+/**
+ * @brief One memory access of a trace.
+ */
+struct TraceRecord {
+  AccessKind kind = AccessKind::Fetch;
+  uint64_t pc = 0; ///< Address of the instruction making the access.
+  uint64_t address = 0;
+  uint64_t size = 0; ///< Bytes accessed.
+};
+
+/**
+ * @brief Streams memory accesses to a trace file.
+ *
+ * A trace is the magic "RVTRACE2" followed by one variable-length record per access: a header byte
+ * holding the kind and, for 1, 2, 4 and 8 byte accesses, the size; then the zigzag varint distance
+ * from the previous address of the same stream (fetches or data); then the size as a varint if the
+ * header does not hold it. A data access then has the zigzag varint distance of its PC from the last
+ * fetch, 0 unless the engine fetches ahead of execute; a fetch is its own PC. A typical record takes
+ * two to four bytes.
+ */
+class TraceWriter {
+ public:
+  /**
+   * @throws std::runtime_error If the file cannot be created.
+   */
+  explicit TraceWriter(const std::filesystem::path &filename);
+  ~TraceWriter();
+
+  TraceWriter(const TraceWriter &) = delete;
+  TraceWriter &operator=(const TraceWriter &) = delete;
+
+  /**
+   * @param pc The instruction making the access; ignored for fetches, which are made at their own PC.
+   */
+  void Record(AccessKind kind, uint64_t pc, uint64_t address, uint64_t size);
+
+  /**
+   * @brief Writes out the buffered records.
+   */
+  void Flush();
+
+  [[nodiscard]] uint64_t GetRecordCount() const {
+    return record_count_;
+  }
+
+ private:
+  std::ofstream file_;
+  std::vector<uint8_t> buffer_;
+  uint64_t last_fetch_ = 0;
+  uint64_t last_data_ = 0;
+  uint64_t record_count_ = 0;
+};
+
+/**
+ * @brief Decodes a trace held in memory. Readers only read the bytes, so any number can share them.
+ */
+class TraceReader {
+ public:
+  /**
+   * @throws std::runtime_error If the bytes do not start with the trace magic.
+   */
+  explicit TraceReader(const std::vector<uint8_t> &bytes);
+
+  /**
+   * @brief Decodes the next record.
+   * @return False at the end of the trace.
+   * @throws std::runtime_error If the trace ends within a record.
+   */
+  bool Next(TraceRecord &record);
+
+ private:
+  const uint8_t *in_;
+  const uint8_t *end_;
+  uint64_t last_fetch_ = 0;
+  uint64_t last_data_ = 0;
+
+  uint64_t GetVarint();
+};
+
+/**
+ * @brief Reads a whole trace file.
+ * @throws std::runtime_error If the file cannot be read.
+ */
+std::vector<uint8_t> LoadTrace(const std::filesystem::path &filename);
+
+/**
+ * @brief One cache configuration of a sweep.
+ */
+struct SweepPoint {
+  std::string label; ///< The sweep file line that described the point.
+  CacheConfig l1;
+  std::optional<CacheConfig> l2;
+  uint64_t memory_latency = 100;
+};
+
+/**
+ * @brief What replaying a trace through one SweepPoint gave.
+ */
+struct SweepResult {
+  SweepPoint point;
+  CacheStats l1i;
+  CacheStats l1d;
+  std::optional<CacheStats> l2;
+  uint64_t accesses = 0;
+  uint64_t total_latency = 0; ///< Cycles of every access, as CacheHierarchy reports them.
+
+  /**
+   * @brief Average memory access time, in cycles.
+   */
+  [[nodiscard]] double Amat() const {
+    return accesses == 0 ? 0.0 : static_cast<double>(total_latency) / static_cast<double>(accesses);
+  }
+};
+
+/**
+ * @brief Reads a sweep file: one configuration per line, as whitespace-separated key=value pairs of
+ *        the Cache config section, applied on top of the current vm_config::config.
+ *
+ * Empty lines and lines starting with '#' are skipped. Every point has the L1 caches, whatever
+ * cache_enabled says.
+ * @throws std::runtime_error If the file cannot be read.
+ * @throws std::invalid_argument If a line has an unknown key or an invalid configuration.
+ */
+std::vector<SweepPoint> ReadSweepFile(const std::filesystem::path &filename);
+
+/**
+ * @brief Replays a trace through every point's cache hierarchy, one point per worker thread at a time.
+ * @param trace The bytes of a trace, shared read-only by the workers.
+ * @param jobs The number of worker threads; 0 uses the hardware concurrency.
+ * @return The results, in the order of points.
+ */
+std::vector<SweepResult> SweepTrace(const std::vector<uint8_t> &trace, const std::vector<SweepPoint> &points,
+                                    unsigned int jobs);
+
+/**
+ * @brief Prints one row of hit rates and AMAT per point, followed by the point's configuration.
+ */
+void PrintSweepReport(std::ostream &out, const std::vector<SweepResult> &results);
+
+} // namespace cache
+
+#endif // CACHE_TRACE_H
@@ -9,6 +9,24 @@
 #include "registers.h"
 #include "alu.h"
 
+/**
+ * @brief The control signals produced by the control unit for one instruction.
+ */
+struct ControlSignals {
+  bool reg_write = false;
+  bool branch = false;
+  bool alu_src = false;
+  bool mem_read = false;
+  bool mem_write = false;
+  bool mem_to_reg = false;
+  bool pc_src = false;
+  //custom
+  bool ldbm_start = false;
+  bool bigmul_start = false;
+
+  uint8_t alu_op{};
+};
+
 /**
  * @brief The ControlUnit class is the base class for the control unit of the CPU.
  */
@@ -32,6 +50,18 @@ class ControlUnit {
   virtual void SetControlSignals(uint32_t instruction) = 0;
   virtual alu::AluOp GetAluSignal(uint32_t instruction, bool ALUOp) = 0;
 
+  /**
+   * @brief Captures the current control signals, e.g. to cache them with a predecoded instruction.
+   * @return The current control signals.
+   */
+  [[nodiscard]] ControlSignals GetControlSignals() const;
+
+  /**
+   * @brief Restores control signals captured by GetControlSignals() without decoding again.
+   * @param signals The control signals to load.
+   */
+  void LoadControlSignals(const ControlSignals &signals);
+
   [[nodiscard]] bool GetAluSrc() const;
   [[nodiscard]] bool GetMemToReg() const;
   [[nodiscard]] bool GetRegWrite() const;
@@ -0,0 +1,106 @@
+/**
+ * @file decode_cache.h
+ * @brief Predecoded instruction cache used to skip re-decoding on every step.
+ */
+#ifndef DECODE_CACHE_H
+#define DECODE_CACHE_H
+
+#include "control_unit_base.h"
+#include "alu.h"
+
+#include <vector>
+#include <cstdint>
+
+/**
+ * @brief Coarse instruction class used to dispatch the execute, memory and writeback stages.
+ */
+enum class ExecutionClass : uint8_t {
+  kInteger, ///< Integer ALU, load and store instructions.
+  kBranch,  ///< Conditional branches.
+  kJal,
+  kJalr,
+  kAuipc,
+  kFloat,   ///< RV64 F instructions.
+  kDouble,  ///< RV64 D instructions.
+  kCsr,
+  kSyscall, ///< ecall.
+  kLdbm,
+  kBigmul,
+  kAtomic,  ///< A extension: LR, SC and the AMOs.
+};
+
+/**
+ * @brief An instruction with its fields, immediate, ALU operation and control signals already decoded.
+ */
+struct DecodedInstruction {
+  uint32_t instruction = 0;
+  uint8_t opcode = 0;
+  uint8_t funct3 = 0;
+  uint8_t funct7 = 0;
+  uint8_t rd = 0;
+  uint8_t rs1 = 0;
+  uint8_t rs2 = 0;
+  uint8_t rs3 = 0;
+  int32_t imm = 0;
+  alu::AluOp alu_op = alu::AluOp::kNone;
+  ControlSignals signals;
+  ExecutionClass execution_class = ExecutionClass::kInteger;
+  uint8_t handler = 0; ///< Slot in the threaded engine's handler table.
+  bool valid = false;
+};
+
+/**
+ * @brief Direct-mapped cache of predecoded instructions covering the text section, indexed by pc >> 2.
+ */
+class DecodeCache {
+ public:
+  DecodeCache() = default;
+
+  /**
+   * @brief Resizes the cache to cover [base, base + size) and invalidates every entry.
+   * @param base The first address of the text section.
+   * @param size The size of the text section in bytes.
+   */
+  void Reset(uint64_t base, uint64_t size);
+
+  /**
+   * @brief Invalidates every entry, keeping the covered range.
+   */
+  void Clear();
+
+  /**
+   * @brief Invalidates the entries overlapping the byte range [address, address + size).
+   * @param address The first written address.
+   * @param size The number of bytes written.
+   */
+  void Invalidate(uint64_t address, uint64_t size);
+
+  /**
+   * @brief Returns the slot for the instruction at the given address.
+   * @param address The instruction address.
+   * @return The slot, which may be invalid, or nullptr if the address is not covered.
+   */
+  [[nodiscard]] DecodedInstruction *Find(uint64_t address) {
+    uint64_t offset = address - base_;
+    if (address < base_ || (offset & 0b11) != 0 || (offset >> 2) >= entries_.size()) {
+      return nullptr;
+    }
+    return &entries_[offset >> 2];
+  }
+
+  [[nodiscard]] uint64_t GetBase() const { return base_; }
+  [[nodiscard]] uint64_t GetSize() const { return entries_.size() * 4; }
+
+  /**
+   * @brief Returns a counter bumped whenever entries are reset, cleared or invalidated.
+   *        Structures derived from the cached entries are stale once it changes.
+   */
+  [[nodiscard]] uint64_t GetGeneration() const { return generation_; }
+
+ private:
+  uint64_t base_ = 0;
+  uint64_t generation_ = 0;
+  std::vector<DecodedInstruction> entries_;
+};
+
+#endif // DECODE_CACHE_H
@@ -8,10 +8,15 @@
 #define MAIN_MEMORY_H
 
 #include "config.h"
+#include "reservation_table.h"
 
+#include <array>
 #include <vector>
-#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <functional>
 #include <cstdint>
+#include <span>
 #include <string>
 #include <stdexcept>
 
@@ -21,6 +26,7 @@
 struct MemoryBlock {
   std::vector<uint8_t> data; ///< A vector representing the memory block data.
   unsigned int block_size = vm_config::config.getMemoryBlockSize(); ///< The size of the memory block in bytes.
+  uint64_t journal_epoch = 0; ///< The last journal epoch the block's contents were journaled in.
 
   /**
    * @brief Constructs a MemoryBlock with a size of 1 KB initialized to 0.
@@ -28,17 +34,155 @@ struct MemoryBlock {
   MemoryBlock() {
     data.resize(block_size, 0);
   }
+
+  /**
+   * @brief Constructs a zero-initialized MemoryBlock of the given size.
+   * @param size The size of the memory block in bytes.
+   */
+  explicit MemoryBlock(unsigned int size) : block_size(size) {
+    data.resize(block_size, 0);
+  }
+};
+
+/**
+ * @brief The contents a memory block had before the first write of a journal epoch.
+ */
+struct BlockImage {
+  uint64_t block_index = 0; ///< The guest block index.
+  std::vector<uint8_t> data; ///< The previous contents, empty if the block did not exist (read as zeros).
+};
+
+/**
+ * @brief Hit and miss counters of the instruction and data TLBs.
+ */
+struct TlbStats {
+  uint64_t instruction_hits = 0; ///< Instruction fetches resolved by the instruction TLB.
+  uint64_t instruction_misses = 0; ///< Instruction fetches that walked the page table.
+  uint64_t data_hits = 0; ///< Data accesses resolved by the data TLB.
+  uint64_t data_misses = 0; ///< Data accesses that walked the page table.
+};
+
+/**
+ * @brief The read-modify-write operations of the A extension's AMO instructions.
+ */
+enum class AtomicOp : uint8_t {
+  kSwap,
+  kAdd,
+  kXor,
+  kAnd,
+  kOr,
+  kMin,  ///< Signed minimum.
+  kMax,  ///< Signed maximum.
+  kMinu, ///< Unsigned minimum.
+  kMaxu, ///< Unsigned maximum.
 };
 
 /**
  * @brief Represents a memory management system with dynamic memory block allocation.
+ *
+ * Blocks are reached through a multi-level page table indexed by the block
+ * index, so the full 64-bit address space stays sparse while a lookup costs a
+ * fixed number of array indexings instead of a hash per byte.
+ *
+ * Several Memory objects can share one page table, see Share(), each keeping
+ * its own TLBs, so that harts on different host threads see the same memory.
  */
 class Memory {
  private:
-  std::unordered_map<uint64_t, MemoryBlock> blocks_; ///< A map storing memory blocks, indexed by block index.
+  /**
+   * @brief A node of the page table. Interior nodes use @ref children, the last level uses @ref blocks.
+   */
+  struct PageTableNode {
+    std::vector<std::shared_ptr<PageTableNode>> children; ///< Next level nodes (interior levels only).
+    std::vector<std::shared_ptr<MemoryBlock>> blocks; ///< Memory blocks (last level only).
+  };
+
+  /**
+   * @brief A TLB entry caching the host block of a guest block index.
+   *
+   * A null @ref block caches the absence of the block, so reads of untouched
+   * memory also hit. Creating or unsharing the block refreshes the entry.
+   */
+  struct TlbEntry {
+    bool valid = false; ///< Whether the entry holds a translation.
+    bool writable = false; ///< Whether the block and its page table path are shared with no Image.
+    uint64_t block_index = 0; ///< The guest block index.
+    MemoryBlock *block = nullptr; ///< The host block, or nullptr if the block does not exist.
+  };
+
+  static constexpr unsigned int kLevelBits = 9; ///< Index bits resolved by every level below the root.
+  static constexpr size_t kTlbEntries = 64; ///< Number of entries of each direct-mapped TLB.
+
+  /**
+   * @brief A direct-mapped software TLB in front of the page table.
+   */
+  struct Tlb {
+    std::array<TlbEntry, kTlbEntries> entries{}; ///< The TLB entries, indexed by the low bits of the block index.
+    uint64_t hits = 0; ///< Lookups resolved by the TLB.
+    uint64_t misses = 0; ///< Lookups that walked the page table.
+  };
+
+  /**
+   * @brief The page table and its blocks, shared by every Memory that Share() joined.
+   */
+  struct Storage {
+    std::shared_ptr<PageTableNode> page_table; ///< Root of the page table, allocated on first write.
+    size_t block_count = 0; ///< Number of allocated memory blocks.
+    std::mutex mutex; ///< Held while a sharer walks or grows the page table.
+    std::once_flag reservations_created;
+    /// LR/SC reservation set versions of every sharer, allocated by the first LR, SC, AMO or store to a
+    /// shared memory so that single-hart programs without atomics keep their heap as it was.
+    std::unique_ptr<ReservationTable> reservations;
+  };
+
+  std::shared_ptr<Storage> storage_ = std::make_shared<Storage>();
+  bool shared_ = false; ///< Whether storage_ may be shared with other Memory objects.
   unsigned int block_size_; ///< The size of each memory block in bytes.
+  unsigned int block_offset_bits_; ///< log2 of the block size.
+  unsigned int levels_; ///< Number of page table levels.
+  unsigned int root_bits_; ///< Index bits resolved by the root level.
+  Tlb itlb_; ///< TLB used by instruction fetches.
+  Tlb dtlb_; ///< TLB used by data accesses.
+  std::vector<BlockImage> *journal_ = nullptr; ///< Receives block pre-images, see JournalWrites().
+  uint64_t journal_epoch_ = 0; ///< Blocks whose journal_epoch differs are journaled on their next write.
   uint64_t memory_size_ = vm_config::config.getMemorySize(); ///< The total memory size in bytes.
 
+  /**
+   * @brief Gets the page table slot of a block index at the given level.
+   * @param block_index The block index.
+   * @param level The page table level, 0 being the root.
+   * @return The slot within the node of that level.
+   */
+  uint64_t GetLevelIndex(uint64_t block_index, unsigned int level) const;
+
+  /**
+   * @brief Finds the memory block with the given index without allocating it.
+   * @param block_index The index of the block to find.
+   * @param unshared If not null, set to whether no Image shares the block or a page table node above it.
+   * @return A pointer to the block, or nullptr if it was never written.
+   */
+  MemoryBlock *FindBlock(uint64_t block_index, bool *unshared = nullptr) const;
+
+  /**
+   * @brief Finds the memory block with the given index through a TLB, refilling it on a miss.
+   * @param block_index The index of the block to find.
+   * @param tlb The TLB to look up.
+   * @return A pointer to the block, or nullptr if it was never written.
+   */
+  MemoryBlock *LookupBlock(uint64_t block_index, Tlb &tlb);
+
+  /**
+   * @brief LookupBlock() on a miss: walks the page table, under the lock if shared, into the TLB entry.
+   *        Kept out of line so the lock stays off the hit path.
+   */
+  [[gnu::noinline]] MemoryBlock *RefillTlb(uint64_t block_index, Tlb &tlb);
+
+  /**
+   * @brief Visits every allocated memory block in increasing block index order.
+   * @param visitor Callback receiving the block index and the block.
+   */
+  void ForEachBlock(const std::function<void(uint64_t, const MemoryBlock &)> &visitor) const;
+
   /**
    * @brief Gets the block index for a given memory address.
    * @param address The memory address.
@@ -60,20 +204,39 @@ class Memory {
    */
   bool IsBlockPresent(uint64_t block_index) const;
 
+  /**
+   * @brief Locks storage_ if it is shared; the other sharers may be walking or growing it.
+   */
+  std::unique_lock<std::mutex> LockShared() const {
+    return shared_ ? std::unique_lock<std::mutex>(storage_->mutex) : std::unique_lock<std::mutex>();
+  }
+
   /**
    * @brief Ensures that a memory block exists at the specified index, if not then adds it.
+   *
+   * Page table nodes and the block are copied on the way down wherever an Image still shares
+   * them, so the returned block can be written without changing any snapshot.
    * @param block_index The index of the block to check or create.
+   * @return The block at the specified index.
    */
-  void EnsureBlockExists(uint64_t block_index);
+  MemoryBlock &EnsureBlockExists(uint64_t block_index);
+
+  /**
+   * @brief Finds or creates the block a write goes to, journaling its contents first if needed.
+   * @param block_index The index of the block about to be written.
+   * @return The block to write.
+   */
+  MemoryBlock *WritableBlock(uint64_t block_index);
 
   /**
    * @brief Generic function to read data of type T from the memory.
    * @tparam T The type of data to read.
    * @param address The memory address to read from.
+   * @param tlb The TLB used to resolve the block.
    * @return The value read from the specified memory address.
    */
   template<typename T>
-  T ReadGeneric(uint64_t address);
+  T ReadGeneric(uint64_t address, Tlb &tlb);
 
   /**
    * @brief Generic function to write data of type T to the memory.
@@ -84,20 +247,162 @@ class Memory {
   template<typename T>
   void WriteGeneric(uint64_t address, T value);
 
+  /**
+   * @brief Finds the aligned value an atomic access goes to, creating its block if writable is set.
+   * @return The value's bytes, or nullptr if the block does not exist and writable is not set.
+   * @throws std::out_of_range If the value runs past the end of memory.
+   * @throws std::invalid_argument If address is not a multiple of sizeof(T).
+   */
+  template<typename T>
+  T *AtomicTarget(uint64_t address, bool writable);
+
+  /**
+   * @brief The reservation table of the storage, created on first use.
+   */
+  ReservationTable &Reservations() const {
+    std::call_once(storage_->reservations_created, [this]() {
+      storage_->reservations = std::make_unique<ReservationTable>();
+    });
+    return *storage_->reservations;
+  }
+
+  /**
+   * @brief Breaks the reservations on [address, address + size) ahead of a plain store to a shared memory.
+   *
+   * Without it an SC would only see that the value is back to what its LR read, so another hart
+   * storing B and then A in between would go unnoticed. A memory nobody shares skips the table.
+   */
+  void BreakReservations(uint64_t address, uint64_t size) {
+    if (shared_) [[unlikely]] {
+      Reservations().InvalidateRange(address, size);
+    }
+  }
+
  public:
   /**
    * @brief Constructs a Memory object.
+   * @throws std::invalid_argument If the configured block size is not a power of two.
    */
-  Memory() {
-    block_size_ = vm_config::config.getMemoryBlockSize();
-  }
+  Memory();
   /**
    * @brief Destroys the Memory object.
    */
   ~Memory() = default;
 
+  // A copy would silently share the contents; Snapshot() copies them and Share() shares them
+  Memory(const Memory &) = delete;
+  Memory &operator=(const Memory &) = delete;
+
+  /**
+   * @brief The contents of a Memory at one moment.
+   *
+   * An image shares the page table and blocks with the memory it was taken from. Whichever side
+   * writes a shared block first gets its own copy, so taking or restoring an image costs nothing up
+   * front and each later write copies at most one block and its page table path.
+   */
+  class Image {
+   public:
+    Image() = default;
+
+    /**
+     * @brief Gets the number of memory blocks the image holds.
+     */
+    [[nodiscard]] size_t GetBlockCount() const {
+      return block_count_;
+    }
+
+   private:
+    friend class Memory;
+    std::shared_ptr<PageTableNode> page_table_; ///< Shared root of the page table.
+    size_t block_count_ = 0;
+  };
+
+  /**
+   * @brief Captures the current contents; later writes to either side leave the other unchanged.
+   * @return An image restorable with Restore().
+   * @throws std::logic_error If the memory is shared: the other sharers' TLBs would write past the image.
+   */
+  Image Snapshot();
+
+  /**
+   * @brief Replaces the contents with an image, sharing its blocks until they are written.
+   * @param image An image taken by Snapshot() on a memory with the same block size.
+   * @throws std::logic_error If the memory is shared.
+   */
+  void Restore(const Image &image);
+
+  /**
+   * @brief Empties the memory. A shared memory is left to its other sharers and this one starts
+   *        afresh on its own.
+   */
   void Reset() {
-    blocks_.clear();
+    storage_ = std::make_shared<Storage>();
+    shared_ = false;
+    itlb_ = Tlb();
+    dtlb_ = Tlb();
+    journal_ = nullptr;
+  }
+
+  /**
+   * @brief Drops the current contents and uses other's from now on: writes through either are seen by both.
+   *
+   * Both may then be used from different threads at once. Accesses to different bytes are
+   * independent; plain accesses to the same bytes from different threads are not ordered, as on hardware
+   * without fences, while LoadReserved(), StoreConditional() and AtomicFetch() are atomic between them.
+   * @param other The memory to share; it becomes shared too.
+   */
+  void Share(Memory &other);
+
+  [[nodiscard]] bool IsShared() const {
+    return shared_;
+  }
+
+  /**
+   * @brief Starts a journal epoch: the first write to each block from now on appends the block's
+   *        previous contents to journal, so RestoreBlocks(journal) brings memory back to this moment.
+   * @param journal Receives the pre-images, or nullptr to stop journaling.
+   * @throws std::logic_error If journal is set and the memory is shared.
+   */
+  void JournalWrites(std::vector<BlockImage> *journal) {
+    if (journal != nullptr && shared_) {
+      throw std::logic_error("Writes to a shared memory cannot be journaled");
+    }
+    journal_ = journal;
+    journal_epoch_++;
+  }
+
+  /**
+   * @brief Writes block images back, without journaling them.
+   * @param images Images taken by JournalWrites(); blocks that did not exist are zero-filled.
+   */
+  void RestoreBlocks(const std::vector<BlockImage> &images);
+
+  [[nodiscard]] unsigned int GetBlockSize() const {
+    return block_size_;
+  }
+
+  /**
+   * @brief Invalidates every TLB entry, keeping the hit and miss counters.
+   */
+  void FlushTlb() {
+    itlb_.entries.fill(TlbEntry());
+    dtlb_.entries.fill(TlbEntry());
+  }
+
+  /**
+   * @brief Gets the hit and miss counters of both TLBs.
+   * @return The TLB statistics.
+   */
+  [[nodiscard]] TlbStats GetTlbStats() const {
+    return {itlb_.hits, itlb_.misses, dtlb_.hits, dtlb_.misses};
+  }
+
+  /**
+   * @brief Gets the number of memory blocks currently allocated.
+   * @return The number of allocated blocks.
+   */
+  [[nodiscard]] size_t GetBlockCount() const {
+    return storage_->block_count;
   }
 
   /**
@@ -114,6 +419,22 @@ class Memory {
    */
   void Write(uint64_t address, uint8_t value);
 
+  /**
+   * @brief Copies a range of memory into a buffer, one block at a time.
+   * @param address The first address of the range.
+   * @param out Receives the bytes; its size is the length of the range.
+   * @throws std::out_of_range If the range runs past the end of memory.
+   */
+  void ReadBlock(uint64_t address, std::span<uint8_t> out);
+
+  /**
+   * @brief Copies a buffer into a range of memory, one block at a time.
+   * @param address The first address of the range.
+   * @param data The bytes to write; its size is the length of the range.
+   * @throws std::out_of_range If the range runs past the end of memory.
+   */
+  void WriteBlock(uint64_t address, std::span<const uint8_t> data);
+
   /**
   * @brief Reads a single byte from the given memory address.
   * @param address The memory address to read from.
@@ -142,6 +463,13 @@ class Memory {
    */
   uint64_t ReadDoubleWord(uint64_t address);
 
+  /**
+   * @brief Reads a 32-bit instruction word through the instruction TLB.
+   * @param address The memory address to fetch from.
+   * @return The 32-bit value at the given address.
+   */
+  uint32_t FetchWord(uint64_t address);
+
   float ReadFloat(uint64_t address);
 
   double ReadDouble(uint64_t address);
@@ -178,6 +506,46 @@ class Memory {
 
   void WriteDouble(uint64_t address, double value);
 
+  /**
+   * @brief An LR: reads a naturally aligned word or doubleword atomically and reserves it.
+   *
+   * The atomic accesses below go to the host memory through sequentially consistent std::atomic_ref
+   * operations, so harts sharing this memory from different threads see them as they would on hardware
+   * with the A extension, whatever aq and rl bits the instructions carry.
+   * @tparam T uint32_t or uint64_t.
+   * @param version Receives the version of the reservation set, for StoreConditional().
+   * @throws std::invalid_argument If address is not a multiple of sizeof(T).
+   */
+  template<typename T>
+  T LoadReserved(uint64_t address, uint32_t &version);
+
+  /**
+   * @brief An SC: writes value if the reservation set is still at version and still holds expected.
+   *
+   * Another hart's SC, AMO or plain store on the set breaks the reservation through its version, even
+   * if the set ends up holding expected again. Once the memory is shared the hart's own plain stores
+   * break it too, which the A extension allows.
+   * @param version The version LoadReserved() returned.
+   * @param expected The value LoadReserved() read.
+   * @return Whether the store happened.
+   */
+  template<typename T>
+  bool StoreConditional(uint64_t address, uint32_t version, T expected, T value);
+
+  /**
+   * @brief An AMO: applies op to the value at address and operand atomically, breaking reservations on it.
+   * @return The value before the operation.
+   */
+  template<typename T>
+  T AtomicFetch(uint64_t address, AtomicOp op, T operand);
+
+  /**
+   * @brief The current version of the reservation set holding address, see ReservationTable.
+   */
+  [[nodiscard]] uint32_t ReservationVersion(uint64_t address) const {
+    return Reservations().Version(address);
+  }
+
   void PrintMemory(uint64_t address, unsigned int rows);
 
   void DumpMemory(std::vector<std::string> args);
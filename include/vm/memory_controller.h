@@ -9,10 +9,19 @@
 
 #include "../config.h"
 #include "main_memory.h"
+#include "cache/cache.h"
+#include "cache/cache_trace.h"
 
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <span>
 #include <string>
 #include <vector>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <utility>
 
 
 /**
@@ -21,49 +30,330 @@
 class MemoryController {
 private:
     Memory memory_; ///< The main memory object.
+
+    uint64_t watch_begin_ = 0; ///< Start of the watched address range.
+    uint64_t watch_end_ = 0; ///< End (exclusive) of the watched address range.
+    std::function<void(uint64_t, uint64_t)> watch_observer_; ///< Called with (address, size) on writes to the watched range.
+    std::unique_ptr<cache::CacheHierarchy> caches_; ///< Sees every access but the _d ones; null while caches are disabled.
+    uint64_t stall_cycles_ = 0; ///< Cycles accesses took beyond the first since the last TakeStallCycles().
+    cache::TraceWriter *trace_ = nullptr; ///< Records every access but the _d ones, if set.
+    uint64_t access_pc_ = 0; ///< The instruction the trace attributes data accesses to.
+
+    void Stall(uint64_t latency) {
+        if (latency > 1) {
+            stall_cycles_ += latency - 1;
+        }
+    }
+
+    /**
+     * @brief Passes an access to the trace and the caches, whichever are enabled.
+     */
+    void Charge(cache::AccessKind kind, uint64_t address, uint64_t size) {
+        // Kept to a test inline: with both disabled this sits on every access of a turbo run
+        if (trace_ != nullptr || caches_ != nullptr) [[unlikely]] {
+            ChargeSlow(kind, address, size);
+        }
+    }
+
+    void ChargeSlow(cache::AccessKind kind, uint64_t address, uint64_t size);
+
+    void NotifyWrite(uint64_t address, uint64_t size) {
+        if (address < watch_end_ && address + size > watch_begin_ && watch_observer_) {
+            watch_observer_(address, size);
+        }
+    }
 public:
     MemoryController() = default;
 
     void Reset() {
         memory_.Reset();
+        ConfigureCaches();
+    }
+
+    /**
+     * @brief Rebuilds the caches, empty, from the Cache section of vm_config::config.
+     */
+    void ConfigureCaches() {
+        stall_cycles_ = 0;
+        if (!vm_config::config.getCacheEnabled()) {
+            caches_.reset();
+            return;
+        }
+        std::optional<cache::CacheConfig> l2;
+        if (vm_config::config.getL2CacheEnabled()) {
+            l2 = vm_config::config.getL2CacheConfig();
+        }
+        caches_ = std::make_unique<cache::CacheHierarchy>(vm_config::config.getL1CacheConfig(), l2,
+                                                          vm_config::config.getMemoryLatency());
+    }
+
+    /**
+     * @brief Gets the caches, or nullptr while they are disabled.
+     */
+    [[nodiscard]] const cache::CacheHierarchy *GetCaches() const {
+        return caches_.get();
+    }
+
+    /**
+     * @brief Returns the stall cycles the accesses since the last call added, and starts counting afresh.
+     *
+     * Every access takes at least the one cycle its instruction does anyway; the cycles the caches
+     * report beyond that are stalls. Always 0 while the caches are disabled.
+     */
+    uint64_t TakeStallCycles() {
+        return std::exchange(stall_cycles_, 0);
+    }
+
+    /**
+     * @brief Puts the caches back as they were when GetCaches() was copied, lines and statistics alike.
+     * @param caches The copy, or nullopt if the caches were disabled.
+     */
+    void RestoreCaches(const std::optional<cache::CacheHierarchy> &caches) {
+        stall_cycles_ = 0;
+        if (caches) {
+            caches_ = std::make_unique<cache::CacheHierarchy>(*caches);
+        } else {
+            caches_.reset();
+        }
+    }
+
+    /**
+     * @brief Charges an instruction fetch to the caches and trace without reading memory, for fetches a
+     * decoded-instruction cache serves.
+     */
+    void ChargeFetch(uint64_t address) {
+        Charge(cache::AccessKind::Fetch, address, 4);
+    }
+
+    /**
+     * @brief Records every later fetch, load, store and block transfer to trace, or stops recording
+     * if trace is null. The trace must outlive the recording.
+     */
+    void TraceAccesses(cache::TraceWriter *trace) {
+        trace_ = trace;
+    }
+
+    /**
+     * @brief Makes the trace attribute the data accesses that follow to the instruction at pc.
+     *
+     * Every fetch does this for its own PC, which is right for engines that execute what they just
+     * fetched; engines that fetch ahead of execute call this before each instruction's accesses.
+     */
+    void SetAccessPc(uint64_t pc) {
+        access_pc_ = pc;
     }
 
     void PrintCacheStatus() const {
+        if (caches_) {
+            caches_->PrintStatus(std::cout);
+        } else {
+            std::cout << "Caches disabled" << std::endl;
+        }
+    }
+
+    /**
+     * @brief Writes the cache configuration and statistics to a JSON file.
+     */
+    void DumpCaches(const std::filesystem::path &filename) const {
+        if (caches_) {
+            caches_->Dump(filename);
+            return;
+        }
+        std::ofstream file(filename);
+        file << "{\n    \"enabled\": false\n}\n";
+    }
+
+    void FlushTlb() {
+        memory_.FlushTlb();
+    }
+
+    /**
+     * @brief Uses other's memory from now on, see Memory::Share(). Caches, trace and write
+     * observer stay this controller's own.
+     */
+    void ShareMemory(MemoryController &other) {
+        memory_.Share(other.memory_);
+    }
+
+    [[nodiscard]] bool IsMemoryShared() const {
+        return memory_.IsShared();
+    }
+
+    [[nodiscard]] TlbStats GetTlbStats() const {
+        return memory_.GetTlbStats();
+    }
+
+    /**
+     * @brief Collects the pre-images of blocks written from now on, see Memory::JournalWrites().
+     */
+    void JournalWrites(std::vector<BlockImage> *journal) {
+        memory_.JournalWrites(journal);
+    }
+
+    /**
+     * @brief Writes journaled block images back and notifies the write observer of each block.
+     */
+    void RestoreBlocks(const std::vector<BlockImage> &images) {
+        memory_.RestoreBlocks(images);
+        for (const BlockImage &image : images) {
+            NotifyWrite(image.block_index * memory_.GetBlockSize(), memory_.GetBlockSize());
+        }
+    }
+
+    /**
+     * @brief Captures the memory contents as a copy-on-write image, see Memory::Snapshot().
+     */
+    [[nodiscard]] Memory::Image Snapshot() {
+        return memory_.Snapshot();
+    }
+
+    /**
+     * @brief Replaces the memory contents with an image and notifies the observer of the whole watched range.
+     */
+    void Restore(const Memory::Image &image) {
+        memory_.Restore(image);
+        NotifyWrite(watch_begin_, watch_end_ - watch_begin_);
+    }
+
+    /**
+     * @brief Registers an observer called after every write overlapping [begin, end).
+     * @param begin The first watched address.
+     * @param end One past the last watched address.
+     * @param observer Called with the written address and size in bytes.
+     */
+    void WatchWrites(uint64_t begin, uint64_t end, std::function<void(uint64_t, uint64_t)> observer) {
+        watch_begin_ = begin;
+        watch_end_ = end;
+        watch_observer_ = std::move(observer);
     }
 
     void WriteByte(uint64_t address, uint8_t value) {
       memory_.WriteByte(address, value);
+      NotifyWrite(address, 1);
+      Charge(cache::AccessKind::Write, address, 1);
     }
 
     void WriteHalfWord(uint64_t address, uint16_t value) {
       memory_.WriteHalfWord(address, value);
+      NotifyWrite(address, 2);
+      Charge(cache::AccessKind::Write, address, 2);
     }
 
     void WriteWord(uint64_t address, uint32_t value) {
       memory_.WriteWord(address, value);
+      NotifyWrite(address, 4);
+      Charge(cache::AccessKind::Write, address, 4);
     }
 
     void WriteDoubleWord(uint64_t address, uint64_t value) {
       memory_.WriteDoubleWord(address, value);
+      NotifyWrite(address, 8);
+      Charge(cache::AccessKind::Write, address, 8);
+    }
+
+    /**
+     * @brief Copies a range of memory into out, page by page.
+     */
+    void ReadBlock(uint64_t address, std::span<uint8_t> out) {
+        memory_.ReadBlock(address, out);
+        Charge(cache::AccessKind::Read, address, out.size());
+    }
+
+    /**
+     * @brief Copies data into memory starting at address, page by page.
+     */
+    void WriteBlock(uint64_t address, std::span<const uint8_t> data) {
+        memory_.WriteBlock(address, data);
+        NotifyWrite(address, data.size());
+        Charge(cache::AccessKind::Write, address, data.size());
+    }
+
+    /**
+     * @brief Reads out.size() consecutive doublewords starting at address.
+     */
+    void ReadDoubleWords(uint64_t address, std::span<uint64_t> out) {
+        ReadBlock(address, {reinterpret_cast<uint8_t *>(out.data()), out.size_bytes()});
+    }
+
+    /**
+     * @brief Writes consecutive doublewords starting at address.
+     */
+    void WriteDoubleWords(uint64_t address, std::span<const uint64_t> data) {
+        WriteBlock(address, {reinterpret_cast<const uint8_t *>(data.data()), data.size_bytes()});
     }
 
     [[nodiscard]] uint8_t ReadByte(uint64_t address) {
+        Charge(cache::AccessKind::Read, address, 1);
         return memory_.ReadByte(address);
     }
 
     [[nodiscard]] uint16_t ReadHalfWord(uint64_t address) {
+        Charge(cache::AccessKind::Read, address, 2);
         return memory_.ReadHalfWord(address);
     }
 
     [[nodiscard]] uint32_t ReadWord(uint64_t address) {
+        Charge(cache::AccessKind::Read, address, 4);
         return memory_.ReadWord(address);
     }
 
     [[nodiscard]] uint64_t ReadDoubleWord(uint64_t address) {
+        Charge(cache::AccessKind::Read, address, 8);
         return memory_.ReadDoubleWord(address);
     }
 
-    // Functions to read memory directly with cache bypass
+    /**
+     * @brief An LR of a uint32_t or uint64_t, see Memory::LoadReserved().
+     */
+    template<typename T>
+    [[nodiscard]] T LoadReserved(uint64_t address, uint32_t &version) {
+        Charge(cache::AccessKind::Read, address, sizeof(T));
+        return memory_.LoadReserved<T>(address, version);
+    }
+
+    /**
+     * @brief An SC, see Memory::StoreConditional(). Charged as a write whether or not it stores.
+     */
+    template<typename T>
+    bool StoreConditional(uint64_t address, uint32_t version, T expected, T value) {
+        bool stored = memory_.StoreConditional<T>(address, version, expected, value);
+        if (stored) {
+            NotifyWrite(address, sizeof(T));
+        }
+        Charge(cache::AccessKind::Write, address, sizeof(T));
+        return stored;
+    }
+
+    /**
+     * @brief An AMO, see Memory::AtomicFetch(). Charged as one write, which brings the line in as a read would.
+     */
+    template<typename T>
+    T AtomicFetch(uint64_t address, AtomicOp op, T operand) {
+        T old = memory_.AtomicFetch<T>(address, op, operand);
+        NotifyWrite(address, sizeof(T));
+        Charge(cache::AccessKind::Write, address, sizeof(T));
+        return old;
+    }
+
+    [[nodiscard]] uint32_t ReservationVersion(uint64_t address) const {
+        return memory_.ReservationVersion(address);
+    }
+
+    [[nodiscard]] uint32_t FetchWord(uint64_t address) {
+        Charge(cache::AccessKind::Fetch, address, 4);
+        return memory_.FetchWord(address);
+    }
+
+    // Functions to read memory directly with cache bypass, for the debugger and undo bookkeeping
+
+    void ReadBlock_d(uint64_t address, std::span<uint8_t> out) {
+        memory_.ReadBlock(address, out);
+    }
+
+    void WriteBlock_d(uint64_t address, std::span<const uint8_t> data) {
+        memory_.WriteBlock(address, data);
+        NotifyWrite(address, data.size());
+    }
 
     [[nodiscard]] uint8_t ReadByte_d(uint64_t address) {
         return memory_.ReadByte(address);
@@ -0,0 +1,273 @@
+/**
+ * @file ooo_core.h
+ * @brief Timing model of an out-of-order superscalar core, driven by an already executed instruction stream.
+ */
+#ifndef OOO_CORE_H
+#define OOO_CORE_H
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <ostream>
+#include <queue>
+#include <string>
+#include <vector>
+
+namespace ooo {
+
+constexpr uint8_t kNoRegister = 0xff;
+constexpr size_t kRegisters = 64; ///< x0-x31, then f0-f31
+constexpr uint64_t kSchedulerWindow = 4096; ///< Cycles of functional unit bookings kept at once
+
+/**
+ * @brief The functional units an instruction can issue to.
+ */
+enum class FuClass : uint8_t {
+  Alu,    ///< Integer ALU, branches and jumps
+  Mul,    ///< Integer multiply, pipelined
+  Div,    ///< Integer divide and remainder, not pipelined
+  Load,   ///< Integer and FP loads
+  Store,  ///< Integer and FP stores
+  Fp,     ///< FP arithmetic, conversions and fused multiply-add, pipelined
+  FpDiv,  ///< FP divide and square root, not pipelined
+  Bigmul, ///< LDBM and BIGMUL on the BIGMUL unit
+  Serial  ///< ecall and CSR accesses: wait for every older instruction to commit
+};
+
+inline std::string fuClassName(FuClass fu) {
+  switch (fu) {
+    case FuClass::Alu: return "alu";
+    case FuClass::Mul: return "mul";
+    case FuClass::Div: return "div";
+    case FuClass::Load: return "load";
+    case FuClass::Store: return "store";
+    case FuClass::Fp: return "fp";
+    case FuClass::FpDiv: return "fp_div";
+    case FuClass::Bigmul: return "bigmul";
+    case FuClass::Serial: return "serialize";
+  }
+  return "unknown";
+}
+
+/**
+ * @brief Why a cycle committed nothing: the reason the oldest instruction was not ready.
+ *
+ * The first four mean the oldest instruction had not reached the ROB yet. The rest name the class of
+ * the oldest instruction while it waited in the ROB for its operands or its functional unit.
+ */
+enum class StallCause : uint8_t {
+  Frontend,   ///< Filling the front end at the start or after a drain
+  Mispredict, ///< Refetching after a mispredicted branch or jump
+  ICache,     ///< Instruction fetch missed the caches
+  Serialize,  ///< Waiting behind an ecall or CSR access
+  Alu,
+  Mul,
+  Div,
+  Load,
+  Store,
+  Fp,
+  FpDiv,
+  Bigmul,
+  Count
+};
+
+inline std::string stallCauseName(StallCause cause) {
+  switch (cause) {
+    case StallCause::Frontend: return "frontend";
+    case StallCause::Mispredict: return "mispredict";
+    case StallCause::ICache: return "icache";
+    case StallCause::Serialize: return "serialize";
+    case StallCause::Alu: return "alu";
+    case StallCause::Mul: return "mul";
+    case StallCause::Div: return "div";
+    case StallCause::Load: return "load";
+    case StallCause::Store: return "store";
+    case StallCause::Fp: return "fp";
+    case StallCause::FpDiv: return "fp_div";
+    case StallCause::Bigmul: return "bigmul";
+    case StallCause::Count: break;
+  }
+  return "unknown";
+}
+
+struct CoreConfig {
+  uint64_t width = 4; ///< Instructions fetched, dispatched and committed per cycle
+  uint64_t frontend_depth = 3; ///< Cycles from fetch to dispatch
+  uint64_t rob_size = 128;
+  uint64_t rs_size = 64; ///< Reservation station entries, shared by every functional unit
+  uint64_t lsq_size = 48; ///< Load/store queue entries
+  uint64_t alu_units = 4;
+  uint64_t muldiv_units = 1; ///< Shared by multiplies and divides
+  uint64_t fp_units = 2; ///< Shared by FP arithmetic, divides and square roots
+  uint64_t mem_ports = 2; ///< Loads and stores issued per cycle
+  uint64_t alu_latency = 1;
+  uint64_t mul_latency = 3;
+  uint64_t div_latency = 20;
+  uint64_t load_latency = 2; ///< Cycles of a load that hits; cache misses add their stall cycles
+  uint64_t fp_latency = 4;
+  uint64_t fp_div_latency = 12;
+  uint64_t redirect_penalty = 2; ///< Cycles from a mispredicted transfer executing to fetch restarting
+
+  /**
+   * @brief Checks that every width, size and unit count is at least 1 and the latencies fit the scheduler.
+   * @throws std::invalid_argument If they do not.
+   */
+  void Validate() const;
+};
+
+/**
+ * @brief One executed instruction, as the timing model needs it.
+ */
+struct InstructionRecord {
+  uint64_t pc = 0;
+  FuClass fu = FuClass::Alu;
+  std::array<uint8_t, 3> sources{kNoRegister, kNoRegister, kNoRegister};
+  uint8_t destination = kNoRegister;
+  uint64_t address = 0; ///< First byte a load or store accessed
+  uint64_t size = 0; ///< Bytes a load or store accessed
+  bool taken = false; ///< Control went somewhere other than pc + 4, which ends a fetch group
+  bool mispredicted = false; ///< The branch predictor got the next PC wrong
+  uint64_t fetch_stall = 0; ///< Cycles the instruction fetch missed the caches for
+  uint64_t memory_stall = 0; ///< Cycles the data access missed the caches for
+  uint64_t unit_cycles = 0; ///< Cycles the BIGMUL unit worked on an LDBM or BIGMUL
+};
+
+struct CoreStats {
+  uint64_t instructions = 0;
+  uint64_t cycles = 0;
+  std::array<uint64_t, static_cast<size_t>(StallCause::Count)> stalls{}; ///< Cycles that committed nothing, by cause
+  uint64_t rob_full = 0; ///< Cycles instructions waited to dispatch for a ROB entry
+  uint64_t rs_full = 0; ///< ... for a reservation station entry
+  uint64_t lsq_full = 0; ///< ... for a load/store queue entry
+  uint64_t store_forwards = 0; ///< Loads that waited for an older store to the same bytes
+  uint64_t mispredictions = 0;
+
+  [[nodiscard]] uint64_t StallCycles() const;
+
+  [[nodiscard]] double Ipc() const {
+    return cycles == 0 ? 0.0 : static_cast<double>(instructions) / static_cast<double>(cycles);
+  }
+};
+
+/**
+ * @brief Schedules executed instructions through an out-of-order core, one at a time, in program order.
+ *
+ * The core fetches width instructions a cycle, ending a fetch group at a taken transfer, and dispatches
+ * them frontend_depth cycles later into the ROB, the reservation stations and, for memory accesses, the
+ * load/store queue, waiting while any of them is full. An instruction issues once its operands are
+ * ready and one of its functional units is free, oldest-ready-first being irrelevant to the schedule;
+ * it completes its latency later and commits in order, width a cycle.
+ *
+ * Instructions arrive already executed (execute at fetch), so the model knows every branch outcome and
+ * memory address: there is no wrong path, only the fetch bubble a misprediction causes until the
+ * transfer executes, and loads wait only for older stores to the same bytes. Stores write at commit
+ * through a write buffer, so their cache misses cost nothing. Each instruction's times are worked out
+ * as it arrives, so feeding it costs a few table lookups rather than a cycle-by-cycle simulation.
+ */
+class Core {
+ public:
+  /**
+   * @throws std::invalid_argument If the configuration fails CoreConfig::Validate().
+   */
+  explicit Core(const CoreConfig &config = CoreConfig());
+
+  /**
+   * @brief Schedules the next instruction in program order.
+   */
+  void Feed(const InstructionRecord &record);
+
+  /**
+   * @brief Empties the pipeline: the next instruction is fetched the cycle after the last commit,
+   *        with every register ready. For when the instruction stream jumps, e.g. after an undo.
+   */
+  void Restart();
+
+  /**
+   * @brief Cycles up to and including the last commit.
+   */
+  [[nodiscard]] uint64_t GetCycles() const {
+    return stats_.cycles;
+  }
+
+  [[nodiscard]] const CoreStats &GetStats() const {
+    return stats_;
+  }
+
+  [[nodiscard]] const CoreConfig &GetConfig() const {
+    return config_;
+  }
+
+  /**
+   * @brief Prints IPC and the stall breakdown as a VM_OOO_STATS line.
+   */
+  void PrintStats(std::ostream &os) const;
+
+ private:
+  /**
+   * @brief Issue slots of one pool of pipelined units, counted per cycle over a sliding window.
+   */
+  class UnitCalendar {
+   public:
+    UnitCalendar() = default;
+    explicit UnitCalendar(uint64_t units) : units_(units), slots_(kSchedulerWindow) {}
+
+    /**
+     * @brief Takes the first cycle at or after ready with a unit free for busy consecutive cycles.
+     */
+    uint64_t Reserve(uint64_t ready, uint64_t busy);
+
+    void Clear();
+
+   private:
+    struct Slot {
+      uint64_t cycle = ~uint64_t{0};
+      uint64_t used = 0;
+    };
+
+    uint64_t units_ = 1;
+    std::vector<Slot> slots_;
+
+    uint64_t Used(uint64_t cycle) const;
+  };
+
+  struct StoreEntry {
+    uint64_t address;
+    uint64_t size;
+    uint64_t complete;
+  };
+
+  CoreConfig config_;
+  CoreStats stats_;
+
+  UnitCalendar alu_;
+  UnitCalendar muldiv_;
+  UnitCalendar fp_;
+  UnitCalendar mem_;
+  uint64_t bigmul_free_ = 0; ///< The one BIGMUL unit works on one instruction at a time
+
+  uint64_t fetch_cycle_ = 0;
+  uint64_t fetch_group_ = 0;
+  bool group_ended_ = false;
+  uint64_t redirect_at_ = 0; ///< Fetch waits for a mispredicted transfer until then
+  uint64_t dispatch_cycle_ = 0;
+  uint64_t dispatch_group_ = 0;
+  uint64_t serialize_until_ = 0; ///< Nothing dispatches before an ecall or CSR access commits
+  uint64_t commit_cycle_ = 0;
+  uint64_t commit_group_ = 0;
+  bool committed_ = false; ///< Whether commit_cycle_ holds a commit yet
+  uint64_t start_cycle_ = 0; ///< Where the stall accounting of the first commit starts
+
+  std::array<uint64_t, kRegisters> register_ready_{};
+  std::deque<uint64_t> rob_; ///< Commit cycles of the instructions that may still hold a ROB entry
+  std::deque<uint64_t> lsq_; ///< Commit cycles of the memory accesses that may still hold an LSQ entry
+  std::priority_queue<uint64_t, std::vector<uint64_t>, std::greater<>> rs_; ///< Issue cycles of RS holders
+  std::deque<StoreEntry> stores_; ///< The last lsq_size stores, for loads to wait on
+
+  uint64_t Latency(const InstructionRecord &record) const;
+  UnitCalendar &Units(FuClass fu);
+};
+
+} // namespace ooo
+
+#endif // OOO_CORE_H
@@ -0,0 +1,84 @@
+/**
+ * @file ooo_vm.h
+ * @brief Out-of-order VM definition: the single-cycle datapath timed by an out-of-order superscalar core
+ */
+#ifndef OOO_VM_H
+#define OOO_VM_H
+
+#include "vm/rvss/rvss_vm.h"
+#include "vm/ooo/ooo_core.h"
+
+#include <cstdint>
+#include <iostream>
+
+/**
+ * @brief VM whose instructions run on the RVSSVM datapath and whose cycles come from an ooo::Core.
+ *
+ * Each instruction executes in full as it is fetched, so results match RVSSVM exactly; what it did
+ * (its functional unit, registers, memory access, branch outcome and cache misses) is fed to core_,
+ * which works out when an out-of-order core configured by the [OutOfOrder] section would have
+ * committed it. cycle_s_ and stall_cycles_ follow core_ rather than counting one cycle per instruction.
+ * Branches are predicted by branch_predictor_ as on the other VMs; a misprediction holds fetch until
+ * the branch executes.
+ *
+ * The core's state carries over between Run, Step and DebugRun. Anything that moves the architectural
+ * state under it (undo, redo, restore, a reverse command) restarts it with an empty pipeline.
+ */
+class OooVM : public RVSSVM {
+ public:
+  OooVM() = default;
+  explicit OooVM(VmOutputPaths output_paths) : RVSSVM(std::move(output_paths)) {}
+  ~OooVM() override = default;
+
+  /**
+   * @brief The functional unit a decoded instruction issues to.
+   */
+  static ooo::FuClass FuClassOf(const DecodedInstruction &decoded);
+
+  [[nodiscard]] const ooo::Core &GetCore() const {
+    return core_;
+  }
+
+  /**
+   * @brief Prints the core's IPC and stall breakdown as a VM_OOO_STATS line.
+   */
+  void ReportOooStats();
+
+  void Run() override;
+  uint64_t RunInstructions(uint64_t count) override;
+  void DebugRun() override;
+
+  /**
+   * @brief Executes the next instruction, times it on the core, and records it for undo.
+   */
+  void Step() override;
+  void Reset() override;
+
+  void PrintType() {
+    std::cout << "ooovm" << std::endl;
+  }
+
+ private:
+  ooo::Core core_;
+
+  // The architectural state the core last left; anything else means it was moved underneath
+  bool synced_ = false;
+  uint64_t synced_pc_ = 0;
+  unsigned int synced_retired_ = 0;
+  unsigned int synced_cycles_ = 0;
+
+  void SyncCore();
+  void MarkSynced();
+
+  /**
+   * @brief Executes the instruction at the PC, running the LDBM/BIGMUL unit to completion, and feeds it to core_.
+   */
+  void ExecuteInstruction();
+
+  /**
+   * @brief Executes the instruction at the PC and records it for undo.
+   */
+  bool StepWithUndo() override;
+};
+
+#endif // OOO_VM_H
@@ -73,10 +73,26 @@ class RegisterFile {
    */
   void WriteFpr(size_t reg, uint64_t value);
 
+  static constexpr size_t kMhartid = 0xF14; ///< Address of the mhartid CSR.
+
   [[nodiscard]] uint64_t ReadCsr(size_t reg) const;
 
+  /**
+   * @brief Writes a CSR. Writes to the read-only CSRs, those at 0xC00 and above such as mhartid, are ignored.
+   */
   void WriteCsr(size_t reg, uint64_t value);
 
+  /**
+   * @brief Sets the mhartid CSR, which Reset() keeps.
+   */
+  void SetHartId(uint64_t hart_id) {
+    csr_[kMhartid] = hart_id;
+  }
+
+  [[nodiscard]] uint64_t GetHartId() const {
+    return csr_[kMhartid];
+  }
+
   /**
    * @brief Retrieves the values of all General-Purpose Registers (GPR).
    * @return A vector containing the values of all GPRs.
@@ -0,0 +1,70 @@
+/**
+ * @file reservation_table.h
+ * @brief Versions of the LR/SC reservation sets, shared by every hart of one memory.
+ */
+
+#ifndef RESERVATION_TABLE_H
+#define RESERVATION_TABLE_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief A fixed-size table of version counters, one per group of reservation sets.
+ *
+ * A reservation set is a naturally aligned doubleword. Sets are hashed onto kSlots counters, so the
+ * table costs the same whatever the number of harts or reservations: a hart keeps the version its LR
+ * saw, and its SC succeeds only if no SC, AMO or other hart's store moved that counter on since. Sets that share a counter
+ * break each other's reservations, which only makes some SCs fail spuriously, as the A extension allows.
+ */
+class ReservationTable {
+ public:
+  static constexpr size_t kSlots = 1024; ///< Number of version counters, a power of two.
+  static constexpr unsigned int kGranuleBits = 3; ///< log2 of the size of a reservation set.
+
+  /**
+   * @brief The current version of the set holding address, for an LR to keep.
+   */
+  [[nodiscard]] uint32_t Version(uint64_t address) const {
+    return versions_[Index(address)].load(std::memory_order_acquire);
+  }
+
+  /**
+   * @brief Moves the set holding address on to the next version if it is still at version.
+   * @return Whether it was: no SC, AMO or store touched the set since the LR that saw version.
+   */
+  bool Claim(uint64_t address, uint32_t version) {
+    return versions_[Index(address)].compare_exchange_strong(version, version + 1, std::memory_order_acq_rel);
+  }
+
+  /**
+   * @brief Moves the set holding address on to the next version, breaking every reservation on it.
+   */
+  void Invalidate(uint64_t address) {
+    versions_[Index(address)].fetch_add(1, std::memory_order_acq_rel);
+  }
+
+  /**
+   * @brief Breaks every reservation on the sets overlapping [address, address + size).
+   */
+  void InvalidateRange(uint64_t address, uint64_t size) {
+    if (size == 0) {
+      return;
+    }
+    for (uint64_t granule = address >> kGranuleBits; granule <= (address + size - 1) >> kGranuleBits; ++granule) {
+      Invalidate(granule << kGranuleBits);
+    }
+  }
+
+ private:
+  std::array<std::atomic<uint32_t>, kSlots> versions_{};
+
+  static size_t Index(uint64_t address) {
+    uint64_t granule = address >> kGranuleBits;
+    return (granule ^ (granule >> 10) ^ (granule >> 20)) & (kSlots - 1);
+  }
+};
+
+#endif // RESERVATION_TABLE_H
@@ -0,0 +1,43 @@
+/**
+ * @file rv5s_control_unit.h
+ * @brief RV5S Control Unit, with the hazard detection the five-stage pipeline needs
+ */
+#ifndef RV5S_CONTROL_UNIT_H
+#define RV5S_CONTROL_UNIT_H
+
+#include "../rvss/rvss_control_unit.h"
+#include "../decode_cache.h"
+
+#include <array>
+#include <cstdint>
+
+/**
+ * @brief The registers an instruction reads and writes, as the hazard detection unit sees them.
+ *
+ * x0-x31 are numbered 0-31 and f0-f31 32-63. x0 is never a source or destination, since writing it
+ * has no effect and reading it needs no forwarding.
+ */
+struct RegisterUse {
+  static constexpr uint8_t kNoRegister = 0xff;
+  static constexpr uint8_t kFprBase = 32;
+
+  uint8_t destination = kNoRegister;
+  std::array<uint8_t, 3> sources{kNoRegister, kNoRegister, kNoRegister};
+  bool is_load = false; ///< The destination is only written in MEM.
+
+  [[nodiscard]] bool Reads(uint8_t reg) const {
+    return reg != kNoRegister && (sources[0] == reg || sources[1] == reg || sources[2] == reg);
+  }
+};
+
+class RV5SControlUnit : public RVSSControlUnit {
+ public:
+  /**
+   * @brief Works out the registers a decoded instruction reads and writes from its opcode.
+   *
+   * ecall counts as reading a7, a0 and a1 and writing a0, which covers the syscalls the VM implements.
+   */
+  static RegisterUse GetRegisterUse(const DecodedInstruction &decoded);
+};
+
+#endif // RV5S_CONTROL_UNIT_H
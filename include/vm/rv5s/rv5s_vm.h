@@ -0,0 +1,133 @@
+/**
+ * @file rv5s_vm.h
+ * @brief RV5S VM definition: a five-stage IF/ID/EX/MEM/WB pipeline
+ */
+#ifndef RV5S_VM_H
+#define RV5S_VM_H
+
+#include "vm/rvss/rvss_vm.h"
+#include "rv5s_control_unit.h"
+
+#include <cstdint>
+#include <iostream>
+
+/**
+ * @brief Hazard and forwarding counts of an RV5SVM since its last reset.
+ */
+struct PipelineStats {
+  uint64_t load_use_stalls = 0; ///< Bubbles between a load and an instruction using its result.
+  uint64_t unit_stall_cycles = 0; ///< Cycles EX was held by a running LDBM or BIGMUL.
+  uint64_t flushes = 0; ///< Mispredicted control transfers, each squashing what was fetched after it.
+  uint64_t squashed = 0; ///< Wrong-path instructions squashed by flushes.
+  uint64_t forwards_ex_mem = 0; ///< Operands forwarded from the EX/MEM register.
+  uint64_t forwards_mem_wb = 0; ///< Operands forwarded from the MEM/WB register.
+};
+
+/**
+ * @brief Five-stage pipelined VM: IF, ID, EX, MEM and WB, with full forwarding, load-use stalls and
+ *        flushing of the instructions fetched after a mispredicted branch or jump.
+ *
+ * Each instruction takes its architectural effect when it reaches EX, through the same stages RVSSVM
+ * runs, so results match RVSSVM exactly and only the cycle counts differ. The pipeline registers carry
+ * what the hazard detection unit needs: the PC, the decoded instruction and the registers it uses.
+ * instructions_retired_ counts instructions as they execute; the cycles of the last ones through MEM
+ * and WB are counted as the pipeline drains at the end of the program.
+ *
+ * Fetch takes the next PC of branches and jumps from branch_predictor_, which learns from them as they
+ * resolve in EX; a wrong prediction costs the two instructions fetched behind it.
+ * A load followed by a use of its result costs one bubble. Bubbles, flushes and the cycles a LDBM/BIGMUL
+ * holds EX are stall cycles, like cache misses.
+ *
+ * The pipeline carries over between Run, Step and DebugRun. Anything that moves the architectural state
+ * under it (undo, redo, restore, a reverse command) empties it, and fetch restarts at the PC. Reverse
+ * commands re-execute on the single-cycle datapath, so they count one cycle per instruction.
+ */
+class RV5SVM : public RVSSVM {
+ public:
+  /**
+   * @brief The contents of one pipeline register.
+   */
+  struct PipelineSlot {
+    bool valid = false; ///< False for a bubble.
+    bool executed = false; ///< The instruction ran in EX and is waiting there for the LDBM/BIGMUL unit.
+    uint64_t pc = 0;
+    uint64_t predicted_pc = 0; ///< Where fetch went next.
+    DecodedInstruction decoded;
+    RegisterUse registers;
+  };
+
+  PipelineSlot if_id_; ///< Between IF and ID: the instruction in ID.
+  PipelineSlot id_ex_; ///< Between ID and EX: the instruction in EX.
+  PipelineSlot ex_mem_; ///< Between EX and MEM: the instruction in MEM.
+  PipelineSlot mem_wb_; ///< Between MEM and WB: the instruction in WB.
+  uint64_t fetch_pc_ = 0; ///< The address IF fetches next.
+
+  PipelineStats pipeline_stats_;
+
+  RV5SVM() = default;
+  explicit RV5SVM(VmOutputPaths output_paths) : RVSSVM(std::move(output_paths)) {}
+  ~RV5SVM() override = default;
+
+  /**
+   * @brief Advances every stage by one cycle.
+   * @return Whether an instruction executed in EX.
+   */
+  bool Clock();
+
+  /**
+   * @brief Squashes every instruction in flight and restarts fetch at the PC.
+   */
+  void FlushPipeline();
+
+  [[nodiscard]] bool PipelineEmpty() const {
+    return !if_id_.valid && !id_ex_.valid && !ex_mem_.valid && !mem_wb_.valid;
+  }
+
+  /**
+   * @brief Prints the pipeline counters as a VM_PIPELINE_STATS line.
+   */
+  void ReportPipelineStats();
+
+  void Run() override;
+
+  /**
+   * @brief Clocks the pipeline until count instructions have retired; the younger ones stay in flight
+   *        for the next call.
+   */
+  uint64_t RunInstructions(uint64_t count) override;
+  void DebugRun() override;
+
+  /**
+   * @brief Clocks the pipeline until the next instruction has executed, and records it for undo.
+   */
+  void Step() override;
+  void Reset() override;
+
+  void PrintType() {
+    std::cout << "rv5svm" << std::endl;
+  }
+
+ private:
+  // The architectural state the pipeline last left; anything else means it was moved underneath
+  bool synced_ = false;
+  uint64_t synced_pc_ = 0;
+  unsigned int synced_retired_ = 0;
+  unsigned int synced_cycles_ = 0;
+
+  void SyncPipeline();
+  void MarkSynced();
+
+  [[nodiscard]] bool UnitBusy() const;
+  void StepUnit();
+  void CountForwards(const PipelineSlot &slot);
+  void ExecuteSlot(PipelineSlot &slot);
+  void FetchSlot(PipelineSlot &slot);
+
+  /**
+   * @brief Clocks until an instruction executes and the LDBM/BIGMUL unit is done with it.
+   * @return False if the program ended or stopped first.
+   */
+  bool StepWithUndo() override;
+};
+
+#endif // RV5S_VM_H
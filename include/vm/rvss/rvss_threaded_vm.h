@@ -0,0 +1,98 @@
+/**
+ * @file rvss_threaded_vm.h
+ * @brief Single-cycle VM with a threaded-dispatch interpreter core
+ */
+#ifndef RVSS_THREADED_VM_H
+#define RVSS_THREADED_VM_H
+
+#include "rvss_vm.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/**
+ * @brief Single-cycle VM whose Run() dispatches each predecoded instruction straight to one handler.
+ *
+ * Register, PC and memory semantics and the cycle/retired counters match RVSSVM. Common integer
+ * instructions get a dedicated handler; everything else (F/D, CSR, ecall, ldbm, bigmul, RV64 W ops)
+ * falls back to the regular Decode/Execute/WriteMemory/WriteBack stages. Step, DebugRun, Undo and Redo
+ * are inherited unchanged, and Run does not record undo history.
+ *
+ * Run() executes whole basic blocks: straight-line runs of micro-ops translated once, keyed by start PC
+ * and chained to their successors. Any write to the text section flushes every block.
+ */
+class RVSSThreadedVM : public RVSSVM {
+ public:
+  enum Handler : uint8_t {
+    kGenericHandler,
+    kAluHandler,
+    kLoadHandler,
+    kStoreHandler,
+    kBranchHandler,
+    kJalHandler,
+    kJalrHandler,
+    kLuiHandler,
+    kAuipcHandler,
+    kHandlerCount,
+  };
+
+  RVSSThreadedVM() = default;
+  explicit RVSSThreadedVM(VmOutputPaths output_paths) : RVSSVM(std::move(output_paths)) {}
+  ~RVSSThreadedVM() override = default;
+
+  static constexpr size_t kMaxBlockLength = 64;
+
+  void Predecode(uint32_t instruction, DecodedInstruction &decoded) override;
+
+  void Run() override;
+  uint64_t RunInstructions(uint64_t count) override;
+  void Reset() override;
+
+  void PrintType() {
+    std::cout << "rvssthreadedvm" << std::endl;
+  }
+
+ private:
+  using HandlerFunction = void (RVSSThreadedVM::*)(const DecodedInstruction &);
+  static const HandlerFunction kHandlers[kHandlerCount];
+
+  /**
+   * @brief A predecoded instruction bound to its handler.
+   */
+  struct MicroOp {
+    HandlerFunction handler;
+    DecodedInstruction decoded;
+  };
+
+  /**
+   * @brief A translated basic block, ending at a branch, jump, ecall, ldbm, bigmul or the end of the text.
+   */
+  struct BasicBlock {
+    uint64_t start_pc = 0;
+    std::vector<MicroOp> ops;
+    BasicBlock *successors[2] = {nullptr, nullptr}; ///< Chained blocks, checked before the block index.
+  };
+
+  std::vector<std::unique_ptr<BasicBlock>> blocks_; ///< Indexed by (start_pc - text base) >> 2.
+  uint64_t blocks_generation_ = 0; ///< decode_cache_ generation the blocks were translated against.
+
+  void FlushBlocks();
+  BasicBlock *LookupBlock(uint64_t start_pc);
+  BasicBlock *NextBlock(BasicBlock *previous, uint64_t start_pc);
+  void StepInstruction();
+
+  void ComputeAluResult(const DecodedInstruction &decoded);
+
+  void HandleGeneric(const DecodedInstruction &decoded);
+  void HandleAlu(const DecodedInstruction &decoded);
+  void HandleLoad(const DecodedInstruction &decoded);
+  void HandleStore(const DecodedInstruction &decoded);
+  void HandleBranch(const DecodedInstruction &decoded);
+  void HandleJal(const DecodedInstruction &decoded);
+  void HandleJalr(const DecodedInstruction &decoded);
+  void HandleLui(const DecodedInstruction &decoded);
+  void HandleAuipc(const DecodedInstruction &decoded);
+};
+
+#endif // RVSS_THREADED_VM_H
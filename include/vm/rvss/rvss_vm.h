@@ -9,110 +9,72 @@
 
 #include "vm/vm_base.h"
 #include "vm/bigmul_unit.h"
+#include "vm/undo_history.h"
 
 #include "rvss_control_unit.h"
 
-#include <stack>
+#include <deque>
+#include <optional>
+#include <string>
 #include <vector>
 #include <iostream>
 #include <cstdint>
+#include <chrono>
+#include <limits>
 
-// TODO: use a circular buffer instead of a stack for undo/redo
-
-struct RegisterChange {
-  unsigned int reg_index;
-  unsigned int reg_type; // 0 for GPR, 1 for CSR, 2 for FPR
-  uint64_t old_value;
-  uint64_t new_value;
-};
-
-struct MemoryChange {
-  uint64_t address;
-  std::vector<uint8_t> old_bytes_vec; 
-  std::vector<uint8_t> new_bytes_vec; 
+/**
+ * @brief The reservation a hart's LR took, which its next SC uses up.
+ */
+struct Reservation {
+  bool valid = false;
+  uint64_t address = 0;
+  uint64_t size = 0; ///< 4 after lr.w, 8 after lr.d.
+  uint64_t value = 0; ///< What the LR read; the SC stores only if memory still holds it.
+  uint32_t version = 0; ///< The reservation set version the LR saw, see ReservationTable.
 };
 
-struct StepDelta {
-  uint64_t old_pc;
-  uint64_t new_pc;
-  std::vector<RegisterChange> register_changes;
-  std::vector<MemoryChange> memory_changes;
-
-  //custom
-  bigmul_unit::BigmulState bigmul_state; // snapshot of bigmul state BEFORE the step
-  uint8_t custom_instr_executed = 0;     // 0 = none, 1 = LDBM, 2 = BIGMUL
+/**
+ * @brief The VM state at an instruction boundary, and what memory looked like then.
+ *
+ * Only the newest checkpoint journals memory: the first write to every block after it is taken saves the
+ * block's previous contents. Restoring a checkpoint writes back the journals of it and every newer one.
+ */
+struct Checkpoint {
+  uint64_t instructions_retired = 0;
+  uint64_t cycles = 0;
+  uint64_t stall_cycles = 0;
+  uint64_t program_counter = 0;
+  RegisterFile registers;
+  std::optional<cache::CacheHierarchy> caches; ///< Lines and statistics of the caches, unless they are disabled.
+  branch_prediction::BranchPredictor branch_predictor; ///< Trained state and per-site statistics.
+  uint64_t branch_mispredictions = 0;
+  BigmulUnit::BigmulState bigmul_state;
+  bool guest_exited = false;
+  Reservation reservation;
+  size_t input_log_position = 0; ///< Stdin lines consumed before the checkpoint.
+  std::vector<BlockImage> overwritten; ///< Blocks written since the checkpoint, as they were at it.
 };
 
-
-// class RingUndoRedo {
-//   std::vector<StepDelta> buffer_;
-//   int current_;      // index of current state
-//   int size_;         // number of valid entries
-//   int head_;
-//   const int capacity_;
-
-//  public:
-//   explicit RingUndoRedo(int cap)
-//     : buffer_(cap), current_(-1), size_(0), head_(-1), capacity_(cap) {}
-
-//   void push(const StepDelta& delta) {
-//     head_ = (head_ + 1) % capacity_;
-//     buffer_[head_] = delta;
-//     current_ = head_;  // move current to new step
-
-//     if (size_ < capacity_)
-//         size_++;
-//     else {
-//         ; // overwrite oldest entry
-//     }
-
-//     // Invalidate all redos beyond head_
-//     int i = (head_ + 1) % capacity_;
-//     while (i != current_) {
-//         buffer_[i] = StepDelta(); // or mark invalid
-//         i = (i + 1) % capacity_;
-//     }
-// }
-
-
-//   bool can_undo() const {
-//     return size_ > 0 && current_ != -1;
-//   }
-
-//   bool can_redo() const {
-//     return current_ != head_ && !buffer_[(current_ + 1) % capacity_].register_changes.empty();
-// }
-
-//   StepDelta undo() {
-//     if (!can_undo()) throw std::runtime_error("Nothing to undo");
-//     StepDelta delta = buffer_[current_];
-//     current_ = (current_ - 1 + capacity_) % capacity_;
-//     return delta;
-//   }
-
-//   StepDelta redo() {
-//     if (!can_redo()) throw std::runtime_error("Nothing to redo");
-
-//     current_ = (current_ + 1) % capacity_;
-//     return buffer_[current_];
-// }
-// };
-
-
-
-
 class RVSSVM : public VmBase {
  public:
   RVSSControlUnit control_unit_;
+  BigmulUnit bigmul_unit_; ///< This VM's LDBM/BIGMUL unit.
   std::atomic<bool> stop_requested_ = false;
 
 
-  std::stack<StepDelta> undo_stack_;
-  std::stack<StepDelta> redo_stack_;
-  // RingUndoRedo history_{1000}; // or however many steps you want to store
+  UndoHistory history_; ///< Steps Undo() and Redo() walk through, the last undo_history_size of them.
 
   StepDelta current_delta_;
 
+  std::deque<Checkpoint> checkpoints_; ///< Oldest first, at most checkpoint_limit of them.
+  uint64_t next_checkpoint_at_ = 0; ///< instructions_retired_ at which the next checkpoint is taken.
+  std::vector<std::string> input_log_; ///< Stdin lines read so far, fed again to reads replayed after a rewind.
+  size_t input_log_cursor_ = 0; ///< The next line a read takes from input_log_ before waiting for new input.
+
+  Reservation reservation_; ///< Set by LR, used up by SC.
+
+  DecodedInstruction decoded_; ///< The instruction in flight, taken from decode_cache_ or decoded on a miss.
+
   // intermediate variables
   int64_t execution_result_{};
   int64_t memory_result_{};
@@ -120,8 +82,13 @@ class RVSSVM : public VmBase {
   // int64_t memory_data_{};
   uint64_t return_address_{};
 
+  // turbo run statistics
+  std::chrono::steady_clock::time_point run_start_time_{};
+  unsigned int run_start_retired_{};
+
   bool branch_flag_ = false;
   int64_t next_pc_{}; // for jal, jalr,
+  std::optional<uint64_t> fetch_prediction_; ///< Set by pipelined VMs to the next PC their fetch predicted for the executing instruction.
 
   // CSR intermediate variables
   uint16_t csr_target_address_{};
@@ -129,11 +96,35 @@ class RVSSVM : public VmBase {
   uint64_t csr_write_val_{};
   uint8_t csr_uimm_{};
 
+  /**
+   * @brief Fully decodes an instruction, including its control signals and ALU operation.
+   * @param instruction The raw instruction.
+   * @param decoded The entry to fill.
+   */
+  virtual void Predecode(uint32_t instruction, DecodedInstruction &decoded);
+
   void Fetch();
 
   void Decode();
 
   void Execute();
+
+  /**
+   * @brief Trains branch_predictor_ with where the control transfer at pc went, and counts a
+   *        misprediction if it predicted otherwise: at fetch_prediction_ if set, else as a fetch
+   *        stage asking right before execution would have.
+   */
+  void ResolveBranch(uint64_t pc, const DecodedInstruction &decoded);
+
+  /**
+   * @brief The kind of control transfer a branch, jal or jalr is, for the branch predictor.
+   */
+  static branch_prediction::BranchKind BranchKindOf(const DecodedInstruction &decoded) {
+    if (decoded.execution_class == ExecutionClass::kBranch) {
+      return branch_prediction::BranchKind::Conditional;
+    }
+    return branch_prediction::ClassifyJump(decoded.execution_class == ExecutionClass::kJalr, decoded.rd, decoded.rs1);
+  }
   void ExecuteFloat();
   void ExecuteDouble();
   void ExecuteCsr();
@@ -142,6 +133,15 @@ class RVSSVM : public VmBase {
   void WriteMemory();
   void WriteMemoryFloat();
   void WriteMemoryDouble();
+  /**
+   * @brief The memory access of an LR, SC or AMO, whose address execution_result_ holds.
+   * @throws std::runtime_error If the width or funct5 encodes no A extension instruction.
+   */
+  void WriteMemoryAtomic();
+  /**
+   * @throws std::runtime_error Naming decoded_.instruction as illegal, always.
+   */
+  [[noreturn]] void ThrowIllegalInstruction() const;
 
   void WriteBack();
   void WriteBackFloat();
@@ -149,11 +149,139 @@ class RVSSVM : public VmBase {
   void WriteBackCsr();
 
   RVSSVM();
-  ~RVSSVM();
+  /**
+   * @brief Creates a VM that dumps its registers and state to the given files instead of vm_state.
+   */
+  explicit RVSSVM(VmOutputPaths output_paths);
+  virtual ~RVSSVM();
+
+  /**
+   * @brief Loads a program like VmBase::LoadProgram() and drops the checkpoints of the previous one.
+   */
+  void LoadProgram(const AssembledProgram &program);
+
+  /**
+   * @brief Applies the BIGMUL settings of vm_config::config to bigmul_unit_ and resets it.
+   */
+  void ConfigureBigmulUnit();
+
+  /**
+   * @brief Takes a checkpoint if checkpoint_interval instructions retired since the last one.
+   *        Called at instruction boundaries with the BIGMUL unit idle.
+   */
+  void MaybeCheckpoint() {
+    if (instructions_retired_ >= next_checkpoint_at_) {
+      TakeCheckpoint();
+    }
+  }
+
+  void TakeCheckpoint();
+
+  /**
+   * @brief Adds the BIGMUL unit state to VmBase::Snapshot().
+   */
+  VmSnapshot Snapshot() override;
+
+  /**
+   * @brief Restores a snapshot and drops the undo history and every checkpoint, which belong to the
+   *        timeline being left.
+   */
+  void Restore(const VmSnapshot &snapshot) override;
+
+  /**
+   * @brief Brings the VM back to checkpoints_[index] and drops every newer checkpoint and the undo history.
+   */
+  void RestoreCheckpoint(size_t index);
+
+  /**
+   * @brief Drops every checkpoint and the stdin log, and schedules a checkpoint at the next instruction.
+   */
+  void ResetCheckpoints();
+
+  /**
+   * @brief Executes forward, silently and ignoring breakpoints, until instructions_retired_ reaches retired.
+   * @param retired The instruction count to stop at.
+   * @param last_breakpoint If set, receives the instruction count before the last breakpoint executed.
+   * @return Whether a breakpoint was executed.
+   */
+  bool ReplayTo(uint64_t retired, uint64_t *last_breakpoint = nullptr);
+
+  /**
+   * @brief Goes back steps instructions by restoring the nearest checkpoint and replaying forward.
+   *        Stops at the oldest checkpoint if it is not that far back.
+   */
+  void ReverseStep(uint64_t steps);
+
+  /**
+   * @brief Goes back to just before the last breakpoint executed, or to the oldest checkpoint if none was.
+   */
+  void ReverseContinue();
+
+  /**
+   * @brief Prints how many steps the undo history holds and the memory it takes.
+   */
+  void ReportHistoryUsage();
 
   void Run() override;
+
+  /**
+   * @brief Executes up to count instructions: Run() without clearing a stop request, flushing program
+   *        output or dumping anything at the end. The PC is printed after each instruction unless silent_run_.
+   * @param count The instructions to execute; a stop request or the end of the program stops it earlier.
+   * @return The instructions executed.
+   */
+  virtual uint64_t RunInstructions(uint64_t count);
+
+  /**
+   * @brief The count Run() passes to RunInstructions(): one past the instruction_execution_limit.
+   */
+  static uint64_t RunLimit() {
+    uint64_t limit = vm_config::config.getInstructionExecutionLimit();
+    return limit == std::numeric_limits<uint64_t>::max() ? limit : limit + 1;
+  }
+
+  /**
+   * @brief Makes this VM use other's memory, as harts of one machine do, see MemoryController::ShareMemory().
+   *        Both drop their checkpoints and take no more, so neither can run in reverse.
+   */
+  void ShareMemory(RVSSVM &other);
+
+  /**
+   * @brief Runs like Run() but without per-instruction output, buffering program output until the end,
+   *        then reports the achieved instructions per second.
+   */
+  void TurboRun();
+
+  /**
+   * @brief Prints the instructions retired and instructions per second since the current TurboRun() began.
+   */
+  void ReportRunThroughput();
+
+  /**
+   * @brief Starts current_delta_ for the instruction at program_counter_, snapshotting the BIGMUL unit
+   *        if it is an LDBM or BIGMUL.
+   */
+  void BeginStepDelta();
+
+  /**
+   * @brief Completes current_delta_ with the state the instruction left and pushes it onto history_.
+   */
+  void EndStepDelta();
+
+  /**
+   * @brief Executes the next instruction and whatever it stalls on, pushing its undo delta.
+   *        DebugRun() calls it once per instruction; engines override it with their own timing.
+   * @return Whether an instruction was executed.
+   */
+  virtual bool StepWithUndo();
+
   void DebugRun() override;
   void Step() override;
+  /**
+   * @brief Takes back the last step, its cycles and stall cycles included. The caches keep the lines
+   *        the step brought in, so executing it again can be charged fewer cycles than the first time;
+   *        Redo() and ReverseStep() give back exactly the cycles of the first time.
+   */
   void Undo() override;
   void Redo() override;
   void Reset() override;
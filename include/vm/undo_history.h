@@ -0,0 +1,131 @@
+/**
+ * @file undo_history.h
+ * @brief Bounded undo/redo history storing each step as a compact encoded delta.
+ */
+#ifndef UNDO_HISTORY_H
+#define UNDO_HISTORY_H
+
+#include "vm/bigmul_unit.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct RegisterChange {
+  unsigned int reg_index;
+  unsigned int reg_type; // 0 for GPR, 1 for CSR, 2 for FPR
+  uint64_t old_value;
+  uint64_t new_value;
+};
+
+struct MemoryChange {
+  uint64_t address;
+  std::vector<uint8_t> old_bytes_vec;
+  std::vector<uint8_t> new_bytes_vec;
+};
+
+/**
+ * @brief Everything one step changed, as recorded while the step runs.
+ */
+struct StepDelta {
+  uint64_t old_pc;
+  uint64_t new_pc;
+  uint64_t cycles = 0; ///< Cycles the step took, its stall cycles included.
+  uint64_t stall_cycles = 0; ///< Of those, the cycles it stalled for.
+  std::vector<RegisterChange> register_changes;
+  std::vector<MemoryChange> memory_changes;
+
+  //custom
+  BigmulUnit::BigmulState bigmul_state; // snapshot of bigmul state BEFORE the step
+  BigmulUnit::BigmulState bigmul_state_after; // snapshot of bigmul state AFTER the step, for redo
+  uint8_t custom_instr_executed = 0;     // 0 = none, 1 = LDBM, 2 = BIGMUL; snapshots are only taken for 1 and 2
+};
+
+/**
+ * @brief Memory held by an UndoHistory.
+ */
+struct UndoHistoryUsage {
+  size_t undo_steps = 0;
+  size_t redo_steps = 0;
+  size_t capacity = 0; ///< Steps kept before the oldest is dropped.
+  size_t encoded_bytes = 0; ///< Bytes of live encoded deltas.
+  size_t reserved_bytes = 0; ///< Bytes allocated for the arena and the step index.
+};
+
+/**
+ * @brief A ring of the last capacity steps, undone and redone from a cursor.
+ *
+ * Steps are encoded back to back into one byte arena: program counters, cycle counts, register values and
+ * memory addresses as LEB128 varints (new values as the zigzag difference from the old), memory bytes verbatim,
+ * and BIGMUL unit snapshots only for LDBM and BIGMUL steps. A plain instruction costs a few bytes
+ * instead of a StepDelta. Pushing past the capacity drops the oldest step; pushing after an undo
+ * drops the steps that could have been redone.
+ */
+class UndoHistory {
+ public:
+  static constexpr size_t kDefaultCapacity = 1000;
+
+  explicit UndoHistory(size_t capacity = kDefaultCapacity);
+
+  /**
+   * @brief Changes how many steps are kept and clears the history. A capacity of 0 disables undo.
+   */
+  void SetCapacity(size_t capacity);
+
+  [[nodiscard]] size_t GetCapacity() const {
+    return capacity_;
+  }
+
+  /**
+   * @brief Records a step after the cursor, dropping the redo steps and, when full, the oldest step.
+   */
+  void Push(const StepDelta &delta);
+
+  [[nodiscard]] bool CanUndo() const {
+    return cursor_ > 0;
+  }
+
+  [[nodiscard]] bool CanRedo() const {
+    return cursor_ < count_;
+  }
+
+  /**
+   * @brief Moves the cursor back one step and returns the step to revert.
+   * @throws std::logic_error If there is nothing to undo.
+   */
+  StepDelta Undo();
+
+  /**
+   * @brief Moves the cursor forward one step and returns the step to reapply.
+   * @throws std::logic_error If there is nothing to redo.
+   */
+  StepDelta Redo();
+
+  void Clear();
+
+  [[nodiscard]] UndoHistoryUsage GetUsage() const;
+
+ private:
+  struct Entry {
+    size_t offset = 0; ///< Where the encoded step starts in arena_.
+  };
+
+  [[nodiscard]] const Entry &EntryAt(size_t position) const {
+    return entries_[(first_ + position) % capacity_];
+  }
+
+  /**
+   * @brief Moves the live steps to the front of the arena once the dropped ones take up most of it.
+   */
+  void Compact();
+
+  size_t capacity_ = 0;
+  std::vector<Entry> entries_; ///< Ring of capacity_ entries, oldest at first_.
+  size_t first_ = 0;
+  size_t count_ = 0; ///< Steps stored, undoable and redoable.
+  size_t cursor_ = 0; ///< Steps before the cursor can be undone, the rest redone.
+  std::vector<uint8_t> arena_; ///< Encoded steps in push order; dropped steps before arena_begin_.
+  size_t arena_begin_ = 0;
+};
+
+#endif // UNDO_HISTORY_H
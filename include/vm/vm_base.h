@@ -9,9 +9,13 @@
 
 #include "registers.h"
 #include "memory_controller.h"
+#include "decode_cache.h"
 #include "alu.h"
+#include "bigmul_unit.h"
+#include "branch_prediction/branch_predictor.h"
 
 #include "vm_asm_mw.h"
+#include "globals.h"
 
 #include <vector>
 #include <string>
@@ -21,6 +25,8 @@
 #include <condition_variable>
 #include <queue>
 #include <atomic>
+#include <iostream>
+#include <sstream>
 
 enum SyscallCode {
     SYSCALL_PRINT_INT = 1,
@@ -33,11 +39,47 @@ enum SyscallCode {
 };
 
 
+/**
+ * @brief Files a VM instance writes its register and state dumps to.
+ */
+struct VmOutputPaths {
+    std::filesystem::path registers_dump = globals::registers_dump_file_path;
+    std::filesystem::path vm_state_dump = globals::vm_state_dump_file_path;
+
+    /**
+     * @brief Returns the dump paths inside the given directory, named like the files in vm_state.
+     */
+    static VmOutputPaths InDirectory(const std::filesystem::path &directory);
+};
+
+/**
+ * @brief The architectural state of a VM at an instruction boundary, see VmBase::Snapshot().
+ *
+ * Memory is held as a copy-on-write image, so a snapshot costs a register file copy and
+ * restoring it costs nothing until memory is written again.
+ */
+struct VmSnapshot {
+    uint64_t program_counter = 0;
+    unsigned int cycles = 0;
+    unsigned int instructions_retired = 0;
+    unsigned int stall_cycles = 0;
+    unsigned int branch_mispredictions = 0;
+    RegisterFile registers;
+    Memory::Image memory;
+    bool guest_exited = false;
+    uint64_t guest_exit_code = 0;
+    BigmulUnit::BigmulState bigmul_state; ///< Filled in by VMs with a BIGMUL unit.
+};
+
 class VmBase {
 public:
     VmBase() = default;
+    explicit VmBase(VmOutputPaths output_paths) : output_paths_(std::move(output_paths)) {}
     ~VmBase() = default;
 
+    VmOutputPaths output_paths_; ///< Where this instance dumps its registers and state.
+    std::ostream *console_ = &std::cout; ///< Receives the VM status lines, e.g. VM_PROGRAM_END.
+
     AssembledProgram program_;
     std::atomic<bool> stop_requested_ = false;
     std::mutex input_mutex_;
@@ -53,11 +95,19 @@ public:
     unsigned int instructions_retired_{};
     float cpi_{};
     float ipc_{};
-    unsigned int stall_cycles_{};
-    unsigned int branch_mispredictions_{};
+    unsigned int stall_cycles_{}; ///< Cycles spent waiting on the caches and memory, included in cycle_s_.
+    unsigned int branch_mispredictions_{}; ///< Control transfers branch_predictor_ predicted a wrong next PC for.
 
     std::string output_status_;
 
+    bool silent_run_ = false; ///< Set by turbo runs: no per-instruction output, syscall output is buffered.
+    std::ostringstream syscall_output_buffer_;
+
+    bool exit_host_on_guest_exit_ = true; ///< Whether the exit syscall also ends the host process.
+    bool guest_exited_ = false; ///< Set once the program made the exit syscall.
+    uint64_t guest_exit_code_ = 0; ///< a0 at the exit syscall.
+    bool input_closed_ = false; ///< Once set, reads of an empty stdin return no input instead of blocking.
+
     
 
 
@@ -67,10 +117,32 @@ public:
     
     alu::Alu alu_;
 
+    DecodeCache decode_cache_; ///< Predecoded instructions of the text section.
+
+    branch_prediction::BranchPredictor branch_predictor_; ///< Rebuilt, untrained, on load and reset.
+
 
     void LoadProgram(const AssembledProgram &program);
     uint64_t program_size_ = 0;
 
+    /**
+     * @brief Counts a cycle, plus the stall cycles of the memory accesses made during it.
+     */
+    void AdvanceCycle() {
+        auto stalls = static_cast<unsigned int>(memory_controller_.TakeStallCycles());
+        cycle_s_ += 1 + stalls;
+        stall_cycles_ += stalls;
+        UpdateCpi();
+    }
+
+    /**
+     * @brief Recomputes cpi_ and ipc_ from the cycle and instruction counters.
+     */
+    void UpdateCpi() {
+        cpi_ = instructions_retired_ == 0 ? 0.0f : static_cast<float>(cycle_s_) / static_cast<float>(instructions_retired_);
+        ipc_ = cycle_s_ == 0 ? 0.0f : static_cast<float>(instructions_retired_) / static_cast<float>(cycle_s_);
+    }
+
     uint64_t GetProgramCounter() const;
     void UpdateProgramCounter(int64_t value);
     
@@ -89,12 +161,42 @@ public:
     // void HandleSyscall();
     void PrintString(uint64_t address);
 
+    /**
+     * @brief Returns the stream program output goes to: std::cout, or a buffer during a silent run.
+     */
+    std::ostream &SyscallOutput() {
+        if (silent_run_) {
+            return syscall_output_buffer_;
+        }
+        return *console_;
+    }
+
+    std::ostream &Console() {
+        return *console_;
+    }
+
+    /**
+     * @brief Writes any buffered program output to the console.
+     */
+    void FlushSyscallOutput();
+
     virtual void Run() = 0;
     virtual void DebugRun() = 0;
     virtual void Step() = 0;
     virtual void Undo() = 0;
     virtual void Redo() = 0;
     virtual void Reset() = 0;
+
+    /**
+     * @brief Captures registers, PC, counters and memory; memory blocks stay shared until written.
+     */
+    virtual VmSnapshot Snapshot();
+
+    /**
+     * @brief Returns to a state taken by Snapshot() on a VM running the same program.
+     */
+    virtual void Restore(const VmSnapshot &snapshot);
+
     void DumpState(const std::filesystem::path &filename);
 
     void ModifyRegister(const std::string &reg_name, uint64_t value);
@@ -104,6 +206,15 @@ public:
         input_cv_.notify_one();
     }
 
+    /**
+     * @brief Marks stdin as exhausted: reads that find no queued input return immediately.
+     */
+    void CloseInput() {
+        std::lock_guard<std::mutex> lock(input_mutex_);
+        input_closed_ = true;
+        input_cv_.notify_all();
+    }
+
 };
 
 #endif // VM_BASE_H
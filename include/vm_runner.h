@@ -9,6 +9,9 @@
 
 #include "vm/vm_base.h"
 #include "vm/rvss/rvss_vm.h"
+#include "vm/rvss/rvss_threaded_vm.h"
+#include "vm/rv5s/rv5s_vm.h"
+#include "vm/ooo/ooo_vm.h"
 #include "config.h"
 #include "vm_asm_mw.h"
 
@@ -16,6 +19,25 @@
 #include <stdexcept>
 #include <sstream>
 
+/**
+ * @brief Creates the VM engine selected by the given VM type.
+ * @param vmType The configured VM type.
+ * @param outputPaths The files the VM dumps its registers and state to.
+ * @return The VM instance.
+ */
+inline std::unique_ptr<RVSSVM> createVM(vm_config::VmTypes vmType, VmOutputPaths outputPaths = VmOutputPaths()) {
+  if (vmType==vm_config::VmTypes::SINGLE_STAGE_THREADED) {
+    return std::make_unique<RVSSThreadedVM>(std::move(outputPaths));
+  }
+  if (vmType==vm_config::VmTypes::MULTI_STAGE) {
+    return std::make_unique<RV5SVM>(std::move(outputPaths));
+  }
+  if (vmType==vm_config::VmTypes::OUT_OF_ORDER) {
+    return std::make_unique<OooVM>(std::move(outputPaths));
+  }
+  return std::make_unique<RVSSVM>(std::move(outputPaths));
+}
+
 // inline std::unique_ptr<VmBase> createVM(vm_config::VmTypes vmType) {
 //   if (vmType==vm_config::VmTypes::SINGLE_STAGE) {
 //     return std::make_unique<RVSSVM>();
@@ -19,6 +19,18 @@
 #include <algorithm>
 
 AssembledProgram assemble(const std::string &filename) {
+  return assemble(filename, globals::disassembly_file_path, globals::errors_dump_file_path);
+}
+
+AssembledProgram assemble(const std::string &filename, const std::filesystem::path &output_directory) {
+  return assemble(filename,
+                  output_directory / globals::disassembly_file_path.filename(),
+                  output_directory / globals::errors_dump_file_path.filename());
+}
+
+AssembledProgram assemble(const std::string &filename,
+                          const std::filesystem::path &disassembly_file_path,
+                          const std::filesystem::path &errors_dump_file_path) {
   std::unique_ptr<Lexer> lexer;
   try {
     lexer = std::make_unique<Lexer>(filename);
@@ -74,12 +86,12 @@ AssembledProgram assemble(const std::string &filename) {
     program.symbol_table = parser.getSymbolTable();
 
     
-    DumpDisasssembly(globals::disassembly_file_path, program);
+    DumpDisasssembly(disassembly_file_path, program);
 
-    DumpNoErrors(globals::errors_dump_file_path);
+    DumpNoErrors(errors_dump_file_path);
 
   } else {
-    DumpErrors(globals::errors_dump_file_path, parser.getErrors());
+    DumpErrors(errors_dump_file_path, parser.getErrors());
     if (globals::verbose_errors_print) {
       parser.printErrors();
     }
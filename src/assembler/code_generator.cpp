@@ -25,6 +25,8 @@ std::vector<std::string> printIntermediateCode(const std::vector<std::pair<ICUni
       code = block.getOpcode() + " " + block.getRd() + " " + block.getRs1() + " " + block.getRs2();
     } else if (instruction_set::isValidSRTypeInstruction(block.getOpcode())) {
       code = block.getOpcode() + " " + block.getRs2() + " " + block.getImm() + "(" + block.getRs1() + ")";
+    } else if (instruction_set::isValidATypeInstruction(block.getOpcode())) {
+      code = block.getOpcode() + " " + block.getRd() + " " + block.getRs2() + " (" + block.getRs1() + ")";
     } else if (instruction_set::isValidITypeInstruction(block.getOpcode())) {
       code = block.getOpcode() + " " + block.getRd() + " " + block.getRs1() + " " + block.getImm();
     } else if (instruction_set::isValidSTypeInstruction(block.getOpcode())) {
@@ -103,6 +105,23 @@ uint32_t generateSRTypeMachineCode(const ICUnit &block) {
   return machineCode;
 }
 
+uint32_t generateATypeMachineCode(const ICUnit &block) {
+  const auto &encoding = instruction_set::A_type_instruction_encoding_map.at(block.getOpcode());
+  const uint32_t rd = extractRegisterIndex(block.getRd());
+  const uint32_t rs1 = extractRegisterIndex(block.getRs1());
+  const uint32_t rs2 = extractRegisterIndex(block.getRs2());
+  uint32_t machineCode = 0;
+  machineCode |= (encoding.funct5.to_ulong() << 27);
+  machineCode |= (encoding.aq.to_ulong() << 26);
+  machineCode |= (encoding.rl.to_ulong() << 25);
+  machineCode |= (rs2 << 20);
+  machineCode |= (rs1 << 15);
+  machineCode |= (encoding.funct3.to_ulong() << 12);
+  machineCode |= (rd << 7);
+  machineCode |= encoding.opcode.to_ulong();
+  return machineCode;
+}
+
 uint32_t generateI1TypeMachineCode(const ICUnit &block) {
   const auto &encoding = instruction_set::I1_type_instruction_encoding_map.at(block.getOpcode());
   const uint32_t rd = extractRegisterIndex(block.getRd());
@@ -380,6 +399,8 @@ std::vector<uint32_t> generateMachineCode(const std::vector<std::pair<ICUnit, bo
       code = generateCSRRTypeMachineCode(block);
     } else if (instruction_set::isValidCSRITypeInstruction(block.getOpcode())) {
       code = generateCSRITypeMachineCode(block);
+    } else if (instruction_set::isValidATypeInstruction(block.getOpcode())) {
+      code = generateATypeMachineCode(block);
     } else if (instruction_set::isValidFDRTypeInstruction(block.getOpcode())) {
       code = generateFDRTypeMachineCode(block);
     } else if (instruction_set::isValidFDR1TypeInstruction(block.getOpcode())) {
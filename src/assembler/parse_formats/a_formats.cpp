@@ -0,0 +1,79 @@
+/**
+ * @file a_formats.cpp
+ * @brief Parsers of the A extension's operand formats.
+ */
+
+#include "assembler/parser.h"
+#include "common/instructions.h"
+#include "vm/registers.h"
+#include "utils.h"
+
+#include <string>
+
+bool Parser::parse_O_GPR_C_GPR_C_LP_GPR_RP() {
+  if (peekToken(1).line_number==currentToken().line_number
+      && peekToken(1).type==TokenType::GP_REGISTER
+      && peekToken(2).line_number==currentToken().line_number
+      && peekToken(2).type==TokenType::COMMA
+      && peekToken(3).line_number==currentToken().line_number
+      && peekToken(3).type==TokenType::GP_REGISTER
+      && peekToken(4).line_number==currentToken().line_number
+      && peekToken(4).type==TokenType::COMMA
+      && peekToken(5).line_number==currentToken().line_number
+      && peekToken(5).type==TokenType::LPAREN
+      && peekToken(6).line_number==currentToken().line_number
+      && peekToken(6).type==TokenType::GP_REGISTER
+      && peekToken(7).line_number==currentToken().line_number
+      && peekToken(7).type==TokenType::RPAREN
+      && (peekToken(8).type==TokenType::EOF_ || peekToken(8).line_number!=currentToken().line_number)
+      ) {
+    ICUnit block;
+    block.setOpcode(currentToken().value);
+    block.setLineNumber(currentToken().line_number);
+    block.setInstructionIndex(instruction_index_);
+
+    // sc and the amos: rd, rs2, (rs1)
+    block.setRd(reg_alias_to_name.at(peekToken(1).value));
+    block.setRs2(reg_alias_to_name.at(peekToken(3).value));
+    block.setRs1(reg_alias_to_name.at(peekToken(6).value));
+
+    skipCurrentLine();
+    intermediate_code_.emplace_back(block, true);
+    instruction_number_line_number_mapping_[instruction_index_] = block.getLineNumber();
+    instruction_index_++;
+    return true;
+  }
+  return false;
+}
+
+bool Parser::parse_O_GPR_C_LP_GPR_RP() {
+  if (peekToken(1).line_number==currentToken().line_number
+      && peekToken(1).type==TokenType::GP_REGISTER
+      && peekToken(2).line_number==currentToken().line_number
+      && peekToken(2).type==TokenType::COMMA
+      && peekToken(3).line_number==currentToken().line_number
+      && peekToken(3).type==TokenType::LPAREN
+      && peekToken(4).line_number==currentToken().line_number
+      && peekToken(4).type==TokenType::GP_REGISTER
+      && peekToken(5).line_number==currentToken().line_number
+      && peekToken(5).type==TokenType::RPAREN
+      && (peekToken(6).type==TokenType::EOF_ || peekToken(6).line_number!=currentToken().line_number)
+      ) {
+    ICUnit block;
+    block.setOpcode(currentToken().value);
+    block.setLineNumber(currentToken().line_number);
+    block.setInstructionIndex(instruction_index_);
+
+    // lr: rd, (rs1), with rs2 encoded as x0
+    block.setRd(reg_alias_to_name.at(peekToken(1).value));
+    block.setRs1(reg_alias_to_name.at(peekToken(4).value));
+    block.setRs2("x0");
+
+    skipCurrentLine();
+    intermediate_code_.emplace_back(block, true);
+    instruction_number_line_number_mapping_[instruction_index_] = block.getLineNumber();
+    instruction_index_++;
+    return true;
+  }
+  return false;
+}
@@ -432,6 +432,16 @@ void Parser::parseTextDirective() {
             break;
           }
 
+          case instruction_set::SyntaxType::O_GPR_C_GPR_C_LP_GPR_RP: {
+            valid_syntax = parse_O_GPR_C_GPR_C_LP_GPR_RP();
+            break;
+          }
+
+          case instruction_set::SyntaxType::O_GPR_C_LP_GPR_RP: {
+            valid_syntax = parse_O_GPR_C_LP_GPR_RP();
+            break;
+          }
+
           default: {
             break;
           }
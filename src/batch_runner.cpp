@@ -0,0 +1,334 @@
+/**
+ * @file batch_runner.cpp
+ * @brief Headless runner that assembles and runs many programs in parallel, one isolated VM per program.
+ */
+
+#include "batch_runner.h"
+
+#include "assembler/assembler.h"
+#include "vm_runner.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <set>
+#include <stdexcept>
+#include <thread>
+
+namespace batch_runner {
+
+namespace {
+
+std::string EscapeJson(const std::string &value) {
+  std::string escaped;
+  for (char c : value) {
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+      escaped += c;
+    } else if (c == '\n') {
+      escaped += "\\n";
+    } else {
+      escaped += c;
+    }
+  }
+  return escaped;
+}
+
+double SecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+std::vector<std::filesystem::path> CollectPrograms(const std::filesystem::path &source) {
+  std::vector<std::filesystem::path> programs;
+  if (std::filesystem::is_directory(source)) {
+    for (const auto &entry : std::filesystem::directory_iterator(source)) {
+      if (entry.is_regular_file() && entry.path().extension() == ".s") {
+        programs.push_back(entry.path());
+      }
+    }
+    std::sort(programs.begin(), programs.end());
+    return programs;
+  }
+
+  std::ifstream list(source);
+  if (!list.is_open()) {
+    throw std::runtime_error("Unable to open batch source: " + source.string());
+  }
+  std::string line;
+  while (std::getline(list, line)) {
+    line.erase(0, line.find_first_not_of(" \t\r"));
+    line.erase(line.find_last_not_of(" \t\r") + 1);
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    std::filesystem::path program(line);
+    if (program.is_relative()) {
+      program = source.parent_path() / program;
+    }
+    programs.push_back(program);
+  }
+  return programs;
+}
+
+namespace {
+
+// Runs program on a fresh VM; configure adjusts the VM after loading, inspect reads it after the run
+BatchResult RunOnFreshVm(const std::filesystem::path &program, const std::filesystem::path &output_directory,
+                         vm_config::VmTypes vm_type,
+                         const std::function<void(RVSSVM &)> &configure,
+                         const std::function<void(const RVSSVM &)> &inspect) {
+  auto start = std::chrono::steady_clock::now();
+  BatchResult result;
+  result.program = program;
+  result.output_directory = output_directory;
+
+  std::filesystem::create_directories(output_directory);
+  std::ofstream console(output_directory / "console.log");
+
+  AssembledProgram assembled;
+  try {
+    assembled = assemble(program.string(), output_directory);
+  } catch (const std::exception &e) {
+    result.status = "VM_PARSE_ERROR";
+    result.error = e.what();
+    result.host_seconds = SecondsSince(start);
+    DumpBatchResult(output_directory / "result.json", result);
+    return result;
+  }
+
+  try {
+    std::unique_ptr<RVSSVM> vm = createVM(vm_type, VmOutputPaths::InDirectory(output_directory));
+    vm->console_ = &console;
+    vm->silent_run_ = true;
+    vm->exit_host_on_guest_exit_ = false;
+    vm->CloseInput();
+
+    vm->LoadProgram(assembled);
+    if (configure) {
+      configure(*vm);
+    }
+    vm->Run();
+    if (inspect) {
+      inspect(*vm);
+    }
+
+    if (vm->guest_exited_) {
+      result.status = "VM_EXIT";
+    } else if (vm->program_counter_ >= vm->program_size_) {
+      result.status = "VM_PROGRAM_END";
+    } else {
+      result.status = "VM_EXECUTION_LIMIT";
+    }
+    result.exited = vm->guest_exited_;
+    result.exit_code = vm->guest_exit_code_;
+    result.instructions_retired = vm->instructions_retired_;
+    result.cycles = vm->cycle_s_;
+    result.gp_registers = vm->registers_.GetGprValues();
+  } catch (const std::exception &e) {
+    result.status = "VM_RUNTIME_ERROR";
+    result.error = e.what();
+  }
+
+  result.host_seconds = SecondsSince(start);
+  DumpBatchResult(output_directory / "result.json", result);
+  return result;
+}
+
+} // namespace
+
+BatchResult RunProgram(const std::filesystem::path &program, const std::filesystem::path &output_directory,
+                       vm_config::VmTypes vm_type) {
+  return RunOnFreshVm(program, output_directory, vm_type, {}, {});
+}
+
+std::vector<BatchResult> RunBatch(const std::vector<std::filesystem::path> &programs,
+                                  const std::filesystem::path &output_directory,
+                                  unsigned int jobs,
+                                  vm_config::VmTypes vm_type) {
+  // One subdirectory per program, named after it; a name already in use gets the program's index
+  // appended, as often as it takes, since a.s, a.s and a_1.s would otherwise share a_1
+  std::vector<std::filesystem::path> program_directories;
+  std::set<std::string> used_names;
+  for (size_t i = 0; i < programs.size(); ++i) {
+    std::string name = programs[i].stem().string();
+    while (used_names.count(name) > 0) {
+      name.append("_").append(std::to_string(i));
+    }
+    used_names.insert(name);
+    program_directories.push_back(output_directory / name);
+  }
+
+  if (jobs == 0) {
+    jobs = std::max(1u, std::thread::hardware_concurrency());
+  }
+  jobs = std::min<size_t>(jobs, std::max<size_t>(programs.size(), 1));
+
+  std::vector<BatchResult> results(programs.size());
+  std::atomic<size_t> next_program = 0;
+  auto worker = [&]() {
+    for (size_t i = next_program++; i < programs.size(); i = next_program++) {
+      results[i] = RunProgram(programs[i], program_directories[i], vm_type);
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (unsigned int i = 0; i < jobs; ++i) {
+    workers.emplace_back(worker);
+  }
+  for (std::thread &thread : workers) {
+    thread.join();
+  }
+  return results;
+}
+
+std::vector<BigmulEngineResult> RunBigmulEngineReport(const std::filesystem::path &program,
+                                                      const std::filesystem::path &output_directory,
+                                                      vm_config::VmTypes vm_type) {
+  std::vector<BigmulEngineResult> results;
+  for (vm_config::BigmulEngine engine : kBigmulEngines) {
+    BigmulEngineResult result;
+    result.engine = engine;
+    std::string name = vm_config::bigmulEngineName(engine);
+    result.run = RunOnFreshVm(
+        program, output_directory / name, vm_type,
+        [engine](RVSSVM &vm) { vm.bigmul_unit_.SetEngine(engine); },
+        [&result](const RVSSVM &vm) {
+          result.bigmul_result = vm.bigmul_unit_.resultCache;
+          result.bigmul_stats = vm.bigmul_unit_.GetStats();
+        });
+    // Every cycle that retired no instruction was spent waiting on LDBM or BIGMUL
+    result.stall_cycles = result.run.cycles - std::min(result.run.cycles, result.run.instructions_retired);
+    results.push_back(std::move(result));
+  }
+
+  // The first engine, singlecycle, is the reference
+  for (BigmulEngineResult &result : results) {
+    result.matches_reference = result.run.Succeeded()
+                               && result.run.status == results.front().run.status
+                               && result.bigmul_result == results.front().bigmul_result
+                               && result.run.gp_registers == results.front().run.gp_registers;
+  }
+  return results;
+}
+
+void PrintBigmulEngineReport(std::ostream &out, const std::vector<BigmulEngineResult> &results) {
+  out << std::left << std::setw(14) << "engine"
+      << std::setw(20) << "status"
+      << std::right << std::setw(14) << "stall_cycles"
+      << std::setw(14) << "total_cycles"
+      << std::setw(14) << "instructions"
+      << std::setw(14) << "products/cyc"
+      << "  result" << '\n';
+  for (const BigmulEngineResult &result : results) {
+    out << std::left << std::setw(14) << vm_config::bigmulEngineName(result.engine)
+        << std::setw(20) << result.run.status
+        << std::right << std::setw(14) << result.stall_cycles
+        << std::setw(14) << result.run.cycles
+        << std::setw(14) << result.run.instructions_retired
+        << std::setw(14) << std::fixed << std::setprecision(2) << result.bigmul_stats.Throughput()
+        << std::defaultfloat
+        << "  " << (result.matches_reference ? "match" : "MISMATCH") << '\n';
+  }
+  for (const BigmulEngineResult &result : results) {
+    if (result.bigmul_stats.stages.empty()) {
+      continue;
+    }
+    out << vm_config::bigmulEngineName(result.engine) << " stage occupancy:";
+    for (const BigmulUnit::StageStats &stage : result.bigmul_stats.stages) {
+      out << ' ' << stage.name << '=' << std::fixed << std::setprecision(1) << stage.Occupancy() * 100 << '%'
+          << std::defaultfloat << " (" << stage.bubble_cycles << " bubbles)";
+    }
+    out << '\n';
+  }
+  out << std::flush;
+}
+
+void DumpBatchResult(const std::filesystem::path &filename, const BatchResult &result) {
+  std::ofstream file(filename);
+  if (!file.is_open()) {
+    throw std::runtime_error("Unable to open file: " + filename.string());
+  }
+
+  file << "{\n";
+  file << "    \"program\": \"" << EscapeJson(result.program.string()) << "\",\n";
+  file << "    \"status\": \"" << result.status << "\",\n";
+  file << "    \"error\": \"" << EscapeJson(result.error) << "\",\n";
+  file << "    \"exited\": " << (result.exited ? "true" : "false") << ",\n";
+  file << "    \"exit_code\": " << result.exit_code << ",\n";
+  file << "    \"instructions_retired\": " << result.instructions_retired << ",\n";
+  file << "    \"cycles\": " << result.cycles << ",\n";
+  file << "    \"host_seconds\": " << std::fixed << std::setprecision(6) << result.host_seconds << ",\n";
+  file << "    \"gp_registers\": {";
+  for (size_t i = 0; i < result.gp_registers.size(); ++i) {
+    file << (i == 0 ? "\n" : ",\n");
+    file << "        \"x" << i << "\": \"0x"
+         << std::hex << std::setw(16) << std::setfill('0') << result.gp_registers[i]
+         << std::setw(0) << std::setfill(' ') << std::dec << "\"";
+  }
+  file << (result.gp_registers.empty() ? "}\n" : "\n    }\n");
+  file << "}\n";
+}
+
+void DumpBatchSummary(const std::filesystem::path &filename, const std::vector<BatchResult> &results,
+                      double host_seconds) {
+  std::ofstream file(filename);
+  if (!file.is_open()) {
+    throw std::runtime_error("Unable to open file: " + filename.string());
+  }
+
+  size_t succeeded = std::count_if(results.begin(), results.end(),
+                                   [](const BatchResult &result) { return result.Succeeded(); });
+  uint64_t total_instructions = 0;
+  for (const BatchResult &result : results) {
+    total_instructions += result.instructions_retired;
+  }
+
+  file << "{\n";
+  file << "    \"programs\": " << results.size() << ",\n";
+  file << "    \"succeeded\": " << succeeded << ",\n";
+  file << "    \"failed\": " << results.size() - succeeded << ",\n";
+  file << "    \"instructions_retired\": " << total_instructions << ",\n";
+  file << "    \"host_seconds\": " << std::fixed << std::setprecision(6) << host_seconds << ",\n";
+  file << "    \"results\": [";
+  for (size_t i = 0; i < results.size(); ++i) {
+    const BatchResult &result = results[i];
+    file << (i == 0 ? "\n" : ",\n");
+    file << "        {\n";
+    file << "            \"program\": \"" << EscapeJson(result.program.string()) << "\",\n";
+    file << "            \"output_directory\": \"" << EscapeJson(result.output_directory.string()) << "\",\n";
+    file << "            \"status\": \"" << result.status << "\",\n";
+    file << "            \"exit_code\": " << result.exit_code << ",\n";
+    file << "            \"instructions_retired\": " << result.instructions_retired << ",\n";
+    file << "            \"cycles\": " << result.cycles << "\n";
+    file << "        }";
+  }
+  file << (results.empty() ? "]\n" : "\n    ]\n");
+  file << "}\n";
+}
+
+void PrintBatchReport(std::ostream &out, const std::vector<BatchResult> &results, double host_seconds) {
+  size_t succeeded = 0;
+  for (const BatchResult &result : results) {
+    out << "VM_BATCH_RESULT " << result.status << " " << result.program.string()
+        << " exit_code=" << result.exit_code
+        << " instructions=" << result.instructions_retired
+        << " cycles=" << result.cycles;
+    if (!result.error.empty()) {
+      out << " error=\"" << result.error << "\"";
+    }
+    out << '\n';
+    succeeded += result.Succeeded() ? 1 : 0;
+  }
+  out << "VM_BATCH_SUMMARY programs=" << results.size()
+      << " succeeded=" << succeeded
+      << " failed=" << results.size() - succeeded
+      << " seconds=" << std::fixed << std::setprecision(6) << host_seconds
+      << std::defaultfloat << std::endl;
+}
+
+} // namespace batch_runner
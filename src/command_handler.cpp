@@ -22,6 +22,8 @@ Command ParseCommand(const std::string &input) {
     command_type = command_handler::CommandType::LOAD;
   } else if (command_str=="run") {
     command_type = command_handler::CommandType::RUN;
+  } else if (command_str=="turbo_run" || command_str=="trun") {
+    command_type = command_handler::CommandType::TURBO_RUN;
   } else if (command_str=="stop") {
     command_type = command_handler::CommandType::STOP;
   } else if (command_str=="run_debug" || command_str=="rd") {
@@ -32,6 +34,16 @@ Command ParseCommand(const std::string &input) {
     command_type = command_handler::CommandType::UNDO;
   } else if (command_str=="redo" || command_str=="r") {
     command_type = command_handler::CommandType::REDO;
+  } else if (command_str=="history_stats") {
+    command_type = command_handler::CommandType::HISTORY_STATS;
+  } else if (command_str=="reverse_step" || command_str=="rs") {
+    command_type = command_handler::CommandType::REVERSE_STEP;
+  } else if (command_str=="reverse_continue" || command_str=="rc") {
+    command_type = command_handler::CommandType::REVERSE_CONTINUE;
+  } else if (command_str=="snapshot") {
+    command_type = command_handler::CommandType::SNAPSHOT;
+  } else if (command_str=="restore") {
+    command_type = command_handler::CommandType::RESTORE;
   } else if (command_str=="reset") {
     command_type = command_handler::CommandType::RESET;
   } else if (command_str=="modify_register" || command_str=="mreg") {
@@ -52,6 +64,8 @@ Command ParseCommand(const std::string &input) {
     command_type = command_handler::CommandType::GET_MEMORY_POINT;
   } else if (command_str=="dump_cache") {
     command_type = command_handler::CommandType::DUMP_CACHE;
+  } else if (command_str=="dump_branch_stats") {
+    command_type = command_handler::CommandType::DUMP_BRANCH_STATS;
   } else if (command_str=="add_breakpoint") {
     command_type = command_handler::CommandType::ADD_BREAKPOINT;
   } else if (command_str=="remove_breakpoint") {
@@ -177,7 +177,30 @@ std::unordered_map<std::string, Instruction> instruction_string_map = {
 
     //custom
     {"ldbm",Instruction::kldbm},
-    {"bigmul",Instruction::kbigmul}
+    {"bigmul",Instruction::kbigmul},
+
+    {"lr.w", Instruction::klr_w},
+    {"lr.d", Instruction::klr_d},
+    {"sc.w", Instruction::ksc_w},
+    {"sc.d", Instruction::ksc_d},
+    {"amoswap.w", Instruction::kamoswap_w},
+    {"amoswap.d", Instruction::kamoswap_d},
+    {"amoadd.w", Instruction::kamoadd_w},
+    {"amoadd.d", Instruction::kamoadd_d},
+    {"amoxor.w", Instruction::kamoxor_w},
+    {"amoxor.d", Instruction::kamoxor_d},
+    {"amoand.w", Instruction::kamoand_w},
+    {"amoand.d", Instruction::kamoand_d},
+    {"amoor.w", Instruction::kamoor_w},
+    {"amoor.d", Instruction::kamoor_d},
+    {"amomin.w", Instruction::kamomin_w},
+    {"amomin.d", Instruction::kamomin_d},
+    {"amomax.w", Instruction::kamomax_w},
+    {"amomax.d", Instruction::kamomax_d},
+    {"amominu.w", Instruction::kamominu_w},
+    {"amominu.d", Instruction::kamominu_d},
+    {"amomaxu.w", Instruction::kamomaxu_w},
+    {"amomaxu.d", Instruction::kamomaxu_d},
 
 };
 
@@ -333,6 +356,35 @@ static const std::unordered_set<std::string> MExtensionInstructions = {
     "mulw", "divw", "divuw", "remw", "remuw",
 };
 
+// A extension: funct3 and funct5 of each mnemonic, which also comes with every ordering suffix
+static const std::unordered_map<std::string, std::pair<unsigned int, unsigned int>> AExtensionBaseInstructions = {
+    {"lr.w", {0b010, 0b00010}},
+    {"lr.d", {0b011, 0b00010}},
+    {"sc.w", {0b010, 0b00011}},
+    {"sc.d", {0b011, 0b00011}},
+    {"amoswap.w", {0b010, 0b00001}},
+    {"amoswap.d", {0b011, 0b00001}},
+    {"amoadd.w", {0b010, 0b00000}},
+    {"amoadd.d", {0b011, 0b00000}},
+    {"amoxor.w", {0b010, 0b00100}},
+    {"amoxor.d", {0b011, 0b00100}},
+    {"amoand.w", {0b010, 0b01100}},
+    {"amoand.d", {0b011, 0b01100}},
+    {"amoor.w", {0b010, 0b01000}},
+    {"amoor.d", {0b011, 0b01000}},
+    {"amomin.w", {0b010, 0b10000}},
+    {"amomin.d", {0b011, 0b10000}},
+    {"amomax.w", {0b010, 0b10100}},
+    {"amomax.d", {0b011, 0b10100}},
+    {"amominu.w", {0b010, 0b11000}},
+    {"amominu.d", {0b011, 0b11000}},
+    {"amomaxu.w", {0b010, 0b11100}},
+    {"amomaxu.d", {0b011, 0b11100}},
+};
+
+// Indexed by the aq and rl bits, aq being the high one
+static const std::array<std::string, 4> AExtensionOrderingSuffixes = {"", ".rl", ".aq", ".aqrl"};
+
 //====================================================================================
 static const std::unordered_set<std::string> FDExtensionRTypeInstructions = {
     "fsgnj.s", "fsgnjn.s", "fsgnjx.s", "fmin.s", "fmax.s",
@@ -438,6 +490,17 @@ std::unordered_map<std::string, SRTypeInstructionEncoding> SR_type_instruction_e
   {"bigmul", {0b0111111, 0b000}}, //O_GPR_C_I_LP_GPR_RP
 };
 
+std::unordered_map<std::string, ATypeInstructionEncoding> A_type_instruction_encoding_map = [] {
+  std::unordered_map<std::string, ATypeInstructionEncoding> map;
+  for (const auto &[name, funct] : AExtensionBaseInstructions) {
+    for (unsigned int ordering = 0; ordering < AExtensionOrderingSuffixes.size(); ++ordering) {
+      map.emplace(name + AExtensionOrderingSuffixes[ordering],
+                  ATypeInstructionEncoding(0b0101111, funct.first, funct.second, ordering >> 1, ordering & 1));
+    }
+  }
+  return map;
+}(); // O_GPR_C_GPR_C_LP_GPR_RP, lr: O_GPR_C_LP_GPR_RP
+
 std::unordered_map<std::string, I1TypeInstructionEncoding> I1_type_instruction_encoding_map = {
     {"addi", {0b0010011, 0b000}}, // O_GPR_C_GPR_C_I
     {"xori", {0b0010011, 0b100}}, // O_GPR_C_GPR_C_I
@@ -847,8 +910,18 @@ std::unordered_map<std::string, std::vector<SyntaxType>> instruction_syntax_map
 
 };
 
+// The A extension's syntaxes, one entry per ordering suffix, follow from its encoding map
+[[maybe_unused]] static const bool a_extension_syntaxes_added = [] {
+  for (const auto &[name, encoding] : A_type_instruction_encoding_map) {
+    instruction_syntax_map[name] = {name.starts_with("lr.") ? SyntaxType::O_GPR_C_LP_GPR_RP
+                                                            : SyntaxType::O_GPR_C_GPR_C_LP_GPR_RP};
+  }
+  return true;
+}();
+
 bool isValidInstruction(const std::string &instruction) {
-  return valid_instructions.find(instruction)!=valid_instructions.end();
+  return valid_instructions.find(instruction)!=valid_instructions.end()
+      || A_type_instruction_encoding_map.find(instruction)!=A_type_instruction_encoding_map.end();
 }
 
 bool isValidRTypeInstruction(const std::string &instruction) {
@@ -922,6 +995,10 @@ bool isValidCSRInstruction(const std::string &instruction) {
       (CSRIInstructions.find(instruction)!=CSRIInstructions.end());
 }
 
+bool isValidATypeInstruction(const std::string &instruction) {
+  return A_type_instruction_encoding_map.find(instruction)!=A_type_instruction_encoding_map.end();
+}
+
 bool isValidFDRTypeInstruction(const std::string &instruction) {
   return (FDExtensionRTypeInstructions.find(instruction)!=FDExtensionRTypeInstructions.end());
 }
@@ -1057,6 +1134,8 @@ std::string getExpectedSyntaxes(const std::string &opcode) {
       {SyntaxType::O_GPR_C_FPR_C_RM, "<gp-reg>, <fp-reg>, <rm>"},
       {SyntaxType::O_GPR_C_FPR_C_FPR, "<gp-reg>, <fp-reg>, <fp-reg>"},
       {SyntaxType::O_FPR_C_I_LP_GPR_RP, "<fp-reg>, <imm>(<gp-reg>)"},
+      {SyntaxType::O_GPR_C_GPR_C_LP_GPR_RP, "<gp-reg>, <gp-reg>, (<gp-reg>)"},
+      {SyntaxType::O_GPR_C_LP_GPR_RP, "<gp-reg>, (<gp-reg>)"},
   };
 
   std::string syntaxes;
@@ -10,6 +10,7 @@ std::filesystem::path globals::errors_dump_file_path = (globals::invokation_path
 std::filesystem::path globals::registers_dump_file_path = (globals::invokation_path / "vm_state" / "registers_dump.json");
 std::filesystem::path globals::memory_dump_file_path = (globals::invokation_path / "vm_state" / "memory_dump.json");
 std::filesystem::path globals::cache_dump_file_path = (globals::invokation_path / "vm_state" / "cache_dump.json");
+std::filesystem::path globals::branch_stats_dump_file_path = (globals::invokation_path / "vm_state" / "branch_stats.json");
 std::filesystem::path globals::vm_state_dump_file_path = (globals::invokation_path / "vm_state" / "vm_state_dump.json");
 
 bool globals::verbose_errors_print = false;
@@ -6,11 +6,19 @@
 #include "vm_runner.h"
 #include "command_handler.h"
 #include "config.h"
+#include "batch_runner.h"
+#include "multi_hart.h"
+#include "vm/cache/cache_trace.h"
 
 #include <iostream>
 #include <thread>
 #include <bitset>
 #include <regex>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <optional>
+#include <functional>
 
 
 
@@ -20,6 +28,14 @@ int main(int argc, char *argv[]) {
     return 1;
   }
 
+  bool turbo_run = false;
+  unsigned int batch_jobs = 0;
+  std::filesystem::path batch_output_directory = globals::vm_state_directory / "batch";
+  std::filesystem::path cache_trace_path;
+  // Run by the last of --assemble, --run, --cache-sweep, --batch and --bigmul-report once every option
+  // is parsed, so options like --turbo apply wherever they appear
+  std::function<int()> action;
+
   for (int i = 1; i < argc; ++i) {
     std::string arg = argv[i];
 
@@ -29,6 +45,17 @@ int main(int argc, char *argv[]) {
                   << "  --help, -h           Show this help message\n"
                   << "  --assemble <file>    Assemble the specified file\n"
                   << "  --run <file>         Run the specified file\n"
+                  << "  --vm-type <type>     Select the VM engine (single_stage, single_stage_threaded, multi_stage,\n"
+                  << "                       out_of_order)\n"
+                  << "  --harts <n>          Make --run run n harts sharing one memory (default: 1)\n"
+                  << "  --hart-schedule <s>  Run the harts round_robin on one thread or in parallel, one thread each\n"
+                  << "  --turbo              Make --run silent and report instructions/second\n"
+                  << "  --cache-trace <file> Make --run record every memory access to a binary trace\n"
+                  << "  --cache-sweep <trace> <configs>  Replay a trace through each cache configuration, in parallel\n"
+                  << "  --batch <dir|list>   Run every .s file of a directory, or every file of a list, in parallel\n"
+                  << "  --jobs <n>           Worker threads for --batch and --cache-sweep (default: hardware concurrency)\n"
+                  << "  --batch-out <dir>    Output directory for --batch and --bigmul-report (default: vm_state/batch)\n"
+                  << "  --bigmul-report <file>  Run the file under every BIGMUL engine and compare cycles and results\n"
                   << "  --verbose-errors     Enable verbose error printing\n"
                   << "  --start-vm           Start the VM with the default program\n"
                   << "  --start-vm --vm-as-backend  Start the VM with the default program in backend mode\n";
@@ -39,32 +66,193 @@ int main(int argc, char *argv[]) {
             std::cerr << "Error: No file specified for assembly.\n";
             return 1;
         }
+        action = [file = std::string(argv[i])]() {
+            try {
+                AssembledProgram program = assemble(file);
+                std::cout << "Assembled program: " << program.filename << '\n';
+                return 0;
+            } catch (const std::runtime_error& e) {
+                std::cerr << e.what() << '\n';
+                return 1;
+            }
+        };
+
+    } else if (arg == "--run") {
+        if (++i >= argc) {
+            std::cerr << "Error: No file specified to run.\n";
+            return 1;
+        }
+        action = [&, file = std::string(argv[i])]() {
+            try {
+                AssembledProgram program = assemble(file);
+                if (vm_config::config.getHartCount() > 1) {
+                    if (!cache_trace_path.empty()) {
+                        std::cerr << "Error: --cache-trace records a single hart.\n";
+                        return 1;
+                    }
+                    multi_hart::Machine machine(vm_config::config.getVmType(), vm_config::config.getHartCount(),
+                                                globals::vm_state_directory);
+                    machine.LoadProgram(program);
+                    machine.Run(vm_config::config.getHartQuantum(), vm_config::config.getHartSchedule());
+                    std::cout << "Program running: " << program.filename << '\n';
+                    return 0;
+                }
+                std::unique_ptr<RVSSVM> vm = createVM(vm_config::config.getVmType());
+                vm->LoadProgram(program);
+                std::optional<cache::TraceWriter> trace;
+                if (!cache_trace_path.empty()) {
+                    trace.emplace(cache_trace_path);
+                    vm->memory_controller_.TraceAccesses(&*trace);
+                }
+                if (turbo_run) {
+                    vm->TurboRun();
+                } else {
+                    vm->Run();
+                }
+                if (trace) {
+                    vm->memory_controller_.TraceAccesses(nullptr);
+                    trace->Flush();
+                    std::cout << "VM_TRACE_WRITTEN records=" << trace->GetRecordCount()
+                              << " file=" << cache_trace_path.string() << '\n';
+                }
+                std::cout << "Program running: " << program.filename << '\n';
+                return 0;
+            } catch (const std::runtime_error& e) {
+                std::cerr << e.what() << '\n';
+                return 1;
+            }
+        };
+
+    } else if (arg == "--vm-type") {
+        if (++i >= argc) {
+            std::cerr << "Error: No VM type specified.\n";
+            return 1;
+        }
         try {
-            AssembledProgram program = assemble(argv[i]);
-            std::cout << "Assembled program: " << program.filename << '\n';
-            return 0;
-        } catch (const std::runtime_error& e) {
+            vm_config::config.modifyConfig("Execution", "processor_type", argv[i]);
+        } catch (const std::invalid_argument& e) {
             std::cerr << e.what() << '\n';
             return 1;
         }
 
-    } else if (arg == "--run") {
+    } else if (arg == "--harts") {
         if (++i >= argc) {
-            std::cerr << "Error: No file specified to run.\n";
+            std::cerr << "Error: No hart count specified.\n";
             return 1;
         }
         try {
-            AssembledProgram program = assemble(argv[i]);
-            RVSSVM vm;
-            vm.LoadProgram(program);
-            vm.Run();
-            std::cout << "Program running: " << program.filename << '\n';
-            return 0;
-        } catch (const std::runtime_error& e) {
+            vm_config::config.modifyConfig("Execution", "hart_count", argv[i]);
+        } catch (const std::exception& e) {
             std::cerr << e.what() << '\n';
             return 1;
         }
 
+    } else if (arg == "--hart-schedule") {
+        if (++i >= argc) {
+            std::cerr << "Error: No hart schedule specified.\n";
+            return 1;
+        }
+        try {
+            vm_config::config.modifyConfig("Execution", "hart_schedule", argv[i]);
+        } catch (const std::invalid_argument& e) {
+            std::cerr << e.what() << '\n';
+            return 1;
+        }
+
+    } else if (arg == "--turbo") {
+        turbo_run = true;
+
+    } else if (arg == "--cache-trace") {
+        if (++i >= argc) {
+            std::cerr << "Error: No trace file specified.\n";
+            return 1;
+        }
+        cache_trace_path = argv[i];
+
+    } else if (arg == "--cache-sweep") {
+        if (i + 2 >= argc) {
+            std::cerr << "Error: --cache-sweep needs a trace file and a configuration file.\n";
+            return 1;
+        }
+        std::filesystem::path trace_path = argv[++i];
+        std::filesystem::path sweep_path = argv[++i];
+        action = [&, trace_path, sweep_path]() {
+            try {
+                auto start = std::chrono::steady_clock::now();
+                std::vector<uint8_t> trace = cache::LoadTrace(trace_path);
+                std::vector<cache::SweepPoint> points = cache::ReadSweepFile(sweep_path);
+                std::vector<cache::SweepResult> results = cache::SweepTrace(trace, points, batch_jobs);
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                cache::PrintSweepReport(std::cout, results);
+                std::cout << "VM_CACHE_SWEEP points=" << results.size() << " seconds=" << seconds << '\n';
+                return 0;
+            } catch (const std::exception& e) {
+                std::cerr << e.what() << '\n';
+                return 1;
+            }
+        };
+
+    } else if (arg == "--jobs") {
+        if (++i >= argc) {
+            std::cerr << "Error: No job count specified.\n";
+            return 1;
+        }
+        try {
+            batch_jobs = std::stoul(argv[i]);
+        } catch (const std::exception &e) {
+            std::cerr << "Invalid job count: " << argv[i] << '\n';
+            return 1;
+        }
+
+    } else if (arg == "--batch-out") {
+        if (++i >= argc) {
+            std::cerr << "Error: No batch output directory specified.\n";
+            return 1;
+        }
+        batch_output_directory = argv[i];
+
+    } else if (arg == "--batch") {
+        if (++i >= argc) {
+            std::cerr << "Error: No batch source specified.\n";
+            return 1;
+        }
+        action = [&, source = std::string(argv[i])]() {
+            try {
+                auto start = std::chrono::steady_clock::now();
+                std::vector<std::filesystem::path> programs = batch_runner::CollectPrograms(source);
+                std::vector<batch_runner::BatchResult> results = batch_runner::RunBatch(
+                    programs, batch_output_directory, batch_jobs, vm_config::config.getVmType());
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                batch_runner::DumpBatchSummary(batch_output_directory / "summary.json", results, seconds);
+                batch_runner::PrintBatchReport(std::cout, results, seconds);
+                bool all_succeeded = std::all_of(results.begin(), results.end(),
+                                                 [](const batch_runner::BatchResult &result) { return result.Succeeded(); });
+                return all_succeeded ? 0 : 1;
+            } catch (const std::exception& e) {
+                std::cerr << e.what() << '\n';
+                return 1;
+            }
+        };
+
+    } else if (arg == "--bigmul-report") {
+        if (++i >= argc) {
+            std::cerr << "Error: No file specified for the BIGMUL report.\n";
+            return 1;
+        }
+        action = [&, file = std::string(argv[i])]() {
+            try {
+                std::vector<batch_runner::BigmulEngineResult> results = batch_runner::RunBigmulEngineReport(
+                    file, batch_output_directory, vm_config::config.getVmType());
+                batch_runner::PrintBigmulEngineReport(std::cout, results);
+                bool all_match = std::all_of(results.begin(), results.end(),
+                                             [](const batch_runner::BigmulEngineResult &result) { return result.matches_reference; });
+                return all_match ? 0 : 1;
+            } catch (const std::exception& e) {
+                std::cerr << e.what() << '\n';
+                return 1;
+            }
+        };
+
     } else if (arg == "--verbose-errors") {
         globals::verbose_errors_print = true;
         std::cout << "Verbose error printing enabled.\n";
@@ -80,6 +268,10 @@ int main(int argc, char *argv[]) {
         return 1;
     }
   }
+
+  if (action) {
+    return action();
+  }
   
 
 
@@ -88,7 +280,8 @@ int main(int argc, char *argv[]) {
 
 
   AssembledProgram program;
-  RVSSVM vm;
+  vm_config::VmTypes vm_type = vm_config::config.getVmType();
+  std::unique_ptr<RVSSVM> vm = createVM(vm_type);
   // try {
   //   program = assemble("/home/vis/Desk/codes/assembler/examples/ntest1.s");
   // } catch (const std::runtime_error &e) {
@@ -109,7 +302,7 @@ int main(int argc, char *argv[]) {
   //     count += 4;
   // }
 
-  // vm.LoadProgram(program);
+  // vm->LoadProgram(program);
   
 
   std::cout << "VM_STARTED" << std::endl;
@@ -120,7 +313,7 @@ int main(int argc, char *argv[]) {
 
   auto launch_vm_thread = [&](auto fn) {
     if (vm_thread.joinable()) {
-      vm.RequestStop();   
+      vm->RequestStop();   
       vm_thread.join();
     }
     vm_running = true;
@@ -133,6 +326,8 @@ int main(int argc, char *argv[]) {
 
 
 
+  std::map<std::string, VmSnapshot> snapshots; ///< Named by the snapshot command, dropped on load.
+
   std::string command_buffer;
   while (true) {
     // std::cout << "=> ";
@@ -161,48 +356,91 @@ int main(int argc, char *argv[]) {
       try {
         program = assemble(command.args[0]);
         std::cout << "VM_PARSE_SUCCESS" << std::endl;
-        vm.output_status_ = "VM_PARSE_SUCCESS";
-        vm.DumpState(globals::vm_state_dump_file_path);
+        vm->output_status_ = "VM_PARSE_SUCCESS";
+        vm->DumpState(globals::vm_state_dump_file_path);
       } catch (const std::runtime_error &e) {
         std::cout << "VM_PARSE_ERROR" << std::endl;
-        vm.output_status_ = "VM_PARSE_ERROR";
-        vm.DumpState(globals::vm_state_dump_file_path);
+        vm->output_status_ = "VM_PARSE_ERROR";
+        vm->DumpState(globals::vm_state_dump_file_path);
         std::cerr << e.what() << '\n';
         continue;
       }
-      vm.LoadProgram(program);
+      if (vm_config::config.getVmType() != vm_type) {
+        // Switch engines between programs; the old VM must be idle first
+        vm->RequestStop();
+        if (vm_thread.joinable()) vm_thread.join();
+        vm_type = vm_config::config.getVmType();
+        vm = createVM(vm_type);
+      }
+      vm->LoadProgram(program);
+      snapshots.clear();
       std::cout << "Program loaded: " << command.args[0] << std::endl;
     } else if (command.type==command_handler::CommandType::RUN) {
-      launch_vm_thread([&]() { vm.Run(); });
+      launch_vm_thread([&]() { vm->Run(); });
+    } else if (command.type==command_handler::CommandType::TURBO_RUN) {
+      launch_vm_thread([&]() { vm->TurboRun(); });
     } else if (command.type==command_handler::CommandType::DEBUG_RUN) {
-      launch_vm_thread([&]() { vm.DebugRun(); });
+      launch_vm_thread([&]() { vm->DebugRun(); });
     } else if (command.type==command_handler::CommandType::STOP) {
-      vm.RequestStop();
+      vm->RequestStop();
       std::cout << "VM_STOPPED" << std::endl;
-      vm.output_status_ = "VM_STOPPED";
-      vm.DumpState(globals::vm_state_dump_file_path);
+      vm->output_status_ = "VM_STOPPED";
+      vm->DumpState(globals::vm_state_dump_file_path);
     } else if (command.type==command_handler::CommandType::STEP) {
       if (vm_running) continue;
-      launch_vm_thread([&]() { vm.Step(); });
+      launch_vm_thread([&]() { vm->Step(); });
 
     } else if (command.type==command_handler::CommandType::UNDO) {
       if (vm_running) continue;
-      vm.Undo();
+      vm->Undo();
     } else if (command.type==command_handler::CommandType::REDO) {
       if (vm_running) continue;
-      vm.Redo();
+      vm->Redo();
+    } else if (command.type==command_handler::CommandType::HISTORY_STATS) {
+      vm->ReportHistoryUsage();
+    } else if (command.type==command_handler::CommandType::REVERSE_STEP) {
+      if (vm_running) continue;
+      try {
+        vm->ReverseStep(command.args.empty() ? 1 : std::stoull(command.args[0]));
+      } catch (const std::exception &e) {
+        std::cout << "VM_REVERSE_STEP_ERROR" << std::endl;
+        std::cerr << e.what() << '\n';
+      }
+    } else if (command.type==command_handler::CommandType::REVERSE_CONTINUE) {
+      if (vm_running) continue;
+      vm->ReverseContinue();
+    } else if (command.type==command_handler::CommandType::SNAPSHOT) {
+      if (vm_running) continue;
+      if (command.args.size() != 1) {
+        std::cout << "VM_SNAPSHOT_ERROR" << std::endl;
+        continue;
+      }
+      snapshots[command.args[0]] = vm->Snapshot();
+      std::cout << "VM_SNAPSHOT_SAVED" << std::endl;
+    } else if (command.type==command_handler::CommandType::RESTORE) {
+      if (vm_running) continue;
+      auto snapshot = command.args.size() == 1 ? snapshots.find(command.args[0]) : snapshots.end();
+      if (snapshot == snapshots.end()) {
+        std::cout << "VM_SNAPSHOT_NOT_FOUND" << std::endl;
+        continue;
+      }
+      vm->Restore(snapshot->second);
+      std::cout << "VM_SNAPSHOT_RESTORED" << std::endl;
+      vm->output_status_ = "VM_SNAPSHOT_RESTORED";
+      DumpRegisters(globals::registers_dump_file_path, vm->registers_);
+      vm->DumpState(globals::vm_state_dump_file_path);
     } else if (command.type==command_handler::CommandType::RESET) {
-      vm.Reset();
+      vm->Reset();
     } else if (command.type==command_handler::CommandType::EXIT) {
-      vm.RequestStop();
+      vm->RequestStop();
       if (vm_thread.joinable()) vm_thread.join(); // ensure clean exit
-      vm.output_status_ = "VM_EXITED";
-      vm.DumpState(globals::vm_state_dump_file_path);
+      vm->output_status_ = "VM_EXITED";
+      vm->DumpState(globals::vm_state_dump_file_path);
       break;
     } else if (command.type==command_handler::CommandType::ADD_BREAKPOINT) {
-      vm.AddBreakpoint(std::stoul(command.args[0], nullptr, 10));
+      vm->AddBreakpoint(std::stoul(command.args[0], nullptr, 10));
     } else if (command.type==command_handler::CommandType::REMOVE_BREAKPOINT) {
-      vm.RemoveBreakpoint(std::stoul(command.args[0], nullptr, 10));
+      vm->RemoveBreakpoint(std::stoul(command.args[0], nullptr, 10));
     } else if (command.type==command_handler::CommandType::MODIFY_REGISTER) {
       try {
         if (command.args.size() != 2) {
@@ -211,8 +449,8 @@ int main(int argc, char *argv[]) {
         }
         std::string reg_name = command.args[0];
         uint64_t value = std::stoull(command.args[1], nullptr, 16);
-        vm.ModifyRegister(reg_name, value);
-        DumpRegisters(globals::registers_dump_file_path, vm.registers_);
+        vm->ModifyRegister(reg_name, value);
+        DumpRegisters(globals::registers_dump_file_path, vm->registers_);
         std::cout << "VM_MODIFY_REGISTER_SUCCESS" << std::endl;
       } catch (const std::out_of_range &e) {
         std::cout << "VM_MODIFY_REGISTER_ERROR" << std::endl;
@@ -227,7 +465,7 @@ int main(int argc, char *argv[]) {
         std::cout << "VM_REGISTER_VAL_START";
         std::cout << "0x"
                   << std::hex
-                  << vm.registers_.ReadGpr(std::stoi(reg_str.substr(1))) 
+                  << vm->registers_.ReadGpr(std::stoi(reg_str.substr(1))) 
                   << std::dec;
         std::cout << "VM_REGISTER_VAL_END"<< std::endl;
       } 
@@ -245,13 +483,13 @@ int main(int argc, char *argv[]) {
         uint64_t value = std::stoull(command.args[2], nullptr, 16);
 
         if (type == "byte") {
-          vm.memory_controller_.WriteByte(address, static_cast<uint8_t>(value));
+          vm->memory_controller_.WriteByte(address, static_cast<uint8_t>(value));
         } else if (type == "half") {
-          vm.memory_controller_.WriteHalfWord(address, static_cast<uint16_t>(value));
+          vm->memory_controller_.WriteHalfWord(address, static_cast<uint16_t>(value));
         } else if (type == "word") {
-          vm.memory_controller_.WriteWord(address, static_cast<uint32_t>(value));
+          vm->memory_controller_.WriteWord(address, static_cast<uint32_t>(value));
         } else if (type == "double") {
-          vm.memory_controller_.WriteDoubleWord(address, value);
+          vm->memory_controller_.WriteDoubleWord(address, value);
         } else {
           std::cout << "VM_MODIFY_MEMORY_ERROR" << std::endl;
           continue;
@@ -270,7 +508,7 @@ int main(int argc, char *argv[]) {
     
     else if (command.type==command_handler::CommandType::DUMP_MEMORY) {
       try {
-        vm.memory_controller_.DumpMemory(command.args);
+        vm->memory_controller_.DumpMemory(command.args);
       } catch (const std::out_of_range &e) {
         std::cout << "VM_MEMORY_DUMP_ERROR" << std::endl;
         continue;
@@ -282,7 +520,7 @@ int main(int argc, char *argv[]) {
       for (size_t i = 0; i < command.args.size(); i+=2) {
         uint64_t address = std::stoull(command.args[i], nullptr, 16);
         uint64_t rows = std::stoull(command.args[i+1]);
-        vm.memory_controller_.PrintMemory(address, rows);
+        vm->memory_controller_.PrintMemory(address, rows);
       }
       std::cout << std::endl;
     } else if (command.type==command_handler::CommandType::GET_MEMORY_POINT) {
@@ -291,17 +529,23 @@ int main(int argc, char *argv[]) {
         continue;
       }
       // uint64_t address = std::stoull(command.args[0], nullptr, 16);
-      vm.memory_controller_.GetMemoryPoint(command.args[0]);
+      vm->memory_controller_.GetMemoryPoint(command.args[0]);
     } 
 
 
     else if (command.type==command_handler::CommandType::VM_STDIN) {
-      vm.PushInput(command.args[0]);
+      vm->PushInput(command.args[0]);
     }
     
     
     else if (command.type==command_handler::CommandType::DUMP_CACHE) {
+      vm->memory_controller_.DumpCaches(globals::cache_dump_file_path);
+      vm->memory_controller_.PrintCacheStatus();
       std::cout << "Cache dumped." << std::endl;
+    } else if (command.type==command_handler::CommandType::DUMP_BRANCH_STATS) {
+      vm->branch_predictor_.Dump(globals::branch_stats_dump_file_path, vm->instructions_retired_);
+      vm->branch_predictor_.PrintReport(std::cout, vm->instructions_retired_);
+      std::cout << "Branch statistics dumped." << std::endl;
     } else {
       std::cout << "Invalid command.";
       std::cout << command_buffer << std::endl;
@@ -0,0 +1,165 @@
+/**
+ * @file multi_hart.cpp
+ * @brief A machine of several harts sharing one memory, run in quanta on one or one-per-hart host threads.
+ */
+
+#include "multi_hart.h"
+
+#include "utils.h"
+#include "vm_runner.h"
+
+#include <algorithm>
+#include <barrier>
+#include <stdexcept>
+#include <thread>
+
+namespace multi_hart {
+
+std::string HartStatus(const RVSSVM &hart) {
+  if (hart.guest_exited_) {
+    return "VM_EXIT";
+  }
+  if (hart.program_counter_ >= hart.program_size_) {
+    return "VM_PROGRAM_END";
+  }
+  return "VM_EXECUTION_LIMIT";
+}
+
+Machine::Machine(vm_config::VmTypes vm_type, uint64_t hart_count, const std::filesystem::path &output_directory,
+                 std::ostream &console)
+    : console_(&console) {
+  if (hart_count == 0) {
+    throw std::invalid_argument("Hart count must be at least 1");
+  }
+  for (uint64_t i = 0; i < hart_count; ++i) {
+    std::filesystem::path directory = i == 0 ? output_directory : output_directory / ("hart" + std::to_string(i));
+    std::filesystem::create_directories(directory);
+
+    auto hart = std::make_unique<Hart>();
+    hart->vm = createVM(vm_type, VmOutputPaths::InDirectory(directory));
+    hart->vm->console_ = &hart->console;
+    hart->vm->silent_run_ = true;
+    hart->vm->exit_host_on_guest_exit_ = false;
+    hart->vm->CloseInput();
+    hart->vm->registers_.SetHartId(i);
+    if (i > 0) {
+      hart->vm->ShareMemory(*harts_.front()->vm);
+    }
+    harts_.push_back(std::move(hart));
+  }
+}
+
+void Machine::LoadProgram(const AssembledProgram &program) {
+  // Every hart writes the same image; each also needs the program size, decode cache and caches it sets up
+  for (const std::unique_ptr<Hart> &hart : harts_) {
+    hart->vm->LoadProgram(program);
+    hart->console.str("");
+  }
+  *console_ << "VM_PROGRAM_LOADED harts=" << harts_.size() << std::endl;
+}
+
+void Machine::RunQuantum(Hart &hart, uint64_t quantum) {
+  uint64_t count = std::min(quantum, hart.budget);
+  try {
+    uint64_t executed = hart.vm->RunInstructions(count);
+    hart.budget -= executed;
+    hart.running = executed == count && hart.budget > 0;
+  } catch (...) {
+    hart.error = std::current_exception();
+    hart.running = false;
+  }
+}
+
+void Machine::ForwardOutput() {
+  for (const std::unique_ptr<Hart> &hart : harts_) {
+    hart->vm->FlushSyscallOutput();
+    std::string output = hart->console.str();
+    if (!output.empty()) {
+      *console_ << output << std::flush;
+      hart->console.str("");
+    }
+  }
+}
+
+void Machine::Run(uint64_t quantum, vm_config::HartSchedule schedule) {
+  if (quantum == 0) {
+    throw std::invalid_argument("Hart quantum must be at least 1");
+  }
+  for (const std::unique_ptr<Hart> &hart : harts_) {
+    hart->vm->ClearStop();
+    hart->budget = RVSSVM::RunLimit();
+    hart->running = true;
+    hart->error = nullptr;
+  }
+  auto any_running = [&]() {
+    return std::any_of(harts_.begin(), harts_.end(), [](const std::unique_ptr<Hart> &hart) {
+      return hart->running;
+    });
+  };
+
+  if (schedule == vm_config::HartSchedule::ROUND_ROBIN) {
+    while (any_running()) {
+      for (const std::unique_ptr<Hart> &hart : harts_) {
+        if (hart->running) {
+          RunQuantum(*hart, quantum);
+        }
+      }
+      ForwardOutput();
+    }
+  } else {
+    // The last hart to arrive forwards the output and decides, for all of them, whether to go on
+    bool done = false;
+    std::barrier quantum_end(static_cast<std::ptrdiff_t>(harts_.size()), [&]() noexcept {
+      ForwardOutput();
+      done = !any_running();
+    });
+    std::vector<std::thread> threads;
+    for (const std::unique_ptr<Hart> &hart : harts_) {
+      threads.emplace_back([&, hart = hart.get()]() {
+        while (true) {
+          if (hart->running) {
+            RunQuantum(*hart, quantum);
+          }
+          quantum_end.arrive_and_wait();
+          if (done) {
+            break;
+          }
+        }
+      });
+    }
+    for (std::thread &thread : threads) {
+      thread.join();
+    }
+  }
+
+  PrintStats(*console_);
+  bool ended = true;
+  for (const std::unique_ptr<Hart> &hart : harts_) {
+    RVSSVM &vm = *hart->vm;
+    vm.output_status_ = HartStatus(vm);
+    ended = ended && vm.output_status_ != "VM_EXECUTION_LIMIT";
+    DumpRegisters(vm.output_paths_.registers_dump, vm.registers_);
+    vm.DumpState(vm.output_paths_.vm_state_dump);
+  }
+  if (ended) {
+    *console_ << "VM_PROGRAM_END" << std::endl;
+  }
+  for (const std::unique_ptr<Hart> &hart : harts_) {
+    if (hart->error) {
+      std::rethrow_exception(hart->error);
+    }
+  }
+}
+
+void Machine::PrintStats(std::ostream &os) const {
+  for (size_t i = 0; i < harts_.size(); ++i) {
+    const RVSSVM &vm = *harts_[i]->vm;
+    os << "VM_HART_STATS hart=" << i
+       << " status=" << HartStatus(vm)
+       << " instructions=" << vm.instructions_retired_
+       << " cycles=" << vm.cycle_s_
+       << " pc=0x" << std::hex << vm.program_counter_ << std::dec << std::endl;
+  }
+}
+
+} // namespace multi_hart
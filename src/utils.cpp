@@ -396,6 +396,9 @@ void SetupConfigFile() {
   config_file << "[Execution]\n";
   config_file << "run_step_delay=0   ; in ms\n";
   config_file << "processor_type=single_stage\n";
+  config_file << "hart_count=1\n";
+  config_file << "hart_quantum=1000   ; instructions between hart synchronizations\n";
+  config_file << "hart_schedule=round_robin   ; round_robin or parallel\n";
   config_file << "hazard_detection=false\n";
   config_file << "forwarding=false\n";
   config_file << "branch_prediction=none\n\n";
@@ -406,17 +409,48 @@ void SetupConfigFile() {
 
   config_file << "[Cache]\n";
   config_file << "cache_enabled=false\n";
-  config_file << "cache_size=0\n";
-  config_file << "cache_block_size=0\n";
-  config_file << "cache_associativity=0\n";
+  config_file << "cache_size=16384   ; in bytes, each of the L1 instruction and data caches\n";
+  config_file << "cache_block_size=64\n";
+  config_file << "cache_associativity=4\n";
   config_file << "cache_read_miss_policy=read_allocate\n";
   config_file << "cache_replacement_policy=LRU\n";
   config_file << "cache_write_hit_policy=write_back\n";
-  config_file << "cache_write_miss_policy=write_allocate\n\n";
+  config_file << "cache_write_miss_policy=write_allocate\n";
+  config_file << "cache_hit_latency=1   ; in cycles\n";
+  config_file << "l2_cache_enabled=false\n";
+  config_file << "l2_cache_size=262144\n";
+  config_file << "l2_cache_block_size=64\n";
+  config_file << "l2_cache_associativity=8\n";
+  config_file << "l2_cache_replacement_policy=LRU\n";
+  config_file << "l2_cache_write_hit_policy=write_back\n";
+  config_file << "l2_cache_write_miss_policy=write_allocate\n";
+  config_file << "l2_cache_hit_latency=10\n";
+  config_file << "memory_latency=100   ; in cycles, per line read from memory\n\n";
 
   config_file << "[BranchPrediction]\n";
-  config_file << "branch_prediction_type=always_not_taken\n";
-  config_file << "branch_prediction_table_size=0\n";
-  config_file << "branch_prediction_table_associativity=0\n";
+  config_file << "branch_prediction_type=always_not_taken   ; always_not_taken, btfn, bimodal, gshare or tage\n";
+  config_file << "branch_prediction_table_size=4096\n";
+  config_file << "branch_history_bits=16\n";
+  config_file << "btb_size=512\n";
+  config_file << "btb_associativity=4\n";
+  config_file << "ras_depth=16\n\n";
+
+  config_file << "[OutOfOrder]   ; used by processor_type=out_of_order\n";
+  config_file << "width=4\n";
+  config_file << "frontend_depth=3\n";
+  config_file << "rob_size=128\n";
+  config_file << "rs_size=64\n";
+  config_file << "lsq_size=48\n";
+  config_file << "alu_units=4\n";
+  config_file << "muldiv_units=1\n";
+  config_file << "fp_units=2\n";
+  config_file << "mem_ports=2\n";
+  config_file << "alu_latency=1\n";
+  config_file << "mul_latency=3\n";
+  config_file << "div_latency=20   ; not pipelined\n";
+  config_file << "load_latency=2\n";
+  config_file << "fp_latency=4\n";
+  config_file << "fp_div_latency=12   ; not pipelined\n";
+  config_file << "redirect_penalty=2\n";
   config_file.close();
 }
\ No newline at end of file
@@ -0,0 +1,212 @@
+/**
+ * @file bigmul_kernels.cpp
+ * @brief Host kernels summing the partial products of one BIGMUL diagonal, scalar and SIMD.
+ */
+
+#include "vm/bigmul_kernels.h"
+
+#include <atomic>
+#include <stdexcept>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define BIGMUL_KERNELS_X86 1
+#endif
+
+namespace bigmul_kernels {
+
+namespace {
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+
+// sum += (hi:lo) << (64 * limb)
+void AddAt(Sum192 &sum, uint64_t lo, uint64_t hi, int limb) {
+  uint64_t *limbs[3] = {&sum.lo, &sum.mid, &sum.hi};
+  unsigned __int128 t = (unsigned __int128)*limbs[limb] + lo;
+  *limbs[limb] = (uint64_t)t;
+  uint64_t carry = (uint64_t)(t >> 64);
+  if (limb + 1 < 3) {
+    t = (unsigned __int128)*limbs[limb + 1] + hi + carry;
+    *limbs[limb + 1] = (uint64_t)t;
+    carry = (uint64_t)(t >> 64);
+    if (limb + 2 < 3) {
+      *limbs[limb + 2] += carry;
+    }
+  }
+}
+
+// Recombines the 32-bit column sums c0..c3, of weight 2^0, 2^32, 2^64 and 2^96, into sum
+void AddColumns(Sum192 &sum, uint64_t c0, uint64_t c1, uint64_t c2, uint64_t c3) {
+  AddAt(sum, c0, 0, 0);
+  AddAt(sum, c1 << 32, c1 >> 32, 0);
+  AddAt(sum, c2, 0, 1);
+  AddAt(sum, c3 << 32, c3 >> 32, 1);
+}
+
+Sum192 ScalarSum(const uint64_t *a, const uint64_t *b, size_t diagonal, size_t first, size_t count) {
+  uint64_t lo = 0, mid = 0, hi = 0;
+  for (size_t i = first; i < first + count; ++i) {
+    unsigned __int128 p = (unsigned __int128)a[i] * b[diagonal - i];
+    unsigned __int128 t0 = (unsigned __int128)lo + (uint64_t)p;
+    lo = (uint64_t)t0;
+    unsigned __int128 t1 = (unsigned __int128)mid + (uint64_t)(p >> 64) + (uint64_t)(t0 >> 64);
+    mid = (uint64_t)t1;
+    hi += (uint64_t)(t1 >> 64);
+  }
+  return {lo, mid, hi};
+}
+
+#pragma GCC diagnostic pop
+
+#ifdef BIGMUL_KERNELS_X86
+
+// Every lane adds at most three values below 2^32 per product, so the 64-bit column
+// sums cannot overflow for any operand BIGMUL accepts
+
+__attribute__((target("avx2")))
+Sum192 Avx2Sum(const uint64_t *a, const uint64_t *b, size_t diagonal, size_t first, size_t count) {
+  const __m256i low32 = _mm256_set1_epi64x(0xffffffff);
+  __m256i c0 = _mm256_setzero_si256(), c1 = c0, c2 = c0, c3 = c0;
+  size_t i = first;
+  for (; i + 4 <= first + count; i += 4) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+    // b[diagonal - i - 3 .. diagonal - i], reversed to line up with a[i .. i + 3]
+    __m256i y = _mm256_permute4x64_epi64(_mm256_loadu_si256((const __m256i *)(b + diagonal - i - 3)), 0x1b);
+    __m256i x_hi = _mm256_srli_epi64(x, 32);
+    __m256i y_hi = _mm256_srli_epi64(y, 32);
+    __m256i ll = _mm256_mul_epu32(x, y);
+    __m256i lh = _mm256_mul_epu32(x, y_hi);
+    __m256i hl = _mm256_mul_epu32(x_hi, y);
+    __m256i hh = _mm256_mul_epu32(x_hi, y_hi);
+    c0 = _mm256_add_epi64(c0, _mm256_and_si256(ll, low32));
+    c1 = _mm256_add_epi64(c1, _mm256_add_epi64(_mm256_srli_epi64(ll, 32),
+                                               _mm256_add_epi64(_mm256_and_si256(lh, low32),
+                                                                _mm256_and_si256(hl, low32))));
+    c2 = _mm256_add_epi64(c2, _mm256_add_epi64(_mm256_add_epi64(_mm256_srli_epi64(lh, 32),
+                                                                _mm256_srli_epi64(hl, 32)),
+                                               _mm256_and_si256(hh, low32)));
+    c3 = _mm256_add_epi64(c3, _mm256_srli_epi64(hh, 32));
+  }
+
+  alignas(32) uint64_t lanes[4][4];
+  _mm256_store_si256((__m256i *)lanes[0], c0);
+  _mm256_store_si256((__m256i *)lanes[1], c1);
+  _mm256_store_si256((__m256i *)lanes[2], c2);
+  _mm256_store_si256((__m256i *)lanes[3], c3);
+  // The compiler only clears the upper halves itself in AVX-compiled files; without this the
+  // SSE code running after the kernel pays for the dirty upper state on every call
+  _mm256_zeroupper();
+  Sum192 sum = ScalarSum(a, b, diagonal, i, first + count - i);
+  AddColumns(sum,
+             lanes[0][0] + lanes[0][1] + lanes[0][2] + lanes[0][3],
+             lanes[1][0] + lanes[1][1] + lanes[1][2] + lanes[1][3],
+             lanes[2][0] + lanes[2][1] + lanes[2][2] + lanes[2][3],
+             lanes[3][0] + lanes[3][1] + lanes[3][2] + lanes[3][3]);
+  return sum;
+}
+
+#pragma GCC diagnostic push
+// GCC 12's AVX-512 intrinsics pass _mm512_undefined values as the unused merge operand, which trips these
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+__attribute__((target("avx512f")))
+Sum192 Avx512Sum(const uint64_t *a, const uint64_t *b, size_t diagonal, size_t first, size_t count) {
+  const __m512i low32 = _mm512_set1_epi64(0xffffffff);
+  const __m512i reverse = _mm512_set_epi64(0, 1, 2, 3, 4, 5, 6, 7);
+  __m512i c0 = _mm512_setzero_si512(), c1 = c0, c2 = c0, c3 = c0;
+  size_t i = first;
+  for (; i + 8 <= first + count; i += 8) {
+    __m512i x = _mm512_loadu_si512((const void *)(a + i));
+    __m512i y = _mm512_permutexvar_epi64(reverse, _mm512_loadu_si512((const void *)(b + diagonal - i - 7)));
+    __m512i x_hi = _mm512_srli_epi64(x, 32);
+    __m512i y_hi = _mm512_srli_epi64(y, 32);
+    __m512i ll = _mm512_mul_epu32(x, y);
+    __m512i lh = _mm512_mul_epu32(x, y_hi);
+    __m512i hl = _mm512_mul_epu32(x_hi, y);
+    __m512i hh = _mm512_mul_epu32(x_hi, y_hi);
+    c0 = _mm512_add_epi64(c0, _mm512_and_si512(ll, low32));
+    c1 = _mm512_add_epi64(c1, _mm512_add_epi64(_mm512_srli_epi64(ll, 32),
+                                               _mm512_add_epi64(_mm512_and_si512(lh, low32),
+                                                                _mm512_and_si512(hl, low32))));
+    c2 = _mm512_add_epi64(c2, _mm512_add_epi64(_mm512_add_epi64(_mm512_srli_epi64(lh, 32),
+                                                                _mm512_srli_epi64(hl, 32)),
+                                               _mm512_and_si512(hh, low32)));
+    c3 = _mm512_add_epi64(c3, _mm512_srli_epi64(hh, 32));
+  }
+
+  uint64_t columns[4] = {(uint64_t)_mm512_reduce_add_epi64(c0), (uint64_t)_mm512_reduce_add_epi64(c1),
+                         (uint64_t)_mm512_reduce_add_epi64(c2), (uint64_t)_mm512_reduce_add_epi64(c3)};
+  _mm256_zeroupper();
+  Sum192 sum = ScalarSum(a, b, diagonal, i, first + count - i);
+  AddColumns(sum, columns[0], columns[1], columns[2], columns[3]);
+  return sum;
+}
+#pragma GCC diagnostic pop
+
+#endif // BIGMUL_KERNELS_X86
+
+std::atomic<Kernel> &ActiveKernel() {
+  static std::atomic<Kernel> kernel{Best()};
+  return kernel;
+}
+
+} // namespace
+
+Sum192 DiagonalSum(const uint64_t *a, const uint64_t *b, size_t diagonal, size_t first, size_t count) {
+  return DiagonalSum(ActiveKernel().load(std::memory_order_relaxed), a, b, diagonal, first, count);
+}
+
+Sum192 DiagonalSum(Kernel kernel, const uint64_t *a, const uint64_t *b, size_t diagonal, size_t first,
+                   size_t count) {
+  switch (kernel) {
+#ifdef BIGMUL_KERNELS_X86
+    case Kernel::AVX2: return Avx2Sum(a, b, diagonal, first, count);
+    case Kernel::AVX512: return Avx512Sum(a, b, diagonal, first, count);
+#endif
+    default: return ScalarSum(a, b, diagonal, first, count);
+  }
+}
+
+bool Supported(Kernel kernel) {
+  switch (kernel) {
+    case Kernel::SCALAR: return true;
+#ifdef BIGMUL_KERNELS_X86
+    case Kernel::AVX2: return __builtin_cpu_supports("avx2");
+    case Kernel::AVX512: return __builtin_cpu_supports("avx512f");
+#endif
+    default: return false;
+  }
+}
+
+Kernel Best() {
+  if (Supported(Kernel::AVX512)) {
+    return Kernel::AVX512;
+  }
+  if (Supported(Kernel::AVX2)) {
+    return Kernel::AVX2;
+  }
+  return Kernel::SCALAR;
+}
+
+void SetKernel(Kernel kernel) {
+  if (!Supported(kernel)) {
+    throw std::invalid_argument("BIGMUL kernel not supported by this host: " + KernelName(kernel));
+  }
+  ActiveKernel().store(kernel, std::memory_order_relaxed);
+}
+
+Kernel GetKernel() {
+  return ActiveKernel().load(std::memory_order_relaxed);
+}
+
+std::string KernelName(Kernel kernel) {
+  switch (kernel) {
+    case Kernel::SCALAR: return "scalar";
+    case Kernel::AVX2: return "avx2";
+    case Kernel::AVX512: return "avx512";
+  }
+  return "unknown";
+}
+
+} // namespace bigmul_kernels
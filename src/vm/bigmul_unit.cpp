@@ -2,82 +2,160 @@
 #include <cstdint>
 #include <cmath>
 #include <iostream>
+#include <stdexcept>
+#include <string>
 #include "vm/bigmul_unit.h"
+#include "vm/bigmul_kernels.h"
 #pragma GCC diagnostic ignored "-Wpedantic"
 
 
-namespace bigmul_unit {
-    bool bigmul_done_ = true;
-    bool ldbm_done_ = true;
-    size_t ldbm_offset = 0;
-    size_t bigmul_prog = 0;
-    size_t write_offset = 0;
-    bool write_done = true;
-    uint64_t base_addr_A = 0;
-    uint64_t base_addr_B = 0;
-    uint64_t base_addr_res = 0;
-    uint64_t cacheA[64] = {0};
-    uint64_t cacheB[64] = {0};
-    uint64_t resultCache[128] = {0};
-    uint64_t size_of_operand = 64; // in Dwords (default 512 bytes = 64 doublewords)
-
-    static int s_diag;          // current diagonal 0..126
-    static int i_min, i_max;    // bounds for s_diag
-    static int k_iter;          // next i to generate in this diagonal
-    static bool gen_done_this_diag;
-
-    struct GenBatch {
-        int  count;             
-        int  i[25];
-        int  j[25];
-        bool valid;
-    };
-
-    struct LoadBatch {
-        int       count;
-        uint64_t  Ai[25];
-        uint64_t  Bj[25];
-        bool      valid;
-    };
-
-    struct MulBatch {
-        uint64_t lo;    // low 64 bits of batch sum
-        uint64_t hi;    // high 64 bits of batch sum
-        uint64_t hi2;
-        bool     valid;
-    };
-
-    struct DelayItem {
-        MulBatch mb;    // value to retire to accumulator
-        int      remain; // number of CSA "stages" still to wait
-        bool     valid;
-    };
-
-    static GenBatch  pGEN;
-    static LoadBatch pLOAD;
-    static MulBatch  pMUL;
-    static DelayItem dq[5];
-    static int dq_len;
-
-    static uint64_t acc0, acc1, acc2;
-
-    static int pending_depth_for_pMUL;
-
-    struct Acc {
-        uint64_t a0, a1, a2;
-    };
-
-    Acc accum[4];
-    static bool accum_valid[4];
-
-    static inline GenBatch  make_empty_gen()  { GenBatch b{}; b.count=0; b.valid=false; return b; }
-    static inline LoadBatch make_empty_load() { LoadBatch b{}; b.count=0; b.valid=false; return b; }
-    static inline MulBatch  make_empty_mul()  { return MulBatch{0,0,0,false}; }
-    static inline DelayItem make_empty_item() { return DelayItem{make_empty_mul(), 0, false}; }
-
-    static inline void acc_clear() { acc0 = acc1 = acc2 = 0; }
-
-    static inline void acc_add_u128(uint64_t lo, uint64_t hi) {
+BigmulUnit::GenBatch  BigmulUnit::make_empty_gen()  { GenBatch b{}; b.count=0; b.valid=false; return b; }
+BigmulUnit::LoadBatch BigmulUnit::make_empty_load() { LoadBatch b{}; b.count=0; b.valid=false; return b; }
+BigmulUnit::MulBatch  BigmulUnit::make_empty_mul()  { return MulBatch{0,0,0,false}; }
+BigmulUnit::DelayItem BigmulUnit::make_empty_item() { return DelayItem{make_empty_mul(), 0, false}; }
+
+namespace {
+    constexpr uint64_t kSchoolbookBatch = 25; // partial products singlecycle() sums per cycle
+
+    // Operands shorter than this are never split; their half sums would be as long as the operand
+    constexpr size_t kKaratsubaMinDwords = 4;
+
+    // out[0, na + nb) = a[0, na) * b[0, nb)
+    void schoolbook_multiply(const uint64_t *a, size_t na, const uint64_t *b, size_t nb, uint64_t *out) {
+        std::fill(out, out + na + nb, 0);
+        for (size_t i = 0; i < na; ++i) {
+            uint64_t carry = 0;
+            for (size_t j = 0; j < nb; ++j) {
+                unsigned __int128 t = (unsigned __int128)a[i] * b[j] + out[i + j] + carry;
+                out[i + j] = (uint64_t)t;
+                carry = (uint64_t)(t >> 64);
+            }
+            out[i + nb] = carry;
+        }
+    }
+
+    // dst[0, dst_len) += src[0, src_len); src limbs past dst_len must be zero
+    void add_into(uint64_t *dst, size_t dst_len, const uint64_t *src, size_t src_len) {
+        uint64_t carry = 0;
+        for (size_t k = 0; k < dst_len && (k < src_len || carry != 0); ++k) {
+            unsigned __int128 t = (unsigned __int128)dst[k] + carry + (k < src_len ? src[k] : 0);
+            dst[k] = (uint64_t)t;
+            carry = (uint64_t)(t >> 64);
+        }
+    }
+
+    // dst[0, dst_len) -= src[0, src_len); the difference must not be negative
+    void subtract_from(uint64_t *dst, size_t dst_len, const uint64_t *src, size_t src_len) {
+        uint64_t borrow = 0;
+        for (size_t k = 0; k < dst_len && (k < src_len || borrow != 0); ++k) {
+            uint64_t subtrahend = k < src_len ? src[k] : 0;
+            uint64_t difference = dst[k] - subtrahend - borrow;
+            borrow = (dst[k] < subtrahend || (dst[k] == subtrahend && borrow)) ? 1 : 0;
+            dst[k] = difference;
+        }
+    }
+
+    // out[0, 2n) = a[0, n) * b[0, n)
+    void karatsuba_multiply(const uint64_t *a, const uint64_t *b, size_t n, size_t threshold, uint64_t *out) {
+        if (n <= threshold || n < kKaratsubaMinDwords) {
+            schoolbook_multiply(a, n, b, n, out);
+            return;
+        }
+        size_t m = n / 2;     // low half
+        size_t h = n - m;     // high half, h >= m
+
+        // z1 = (a0 + a1)(b0 + b1)
+        std::vector<uint64_t> sum_a(a + m, a + n), sum_b(b + m, b + n);
+        sum_a.push_back(0);
+        sum_b.push_back(0);
+        add_into(sum_a.data(), h + 1, a, m);
+        add_into(sum_b.data(), h + 1, b, m);
+        std::vector<uint64_t> z1(2 * (h + 1));
+        karatsuba_multiply(sum_a.data(), sum_b.data(), h + 1, threshold, z1.data());
+
+        // z0 = a0 b0 and z2 = a1 b1 land directly in their places
+        karatsuba_multiply(a, b, m, threshold, out);
+        karatsuba_multiply(a + m, b + m, h, threshold, out + 2 * m);
+
+        // a b = z0 + (z1 - z0 - z2) << 64m + z2 << 128m
+        subtract_from(z1.data(), z1.size(), out, 2 * m);
+        subtract_from(z1.data(), z1.size(), out + 2 * m, 2 * h);
+        add_into(out + m, 2 * n - m, z1.data(), z1.size());
+    }
+
+    int csa_depth_for_count(int count) {
+        if (count <= 1) return 0;
+        double lg = std::log2((double)count);
+        int d = (int)std::ceil(lg) - 1;
+        if (d < 0) d = 0;
+        if (d > 4) d = 4; // queue of max 5 items
+        return d;
+    }
+} // namespace
+
+    BigmulUnit::BigmulUnit(size_t cache_dwords) {
+        SetCacheDwords(cache_dwords);
+        reset();
+    }
+
+    void BigmulUnit::SetCacheDwords(size_t cache_dwords) {
+        if (cache_dwords == 0 || cache_dwords % kTransferDwords != 0) {
+            throw std::invalid_argument("BIGMUL cache size must be a nonzero multiple of "
+                                        + std::to_string(kTransferDwords) + " doublewords: "
+                                        + std::to_string(cache_dwords));
+        }
+        cache_dwords_ = cache_dwords;
+    }
+
+    void BigmulUnit::SetKaratsubaThreshold(size_t dwords) {
+        if (dwords == 0) {
+            throw std::invalid_argument("BIGMUL Karatsuba threshold must be at least 1 doubleword");
+        }
+        karatsuba_threshold_ = dwords;
+    }
+
+    uint64_t BigmulUnit::SchoolbookCycles(uint64_t dwords) {
+        // One cycle per batch of up to 25 partial products, batches never span diagonals
+        uint64_t cycles = 0;
+        for (uint64_t s = 0; s + 1 < 2 * dwords; ++s) {
+            uint64_t lo = s > dwords - 1 ? s - (dwords - 1) : 0;
+            uint64_t hi = s < dwords - 1 ? s : dwords - 1;
+            cycles += (hi - lo + 1 + kSchoolbookBatch - 1) / kSchoolbookBatch;
+        }
+        return cycles;
+    }
+
+    uint64_t BigmulUnit::KaratsubaCycles(uint64_t dwords) const {
+        if (dwords <= karatsuba_threshold_ || dwords < kKaratsubaMinDwords) {
+            return SchoolbookCycles(dwords);
+        }
+        uint64_t m = dwords / 2;
+        uint64_t h = dwords - m;
+        auto adder_cycles = [](uint64_t length) {
+            return (length + kTransferDwords - 1) / kTransferDwords;
+        };
+        uint64_t half_sums = 2 * adder_cycles(h + 1);
+        uint64_t combine = 3 * adder_cycles(2 * (h + 1)); // z1 - z0, z1 - z2, add z1 into the product
+        return KaratsubaCycles(m) + KaratsubaCycles(h) + KaratsubaCycles(h + 1) + half_sums + combine;
+    }
+
+    bool BigmulUnit::SetOperandDwords(uint64_t dwords) {
+        if (dwords == 0 || dwords > kMaxOperandDwords) {
+            return false;
+        }
+        size_of_operand = dwords;
+        return true;
+    }
+
+    void BigmulUnit::LdbmLoaded() {
+        ldbm_done_ = true;
+        resident_tile_A = 0;
+        resident_tile_B = 0;
+    }
+
+    void BigmulUnit::acc_clear() { acc0 = acc1 = acc2 = 0; }
+
+    void BigmulUnit::acc_add_u128(uint64_t lo, uint64_t hi) {
         unsigned __int128 t0 = (unsigned __int128)acc0 + lo;
         acc0 = (uint64_t)t0;
         uint64_t c0 = (uint64_t)(t0 >> 64);
@@ -89,41 +167,78 @@ namespace bigmul_unit {
         acc2 += c1;
     }
 
-    static inline void acc_add_u192(uint64_t lo, uint64_t hi, uint64_t hi2) {
+    void BigmulUnit::acc_add_u192(uint64_t lo, uint64_t hi, uint64_t hi2) {
         acc_add_u128(lo, hi);
         acc2 += hi2;
     }
 
-    static inline void acc_shr_64() {
+    void BigmulUnit::acc_shr_64() {
         acc0 = acc1;
         acc1 = acc2;
         acc2 = 0;
     }
 
-    static inline uint64_t acc_low64() { return acc0; }
-
-    static inline int csa_depth_for_count(int count) {
-        if (count <= 1) return 0;
-        double lg = std::log2((double)count);
-        int d = (int)std::ceil(lg) - 1;
-        if (d < 0) d = 0;
-        if (d > 4) d = 4; // queue of max 5 items
-        return d;
-    }
+    uint64_t BigmulUnit::acc_low64() const { return acc0; }
 
-    static inline void dq_pop_front() {
+    void BigmulUnit::dq_pop_front() {
         if (dq_len == 0) return;
         for (int i = 1; i < dq_len; ++i) dq[i-1] = dq[i];
         dq[--dq_len] = make_empty_item();
     }
 
-    static inline void dq_push(const MulBatch &mb, int remain) {
+    void BigmulUnit::dq_push(const MulBatch &mb, int remain) {
         if (remain <= 0) return;        // should not queue zero remaining
         if (dq_len >= 5) return;        // overflow shouldn’t happen
         dq[dq_len++] = DelayItem{mb, remain, true};
     }
 
-    void reset(){
+    void BigmulUnit::clear_pipeline() {
+        pGEN  = make_empty_gen();
+        pLOAD = make_empty_load();
+        pMUL  = make_empty_mul();
+        for (int i=0;i<5;++i) dq[i] = make_empty_item();
+        dq_len = 0;
+
+        pending_depth_for_pMUL = 0;
+
+        for (int i = 0; i < 4; ++i) {
+            accum[i].a0 = accum[i].a1 = accum[i].a2 = 0;
+            accum_valid[i] = false;
+        }
+    }
+
+    void BigmulUnit::sample_stages(std::initializer_list<bool> busy) {
+        size_t stage = 0;
+        for (bool occupied : busy) {
+            if (occupied) {
+                stats_.stages[stage].busy_cycles++;
+            } else {
+                stats_.stages[stage].bubble_cycles++;
+            }
+            ++stage;
+        }
+    }
+
+    void BigmulUnit::sample_csa_stages() {
+        // A batch needing d CSA levels enters the tree at level kCsaStages - d, so the
+        // level it is in follows from the cycles it has left; the last level feeds the accumulator
+        bool busy[kCsaStages] = {false};
+        for (int i = 0; i < dq_len; ++i) {
+            if (dq[i].valid && dq[i].remain < kCsaStages) {
+                busy[kCsaStages - 1 - dq[i].remain] = true;
+            }
+        }
+        for (int level = 0; level < kCsaStages; ++level) {
+            StageStats &stage = stats_.stages[3 + level];
+            if (busy[level]) {
+                stage.busy_cycles++;
+            } else {
+                stage.bubble_cycles++;
+            }
+        }
+    }
+
+    void BigmulUnit::reset(){
         ldbm_done_ = true;
         ldbm_offset = 0;
 
@@ -136,48 +251,85 @@ namespace bigmul_unit {
         base_addr_A = 0;
         base_addr_B = 0;
         base_addr_res = 0;
-
-        std::fill(std::begin(cacheA), std::end(cacheA), 0);
-        std::fill(std::begin(cacheB), std::end(cacheB), 0);
-        std::fill(std::begin(resultCache), std::end(resultCache), 0);
+        size_of_operand = 64;
+
+        cacheA.assign(cache_dwords_, 0);
+        cacheB.assign(cache_dwords_, 0);
+        resultCache.assign(size_of_operand * 2, 0);
+        resident_tile_A = kNoTile;
+        resident_tile_B = kNoTile;
+
+        tile_count_ = 1;
+        tile_index_ = 0;
+        tile_A_ = tile_B_ = 0;
+        len_A_ = len_B_ = (int)std::min<uint64_t>(size_of_operand, cache_dwords_);
+        stall_cycles_ = 0;
+        finish_after_stall_ = false;
+        tileResult.clear();
+        stats_ = BigmulStats();
 
         s_diag = 0; i_min = 0; i_max = 0; k_iter = 0;
         gen_done_this_diag = false;
 
-        pGEN  = make_empty_gen();
-        pLOAD = make_empty_load();
-        pMUL  = make_empty_mul();
-        for (int i=0;i<5;++i) dq[i] = make_empty_item();
-        dq_len = 0;
-
-        pending_depth_for_pMUL = 0;
+        clear_pipeline();
         acc_clear();
+    }
 
-        for (int i = 0; i < 4; ++i) {
-            accum[i].a0 = accum[i].a1 = accum[i].a2 = 0;
-            accum_valid[i] = false;
+    void BigmulUnit::fill_tile(std::vector<uint64_t> &cache, uint64_t base, int tile) {
+        if (!read_operand_) {
+            throw std::logic_error("BIGMUL operand reader not set");
         }
-    }
+        // Whole tiles are filled, like LDBM fills the whole caches
+        uint64_t first = (uint64_t)tile * cache_dwords_;
+        read_operand_(base + first * 8ULL, std::span<uint64_t>(cache.data(), cache_dwords_));
+        uint64_t cycles = cache_dwords_ / kTransferDwords;
+        stall_cycles_ += cycles;
+        stats_.tile_fill_cycles += cycles;
+    }
+
+    void BigmulUnit::start_tile() {
+        // Walk the tile pairs row by row, reversing every other row so the B tile
+        // at the end of a row is still resident at the start of the next one
+        size_t row = tile_index_ / tile_count_;
+        size_t column = tile_index_ % tile_count_;
+        tile_A_ = (int)row;
+        tile_B_ = (int)((row % 2 == 0) ? column : tile_count_ - 1 - column);
+        len_A_ = (int)std::min<uint64_t>(cache_dwords_, size_of_operand - (uint64_t)tile_A_ * cache_dwords_);
+        len_B_ = (int)std::min<uint64_t>(cache_dwords_, size_of_operand - (uint64_t)tile_B_ * cache_dwords_);
+
+        if (resident_tile_A != tile_A_) {
+            fill_tile(cacheA, base_addr_A, tile_A_);
+            resident_tile_A = tile_A_;
+        }
+        if (resident_tile_B != tile_B_) {
+            fill_tile(cacheB, base_addr_B, tile_B_);
+            resident_tile_B = tile_B_;
+        }
+        tileResult.assign(len_A_ + len_B_, 0);
+        stats_.tiles++;
 
-    void start_bigmul(){
-        // Initialize first
         s_diag = 0;
         i_min  = 0;
         i_max  = 0;        // for s=0, only (0,0)
         k_iter = i_min;
         gen_done_this_diag = false;
 
-        // Clear pipeline
-        pGEN  = make_empty_gen();
-        pLOAD = make_empty_load();
-        pMUL  = make_empty_mul();
-        for (int i=0;i<5;++i) dq[i] = make_empty_item();
-        dq_len = 0;
-        // Carry for s=0 is 0
+        // Clear pipeline; carry for s=0 is 0
+        clear_pipeline();
         acc_clear();
-        for (int i = 0; i < 4; ++i) {
-            accum[i].a0 = accum[i].a1 = accum[i].a2 = 0;
-            accum_valid[i] = false;
+    }
+
+    void BigmulUnit::start_bigmul(){
+        tile_count_ = (size_of_operand + cache_dwords_ - 1) / cache_dwords_;
+        tile_index_ = 0;
+        stall_cycles_ = 0;
+        finish_after_stall_ = false;
+        stats_ = BigmulStats();
+        resultCache.assign(size_of_operand * 2, 0);
+        if (engine_ == vm_config::BigmulEngine::STAGED3) {
+            stats_.stages = {{"GEN"}, {"LOAD"}, {"MUL"}};
+        } else if (engine_ == vm_config::BigmulEngine::STAGED7) {
+            stats_.stages = {{"GEN"}, {"LOAD"}, {"MUL"}, {"CSA1"}, {"CSA2"}, {"CSA3"}, {"CSA4"}};
         }
 
         // bigmul running
@@ -186,25 +338,115 @@ namespace bigmul_unit {
         bigmul_done_ = false;
         bigmul_prog  = 1; // just a running marker
         write_done   = true;
+
+        if (algorithm_ == vm_config::BigmulAlgorithm::KARATSUBA) {
+            start_karatsuba();
+        } else {
+            start_tile();
+        }
     }
 
-    bool GetBigmulDone(){
+    std::vector<uint64_t> BigmulUnit::load_operand(const std::vector<uint64_t> &cache, int resident_tile,
+                                                   uint64_t base) {
+        // Whatever LDBM left in the cache is reused, the rest is streamed in at the LDBM rate
+        std::vector<uint64_t> operand(size_of_operand);
+        size_t cached = resident_tile == 0 ? std::min<size_t>(size_of_operand, cache_dwords_) : 0;
+        std::copy(cache.begin(), cache.begin() + cached, operand.begin());
+        if (cached < size_of_operand) {
+            if (!read_operand_) {
+                throw std::logic_error("BIGMUL operand reader not set");
+            }
+            read_operand_(base + cached * 8ULL,
+                          std::span<uint64_t>(operand.data() + cached, size_of_operand - cached));
+            uint64_t cycles = (size_of_operand - cached + kTransferDwords - 1) / kTransferDwords;
+            stall_cycles_ += cycles;
+            stats_.tile_fill_cycles += cycles;
+        }
+        return operand;
+    }
+
+    void BigmulUnit::start_karatsuba() {
+        std::vector<uint64_t> a = load_operand(cacheA, resident_tile_A, base_addr_A);
+        std::vector<uint64_t> b = load_operand(cacheB, resident_tile_B, base_addr_B);
+        karatsuba_multiply(a.data(), b.data(), size_of_operand, karatsuba_threshold_, resultCache.data());
+
+        uint64_t cycles = KaratsubaCycles(size_of_operand);
+        stall_cycles_ += cycles;
+        stats_.compute_cycles += cycles;
+        finish_after_stall_ = true;
+    }
+
+    bool BigmulUnit::finish_diagonal() {
+        // All partial products for diagonal s_diag are accumulated in acc0/1/2.
+        // Emit the low 64 bits, then shift accumulator (carry into next word).
+        tileResult[s_diag] = acc_low64();
+        acc_shr_64();
+
+        // Last diagonal
+        int LAST = len_A_ + len_B_ - 2;
+        if (s_diag == LAST) {
+            tileResult[LAST + 1] = acc_low64();
+            finish_tile();
+            return true;
+        }
+
+        // Move to next diagonal s_diag + 1
+        ++s_diag;
+        i_min = (s_diag > len_B_ - 1) ? (s_diag - (len_B_ - 1)) : 0;
+        i_max = (s_diag < len_A_ - 1) ?  s_diag                 : len_A_ - 1;
+        k_iter = i_min;
+        gen_done_this_diag = false;
+
+        // We KEEP acc0/1/2 (already shifted) as carry for next diagonal.
+        return false;
+    }
+
+    void BigmulUnit::finish_tile() {
+        if (tile_count_ == 1) {
+            std::copy(tileResult.begin(), tileResult.end(), resultCache.begin());
+            finish_bigmul();
+            return;
+        }
+
+        // Add the tile product into the result at its offset, rippling the carry upwards
+        size_t offset = (size_t)(tile_A_ + tile_B_) * cache_dwords_;
+        uint64_t carry = 0;
+        for (size_t k = 0; k < tileResult.size() || carry != 0; ++k) {
+            unsigned __int128 sum = (unsigned __int128)resultCache[offset + k] + carry
+                                    + (k < tileResult.size() ? tileResult[k] : 0);
+            resultCache[offset + k] = (uint64_t)sum;
+            carry = (uint64_t)(sum >> 64);
+        }
+        uint64_t cycles = (tileResult.size() + kTransferDwords - 1) / kTransferDwords;
+        stall_cycles_ += cycles;
+        stats_.accumulate_cycles += cycles;
+
+        if (++tile_index_ == tile_count_ * tile_count_) {
+            finish_after_stall_ = true;
+        } else {
+            start_tile();
+        }
+    }
+
+    void BigmulUnit::finish_bigmul() {
+        // Mark compute phase done. VM will now enter writeback phase
+        bigmul_prog = 0;
+        write_done  = false;
+    }
+
+    bool BigmulUnit::GetBigmulDone() const {
         return bigmul_done_;
     }
 
-    bool GetLdbmDone(){
+    bool BigmulUnit::GetLdbmDone() const {
         return ldbm_done_;
     }
 
-    bool GetWriteDone(){
+    bool BigmulUnit::GetWriteDone() const {
         return write_done;
     }
 
-    // void loadcache(const std::vector<uint8_t>& bufA, const std::vector<uint8_t>& bufB){
-
-    // }
-
-    void singlecycle(){
+    void BigmulUnit::singlecycle(){
         // If nothing to do, return
     if (bigmul_done_) return;
 
@@ -213,82 +455,30 @@ namespace bigmul_unit {
         start_bigmul();
     }
 
-    //     Single-cycle GEN + LOAD + MUL + CSA for this cycle 
+    //     Single-cycle GEN + LOAD + MUL + CSA for this cycle
     // We process up to 25 (i,j) pairs on the current diagonal s_diag
     const int BATCH = 25;
-    int processed = 0;
-
-    // Local 192-bit batch sum
-    uint64_t b0 = 0;  // low 64 bits
-    uint64_t b1 = 0;  // middle 64 bits
-    uint64_t b2 = 0;  // high 64 bits
-
-    // Generate indices (GEN), load from cache (LOAD), multiply and sum (MUL+CSA)
-    while (processed < BATCH && k_iter <= i_max) {
-        int ii = k_iter;
-        int jj = s_diag - ii;
-        ++k_iter;
-        ++processed;
-
-        // LOAD
-        uint64_t Ai = cacheA[ii];
-        uint64_t Bj = cacheB[jj];
-
-        // MUL: 64x64 => 128
-        __uint128_t p = ( (__uint128_t)Ai * (__uint128_t)Bj );
-        uint64_t lo = (uint64_t)p;
-        uint64_t hi = (uint64_t)(p >> 64);
-
-        // Local 192-bit sum
-        unsigned __int128 t0 = (unsigned __int128)b0 + lo;
-        b0 = (uint64_t)t0;
-        uint64_t c0 = (uint64_t)(t0 >> 64);
-
-        unsigned __int128 t1 = (unsigned __int128)b1 + hi + c0;
-        b1 = (uint64_t)t1;
-        uint64_t c1 = (uint64_t)(t1 >> 64);
-
-        b2 += c1;
-    }
+    int processed = std::max(0, std::min(BATCH, i_max - k_iter + 1));
 
-    // Add this batch’s 192-bit sum into the running diagonal accumulator
+    // Multiply and sum the batch on the host kernel, then add its 192-bit sum
+    // into the running diagonal accumulator
     if (processed > 0) {
-        acc_add_u192(b0, b1, b2);
+        bigmul_kernels::Sum192 batch = bigmul_kernels::DiagonalSum(cacheA.data(), cacheB.data(), s_diag,
+                                                                   k_iter, processed);
+        acc_add_u192(batch.lo, batch.mid, batch.hi);
+        k_iter += processed;
     }
+    stats_.partial_products += processed;
 
-    //  Check if we finished this diagonal 
+    //  Check if we finished this diagonal
     if (k_iter > i_max) {
-        // All partial products for diagonal s_diag are accumulated in acc0/1/2.
-        // Emit the low 64 bits to resultCache[s_diag], then shift accumulator.
-        resultCache[s_diag] = acc_low64();
-        acc_shr_64();  // carry into next word
-
-        // Last diagonal
-        int LAST = (size_of_operand * 2) - 2;
-        if (s_diag == LAST) {
-            resultCache[LAST + 1] = acc_low64();
-
-            // Mark compute phase done. VM will now enter writeback phase
-            bigmul_prog = 0;
-            write_done  = false;
-            return;
-        }
-
-        // Move to next diagonal s_diag + 1
-        ++s_diag;
-        int LIM = size_of_operand - 1;
-        i_min = (s_diag > LIM) ? (s_diag - LIM) : 0;
-        i_max = (s_diag < LIM) ?  s_diag        : LIM;
-        k_iter = i_min;
-
-        // We KEEP acc0/1/2 (already shifted) as carry for next diagonal.
-        // No need to clear acc here.
+        finish_diagonal();
     }
     }
 
     // GEN + LOAD + MUL in one stage,
 // CSA in multiple stages using dq + csa_depth_for_count().
-void csa_only_pipeline() {
+void BigmulUnit::csa_only_pipeline() {
        if (bigmul_done_) return;
 
         // First active cycle
@@ -333,37 +523,16 @@ void csa_only_pipeline() {
         // 4) FRONT-END: GEN + LOAD + MUL (one stage)
         // ------------------------------------------
         const int BATCH = 25; // at most 25 partial products per cycle
-        int processed = 0;
-
-        uint64_t b0 = 0;  // low  64 bits
-        uint64_t b1 = 0;  // mid  64 bits
-        uint64_t b2 = 0;  // high 64 bits
-
-        while (processed < BATCH && k_iter <= i_max) {
-            int ii = k_iter;
-            int jj = s_diag - ii;
-            ++k_iter;
-            ++processed;
+        int processed = std::max(0, std::min(BATCH, i_max - k_iter + 1));
 
-            uint64_t Ai = cacheA[ii];
-            uint64_t Bj = cacheB[jj];
-
-            __uint128_t p = ( (__uint128_t)Ai * (__uint128_t)Bj );
-            uint64_t lo = (uint64_t)p;
-            uint64_t hi = (uint64_t)(p >> 64);
-
-            // (b2 b1 b0) += (0 hi lo)
-            unsigned __int128 t0 = (unsigned __int128)b0 + lo;
-            b0 = (uint64_t)t0;
-            uint64_t c0 = (uint64_t)(t0 >> 64);
-
-            unsigned __int128 t1 = (unsigned __int128)b1 + hi + c0;
-            b1 = (uint64_t)t1;
-            uint64_t c1 = (uint64_t)(t1 >> 64);
-
-            b2 += c1;
+        bigmul_kernels::Sum192 batch;
+        if (processed > 0) {
+            batch = bigmul_kernels::DiagonalSum(cacheA.data(), cacheB.data(), s_diag, k_iter, processed);
+            k_iter += processed;
         }
 
+        stats_.partial_products += processed;
+
         // If we exhausted all (i,j) for this diagonal, mark GEN done
         if (k_iter > i_max) {
             gen_done_this_diag = true;
@@ -373,9 +542,9 @@ void csa_only_pipeline() {
         // 5) Insert new batch sum into stage 0
         // ------------------------------------------
         if (processed > 0) {
-            accum[0].a0   = b0;
-            accum[0].a1   = b1;
-            accum[0].a2   = b2;
+            accum[0].a0   = batch.lo;
+            accum[0].a1   = batch.mid;
+            accum[0].a2   = batch.hi;
             accum_valid[0] = true;
         }
 
@@ -394,30 +563,10 @@ void csa_only_pipeline() {
 
         if (gen_done_this_diag && pipe_empty) {
             // All contributions for this diagonal are inside acc0/1/2
-            resultCache[s_diag] = acc_low64();
-            acc_shr_64(); // carry to next word
-
-            int LIM  = (int)size_of_operand - 1;         // e.g., 63
-            int LAST = (int)(size_of_operand * 2) - 2;   // e.g., 126
-
-            if (s_diag == LAST) {
-                // Final extra word from remaining carry (s = LAST+1)
-                resultCache[LAST + 1] = acc_low64();
-
-                bigmul_prog = 0;
-                write_done  = false; // VM will do writeback
+            if (finish_diagonal()) {
                 return;
             }
 
-            // Advance to next diagonal
-            ++s_diag;
-            i_min = (s_diag > LIM) ? (s_diag - LIM) : 0;
-            i_max = (s_diag < LIM) ?  s_diag        : LIM;
-            k_iter = i_min;
-
-            // Reset per-diagonal state (carry already in acc0/1/2)
-            gen_done_this_diag = false;
-
             // Clear pipeline for next diagonal
             for (int i = 0; i < 4; ++i) {
                 accum[i].a0 = accum[i].a1 = accum[i].a2 = 0;
@@ -428,7 +577,7 @@ void csa_only_pipeline() {
 
 
 
-    void staged3pipeline(){
+    void BigmulUnit::staged3pipeline(){
         //3-4 STAGED PIPELINE
     if (bigmul_done_) return;
 
@@ -436,7 +585,9 @@ void csa_only_pipeline() {
         start_bigmul();
     }
 
-    
+    // Batches held by the GEN, LOAD and MUL registers during this cycle
+    sample_stages({pGEN.valid, pLOAD.valid, pMUL.valid});
+
     // 1) RETIRE previous MUL batch into accumulator-
     if (pMUL.valid) {
         acc_add_u192(pMUL.lo, pMUL.hi, pMUL.hi2);
@@ -494,6 +645,7 @@ void csa_only_pipeline() {
         }
         nextGEN.count = produced;
         nextGEN.valid = (produced > 0);
+        stats_.partial_products += produced;
 
         if (k_iter > i_max) {
             gen_done_this_diag = true; // finished generating this diagonal
@@ -511,31 +663,12 @@ void csa_only_pipeline() {
 
     if (gen_done_this_diag && pipe_empty) {
         // All partial products for this diagonal are in acc0/1/2
-        resultCache[s_diag] = acc_low64();
-        acc_shr_64();   // carry into next word
-
-        //last diagonal of partial products
-        if (s_diag == 126) {
-            // Final word from remaining accumulator (s = 127)
-            resultCache[127] = acc_low64();
-            bigmul_prog  = 0;
-            write_done   = false;   // VM will now do writeback
-            return;
-        }
-
-        // Advance to next diagonal
-        ++s_diag;
-        i_min = (s_diag > 63) ? (s_diag - 63) : 0;
-        i_max = (s_diag < 63) ?  s_diag       : 63;
-        k_iter = i_min;
-
-        // Reset diagonal control
-        gen_done_this_diag = false;
+        finish_diagonal();
     }
 
     }
 
-    void stage7pipeline(){
+    void BigmulUnit::staged7pipeline(){
         //COMPLETE 7 STAGED PIPELINE
         //std::cout << "[BIGMUL EXEC] prog=" << bigmul_prog << std::endl;
         if (bigmul_done_) return;
@@ -553,6 +686,10 @@ void csa_only_pipeline() {
                 dq[i].remain -= 1;
         }
 
+        // Batches held by the GEN, LOAD and MUL registers and the CSA tree during this cycle
+        sample_stages({pGEN.valid, pLOAD.valid, pMUL.valid});
+        sample_csa_stages();
+
         if (pMUL.valid) {
             if (pending_depth_for_pMUL <= 0) {
                 acc_add_u192(pMUL.lo, pMUL.hi, pMUL.hi2);
@@ -611,6 +748,7 @@ void csa_only_pipeline() {
             }
             pGEN.count = produced;
             pGEN.valid = (produced > 0);
+            stats_.partial_products += produced;
 
             if (k_iter > i_max) {
                 gen_done_this_diag = true; // no more GEN for this diagonal
@@ -620,33 +758,16 @@ void csa_only_pipeline() {
         const bool pipe_empty = !pGEN.valid && !pLOAD.valid && !pMUL.valid && (dq_len == 0);
 
         if (gen_done_this_diag && pipe_empty) {
-            resultCache[s_diag] = acc_low64();
-            acc_shr_64();
-
-            if (s_diag == 126) {
-                resultCache[127] = acc_low64();
-                bigmul_prog  = 0;
-                write_done   = false;
+            if (finish_diagonal()) {
                 //std::cout << "[BIGMUL DONE] finishing compute phase" << std::endl;
                 return;
             }
-
-            s_diag++;
-            i_min = (s_diag > 63) ? (s_diag - 63) : 0;
-            i_max = (s_diag < 63) ?  s_diag       : 63;
-            k_iter = i_min;
-            pGEN  = make_empty_gen();
-            pLOAD = make_empty_load();
-            pMUL  = make_empty_mul();
-            for (int i=0;i<5;++i) dq[i] = make_empty_item();
-            dq_len = 0;
-
-            gen_done_this_diag = false;
+            clear_pipeline();
         }
 
     }
 
-    void systolicmultiply(){
+    void BigmulUnit::systolicmultiply(){
          if (bigmul_done_) return;
 
     // Start if not already running
@@ -655,56 +776,44 @@ void csa_only_pipeline() {
         return;
     }
 
-    // Every cycle → compute ONE diagonal result word
-
-    if (s_diag < 128) {
+    // Every cycle → compute ONE full diagonal of the tile pair
+    bigmul_kernels::Sum192 diagonal = bigmul_kernels::DiagonalSum(cacheA.data(), cacheB.data(), s_diag,
+                                                                  i_min, i_max - i_min + 1);
+    acc_add_u192(diagonal.lo, diagonal.mid, diagonal.hi);
+    stats_.partial_products += i_max - i_min + 1;
 
-        int sd = s_diag;
-        unsigned __int128 acc = 0;
+    // Store the low 64 bits and carry the rest, just like the diagonal method
+    finish_diagonal();
+    }
 
-        // Determine which (i,j) pairs lie on diagonal "sd"
-        int imin = (sd > 63) ? (sd - 63) : 0;
-        int imax = (sd < 63) ? sd : 63;
+    void BigmulUnit::executeBigmul(){
+        if (bigmul_done_) return;
 
-        // Compute full diagonal sum
-        for (int i = imin; i <= imax; i++) {
-            int j = sd - i;
-            unsigned __int128 p =
-                (unsigned __int128)cacheA[i] *
-                (unsigned __int128)cacheB[j];
-            acc += p;
+        if (bigmul_prog == 0) {
+            start_bigmul();
         }
 
-        // Store the low 64 bits just like your diagonal method
-        resultCache[sd] = (uint64_t)(acc & 0xFFFFFFFFFFFFFFFFULL);
-
-        // Next diagonal
-        s_diag++;
-
-        // All 128 diagonals complete?
-        if (s_diag == 128) {
-            bigmul_done_ = false;
-            write_done = false;     // your VM will write resultCache to memory
-            bigmul_prog = 0;
+        // Tile fills and tile accumulation stall the engine
+        if (stall_cycles_ > 0) {
+            --stall_cycles_;
+            if (stall_cycles_ == 0 && finish_after_stall_) {
+                finish_after_stall_ = false;
+                finish_bigmul();
+            }
+            return;
         }
 
-        return;
-    }
-    }
-
-    void executeBigmul(){
-        singlecycle();
+        stats_.compute_cycles++;
+        switch (engine_) {
+            case vm_config::BigmulEngine::SINGLECYCLE: singlecycle(); break;
+            case vm_config::BigmulEngine::CSA_ONLY: csa_only_pipeline(); break;
+            case vm_config::BigmulEngine::STAGED3: staged3pipeline(); break;
+            case vm_config::BigmulEngine::STAGED7: staged7pipeline(); break;
+            case vm_config::BigmulEngine::SYSTOLIC: systolicmultiply(); break;
+        }
     }
 
-    // std::size_t getResultSize(){
-
-    // }
-
-    // void invalidateCaches(){
-
-    // }
-
-    BigmulState snapshot() {
+    BigmulUnit::BigmulState BigmulUnit::snapshot() const {
     BigmulState s;
     s.bigmul_done   = bigmul_done_;
     s.ldbm_done     = ldbm_done_;
@@ -715,19 +824,18 @@ void csa_only_pipeline() {
     s.base_addr_A   = base_addr_A;
     s.base_addr_B   = base_addr_B;
     s.base_addr_res = base_addr_res;
+    s.size_of_operand = size_of_operand;
+    s.resident_tile_A = resident_tile_A;
+    s.resident_tile_B = resident_tile_B;
 
-    for (int i=0;i<64;i++){
-        s.cacheA[i] = cacheA[i];
-        s.cacheB[i] = cacheB[i];
-    }
-    for (int i=0;i<128;i++){
-        s.resultCache[i] = resultCache[i];
-    }
+    s.cacheA      = cacheA;
+    s.cacheB      = cacheB;
+    s.resultCache = resultCache;
 
     return s;
 }
 
-void restore(const BigmulState &s) {
+void BigmulUnit::restore(const BigmulState &s) {
     bigmul_done_   = s.bigmul_done;
     ldbm_done_     = s.ldbm_done;
     write_done     = s.write_done;
@@ -737,14 +845,12 @@ void restore(const BigmulState &s) {
     base_addr_A    = s.base_addr_A;
     base_addr_B    = s.base_addr_B;
     base_addr_res  = s.base_addr_res;
+    size_of_operand = s.size_of_operand;
+    resident_tile_A = s.resident_tile_A;
+    resident_tile_B = s.resident_tile_B;
 
-    for (int i=0;i<64;i++){
-        cacheA[i] = s.cacheA[i];
-        cacheB[i] = s.cacheB[i];
-    }
-    for (int i=0;i<128;i++){
-        resultCache[i] = s.resultCache[i];
-    }
+    cacheA      = s.cacheA;
+    cacheB      = s.cacheB;
+    resultCache = s.resultCache;
     // Step() always finishes a whole LDBM/BIGMUL and reset() clears caches.
 }
-}
\ No newline at end of file
@@ -0,0 +1,398 @@
+/**
+ * @file branch_predictor.cpp
+ * @brief Branch direction predictors, the branch target buffer and return address stack, and the
+ *        per-branch statistics of how well they did.
+ */
+#include "vm/branch_prediction/branch_predictor.h"
+
+#include <algorithm>
+#include <bit>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace branch_prediction {
+
+namespace {
+
+constexpr unsigned int kTageTagBits = 10;
+constexpr uint64_t kTageAgingPeriod = 1 << 18;
+
+/**
+ * @brief XORs the last length outcomes of history together in chunks of bits, so long histories index small tables.
+ */
+uint64_t Fold(uint64_t history, unsigned int length, unsigned int bits) {
+  if (bits == 0) {
+    return 0;
+  }
+  if (length < 64) {
+    history &= (uint64_t{1} << length) - 1;
+  }
+  uint64_t chunk_mask = bits >= 64 ? ~uint64_t{0} : (uint64_t{1} << bits) - 1;
+  uint64_t folded = 0;
+  while (history != 0) {
+    folded ^= history & chunk_mask;
+    history = bits >= 64 ? 0 : history >> bits;
+  }
+  return folded;
+}
+
+void UpdateCounter(uint8_t &counter, bool taken) {
+  if (taken) {
+    counter += counter < 3;
+  } else {
+    counter -= counter > 0;
+  }
+}
+
+double PerThousand(uint64_t count, uint64_t instructions) {
+  return instructions == 0 ? 0.0 : 1000.0 * static_cast<double>(count) / static_cast<double>(instructions);
+}
+
+std::string HexAddress(uint64_t address) {
+  std::ostringstream hex;
+  hex << "0x" << std::hex << std::setw(8) << std::setfill('0') << address;
+  return hex.str();
+}
+
+} // namespace
+
+void PredictorConfig::Validate() const {
+  if (table_size == 0 || !std::has_single_bit(table_size)) {
+    throw std::invalid_argument("Branch predictor table size must be a power of two: " + std::to_string(table_size));
+  }
+  if (history_bits > 64) {
+    throw std::invalid_argument("Branch history is at most 64 bits: " + std::to_string(history_bits));
+  }
+  if (btb_associativity == 0 || btb_size < btb_associativity || btb_size % btb_associativity != 0
+      || !std::has_single_bit(btb_size / btb_associativity)) {
+    throw std::invalid_argument("BTB size " + std::to_string(btb_size) + " is not a power of two number of "
+                                + std::to_string(btb_associativity) + "-way sets");
+  }
+  if (ras_depth == 0) {
+    throw std::invalid_argument("Return address stack depth must be at least 1");
+  }
+}
+
+BimodalPredictor::BimodalPredictor(uint64_t table_size) : counters_(table_size, 1), mask_(table_size - 1) {}
+
+bool BimodalPredictor::Predict(uint64_t pc, uint64_t) const {
+  return counters_[(pc >> 2) & mask_] >= 2;
+}
+
+void BimodalPredictor::Update(uint64_t pc, uint64_t, bool taken) {
+  UpdateCounter(counters_[(pc >> 2) & mask_], taken);
+}
+
+GsharePredictor::GsharePredictor(uint64_t table_size, uint64_t history_bits)
+    : counters_(table_size, 1), mask_(table_size - 1), index_bits_(std::countr_zero(table_size)),
+      history_mask_(history_bits >= 64 ? ~uint64_t{0} : (uint64_t{1} << history_bits) - 1) {}
+
+uint64_t GsharePredictor::Index(uint64_t pc) const {
+  return ((pc >> 2) ^ Fold(history_, 64, index_bits_)) & mask_;
+}
+
+bool GsharePredictor::Predict(uint64_t pc, uint64_t) const {
+  return counters_[Index(pc)] >= 2;
+}
+
+void GsharePredictor::Update(uint64_t pc, uint64_t, bool taken) {
+  UpdateCounter(counters_[Index(pc)], taken);
+  history_ = ((history_ << 1) | taken) & history_mask_;
+}
+
+TagePredictor::TagePredictor(uint64_t table_size, uint64_t history_bits)
+    : base_(table_size), mask_(table_size - 1), index_bits_(std::countr_zero(table_size)) {
+  auto longest = static_cast<unsigned int>(std::max<uint64_t>(history_bits, 1));
+  for (size_t t = 0; t < kTables; ++t) {
+    tables_[t].assign(table_size, Entry());
+    history_lengths_[t] = std::max(1u, longest >> (kTables - 1 - t));
+  }
+}
+
+TagePredictor::Lookup TagePredictor::Find(uint64_t pc) const {
+  Lookup lookup;
+  for (int t = kTables - 1; t >= 0; --t) {
+    unsigned int length = history_lengths_[t];
+    lookup.index[t] = ((pc >> 2) ^ Fold(history_, length, index_bits_)) & mask_;
+    lookup.tag[t] = static_cast<uint16_t>(((pc >> 2) ^ Fold(history_, length, kTageTagBits)
+                                           ^ (Fold(history_, length, kTageTagBits - 1) << 1))
+                                          & ((1u << kTageTagBits) - 1));
+    const Entry &entry = tables_[t][lookup.index[t]];
+    if (entry.valid && entry.tag == lookup.tag[t]) {
+      if (lookup.provider < 0) {
+        lookup.provider = t;
+      } else if (lookup.alternate < 0) {
+        lookup.alternate = t;
+      }
+    }
+  }
+  return lookup;
+}
+
+bool TagePredictor::PredictionOf(const Lookup &lookup, int table, uint64_t pc) const {
+  if (table < 0) {
+    return base_.Predict(pc, 0);
+  }
+  return tables_[table][lookup.index[table]].counter >= 0;
+}
+
+bool TagePredictor::Predict(uint64_t pc, uint64_t) const {
+  Lookup lookup = Find(pc);
+  return PredictionOf(lookup, lookup.provider, pc);
+}
+
+void TagePredictor::Update(uint64_t pc, uint64_t target, bool taken) {
+  Lookup lookup = Find(pc);
+  bool prediction = PredictionOf(lookup, lookup.provider, pc);
+
+  if (lookup.provider >= 0) {
+    Entry &entry = tables_[lookup.provider][lookup.index[lookup.provider]];
+    // An entry is useful when it is right where the shorter history would have been wrong
+    if (prediction != PredictionOf(lookup, lookup.alternate, pc)) {
+      if (prediction == taken) {
+        entry.useful += entry.useful < 3;
+      } else {
+        entry.useful -= entry.useful > 0;
+      }
+    }
+    if (taken) {
+      entry.counter += entry.counter < 3;
+    } else {
+      entry.counter -= entry.counter > -4;
+    }
+  } else {
+    base_.Update(pc, target, taken);
+  }
+
+  if (prediction != taken) {
+    bool allocated = false;
+    for (size_t t = lookup.provider + 1; t < kTables; ++t) {
+      Entry &entry = tables_[t][lookup.index[t]];
+      if (!entry.valid || entry.useful == 0) {
+        entry = Entry{.tag = lookup.tag[t], .counter = static_cast<int8_t>(taken ? 0 : -1), .useful = 0,
+                      .valid = true};
+        allocated = true;
+        break;
+      }
+    }
+    if (!allocated) {
+      for (size_t t = lookup.provider + 1; t < kTables; ++t) {
+        Entry &entry = tables_[t][lookup.index[t]];
+        entry.useful -= entry.useful > 0;
+      }
+    }
+  }
+
+  if (++updates_ % kTageAgingPeriod == 0) {
+    for (std::vector<Entry> &table : tables_) {
+      for (Entry &entry : table) {
+        entry.useful >>= 1;
+      }
+    }
+  }
+  history_ = (history_ << 1) | taken;
+}
+
+BranchTargetBuffer::BranchTargetBuffer(uint64_t size, uint64_t associativity)
+    : entries_(size), associativity_(associativity), set_mask_(size / associativity - 1) {}
+
+std::optional<uint64_t> BranchTargetBuffer::Lookup(uint64_t pc) const {
+  const Entry *set = &entries_[((pc >> 2) & set_mask_) * associativity_];
+  for (uint64_t way = 0; way < associativity_; ++way) {
+    if (set[way].valid && set[way].pc == pc) {
+      return set[way].target;
+    }
+  }
+  return std::nullopt;
+}
+
+void BranchTargetBuffer::Update(uint64_t pc, uint64_t target) {
+  Entry *set = &entries_[((pc >> 2) & set_mask_) * associativity_];
+  // Invalid entries were never used, so the least recently used entry is an invalid one if there is any
+  Entry *victim = set;
+  for (uint64_t way = 0; way < associativity_; ++way) {
+    if (set[way].valid && set[way].pc == pc) {
+      victim = &set[way];
+      break;
+    }
+    if (set[way].last_used < victim->last_used) {
+      victim = &set[way];
+    }
+  }
+  *victim = Entry{.valid = true, .pc = pc, .target = target, .last_used = ++access_count_};
+}
+
+void ReturnAddressStack::Push(uint64_t address) {
+  entries_[top_] = address;
+  top_ = (top_ + 1) % entries_.size();
+  count_ = std::min(count_ + 1, entries_.size());
+}
+
+std::optional<uint64_t> ReturnAddressStack::Pop() {
+  if (count_ == 0) {
+    return std::nullopt;
+  }
+  top_ = (top_ + entries_.size() - 1) % entries_.size();
+  count_--;
+  return entries_[top_];
+}
+
+BranchPredictor::BranchPredictor(const PredictorConfig &config)
+    : config_((config.Validate(), config)),
+      btb_(config.btb_size, config.btb_associativity),
+      ras_(config.ras_depth) {
+  switch (config_.type) {
+    case PredictorType::AlwaysNotTaken: direction_ = std::make_unique<StaticPredictor>(false);
+      break;
+    case PredictorType::Btfn: direction_ = std::make_unique<StaticPredictor>(true);
+      break;
+    case PredictorType::Bimodal: direction_ = std::make_unique<BimodalPredictor>(config_.table_size);
+      break;
+    case PredictorType::Gshare: direction_ = std::make_unique<GsharePredictor>(config_.table_size, config_.history_bits);
+      break;
+    case PredictorType::Tage: direction_ = std::make_unique<TagePredictor>(config_.table_size, config_.history_bits);
+      break;
+  }
+}
+
+BranchPredictor::BranchPredictor(const BranchPredictor &other)
+    : config_(other.config_),
+      direction_(other.direction_->Clone()),
+      btb_(other.btb_),
+      ras_(other.ras_),
+      sites_(other.sites_),
+      branches_(other.branches_),
+      mispredictions_(other.mispredictions_) {}
+
+BranchPredictor &BranchPredictor::operator=(const BranchPredictor &other) {
+  if (this != &other) {
+    *this = BranchPredictor(other);
+  }
+  return *this;
+}
+
+uint64_t BranchPredictor::Predict(uint64_t pc, BranchKind kind, uint64_t direct_target) const {
+  switch (kind) {
+    case BranchKind::Conditional:
+      if (!direction_->Predict(pc, direct_target)) {
+        return pc + 4;
+      }
+      break;
+    case BranchKind::Return:
+      if (std::optional<uint64_t> top = ras_.Top()) {
+        return *top;
+      }
+      break;
+    default:
+      break;
+  }
+  // Fetch cannot redirect without a target to redirect to
+  return btb_.Lookup(pc).value_or(pc + 4);
+}
+
+bool BranchPredictor::Update(uint64_t pc, BranchKind kind, uint64_t direct_target, uint64_t next_pc,
+                             uint64_t predicted_pc) {
+  bool taken = kind != BranchKind::Conditional || next_pc == direct_target;
+  if (kind == BranchKind::Conditional) {
+    direction_->Update(pc, direct_target, taken);
+  }
+  if (taken) {
+    btb_.Update(pc, next_pc);
+  }
+  if (kind == BranchKind::Call) {
+    ras_.Push(pc + 4);
+  } else if (kind == BranchKind::Return) {
+    ras_.Pop();
+  }
+
+  bool mispredicted = predicted_pc != next_pc;
+  if ((pc >> 2) >= sites_.size()) {
+    sites_.resize((pc >> 2) + 1);
+  }
+  BranchSiteStats &site = sites_[pc >> 2];
+  site.kind = kind;
+  site.executed++;
+  site.taken += taken;
+  site.mispredicted += mispredicted;
+  branches_++;
+  mispredictions_ += mispredicted;
+  return mispredicted;
+}
+
+std::vector<std::pair<uint64_t, const BranchSiteStats *>> BranchPredictor::SitesByMispredictions() const {
+  std::vector<std::pair<uint64_t, const BranchSiteStats *>> sites;
+  for (size_t slot = 0; slot < sites_.size(); ++slot) {
+    if (sites_[slot].executed != 0) {
+      sites.emplace_back(slot << 2, &sites_[slot]);
+    }
+  }
+  std::sort(sites.begin(), sites.end(), [](const auto &a, const auto &b) {
+    if (a.second->mispredicted != b.second->mispredicted) {
+      return a.second->mispredicted > b.second->mispredicted;
+    }
+    return a.first < b.first;
+  });
+  return sites;
+}
+
+void BranchPredictor::PrintReport(std::ostream &os, uint64_t instructions) const {
+  double accuracy = branches_ == 0 ? 0.0
+                                   : 1.0 - static_cast<double>(mispredictions_) / static_cast<double>(branches_);
+  os << "Branch predictor " << predictorTypeName(config_.type) << ": branches=" << branches_
+     << " mispredictions=" << mispredictions_
+     << " accuracy=" << std::fixed << std::setprecision(4) << accuracy
+     << " mpki=" << std::setprecision(3) << PerThousand(mispredictions_, instructions) << std::defaultfloat << '\n';
+  os << std::right << std::setw(12) << "pc"
+     << std::setw(10) << "kind"
+     << std::setw(12) << "executed"
+     << std::setw(12) << "taken"
+     << std::setw(14) << "mispredicted"
+     << std::setw(10) << "accuracy"
+     << std::setw(10) << "mpki" << '\n';
+  for (const auto &[pc, site] : SitesByMispredictions()) {
+    os << std::setw(12) << HexAddress(pc)
+       << std::setw(10) << branchKindName(site->kind)
+       << std::setw(12) << site->executed
+       << std::setw(12) << site->taken
+       << std::setw(14) << site->mispredicted
+       << std::fixed << std::setprecision(4) << std::setw(10) << site->Accuracy()
+       << std::setprecision(3) << std::setw(10) << PerThousand(site->mispredicted, instructions)
+       << std::defaultfloat << '\n';
+  }
+  os << std::flush;
+}
+
+void BranchPredictor::Dump(const std::filesystem::path &filename, uint64_t instructions) const {
+  std::ofstream file(filename);
+  if (!file.is_open()) {
+    std::cerr << "Error opening file for dumping branch statistics: " << filename.string() << std::endl;
+    return;
+  }
+  file << "{\n";
+  file << "    \"predictor\": \"" << predictorTypeName(config_.type) << "\",\n";
+  file << "    \"table_size\": " << config_.table_size << ",\n";
+  file << "    \"history_bits\": " << config_.history_bits << ",\n";
+  file << "    \"btb_size\": " << config_.btb_size << ",\n";
+  file << "    \"btb_associativity\": " << config_.btb_associativity << ",\n";
+  file << "    \"ras_depth\": " << config_.ras_depth << ",\n";
+  file << "    \"instructions\": " << instructions << ",\n";
+  file << "    \"branches\": " << branches_ << ",\n";
+  file << "    \"mispredictions\": " << mispredictions_ << ",\n";
+  file << "    \"mpki\": " << PerThousand(mispredictions_, instructions) << ",\n";
+  file << "    \"sites\": [\n";
+  std::vector<std::pair<uint64_t, const BranchSiteStats *>> sites = SitesByMispredictions();
+  for (size_t i = 0; i < sites.size(); ++i) {
+    const BranchSiteStats &site = *sites[i].second;
+    file << "        {\"pc\": \"" << HexAddress(sites[i].first) << "\", \"kind\": \"" << branchKindName(site.kind)
+         << "\", \"executed\": " << site.executed << ", \"taken\": " << site.taken
+         << ", \"mispredicted\": " << site.mispredicted << ", \"accuracy\": " << site.Accuracy()
+         << ", \"mpki\": " << PerThousand(site.mispredicted, instructions) << "}"
+         << (i + 1 < sites.size() ? ",\n" : "\n");
+  }
+  file << "    ]\n";
+  file << "}\n";
+}
+
+} // namespace branch_prediction
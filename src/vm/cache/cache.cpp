@@ -4,3 +4,250 @@
  * @author Vishank Singh, https://github.com/VishankSingh
  */
 #include "vm/cache/cache.h"
+
+#include <algorithm>
+#include <bit>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+namespace cache {
+
+void CacheConfig::Validate() const {
+  if (block_size == 0 || !std::has_single_bit(block_size)) {
+    throw std::invalid_argument("Cache block size must be a power of two: " + std::to_string(block_size));
+  }
+  if (associativity == 0) {
+    throw std::invalid_argument("Cache associativity must be at least 1");
+  }
+  uint64_t set_size = block_size * associativity;
+  if (size < set_size || size % set_size != 0 || !std::has_single_bit(size / set_size)) {
+    throw std::invalid_argument("Cache size " + std::to_string(size) + " is not a power of two number of "
+                                + std::to_string(associativity) + "-way sets of " + std::to_string(block_size)
+                                + " byte lines");
+  }
+}
+
+Cache::Cache(CacheType type, const CacheConfig &config) : type_(type), config_(config) {
+  config_.Validate();
+  uint64_t set_count = config_.size / (config_.block_size * config_.associativity);
+  sets_.assign(set_count, CacheSet(config_.associativity));
+  offset_bits_ = std::countr_zero(config_.block_size);
+  set_mask_ = set_count - 1;
+}
+
+void Cache::Reset() {
+  for (CacheSet &set : sets_) {
+    std::fill(set.lines.begin(), set.lines.end(), CacheLine());
+  }
+  stats_ = CacheStats();
+  access_count_ = 0;
+  random_.seed();
+}
+
+CacheLine &Cache::Victim(CacheSet &set) {
+  for (CacheLine &line : set.lines) {
+    if (line.state == CacheLineState::Invalid) {
+      return line;
+    }
+  }
+  switch (config_.replacement_policy) {
+    case ReplacementPolicy::LRU:
+      return *std::min_element(set.lines.begin(), set.lines.end(), [](const CacheLine &a, const CacheLine &b) {
+        return a.last_used < b.last_used;
+      });
+    case ReplacementPolicy::FIFO:
+      return *std::min_element(set.lines.begin(), set.lines.end(), [](const CacheLine &a, const CacheLine &b) {
+        return a.filled < b.filled;
+      });
+    case ReplacementPolicy::Random:
+      break;
+  }
+  return set.lines[random_() % set.lines.size()];
+}
+
+CacheAccess Cache::Access(uint64_t address, bool is_write) {
+  CacheAccess result;
+  access_count_++;
+  stats_.accesses++;
+  if (is_write) {
+    stats_.writes++;
+  } else {
+    stats_.reads++;
+  }
+
+  uint64_t line_number = address >> offset_bits_;
+  CacheSet &set = sets_[line_number & set_mask_];
+  for (CacheLine &line : set.lines) {
+    if (line.state != CacheLineState::Invalid && line.tag == line_number) {
+      stats_.hits++;
+      line.last_used = access_count_;
+      if (is_write) {
+        if (config_.write_hit_policy == WriteHitPolicy::WriteBack) {
+          line.state = CacheLineState::Dirty;
+        } else {
+          result.write_through = true;
+        }
+      }
+      result.hit = true;
+      return result;
+    }
+  }
+
+  stats_.misses++;
+  if (is_write) {
+    stats_.write_misses++;
+    if (config_.write_miss_policy == WriteMissPolicy::NoWriteAllocate) {
+      result.write_through = true;
+      return result;
+    }
+  } else {
+    stats_.read_misses++;
+  }
+
+  CacheLine &victim = Victim(set);
+  if (victim.state != CacheLineState::Invalid) {
+    stats_.evictions++;
+    if (victim.state == CacheLineState::Dirty) {
+      stats_.writebacks++;
+      result.writeback = victim.tag << offset_bits_;
+    }
+  }
+  victim.tag = line_number;
+  victim.state = CacheLineState::Valid;
+  victim.last_used = access_count_;
+  victim.filled = access_count_;
+  result.fill = true;
+  if (is_write) {
+    if (config_.write_hit_policy == WriteHitPolicy::WriteBack) {
+      victim.state = CacheLineState::Dirty;
+    } else {
+      result.write_through = true;
+    }
+  }
+  return result;
+}
+
+CacheHierarchy::CacheHierarchy(const CacheConfig &l1, const std::optional<CacheConfig> &l2, uint64_t memory_latency)
+    : l1i_(CacheType::Instruction, l1), l1d_(CacheType::Data, l1), memory_latency_(memory_latency) {
+  if (l2) {
+    l2_.emplace(CacheType::Unified, *l2);
+  }
+}
+
+void CacheHierarchy::Reset() {
+  l1i_.Reset();
+  l1d_.Reset();
+  if (l2_) {
+    l2_->Reset();
+  }
+  memory_reads_ = 0;
+  memory_writes_ = 0;
+}
+
+uint64_t CacheHierarchy::Access(Cache &l1, uint64_t address, uint64_t size, bool is_write) {
+  const uint64_t block_size = l1.GetConfig().block_size;
+  uint64_t latency = 0;
+  uint64_t end = address + size;
+  while (address < end) {
+    uint64_t line = address & ~(block_size - 1);
+    uint64_t chunk = std::min(end, line + block_size) - address;
+    CacheAccess access = l1.Access(address, is_write);
+    latency += l1.GetConfig().hit_latency;
+    if (access.writeback) {
+      AccessNextLevel(*access.writeback, block_size, true);
+    }
+    if (access.fill) {
+      latency += AccessNextLevel(line, block_size, false);
+    }
+    if (access.write_through) {
+      AccessNextLevel(address, chunk, true);
+    }
+    address += chunk;
+  }
+  return latency;
+}
+
+uint64_t CacheHierarchy::AccessNextLevel(uint64_t address, uint64_t size, bool is_write) {
+  if (!l2_) {
+    if (is_write) {
+      memory_writes_++;
+      return 0;
+    }
+    memory_reads_++;
+    return memory_latency_;
+  }
+  const uint64_t block_size = l2_->GetConfig().block_size;
+  uint64_t latency = 0;
+  uint64_t end = address + size;
+  while (address < end) {
+    CacheAccess access = l2_->Access(address, is_write);
+    latency += l2_->GetConfig().hit_latency;
+    if (access.fill) {
+      memory_reads_++;
+      latency += memory_latency_;
+    }
+    memory_writes_ += access.writeback.has_value() + access.write_through;
+    address = (address & ~(block_size - 1)) + block_size;
+  }
+  return is_write ? 0 : latency;
+}
+
+void CacheHierarchy::PrintStatus(std::ostream &os) const {
+  auto print = [&os](const std::string &name, const Cache &cache) {
+    const CacheStats &stats = cache.GetStats();
+    os << name << ": accesses=" << stats.accesses << " hits=" << stats.hits << " misses=" << stats.misses
+       << " evictions=" << stats.evictions << " writebacks=" << stats.writebacks
+       << " hit_rate=" << std::fixed << std::setprecision(4) << stats.HitRate() << std::defaultfloat << std::endl;
+  };
+  print("L1I", l1i_);
+  print("L1D", l1d_);
+  if (l2_) {
+    print("L2", *l2_);
+  }
+  os << "Memory: line_reads=" << memory_reads_ << " writes=" << memory_writes_ << std::endl;
+}
+
+void CacheHierarchy::Dump(const std::filesystem::path &filename) const {
+  std::ofstream file(filename);
+  if (!file.is_open()) {
+    std::cerr << "Error opening file for dumping caches: " << filename.string() << std::endl;
+    return;
+  }
+  auto dump = [&file](const std::string &name, const Cache &cache, bool last) {
+    const CacheConfig &config = cache.GetConfig();
+    const CacheStats &stats = cache.GetStats();
+    file << "        \"" << name << "\": {\n";
+    file << "            \"size\": " << config.size << ",\n";
+    file << "            \"block_size\": " << config.block_size << ",\n";
+    file << "            \"associativity\": " << config.associativity << ",\n";
+    file << "            \"replacement_policy\": \"" << replacementPolicyName(config.replacement_policy) << "\",\n";
+    file << "            \"write_hit_policy\": \"" << writeHitPolicyName(config.write_hit_policy) << "\",\n";
+    file << "            \"write_miss_policy\": \"" << writeMissPolicyName(config.write_miss_policy) << "\",\n";
+    file << "            \"hit_latency\": " << config.hit_latency << ",\n";
+    file << "            \"accesses\": " << stats.accesses << ",\n";
+    file << "            \"hits\": " << stats.hits << ",\n";
+    file << "            \"misses\": " << stats.misses << ",\n";
+    file << "            \"read_misses\": " << stats.read_misses << ",\n";
+    file << "            \"write_misses\": " << stats.write_misses << ",\n";
+    file << "            \"evictions\": " << stats.evictions << ",\n";
+    file << "            \"writebacks\": " << stats.writebacks << ",\n";
+    file << "            \"hit_rate\": " << stats.HitRate() << "\n";
+    file << "        }" << (last ? "\n" : ",\n");
+  };
+  file << "{\n";
+  file << "    \"enabled\": true,\n";
+  file << "    \"caches\": {\n";
+  dump("L1I", l1i_, false);
+  dump("L1D", l1d_, !l2_);
+  if (l2_) {
+    dump("L2", *l2_, true);
+  }
+  file << "    },\n";
+  file << "    \"memory_latency\": " << memory_latency_ << ",\n";
+  file << "    \"memory_line_reads\": " << memory_reads_ << ",\n";
+  file << "    \"memory_writes\": " << memory_writes_ << "\n";
+  file << "}\n";
+}
+
+} // namespace cache
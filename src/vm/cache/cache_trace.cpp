@@ -0,0 +1,258 @@
+/**
+ * @file cache_trace.cpp
+ * @brief Binary memory-access traces, and the sweep that replays one trace through many cache configurations.
+ */
+#include "vm/cache/cache_trace.h"
+#include "config.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+namespace cache {
+
+namespace {
+
+constexpr char kTraceMagic[8] = {'R', 'V', 'T', 'R', 'A', 'C', 'E', '2'};
+constexpr size_t kFlushThreshold = 1 << 16;
+
+// Header byte: kind in bits 0-1, log2 of the size in bits 2-3, or bit 4 when a size varint follows
+constexpr uint8_t kKindMask = 0x03;
+constexpr unsigned int kSizeShift = 2;
+constexpr uint8_t kExplicitSize = 0x10;
+
+void PutVarint(std::vector<uint8_t> &out, uint64_t value) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<uint8_t>(value) | 0x80);
+    value >>= 7;
+  }
+  out.push_back(static_cast<uint8_t>(value));
+}
+
+// Small differences of either sign encode to small varints
+uint64_t ZigZag(uint64_t difference) {
+  return (difference << 1) ^ static_cast<uint64_t>(static_cast<int64_t>(difference) >> 63);
+}
+
+uint64_t UnZigZag(uint64_t value) {
+  return (value >> 1) ^ (~(value & 1) + 1);
+}
+
+} // namespace
+
+TraceWriter::TraceWriter(const std::filesystem::path &filename) : file_(filename, std::ios::binary) {
+  if (!file_.is_open()) {
+    throw std::runtime_error("Unable to create trace file: " + filename.string());
+  }
+  file_.write(kTraceMagic, sizeof(kTraceMagic));
+  buffer_.reserve(kFlushThreshold + 32);
+}
+
+TraceWriter::~TraceWriter() {
+  Flush();
+}
+
+void TraceWriter::Record(AccessKind kind, uint64_t pc, uint64_t address, uint64_t size) {
+  uint8_t header = static_cast<uint8_t>(kind);
+  bool implied_size = size != 0 && size <= 8 && std::has_single_bit(size);
+  if (implied_size) {
+    header |= static_cast<uint8_t>(std::countr_zero(size) << kSizeShift);
+  } else {
+    header |= kExplicitSize;
+  }
+  buffer_.push_back(header);
+
+  uint64_t &last = kind == AccessKind::Fetch ? last_fetch_ : last_data_;
+  PutVarint(buffer_, ZigZag(address - last));
+  last = address;
+  if (!implied_size) {
+    PutVarint(buffer_, size);
+  }
+  if (kind != AccessKind::Fetch) {
+    PutVarint(buffer_, ZigZag(pc - last_fetch_));
+  }
+
+  record_count_++;
+  if (buffer_.size() >= kFlushThreshold) {
+    Flush();
+  }
+}
+
+void TraceWriter::Flush() {
+  file_.write(reinterpret_cast<const char *>(buffer_.data()), static_cast<std::streamsize>(buffer_.size()));
+  file_.flush();
+  buffer_.clear();
+}
+
+TraceReader::TraceReader(const std::vector<uint8_t> &bytes)
+    : in_(bytes.data()), end_(bytes.data() + bytes.size()) {
+  if (bytes.size() < sizeof(kTraceMagic) || std::memcmp(bytes.data(), kTraceMagic, sizeof(kTraceMagic)) != 0) {
+    throw std::runtime_error("Not a memory access trace");
+  }
+  in_ += sizeof(kTraceMagic);
+}
+
+uint64_t TraceReader::GetVarint() {
+  uint64_t value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (in_ == end_) {
+      break;
+    }
+    uint8_t byte = *in_++;
+    value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      return value;
+    }
+  }
+  throw std::runtime_error("Truncated memory access trace");
+}
+
+bool TraceReader::Next(TraceRecord &record) {
+  if (in_ == end_) {
+    return false;
+  }
+  uint8_t header = *in_++;
+  record.kind = static_cast<AccessKind>(header & kKindMask);
+  if (record.kind > AccessKind::Write) {
+    throw std::runtime_error("Corrupt memory access trace");
+  }
+  uint64_t &last = record.kind == AccessKind::Fetch ? last_fetch_ : last_data_;
+  last += UnZigZag(GetVarint());
+  record.address = last;
+  record.size = (header & kExplicitSize) ? GetVarint() : uint64_t{1} << ((header >> kSizeShift) & 0x03);
+  record.pc = record.kind == AccessKind::Fetch ? last_fetch_ : last_fetch_ + UnZigZag(GetVarint());
+  return true;
+}
+
+std::vector<uint8_t> LoadTrace(const std::filesystem::path &filename) {
+  std::ifstream file(filename, std::ios::binary);
+  if (!file.is_open()) {
+    throw std::runtime_error("Unable to open trace file: " + filename.string());
+  }
+  return {std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+}
+
+std::vector<SweepPoint> ReadSweepFile(const std::filesystem::path &filename) {
+  std::ifstream file(filename);
+  if (!file.is_open()) {
+    throw std::runtime_error("Unable to open sweep file: " + filename.string());
+  }
+  std::vector<SweepPoint> points;
+  std::string line;
+  while (std::getline(file, line)) {
+    line.erase(0, line.find_first_not_of(" \t"));
+    line.erase(line.find_last_not_of(" \t\r") + 1);
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    vm_config::VmConfig config = vm_config::config;
+    std::istringstream pairs(line);
+    std::string pair;
+    while (pairs >> pair) {
+      size_t equals = pair.find('=');
+      if (equals == std::string::npos) {
+        throw std::invalid_argument("Expected key=value in sweep file: " + pair);
+      }
+      config.modifyConfig("Cache", pair.substr(0, equals), pair.substr(equals + 1));
+    }
+    SweepPoint &point = points.emplace_back();
+    point.label = line;
+    point.l1 = config.getL1CacheConfig();
+    if (config.getL2CacheEnabled()) {
+      point.l2 = config.getL2CacheConfig();
+    }
+    point.memory_latency = config.getMemoryLatency();
+  }
+  return points;
+}
+
+std::vector<SweepResult> SweepTrace(const std::vector<uint8_t> &trace, const std::vector<SweepPoint> &points,
+                                    unsigned int jobs) {
+  // Fail on a bad trace here rather than in every worker
+  TraceReader{trace};
+
+  if (jobs == 0) {
+    jobs = std::max(1u, std::thread::hardware_concurrency());
+  }
+  jobs = std::min<size_t>(jobs, std::max<size_t>(points.size(), 1));
+
+  std::vector<SweepResult> results(points.size());
+  std::vector<std::exception_ptr> errors(points.size());
+  std::atomic<size_t> next_point = 0;
+  auto worker = [&]() {
+    for (size_t i = next_point++; i < points.size(); i = next_point++) {
+      try {
+        SweepResult &result = results[i];
+        result.point = points[i];
+        CacheHierarchy caches(points[i].l1, points[i].l2, points[i].memory_latency);
+        TraceReader reader(trace);
+        TraceRecord record;
+        while (reader.Next(record)) {
+          switch (record.kind) {
+            case AccessKind::Fetch: result.total_latency += caches.Fetch(record.address, record.size);
+              break;
+            case AccessKind::Read: result.total_latency += caches.Read(record.address, record.size);
+              break;
+            case AccessKind::Write: result.total_latency += caches.Write(record.address, record.size);
+              break;
+          }
+          result.accesses++;
+        }
+        result.l1i = caches.GetL1InstructionCache().GetStats();
+        result.l1d = caches.GetL1DataCache().GetStats();
+        if (caches.GetL2Cache()) {
+          result.l2 = caches.GetL2Cache()->GetStats();
+        }
+      } catch (...) {
+        errors[i] = std::current_exception();
+      }
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (unsigned int i = 0; i < jobs; ++i) {
+    workers.emplace_back(worker);
+  }
+  for (std::thread &thread : workers) {
+    thread.join();
+  }
+  for (const std::exception_ptr &error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+  return results;
+}
+
+void PrintSweepReport(std::ostream &out, const std::vector<SweepResult> &results) {
+  out << std::right << std::setw(6) << "point"
+      << std::setw(12) << "accesses"
+      << std::setw(10) << "L1I hit"
+      << std::setw(10) << "L1D hit"
+      << std::setw(10) << "L2 hit"
+      << std::setw(10) << "AMAT"
+      << "  configuration" << '\n';
+  for (size_t i = 0; i < results.size(); ++i) {
+    const SweepResult &result = results[i];
+    out << std::setw(6) << i
+        << std::setw(12) << result.accesses
+        << std::fixed << std::setprecision(4)
+        << std::setw(10) << result.l1i.HitRate()
+        << std::setw(10) << result.l1d.HitRate();
+    if (result.l2) {
+      out << std::setw(10) << result.l2->HitRate();
+    } else {
+      out << std::setw(10) << "-";
+    }
+    out << std::setprecision(2) << std::setw(10) << result.Amat() << std::defaultfloat
+        << "  " << result.point.label << '\n';
+  }
+  out << std::flush;
+}
+
+} // namespace cache
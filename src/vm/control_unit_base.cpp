@@ -43,4 +43,32 @@ bool ControlUnit::GetLdbmStart() const {
 
 bool ControlUnit::GetBigmulStart() const {
   return bigmul_start_;
-}
\ No newline at end of file
+}
+
+ControlSignals ControlUnit::GetControlSignals() const {
+  ControlSignals signals;
+  signals.reg_write = reg_write_;
+  signals.branch = branch_;
+  signals.alu_src = alu_src_;
+  signals.mem_read = mem_read_;
+  signals.mem_write = mem_write_;
+  signals.mem_to_reg = mem_to_reg_;
+  signals.pc_src = pc_src_;
+  signals.ldbm_start = ldbm_start_;
+  signals.bigmul_start = bigmul_start_;
+  signals.alu_op = alu_op_;
+  return signals;
+}
+
+void ControlUnit::LoadControlSignals(const ControlSignals &signals) {
+  reg_write_ = signals.reg_write;
+  branch_ = signals.branch;
+  alu_src_ = signals.alu_src;
+  mem_read_ = signals.mem_read;
+  mem_write_ = signals.mem_write;
+  mem_to_reg_ = signals.mem_to_reg;
+  pc_src_ = signals.pc_src;
+  ldbm_start_ = signals.ldbm_start;
+  bigmul_start_ = signals.bigmul_start;
+  alu_op_ = signals.alu_op;
+}
@@ -0,0 +1,36 @@
+/**
+ * @file decode_cache.cpp
+ * @brief Predecoded instruction cache implementation
+ */
+
+#include "vm/decode_cache.h"
+
+#include <algorithm>
+#include <cstdint>
+
+void DecodeCache::Reset(uint64_t base, uint64_t size) {
+  base_ = base;
+  entries_.assign((size + 3) / 4, DecodedInstruction());
+  generation_++;
+}
+
+void DecodeCache::Clear() {
+  for (auto &entry : entries_) {
+    entry.valid = false;
+  }
+  generation_++;
+}
+
+void DecodeCache::Invalidate(uint64_t address, uint64_t size) {
+  uint64_t end = address + size;
+  uint64_t limit = base_ + GetSize();
+  if (size == 0 || end <= base_ || address >= limit) {
+    return;
+  }
+  uint64_t first = (std::max(address, base_) - base_) >> 2;
+  uint64_t last = (std::min(end, limit) - base_ + 3) >> 2;
+  for (uint64_t i = first; i < last; ++i) {
+    entries_[i].valid = false;
+  }
+  generation_++;
+}
@@ -16,50 +16,316 @@
 #include <fstream>
 #include <iomanip>
 #include <algorithm>
+#include <atomic>
 #include <sstream>
+#include <bit>
+#include <type_traits>
+
+static_assert(std::endian::native == std::endian::little,
+              "Memory copies whole values with memcpy and expects a little-endian host");
+
+Memory::Memory() {
+  block_size_ = vm_config::config.getMemoryBlockSize();
+  if (block_size_ == 0 || (block_size_ & (block_size_ - 1)) != 0) {
+    throw std::invalid_argument("Memory block size must be a power of two: " + std::to_string(block_size_));
+  }
+  block_offset_bits_ = std::countr_zero(block_size_);
+  unsigned int index_bits = 64 - block_offset_bits_;
+  levels_ = (index_bits + kLevelBits - 1)/kLevelBits;
+  root_bits_ = index_bits - (levels_ - 1)*kLevelBits;
+}
 
 uint8_t Memory::Read(uint64_t address) {
   if (address >= memory_size_) {
     throw std::out_of_range("Memory address out of range: " + std::to_string(address));
   }
-  uint64_t block_index = GetBlockIndex(address);
-  uint64_t offset = GetBlockOffset(address);
-  if (!IsBlockPresent(block_index)) {
+  const MemoryBlock *block = LookupBlock(GetBlockIndex(address), dtlb_);
+  if (block == nullptr) {
     return 0;
   }
-  return blocks_[block_index].data[offset];
+  return block->data[GetBlockOffset(address)];
 }
 
 void Memory::Write(uint64_t address, uint8_t value) {
   if (address >= memory_size_) {
     throw std::out_of_range(std::string("Memory address out of range: ") + std::to_string(address));
   }
-  uint64_t block_index = GetBlockIndex(address);
-  uint64_t offset = GetBlockOffset(address);
-  EnsureBlockExists(block_index);
-  blocks_[block_index].data[offset] = value;
+  BreakReservations(address, 1);
+  MemoryBlock *block = WritableBlock(GetBlockIndex(address));
+  block->data[GetBlockOffset(address)] = value;
+}
+
+void Memory::ReadBlock(uint64_t address, std::span<uint8_t> out) {
+  if (out.size() > memory_size_ || address > memory_size_ - out.size()) {
+    throw std::out_of_range("Memory range out of range: " + std::to_string(address)
+                            + " + " + std::to_string(out.size()));
+  }
+  size_t done = 0;
+  while (done < out.size()) {
+    uint64_t offset = GetBlockOffset(address + done);
+    size_t chunk = std::min<size_t>(block_size_ - offset, out.size() - done);
+    const MemoryBlock *block = LookupBlock(GetBlockIndex(address + done), dtlb_);
+    if (block == nullptr) {
+      std::fill_n(out.data() + done, chunk, 0);
+    } else {
+      std::memcpy(out.data() + done, block->data.data() + offset, chunk);
+    }
+    done += chunk;
+  }
+}
+
+void Memory::WriteBlock(uint64_t address, std::span<const uint8_t> data) {
+  if (data.size() > memory_size_ || address > memory_size_ - data.size()) {
+    throw std::out_of_range("Memory range out of range: " + std::to_string(address)
+                            + " + " + std::to_string(data.size()));
+  }
+  BreakReservations(address, data.size());
+  size_t done = 0;
+  while (done < data.size()) {
+    uint64_t block_index = GetBlockIndex(address + done);
+    uint64_t offset = GetBlockOffset(address + done);
+    size_t chunk = std::min<size_t>(block_size_ - offset, data.size() - done);
+    MemoryBlock *block = WritableBlock(block_index);
+    std::memcpy(block->data.data() + offset, data.data() + done, chunk);
+    done += chunk;
+  }
 }
 
 uint64_t Memory::GetBlockIndex(uint64_t address) const {
-  return address/block_size_;
+  return address >> block_offset_bits_;
 }
 
 uint64_t Memory::GetBlockOffset(uint64_t address) const {
-  return address%block_size_;
+  return address & (block_size_ - 1);
+}
+
+uint64_t Memory::GetLevelIndex(uint64_t block_index, unsigned int level) const {
+  unsigned int shift = (levels_ - 1 - level)*kLevelBits;
+  unsigned int bits = (level == 0) ? root_bits_ : kLevelBits;
+  return (block_index >> shift) & ((uint64_t{1} << bits) - 1);
+}
+
+MemoryBlock *Memory::FindBlock(uint64_t block_index, bool *unshared) const {
+  const std::shared_ptr<PageTableNode> *node = &storage_->page_table;
+  bool owned = true;
+  for (unsigned int level = 0; *node && level + 1 < levels_; ++level) {
+    owned = owned && node->use_count() == 1;
+    node = &(*node)->children[GetLevelIndex(block_index, level)];
+  }
+  if (!*node) {
+    if (unshared != nullptr) {
+      *unshared = false;
+    }
+    return nullptr;
+  }
+  const std::shared_ptr<MemoryBlock> &block = (*node)->blocks[GetLevelIndex(block_index, levels_ - 1)];
+  if (unshared != nullptr) {
+    *unshared = owned && node->use_count() == 1 && block.use_count() == 1;
+  }
+  return block.get();
+}
+
+MemoryBlock *Memory::LookupBlock(uint64_t block_index, Tlb &tlb) {
+  TlbEntry &entry = tlb.entries[block_index & (kTlbEntries - 1)];
+  // Another sharer may have created a block this TLB cached the absence of
+  if (entry.valid && entry.block_index == block_index && (entry.block != nullptr || !shared_)) [[likely]] {
+    tlb.hits++;
+    return entry.block;
+  }
+  return RefillTlb(block_index, tlb);
+}
+
+MemoryBlock *Memory::RefillTlb(uint64_t block_index, Tlb &tlb) {
+  TlbEntry &entry = tlb.entries[block_index & (kTlbEntries - 1)];
+  tlb.misses++;
+  std::unique_lock<std::mutex> lock = LockShared();
+  entry.valid = true;
+  entry.block_index = block_index;
+  entry.block = FindBlock(block_index, &entry.writable);
+  return entry.block;
 }
 
 bool Memory::IsBlockPresent(uint64_t block_index) const {
-  return blocks_.find(block_index)!=blocks_.end();
+  std::unique_lock<std::mutex> lock = LockShared();
+  return FindBlock(block_index) != nullptr;
 }
 
-void Memory::EnsureBlockExists(uint64_t block_index) {
-  if (blocks_.find(block_index)==blocks_.end()) {
-    blocks_.emplace(block_index, MemoryBlock());
+MemoryBlock &Memory::EnsureBlockExists(uint64_t block_index) {
+  auto make_node = [&](unsigned int level) {
+    auto node = std::make_shared<PageTableNode>();
+    size_t slots = size_t{1} << ((level == 0) ? root_bits_ : kLevelBits);
+    if (level + 1 < levels_) {
+      node->children.resize(slots);
+    } else {
+      node->blocks.resize(slots);
+    }
+    return node;
+  };
+  // Gives this memory its own copy of something an Image still points to
+  auto unshare = [](auto &pointer) {
+    if (pointer.use_count() > 1) {
+      pointer = std::make_shared<typename std::remove_reference_t<decltype(pointer)>::element_type>(*pointer);
+    }
+  };
+
+  std::unique_lock<std::mutex> lock = LockShared();
+  std::shared_ptr<PageTableNode> &page_table = storage_->page_table;
+  if (!page_table) {
+    page_table = make_node(0);
+  }
+  unshare(page_table);
+  PageTableNode *node = page_table.get();
+  for (unsigned int level = 0; level + 1 < levels_; ++level) {
+    std::shared_ptr<PageTableNode> &child = node->children[GetLevelIndex(block_index, level)];
+    if (!child) {
+      child = make_node(level + 1);
+    }
+    unshare(child);
+    node = child.get();
+  }
+
+  std::shared_ptr<MemoryBlock> &block = node->blocks[GetLevelIndex(block_index, levels_ - 1)];
+  if (!block) {
+    block = std::make_shared<MemoryBlock>(block_size_);
+    storage_->block_count++;
+  }
+  unshare(block);
+  // Entries may have cached the absence of this block, or the copy an Image keeps
+  for (Tlb *tlb : {&itlb_, &dtlb_}) {
+    TlbEntry &entry = tlb->entries[block_index & (kTlbEntries - 1)];
+    if (entry.valid && entry.block_index == block_index) {
+      entry.block = block.get();
+      entry.writable = true;
+    }
+  }
+  return *block;
+}
+
+MemoryBlock *Memory::WritableBlock(uint64_t block_index) {
+  MemoryBlock *block = LookupBlock(block_index, dtlb_);
+  if (journal_ != nullptr && (block == nullptr || block->journal_epoch != journal_epoch_)) {
+    journal_->push_back({block_index, block == nullptr ? std::vector<uint8_t>() : block->data});
+  }
+  if (block == nullptr || !dtlb_.entries[block_index & (kTlbEntries - 1)].writable) {
+    block = &EnsureBlockExists(block_index);
+  }
+  if (journal_ != nullptr) {
+    block->journal_epoch = journal_epoch_;
+  }
+  return block;
+}
+
+Memory::Image Memory::Snapshot() {
+  if (shared_) {
+    throw std::logic_error("A shared memory cannot be snapshotted");
+  }
+  Image image;
+  image.page_table_ = storage_->page_table;
+  image.block_count_ = storage_->block_count;
+  // Every block is shared now, so the next write to each has to go through EnsureBlockExists()
+  for (Tlb *tlb : {&itlb_, &dtlb_}) {
+    for (TlbEntry &entry : tlb->entries) {
+      entry.writable = false;
+    }
+  }
+  return image;
+}
+
+void Memory::Restore(const Image &image) {
+  if (shared_) {
+    throw std::logic_error("A shared memory cannot be restored");
+  }
+  storage_->page_table = image.page_table_;
+  storage_->block_count = image.block_count_;
+  FlushTlb();
+}
+
+void Memory::Share(Memory &other) {
+  if (other.block_size_ != block_size_) {
+    throw std::invalid_argument("Memories of different block sizes cannot be shared");
+  }
+  if (journal_ != nullptr || other.journal_ != nullptr) {
+    throw std::logic_error("A journaling memory cannot be shared");
+  }
+  {
+    // Sharers cache block pointers in their TLBs, so no block may move to a copy once shared: take
+    // the blocks back from any Image still pointing to them
+    std::unique_lock<std::mutex> lock = other.LockShared();
+    std::function<void(std::shared_ptr<PageTableNode> &)> own = [&](std::shared_ptr<PageTableNode> &node) {
+      if (!node) {
+        return;
+      }
+      if (node.use_count() > 1) {
+        node = std::make_shared<PageTableNode>(*node);
+      }
+      for (std::shared_ptr<PageTableNode> &child : node->children) {
+        own(child);
+      }
+      for (std::shared_ptr<MemoryBlock> &block : node->blocks) {
+        if (block && block.use_count() > 1) {
+          block = std::make_shared<MemoryBlock>(*block);
+        }
+      }
+    };
+    own(other.storage_->page_table);
+  }
+  storage_ = other.storage_;
+  shared_ = true;
+  other.shared_ = true;
+  FlushTlb();
+  other.FlushTlb();
+}
+
+void Memory::RestoreBlocks(const std::vector<BlockImage> &images) {
+  // Newest first, so a block journaled twice ends up with its oldest image
+  for (auto it = images.rbegin(); it != images.rend(); ++it) {
+    const BlockImage &image = *it;
+    MemoryBlock &block = EnsureBlockExists(image.block_index);
+    if (image.data.empty()) {
+      std::fill(block.data.begin(), block.data.end(), 0);
+    } else {
+      std::copy(image.data.begin(), image.data.end(), block.data.begin());
+    }
+  }
+}
+
+void Memory::ForEachBlock(const std::function<void(uint64_t, const MemoryBlock &)> &visitor) const {
+  std::function<void(const PageTableNode &, unsigned int, uint64_t)> walk =
+      [&](const PageTableNode &node, unsigned int level, uint64_t prefix) {
+    unsigned int bits = (level == 0) ? root_bits_ : kLevelBits;
+    if (level + 1 < levels_) {
+      for (size_t i = 0; i < node.children.size(); ++i) {
+        if (node.children[i]) {
+          walk(*node.children[i], level + 1, (prefix << bits) | i);
+        }
+      }
+    } else {
+      for (size_t i = 0; i < node.blocks.size(); ++i) {
+        if (node.blocks[i]) {
+          visitor((prefix << bits) | i, *node.blocks[i]);
+        }
+      }
+    }
+  };
+  if (storage_->page_table) {
+    walk(*storage_->page_table, 0, 0);
   }
 }
 
 template<typename T>
-T Memory::ReadGeneric(uint64_t address) {
+T Memory::ReadGeneric(uint64_t address, Tlb &tlb) {
+  uint64_t offset = GetBlockOffset(address);
+  if (offset + sizeof(T) <= block_size_) {
+    // Fast path: the whole value lives in one block
+    const MemoryBlock *block = LookupBlock(GetBlockIndex(address), tlb);
+    if (block == nullptr) {
+      return 0;
+    }
+    T value;
+    std::memcpy(&value, block->data.data() + offset, sizeof(T));
+    return value;
+  }
+
   T value = 0;
   for (size_t i = 0; i < sizeof(T); ++i) {
     value |= static_cast<T>(Read(address + i)) << (8*i);
@@ -69,6 +335,15 @@ T Memory::ReadGeneric(uint64_t address) {
 
 template<typename T>
 void Memory::WriteGeneric(uint64_t address, T value) {
+  uint64_t offset = GetBlockOffset(address);
+  if (offset + sizeof(T) <= block_size_) {
+    // Fast path: the whole value lives in one block
+    BreakReservations(address, sizeof(T));
+    MemoryBlock *block = WritableBlock(GetBlockIndex(address));
+    std::memcpy(block->data.data() + offset, &value, sizeof(T));
+    return;
+  }
+
   for (size_t i = 0; i < sizeof(T); ++i) {
     Write(address + i, static_cast<uint8_t>(value >> (8*i)));
   }
@@ -85,31 +360,35 @@ uint16_t Memory::ReadHalfWord(uint64_t address) {
   if (address >= memory_size_ - 1) {
     throw std::out_of_range(std::string("Memory address out of range: ") + std::to_string(address));
   }
-  return ReadGeneric<uint16_t>(address);
+  return ReadGeneric<uint16_t>(address, dtlb_);
 }
 
 uint32_t Memory::ReadWord(uint64_t address) {
   if (address >= memory_size_ - 3) {
     throw std::out_of_range(std::string("Memory address out of range: ") + std::to_string(address));
   }
-  return ReadGeneric<uint32_t>(address);
+  return ReadGeneric<uint32_t>(address, dtlb_);
 }
 
 uint64_t Memory::ReadDoubleWord(uint64_t address) {
   if (address >= memory_size_ - 7) {
     throw std::out_of_range(std::string("Memory address out of range: ") + std::to_string(address));
   }
-  return ReadGeneric<uint64_t>(address);
+  return ReadGeneric<uint64_t>(address, dtlb_);
+}
+
+uint32_t Memory::FetchWord(uint64_t address) {
+  if (address >= memory_size_ - 3) {
+    throw std::out_of_range(std::string("Memory address out of range: ") + std::to_string(address));
+  }
+  return ReadGeneric<uint32_t>(address, itlb_);
 }
 
 float Memory::ReadFloat(uint64_t address) {
   if (address >= memory_size_ - (sizeof(float) - 1)) {
     throw std::out_of_range(std::string("Memory address out of range: ") + std::to_string(address));;
   }
-  uint32_t value = 0;
-  for (size_t i = 0; i < sizeof(float); ++i) {
-    value |= static_cast<uint32_t>(Read(address + i)) << (8*i);
-  }
+  uint32_t value = ReadGeneric<uint32_t>(address, dtlb_);
   float result;
   std::memcpy(&result, &value, sizeof(float));
   return result;
@@ -119,10 +398,7 @@ double Memory::ReadDouble(uint64_t address) {
   if (address >= memory_size_ - (sizeof(double) - 1)) {
     throw std::out_of_range(std::string("Memory address out of range: ") + std::to_string(address));
   }
-  uint64_t value = 0;
-  for (size_t i = 0; i < sizeof(double); ++i) {
-    value |= static_cast<uint64_t>(Read(address + i)) << (8*i);
-  }
+  uint64_t value = ReadGeneric<uint64_t>(address, dtlb_);
   double result;
   std::memcpy(&result, &value, sizeof(double));
   return result;
@@ -162,9 +438,7 @@ void Memory::WriteFloat(uint64_t address, float value) {
   }
   uint32_t value_bits;
   std::memcpy(&value_bits, &value, sizeof(float));
-  for (size_t i = 0; i < sizeof(float); ++i) {
-    Write(address + i, static_cast<uint8_t>((value_bits >> (8*i)) & 0xFF));
-  }
+  WriteGeneric<uint32_t>(address, value_bits);
 }
 
 void Memory::WriteDouble(uint64_t address, double value) {
@@ -173,11 +447,76 @@ void Memory::WriteDouble(uint64_t address, double value) {
   }
   uint64_t value_bits;
   std::memcpy(&value_bits, &value, sizeof(double));
-  for (size_t i = 0; i < sizeof(double); ++i) {
-    Write(address + i, static_cast<uint8_t>((value_bits >> (8*i)) & 0xFF));
+  WriteGeneric<uint64_t>(address, value_bits);
+}
+
+template<typename T>
+T *Memory::AtomicTarget(uint64_t address, bool writable) {
+  if (address >= memory_size_ - (sizeof(T) - 1)) {
+    throw std::out_of_range(std::string("Memory address out of range: ") + std::to_string(address));
+  }
+  if (address % sizeof(T) != 0) {
+    throw std::invalid_argument(std::string("Misaligned atomic memory access: ") + std::to_string(address));
+  }
+  // Aligned values never straddle a block, and block data is allocated at least this aligned
+  MemoryBlock *block = writable ? WritableBlock(GetBlockIndex(address)) : LookupBlock(GetBlockIndex(address), dtlb_);
+  if (block == nullptr) {
+    return nullptr;
+  }
+  return reinterpret_cast<T *>(block->data.data() + GetBlockOffset(address));
+}
+
+template<typename T>
+T Memory::LoadReserved(uint64_t address, uint32_t &version) {
+  // The version is taken first: an SC or AMO between the two reads only makes the SC fail
+  version = Reservations().Version(address);
+  T *target = AtomicTarget<T>(address, false);
+  return target == nullptr ? 0 : std::atomic_ref<T>(*target).load();
+}
+
+template<typename T>
+bool Memory::StoreConditional(uint64_t address, uint32_t version, T expected, T value) {
+  T *target = AtomicTarget<T>(address, true);
+  if (!Reservations().Claim(address, version)) {
+    return false;
   }
+  return std::atomic_ref<T>(*target).compare_exchange_strong(expected, value);
 }
 
+template<typename T>
+T Memory::AtomicFetch(uint64_t address, AtomicOp op, T operand) {
+  using Signed = std::make_signed_t<T>;
+  std::atomic_ref<T> target(*AtomicTarget<T>(address, true));
+  Reservations().Invalidate(address);
+  switch (op) {
+    case AtomicOp::kSwap: return target.exchange(operand);
+    case AtomicOp::kAdd: return target.fetch_add(operand);
+    case AtomicOp::kXor: return target.fetch_xor(operand);
+    case AtomicOp::kAnd: return target.fetch_and(operand);
+    case AtomicOp::kOr: return target.fetch_or(operand);
+    default: break;
+  }
+  // The minimums and maximums have no host instruction; retry until no other hart got in between
+  T old = target.load();
+  T value;
+  do {
+    switch (op) {
+      case AtomicOp::kMin: value = static_cast<Signed>(old) < static_cast<Signed>(operand) ? old : operand; break;
+      case AtomicOp::kMax: value = static_cast<Signed>(old) > static_cast<Signed>(operand) ? old : operand; break;
+      case AtomicOp::kMinu: value = std::min(old, operand); break;
+      default: value = std::max(old, operand); break;
+    }
+  } while (!target.compare_exchange_weak(old, value));
+  return old;
+}
+
+template uint32_t Memory::LoadReserved<uint32_t>(uint64_t, uint32_t &);
+template uint64_t Memory::LoadReserved<uint64_t>(uint64_t, uint32_t &);
+template bool Memory::StoreConditional<uint32_t>(uint64_t, uint32_t, uint32_t, uint32_t);
+template bool Memory::StoreConditional<uint64_t>(uint64_t, uint32_t, uint64_t, uint64_t);
+template uint32_t Memory::AtomicFetch<uint32_t>(uint64_t, AtomicOp, uint32_t);
+template uint64_t Memory::AtomicFetch<uint64_t>(uint64_t, AtomicOp, uint64_t);
+
 void Memory::PrintMemory(const uint64_t address, unsigned int rows) {
   constexpr size_t bytes_per_row = 8; // One row equals 64 bytes
   std::cout << "Memory Dump at Address: 0x" << std::hex << address << std::dec << "\n";
@@ -272,15 +611,15 @@ void Memory::GetMemoryPoint(std::string addr_str) {
 void Memory::printMemoryUsage() const {
   std::cout << "Memory Usage Report:\n";
   std::cout << "---------------------\n";
-  std::cout << "Block Count: " << blocks_.size() << "\n";
-  for (const auto &[block_index, block] : blocks_) {
+  std::cout << "Block Count: " << storage_->block_count << "\n";
+  ForEachBlock([&](uint64_t block_index, const MemoryBlock &block) {
     size_t used_bytes = std::count_if(block.data.begin(), block.data.end(),
                                       [](uint8_t byte) { return byte!=0; });
     if (used_bytes > 0) {
       std::cout << "Block " << block_index << ": " << used_bytes
                 << " / " << block_size_ << " bytes used\n";
     }
-  }
+  });
 
 }
 
@@ -4,4 +4,23 @@
  * @author Vishank Singh, https://github.com/VishankSingh
  */
 
-#include "vm/memory_controller.h"
\ No newline at end of file
+#include "vm/memory_controller.h"
+
+void MemoryController::ChargeSlow(cache::AccessKind kind, uint64_t address, uint64_t size) {
+    if (kind == cache::AccessKind::Fetch) {
+        access_pc_ = address;
+    }
+    if (trace_) {
+        trace_->Record(kind, access_pc_, address, size);
+    }
+    if (caches_) {
+        switch (kind) {
+            case cache::AccessKind::Fetch: Stall(caches_->Fetch(address, size));
+                break;
+            case cache::AccessKind::Read: Stall(caches_->Read(address, size));
+                break;
+            case cache::AccessKind::Write: Stall(caches_->Write(address, size));
+                break;
+        }
+    }
+}
@@ -0,0 +1,306 @@
+/**
+ * @file ooo_core.cpp
+ * @brief Timing model of an out-of-order superscalar core.
+ */
+#include "vm/ooo/ooo_core.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <numeric>
+#include <stdexcept>
+
+namespace ooo {
+
+namespace {
+
+bool Overlaps(uint64_t address, uint64_t size, uint64_t other_address, uint64_t other_size) {
+  return address < other_address + other_size && other_address < address + size;
+}
+
+StallCause BackendCause(FuClass fu) {
+  switch (fu) {
+    case FuClass::Alu: return StallCause::Alu;
+    case FuClass::Mul: return StallCause::Mul;
+    case FuClass::Div: return StallCause::Div;
+    case FuClass::Load: return StallCause::Load;
+    case FuClass::Store: return StallCause::Store;
+    case FuClass::Fp: return StallCause::Fp;
+    case FuClass::FpDiv: return StallCause::FpDiv;
+    case FuClass::Bigmul: return StallCause::Bigmul;
+    case FuClass::Serial: return StallCause::Serialize;
+  }
+  return StallCause::Alu;
+}
+
+bool IsMemory(FuClass fu) {
+  return fu == FuClass::Load || fu == FuClass::Store || fu == FuClass::Bigmul;
+}
+
+} // namespace
+
+void CoreConfig::Validate() const {
+  const std::pair<const char *, uint64_t> at_least_one[] = {
+      {"width", width}, {"rob_size", rob_size}, {"rs_size", rs_size}, {"lsq_size", lsq_size},
+      {"alu_units", alu_units}, {"muldiv_units", muldiv_units}, {"fp_units", fp_units}, {"mem_ports", mem_ports},
+      {"alu_latency", alu_latency}, {"mul_latency", mul_latency}, {"div_latency", div_latency},
+      {"load_latency", load_latency}, {"fp_latency", fp_latency}, {"fp_div_latency", fp_div_latency}};
+  for (const auto &[name, value] : at_least_one) {
+    if (value == 0) {
+      throw std::invalid_argument(std::string("Out-of-order core ") + name + " must be at least 1");
+    }
+  }
+  // A divide holds its unit for its whole latency, which the unit calendars must be able to see at once
+  if (div_latency >= kSchedulerWindow || fp_div_latency >= kSchedulerWindow) {
+    throw std::invalid_argument("Out-of-order core divide latencies must be below "
+                                + std::to_string(kSchedulerWindow));
+  }
+}
+
+uint64_t CoreStats::StallCycles() const {
+  return std::accumulate(stalls.begin(), stalls.end(), uint64_t{0});
+}
+
+uint64_t Core::UnitCalendar::Used(uint64_t cycle) const {
+  const Slot &slot = slots_[cycle % kSchedulerWindow];
+  return slot.cycle == cycle ? slot.used : 0;
+}
+
+uint64_t Core::UnitCalendar::Reserve(uint64_t ready, uint64_t busy) {
+  uint64_t start = ready;
+  for (uint64_t cycle = start; cycle < start + busy; ++cycle) {
+    if (Used(cycle) >= units_) {
+      start = cycle + 1;
+    }
+  }
+  for (uint64_t cycle = start; cycle < start + busy; ++cycle) {
+    Slot &slot = slots_[cycle % kSchedulerWindow];
+    if (slot.cycle != cycle) {
+      slot = Slot{cycle, 0};
+    }
+    slot.used++;
+  }
+  return start;
+}
+
+void Core::UnitCalendar::Clear() {
+  std::fill(slots_.begin(), slots_.end(), Slot());
+}
+
+Core::Core(const CoreConfig &config)
+    : config_((config.Validate(), config)),
+      alu_(config.alu_units),
+      muldiv_(config.muldiv_units),
+      fp_(config.fp_units),
+      mem_(config.mem_ports) {}
+
+uint64_t Core::Latency(const InstructionRecord &record) const {
+  switch (record.fu) {
+    case FuClass::Alu:
+    case FuClass::Store:
+    case FuClass::Serial: return config_.alu_latency;
+    case FuClass::Mul: return config_.mul_latency;
+    case FuClass::Div: return config_.div_latency;
+    case FuClass::Load: return config_.load_latency + record.memory_stall;
+    case FuClass::Fp: return config_.fp_latency;
+    case FuClass::FpDiv: return config_.fp_div_latency;
+    case FuClass::Bigmul: return std::max<uint64_t>(record.unit_cycles, 1) + record.memory_stall;
+  }
+  return 1;
+}
+
+Core::UnitCalendar &Core::Units(FuClass fu) {
+  switch (fu) {
+    case FuClass::Mul:
+    case FuClass::Div: return muldiv_;
+    case FuClass::Fp:
+    case FuClass::FpDiv: return fp_;
+    case FuClass::Load:
+    case FuClass::Store: return mem_;
+    default: return alu_;
+  }
+}
+
+void Core::Feed(const InstructionRecord &record) {
+  // Fetch: width a cycle, a fetch group ending at a taken transfer, and no further ahead of dispatch
+  // than the front end holds
+  StallCause front_cause = StallCause::Frontend;
+  uint64_t fetch = fetch_cycle_;
+  if (group_ended_ || fetch_group_ == config_.width) {
+    fetch++;
+  }
+  if (dispatch_cycle_ > fetch + config_.frontend_depth) {
+    fetch = dispatch_cycle_ - config_.frontend_depth;
+  }
+  if (redirect_at_ > fetch) {
+    fetch = redirect_at_;
+    front_cause = StallCause::Mispredict;
+  }
+  if (record.fetch_stall != 0) {
+    fetch += record.fetch_stall;
+    front_cause = StallCause::ICache;
+  }
+  fetch_group_ = fetch == fetch_cycle_ ? fetch_group_ + 1 : 1;
+  fetch_cycle_ = fetch;
+  group_ended_ = record.taken;
+
+  // Dispatch: in order, width a cycle, into a free ROB, RS and LSQ entry
+  uint64_t dispatch = std::max(fetch + config_.frontend_depth, dispatch_cycle_);
+  if (dispatch == dispatch_cycle_ && dispatch_group_ == config_.width) {
+    dispatch++;
+  }
+  uint64_t serialize = record.fu == FuClass::Serial && committed_ ? commit_cycle_ + 1 : serialize_until_;
+  if (serialize > dispatch) {
+    dispatch = serialize;
+    front_cause = StallCause::Serialize;
+  }
+  if (rob_.size() == config_.rob_size && rob_.front() + 1 > dispatch) {
+    stats_.rob_full += rob_.front() + 1 - dispatch;
+    dispatch = rob_.front() + 1;
+  }
+  while (true) {
+    while (!rs_.empty() && rs_.top() < dispatch) {
+      rs_.pop();
+    }
+    if (rs_.size() < config_.rs_size) {
+      break;
+    }
+    stats_.rs_full += rs_.top() + 1 - dispatch;
+    dispatch = rs_.top() + 1;
+  }
+  bool memory = IsMemory(record.fu);
+  if (memory && lsq_.size() == config_.lsq_size && lsq_.front() + 1 > dispatch) {
+    stats_.lsq_full += lsq_.front() + 1 - dispatch;
+    dispatch = lsq_.front() + 1;
+  }
+  dispatch_group_ = dispatch == dispatch_cycle_ ? dispatch_group_ + 1 : 1;
+  dispatch_cycle_ = dispatch;
+
+  // Issue: once the operands are ready and a unit is free
+  uint64_t ready = dispatch + 1;
+  for (uint8_t source : record.sources) {
+    if (source != kNoRegister && source < kRegisters) {
+      ready = std::max(ready, register_ready_[source]);
+    }
+  }
+  if (record.fu == FuClass::Load) {
+    bool forwarded = false;
+    for (const StoreEntry &store : stores_) {
+      if (Overlaps(record.address, record.size, store.address, store.size)) {
+        ready = std::max(ready, store.complete);
+        forwarded = true;
+      }
+    }
+    stats_.store_forwards += forwarded;
+  } else if (record.fu == FuClass::Bigmul) {
+    for (const StoreEntry &store : stores_) {
+      ready = std::max(ready, store.complete);
+    }
+  }
+
+  uint64_t latency = Latency(record);
+  uint64_t issue;
+  if (record.fu == FuClass::Bigmul) {
+    issue = std::max(ready, bigmul_free_);
+    bigmul_free_ = issue + latency;
+  } else {
+    bool pipelined = record.fu != FuClass::Div && record.fu != FuClass::FpDiv;
+    issue = Units(record.fu).Reserve(ready, pipelined ? 1 : latency);
+  }
+  rs_.push(issue);
+  uint64_t complete = issue + latency;
+  if (record.destination != kNoRegister && record.destination != 0 && record.destination < kRegisters) {
+    register_ready_[record.destination] = complete;
+  }
+  if (record.fu == FuClass::Store) {
+    stores_.push_back({record.address, record.size, complete});
+  } else if (record.fu == FuClass::Bigmul) {
+    // LDBM and BIGMUL read and write memory the model does not see: younger loads wait for them
+    stores_.push_back({0, ~uint64_t{0}, complete});
+  }
+  if (stores_.size() > config_.lsq_size) {
+    stores_.pop_front();
+  }
+
+  // Commit: in order, width a cycle. The cycles since the last commit are blamed on this instruction,
+  // on the front end while it had not dispatched yet and on its class after
+  uint64_t commit = complete;
+  uint64_t idle_from = start_cycle_;
+  if (committed_) {
+    commit = std::max(commit, commit_cycle_);
+    if (commit == commit_cycle_ && commit_group_ == config_.width) {
+      commit++;
+    }
+    idle_from = commit_cycle_ + 1;
+  }
+  if (commit > idle_from) {
+    uint64_t idle = commit - idle_from;
+    uint64_t front = std::min(idle, dispatch > idle_from ? dispatch - idle_from : 0);
+    stats_.stalls[static_cast<size_t>(front_cause)] += front;
+    stats_.stalls[static_cast<size_t>(BackendCause(record.fu))] += idle - front;
+  }
+  commit_group_ = committed_ && commit == commit_cycle_ ? commit_group_ + 1 : 1;
+  commit_cycle_ = commit;
+  committed_ = true;
+  stats_.cycles = commit + 1;
+  stats_.instructions++;
+
+  rob_.push_back(commit);
+  if (rob_.size() > config_.rob_size) {
+    rob_.pop_front();
+  }
+  if (memory) {
+    lsq_.push_back(commit);
+    if (lsq_.size() > config_.lsq_size) {
+      lsq_.pop_front();
+    }
+  }
+  if (record.fu == FuClass::Serial) {
+    serialize_until_ = commit + 1;
+  }
+  if (record.mispredicted) {
+    stats_.mispredictions++;
+    redirect_at_ = complete + config_.redirect_penalty;
+  }
+}
+
+void Core::Restart() {
+  uint64_t next = committed_ ? commit_cycle_ + 1 : start_cycle_;
+  alu_.Clear();
+  muldiv_.Clear();
+  fp_.Clear();
+  mem_.Clear();
+  bigmul_free_ = 0;
+  fetch_cycle_ = next;
+  fetch_group_ = 0;
+  group_ended_ = false;
+  redirect_at_ = 0;
+  dispatch_cycle_ = next;
+  dispatch_group_ = 0;
+  serialize_until_ = 0;
+  commit_cycle_ = next;
+  commit_group_ = 0;
+  committed_ = false;
+  start_cycle_ = next;
+  register_ready_.fill(0);
+  rob_.clear();
+  lsq_.clear();
+  rs_ = {};
+  stores_.clear();
+}
+
+void Core::PrintStats(std::ostream &os) const {
+  os << "VM_OOO_STATS cycles=" << stats_.cycles
+     << " instructions=" << stats_.instructions
+     << " ipc=" << std::fixed << std::setprecision(3) << stats_.Ipc() << std::defaultfloat
+     << " stall_cycles=" << stats_.StallCycles();
+  for (size_t cause = 0; cause < stats_.stalls.size(); ++cause) {
+    os << " stall_" << stallCauseName(static_cast<StallCause>(cause)) << "=" << stats_.stalls[cause];
+  }
+  os << " rob_full=" << stats_.rob_full
+     << " rs_full=" << stats_.rs_full
+     << " lsq_full=" << stats_.lsq_full
+     << " store_forwards=" << stats_.store_forwards
+     << " mispredictions=" << stats_.mispredictions << std::endl;
+}
+
+} // namespace ooo
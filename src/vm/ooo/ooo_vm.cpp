@@ -0,0 +1,184 @@
+/**
+ * @file ooo_vm.cpp
+ * @brief Out-of-order VM implementation
+ */
+
+#include "vm/ooo/ooo_vm.h"
+
+#include "vm/rv5s/rv5s_control_unit.h"
+#include "utils.h"
+#include "config.h"
+
+ooo::FuClass OooVM::FuClassOf(const DecodedInstruction &decoded) {
+  switch (decoded.execution_class) {
+    case ExecutionClass::kLdbm:
+    case ExecutionClass::kBigmul: return ooo::FuClass::Bigmul;
+    case ExecutionClass::kCsr:
+    case ExecutionClass::kAtomic: // read-modify-write of shared memory, kept in order
+    case ExecutionClass::kSyscall: return ooo::FuClass::Serial;
+    default: break;
+  }
+  if (decoded.signals.mem_read) {
+    return ooo::FuClass::Load;
+  }
+  if (decoded.signals.mem_write) {
+    return ooo::FuClass::Store;
+  }
+  if (decoded.execution_class == ExecutionClass::kFloat || decoded.execution_class == ExecutionClass::kDouble) {
+    uint8_t funct5 = decoded.funct7 >> 2;
+    bool divide = decoded.opcode == 0b1010011 && (funct5 == 0b00011 || funct5 == 0b01011); // fdiv, fsqrt
+    return divide ? ooo::FuClass::FpDiv : ooo::FuClass::Fp;
+  }
+  if ((decoded.opcode == 0b0110011 || decoded.opcode == 0b0111011) && decoded.funct7 == 0b0000001) {
+    return decoded.funct3 < 0b100 ? ooo::FuClass::Mul : ooo::FuClass::Div;
+  }
+  return ooo::FuClass::Alu;
+}
+
+void OooVM::SyncCore() {
+  if (synced_ && synced_pc_ == program_counter_ && synced_retired_ == instructions_retired_
+      && synced_cycles_ == cycle_s_) {
+    return;
+  }
+  if (instructions_retired_ == 0 && cycle_s_ == 0) {
+    // A new program: pick up the configuration it was loaded with
+    core_ = ooo::Core(vm_config::config.getOooCoreConfig());
+  } else {
+    core_.Restart();
+  }
+}
+
+void OooVM::MarkSynced() {
+  synced_ = true;
+  synced_pc_ = program_counter_;
+  synced_retired_ = instructions_retired_;
+  synced_cycles_ = cycle_s_;
+}
+
+void OooVM::ExecuteInstruction() {
+  ooo::InstructionRecord record;
+  record.pc = program_counter_;
+  uint64_t mispredictions = branch_mispredictions_;
+
+  MaybeCheckpoint();
+  Fetch();
+  record.fetch_stall = memory_controller_.TakeStallCycles();
+  Decode();
+  Execute();
+  record.fu = FuClassOf(decoded_);
+  if (record.fu == ooo::FuClass::Load || record.fu == ooo::FuClass::Store) {
+    record.address = static_cast<uint64_t>(execution_result_);
+    record.size = uint64_t{1} << (decoded_.funct3 & 0b11);
+  }
+  WriteMemory();
+  WriteBack();
+  instructions_retired_++;
+
+  while (control_unit_.GetLdbmStart() && !bigmul_unit_.GetLdbmDone()) {
+    WriteMemory(); // LDBM loading
+    record.unit_cycles++;
+  }
+  while (control_unit_.GetBigmulStart() && !bigmul_unit_.GetBigmulDone()) {
+    if (!bigmul_unit_.GetWriteDone()) {
+      WriteMemory(); // BIGMUL result writing
+    } else {
+      bigmul_unit_.executeBigmul();
+    }
+    record.unit_cycles++;
+  }
+  record.memory_stall = memory_controller_.TakeStallCycles();
+
+  RegisterUse registers = RV5SControlUnit::GetRegisterUse(decoded_);
+  record.sources = registers.sources;
+  record.destination = registers.destination;
+  record.taken = program_counter_ != record.pc + 4;
+  record.mispredicted = branch_mispredictions_ != mispredictions;
+
+  uint64_t cycles = core_.GetCycles();
+  uint64_t stalls = core_.GetStats().StallCycles();
+  core_.Feed(record);
+  cycle_s_ += core_.GetCycles() - cycles;
+  stall_cycles_ += core_.GetStats().StallCycles() - stalls;
+  UpdateCpi();
+}
+
+bool OooVM::StepWithUndo() {
+  BeginStepDelta();
+  ExecuteInstruction();
+  EndStepDelta();
+  return true;
+}
+
+void OooVM::ReportOooStats() {
+  core_.PrintStats(Console());
+}
+
+uint64_t OooVM::RunInstructions(uint64_t count) {
+  SyncCore();
+  uint64_t instruction_executed = 0;
+
+  while (!stop_requested_ && program_counter_ < program_size_) {
+    if (instruction_executed >= count) {
+      break;
+    }
+    ExecuteInstruction();
+    instruction_executed++;
+    if (!silent_run_) {
+      Console() << "Program Counter: " << program_counter_ << std::endl;
+    }
+  }
+  MarkSynced();
+  // Running is not undoable; drop what the stages recorded
+  current_delta_ = StepDelta();
+  return instruction_executed;
+}
+
+void OooVM::Run() {
+  ClearStop();
+  RunInstructions(RunLimit());
+  FlushSyscallOutput();
+  if (program_counter_ >= program_size_) {
+    Console() << "VM_PROGRAM_END" << std::endl;
+    output_status_ = "VM_PROGRAM_END";
+    ReportOooStats();
+  }
+  DumpRegisters(output_paths_.registers_dump, registers_);
+  DumpState(output_paths_.vm_state_dump);
+}
+
+void OooVM::DebugRun() {
+  SyncCore();
+  RVSSVM::DebugRun();
+  MarkSynced();
+  if (program_counter_ >= program_size_) {
+    ReportOooStats();
+  }
+}
+
+void OooVM::Step() {
+  SyncCore();
+  if (program_counter_ < program_size_) {
+    StepWithUndo();
+    Console() << "Program Counter: " << std::hex << program_counter_ << std::dec << std::endl;
+    if (program_counter_ < program_size_) {
+      Console() << "VM_STEP_COMPLETED" << std::endl;
+      output_status_ = "VM_STEP_COMPLETED";
+    } else {
+      Console() << "VM_LAST_INSTRUCTION_STEPPED" << std::endl;
+      output_status_ = "VM_LAST_INSTRUCTION_STEPPED";
+      ReportOooStats();
+    }
+  } else {
+    Console() << "VM_PROGRAM_END" << std::endl;
+    output_status_ = "VM_PROGRAM_END";
+  }
+  MarkSynced();
+  DumpRegisters(output_paths_.registers_dump, registers_);
+  DumpState(output_paths_.vm_state_dump);
+}
+
+void OooVM::Reset() {
+  RVSSVM::Reset();
+  core_ = ooo::Core(vm_config::config.getOooCoreConfig());
+  MarkSynced();
+}
@@ -15,10 +15,12 @@
 RegisterFile::RegisterFile() = default;
 
 void RegisterFile::Reset() {
+  uint64_t hart_id = csr_[kMhartid];
   gpr_.fill(0);
   fpr_.fill(0.0);
   csr_.fill(0);
   csr_[0x002] = 0b000; // Default: RNE (IEEE 754)
+  csr_[kMhartid] = hart_id;
 }
 
 uint64_t RegisterFile::ReadGpr(size_t reg) const {
@@ -50,6 +52,7 @@ uint64_t RegisterFile::ReadCsr(size_t reg) const {
 
 void RegisterFile::WriteCsr(size_t reg, uint64_t value) {
   if (reg >= NUM_CSR) throw std::out_of_range("Invalid CSR index");
+  if ((reg >> 10) == 0b11) return; // read-only
   csr_[reg] = value;
 }
 
@@ -105,13 +108,14 @@ const std::unordered_set<std::string> valid_floating_point_registers = {
 };
 
 const std::unordered_set<std::string> valid_csr_registers = {
-    "fflags", "frm", "fcsr"
+    "fflags", "frm", "fcsr", "mhartid"
 };
 
 const std::unordered_map<std::string, int> csr_to_address{
     {"fflags", 0x001},
     {"frm", 0x002},
     {"fcsr", 0x003},
+    {"mhartid", 0xF14},
 };
 
 const std::unordered_map<std::string, std::string> reg_alias_to_name = {
@@ -251,6 +255,7 @@ const std::unordered_map<std::string, std::string> reg_alias_to_name = {
     {"fflags", "fflags"},
     {"frm", "frm"},
     {"fcsr", "fcsr"},
+    {"mhartid", "mhartid"},
 
 };
 
@@ -0,0 +1,118 @@
+/**
+ * @file rv5s_control_unit.cpp
+ * @brief RV5S Control Unit implementation
+ */
+
+#include "vm/rv5s/rv5s_control_unit.h"
+
+namespace {
+
+uint8_t Gpr(uint8_t index) {
+  return index == 0 ? RegisterUse::kNoRegister : index;
+}
+
+uint8_t Fpr(uint8_t index) {
+  return static_cast<uint8_t>(RegisterUse::kFprBase + index);
+}
+
+} // namespace
+
+RegisterUse RV5SControlUnit::GetRegisterUse(const DecodedInstruction &decoded) {
+  RegisterUse use;
+  const uint8_t rd = decoded.rd;
+  const uint8_t rs1 = decoded.rs1;
+  const uint8_t rs2 = decoded.rs2;
+
+  switch (decoded.opcode) {
+    case 0b0110111: // lui
+    case 0b0010111: // auipc
+    case 0b1101111: // jal
+      use.destination = Gpr(rd);
+      break;
+    case 0b1100111: // jalr
+    case 0b0010011: // I-type ALU
+    case 0b0011011: // I-type ALU, word
+      use.destination = Gpr(rd);
+      use.sources = {Gpr(rs1), RegisterUse::kNoRegister, RegisterUse::kNoRegister};
+      break;
+    case 0b0000011: // loads
+      use.destination = Gpr(rd);
+      use.sources = {Gpr(rs1), RegisterUse::kNoRegister, RegisterUse::kNoRegister};
+      use.is_load = true;
+      break;
+    case 0b0101111: // lr, sc, amos
+      use.destination = Gpr(rd);
+      use.sources = {Gpr(rs1), Gpr(rs2), RegisterUse::kNoRegister};
+      use.is_load = true;
+      break;
+    case 0b0110011: // R-type
+    case 0b0111011: // R-type, word
+      use.destination = Gpr(rd);
+      use.sources = {Gpr(rs1), Gpr(rs2), RegisterUse::kNoRegister};
+      break;
+    case 0b1100011: // branches
+    case 0b0100011: // stores
+    case 0b0101010: // ldbm
+    case 0b0111111: // bigmul
+      use.sources = {Gpr(rs1), Gpr(rs2), RegisterUse::kNoRegister};
+      break;
+    case 0b0000111: // flw, fld
+      use.destination = Fpr(rd);
+      use.sources = {Gpr(rs1), RegisterUse::kNoRegister, RegisterUse::kNoRegister};
+      use.is_load = true;
+      break;
+    case 0b0100111: // fsw, fsd
+      use.sources = {Gpr(rs1), Fpr(rs2), RegisterUse::kNoRegister};
+      break;
+    case 0b1000011: // fmadd
+    case 0b1000111: // fmsub
+    case 0b1001011: // fnmsub
+    case 0b1001111: // fnmadd
+      use.destination = Fpr(rd);
+      use.sources = {Fpr(rs1), Fpr(rs2), Fpr(decoded.rs3)};
+      break;
+    case 0b1010011: { // OP-FP, by funct5
+      switch (decoded.funct7 >> 2) {
+        case 0b11000: // fcvt to integer
+        case 0b11100: // fmv.x, fclass
+          use.destination = Gpr(rd);
+          use.sources[0] = Fpr(rs1);
+          break;
+        case 0b11010: // fcvt from integer
+        case 0b11110: // fmv from integer
+          use.destination = Fpr(rd);
+          use.sources[0] = Gpr(rs1);
+          break;
+        case 0b10100: // feq, flt, fle
+          use.destination = Gpr(rd);
+          use.sources = {Fpr(rs1), Fpr(rs2), RegisterUse::kNoRegister};
+          break;
+        case 0b01011: // fsqrt
+        case 0b01000: // fcvt between precisions
+          use.destination = Fpr(rd);
+          use.sources[0] = Fpr(rs1);
+          break;
+        default:
+          use.destination = Fpr(rd);
+          use.sources = {Fpr(rs1), Fpr(rs2), RegisterUse::kNoRegister};
+          break;
+      }
+      break;
+    }
+    case 0b1110011: { // ecall and CSR instructions
+      if (decoded.funct3 == 0) {
+        use.destination = 10;
+        use.sources = {17, 10, 11};
+      } else {
+        use.destination = Gpr(rd);
+        if (decoded.funct3 < 0b100) {
+          use.sources[0] = Gpr(rs1);
+        }
+      }
+      break;
+    }
+    default:
+      break;
+  }
+  return use;
+}
@@ -0,0 +1,285 @@
+/**
+ * @file rv5s_vm.cpp
+ * @brief RV5S VM implementation
+ */
+
+#include "vm/rv5s/rv5s_vm.h"
+
+#include "utils.h"
+#include "config.h"
+
+#include <iomanip>
+
+void RV5SVM::FlushPipeline() {
+  if_id_ = PipelineSlot();
+  id_ex_ = PipelineSlot();
+  ex_mem_ = PipelineSlot();
+  mem_wb_ = PipelineSlot();
+  fetch_pc_ = program_counter_;
+}
+
+void RV5SVM::SyncPipeline() {
+  if (!synced_ || synced_pc_ != program_counter_ || synced_retired_ != instructions_retired_
+      || synced_cycles_ != cycle_s_) {
+    FlushPipeline();
+  }
+}
+
+void RV5SVM::MarkSynced() {
+  synced_ = true;
+  synced_pc_ = program_counter_;
+  synced_retired_ = instructions_retired_;
+  synced_cycles_ = cycle_s_;
+}
+
+bool RV5SVM::UnitBusy() const {
+  if (!id_ex_.valid || !id_ex_.executed) {
+    return false;
+  }
+  const ControlSignals &signals = id_ex_.decoded.signals;
+  return (signals.ldbm_start && !bigmul_unit_.GetLdbmDone())
+      || (signals.bigmul_start && !bigmul_unit_.GetBigmulDone());
+}
+
+void RV5SVM::StepUnit() {
+  // Fetch decodes into the control unit too; bring back the signals of the instruction in EX
+  control_unit_.LoadControlSignals(id_ex_.decoded.signals);
+  if (id_ex_.decoded.signals.ldbm_start || !bigmul_unit_.GetWriteDone()) {
+    WriteMemory(); // LDBM loading or BIGMUL result writing
+  } else {
+    bigmul_unit_.executeBigmul();
+  }
+}
+
+void RV5SVM::CountForwards(const PipelineSlot &slot) {
+  for (uint8_t source : slot.registers.sources) {
+    if (source == RegisterUse::kNoRegister) {
+      continue;
+    }
+    if (ex_mem_.valid && ex_mem_.registers.destination == source) {
+      pipeline_stats_.forwards_ex_mem++;
+    } else if (mem_wb_.valid && mem_wb_.registers.destination == source) {
+      pipeline_stats_.forwards_mem_wb++;
+    }
+  }
+}
+
+void RV5SVM::ExecuteSlot(PipelineSlot &slot) {
+  MaybeCheckpoint();
+  // Decode again rather than trust IF: a store ahead of this instruction may have rewritten it
+  DecodedInstruction *cached = decode_cache_.Find(program_counter_);
+  if (cached != nullptr && cached->valid) {
+    decoded_ = *cached;
+  } else {
+    Predecode(memory_controller_.ReadWord_d(program_counter_), decoded_);
+    if (cached != nullptr) {
+      *cached = decoded_;
+    }
+  }
+  slot.decoded = decoded_;
+  current_instruction_ = decoded_.instruction;
+  UpdateProgramCounter(4);
+  Decode();
+  fetch_prediction_ = slot.predicted_pc;
+  Execute();
+  fetch_prediction_.reset();
+  WriteMemory();
+  WriteBack();
+  instructions_retired_++;
+}
+
+void RV5SVM::FetchSlot(PipelineSlot &slot) {
+  if (fetch_pc_ >= program_size_) {
+    slot = PipelineSlot();
+    return;
+  }
+  DecodedInstruction *cached = decode_cache_.Find(fetch_pc_);
+  if (cached != nullptr && cached->valid) {
+    slot.decoded = *cached;
+    memory_controller_.ChargeFetch(fetch_pc_);
+  } else {
+    Predecode(memory_controller_.FetchWord(fetch_pc_), slot.decoded);
+    if (cached != nullptr) {
+      *cached = slot.decoded;
+    }
+  }
+  slot.valid = true;
+  slot.executed = false;
+  slot.pc = fetch_pc_;
+  slot.registers = RV5SControlUnit::GetRegisterUse(slot.decoded);
+  slot.predicted_pc = fetch_pc_ + 4;
+  ExecutionClass execution_class = slot.decoded.execution_class;
+  if (execution_class == ExecutionClass::kBranch || execution_class == ExecutionClass::kJal
+      || execution_class == ExecutionClass::kJalr) {
+    slot.predicted_pc = branch_predictor_.Predict(fetch_pc_, BranchKindOf(slot.decoded),
+                                                  fetch_pc_ + static_cast<int64_t>(slot.decoded.imm));
+  }
+  fetch_pc_ = slot.predicted_pc;
+}
+
+bool RV5SVM::Clock() {
+  bool executed = false;
+  bool redirect = false;
+
+  // EX: execute the instruction, or keep it while the LDBM/BIGMUL unit works
+  PipelineSlot next_ex_mem;
+  bool ex_held = false;
+  if (id_ex_.valid) {
+    // IF ran ahead last cycle, maybe down a path about to be squashed
+    memory_controller_.SetAccessPc(id_ex_.pc);
+    if (id_ex_.executed) {
+      StepUnit();
+      pipeline_stats_.unit_stall_cycles++;
+      stall_cycles_++;
+    } else {
+      CountForwards(id_ex_);
+      ExecuteSlot(id_ex_);
+      id_ex_.executed = true;
+      executed = true;
+      redirect = program_counter_ != id_ex_.predicted_pc;
+    }
+    ex_held = UnitBusy();
+    if (!ex_held) {
+      next_ex_mem = id_ex_;
+    }
+  }
+
+  // ID and IF: hold behind a busy EX, insert a bubble on a load-use hazard, or move along
+  PipelineSlot next_id_ex;
+  PipelineSlot next_if_id = if_id_;
+  if (ex_held) {
+    next_id_ex = id_ex_;
+  } else if (if_id_.valid && id_ex_.valid && id_ex_.registers.is_load
+             && if_id_.registers.Reads(id_ex_.registers.destination)) {
+    pipeline_stats_.load_use_stalls++;
+    stall_cycles_++;
+  } else {
+    next_id_ex = if_id_;
+    FetchSlot(next_if_id);
+  }
+
+  // A mispredicted branch or jump squashes what fetch took after it
+  if (redirect) {
+    uint64_t squashed = next_id_ex.valid + next_if_id.valid;
+    next_id_ex = PipelineSlot();
+    next_if_id = PipelineSlot();
+    fetch_pc_ = program_counter_;
+    pipeline_stats_.flushes++;
+    pipeline_stats_.squashed += squashed;
+    stall_cycles_ += squashed;
+  }
+
+  // WB retires mem_wb_; its architectural effect happened in EX
+  mem_wb_ = ex_mem_;
+  ex_mem_ = next_ex_mem;
+  id_ex_ = next_id_ex;
+  if_id_ = next_if_id;
+  AdvanceCycle();
+  return executed;
+}
+
+bool RV5SVM::StepWithUndo() {
+  BeginStepDelta();
+
+  bool executed = false;
+  while (!executed || UnitBusy()) {
+    if (PipelineEmpty() && fetch_pc_ >= program_size_) {
+      current_delta_ = StepDelta();
+      return false;
+    }
+    executed = Clock() || executed;
+  }
+  // Count the last instruction's way through MEM and WB
+  if (program_counter_ >= program_size_) {
+    while (!PipelineEmpty()) {
+      Clock();
+    }
+  }
+
+  EndStepDelta();
+  return true;
+}
+
+void RV5SVM::ReportPipelineStats() {
+  Console() << "VM_PIPELINE_STATS cycles=" << cycle_s_
+            << " instructions=" << instructions_retired_
+            << " cpi=" << std::fixed << std::setprecision(3) << cpi_ << std::defaultfloat
+            << " stall_cycles=" << stall_cycles_
+            << " load_use_stalls=" << pipeline_stats_.load_use_stalls
+            << " unit_stall_cycles=" << pipeline_stats_.unit_stall_cycles
+            << " flushes=" << pipeline_stats_.flushes
+            << " squashed=" << pipeline_stats_.squashed
+            << " forwards_ex_mem=" << pipeline_stats_.forwards_ex_mem
+            << " forwards_mem_wb=" << pipeline_stats_.forwards_mem_wb << std::endl;
+}
+
+uint64_t RV5SVM::RunInstructions(uint64_t count) {
+  SyncPipeline();
+  uint64_t instruction_executed = 0;
+
+  while (!stop_requested_ && !(PipelineEmpty() && fetch_pc_ >= program_size_)) {
+    if (instruction_executed >= count) {
+      break;
+    }
+    if (Clock()) {
+      instruction_executed++;
+      if (!silent_run_) {
+        Console() << "Program Counter: " << program_counter_ << std::endl;
+      }
+    }
+  }
+  MarkSynced();
+  // Running is not undoable; drop what the stages recorded
+  current_delta_ = StepDelta();
+  return instruction_executed;
+}
+
+void RV5SVM::Run() {
+  ClearStop();
+  RunInstructions(RunLimit());
+  FlushSyscallOutput();
+  if (program_counter_ >= program_size_) {
+    Console() << "VM_PROGRAM_END" << std::endl;
+    output_status_ = "VM_PROGRAM_END";
+    ReportPipelineStats();
+  }
+  DumpRegisters(output_paths_.registers_dump, registers_);
+  DumpState(output_paths_.vm_state_dump);
+}
+
+void RV5SVM::DebugRun() {
+  SyncPipeline();
+  RVSSVM::DebugRun();
+  MarkSynced();
+  if (program_counter_ >= program_size_) {
+    ReportPipelineStats();
+  }
+}
+
+void RV5SVM::Step() {
+  SyncPipeline();
+  if (program_counter_ < program_size_ && StepWithUndo()) {
+    Console() << "Program Counter: " << std::hex << program_counter_ << std::dec << std::endl;
+    if (program_counter_ < program_size_) {
+      Console() << "VM_STEP_COMPLETED" << std::endl;
+      output_status_ = "VM_STEP_COMPLETED";
+    } else {
+      Console() << "VM_LAST_INSTRUCTION_STEPPED" << std::endl;
+      output_status_ = "VM_LAST_INSTRUCTION_STEPPED";
+      ReportPipelineStats();
+    }
+  } else if (program_counter_ >= program_size_) {
+    Console() << "VM_PROGRAM_END" << std::endl;
+    output_status_ = "VM_PROGRAM_END";
+  }
+  MarkSynced();
+  DumpRegisters(output_paths_.registers_dump, registers_);
+  DumpState(output_paths_.vm_state_dump);
+}
+
+void RV5SVM::Reset() {
+  RVSSVM::Reset();
+  pipeline_stats_ = PipelineStats();
+  FlushPipeline();
+  MarkSynced();
+}
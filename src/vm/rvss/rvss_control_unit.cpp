@@ -41,6 +41,13 @@ void RVSSControlUnit::SetControlSignals(uint32_t instruction) {
       bigmul_start_ = true;
       break;
     }
+    case 0b0101111: {// A extension (LR, SC, AMOs): read, maybe write, and write rd
+      mem_to_reg_ = true;
+      reg_write_ = true;
+      mem_read_ = true;
+      mem_write_ = true;
+      break;
+    }
     case 0b0000011: 
     
     
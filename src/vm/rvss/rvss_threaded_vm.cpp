@@ -0,0 +1,341 @@
+/**
+ * @file rvss_threaded_vm.cpp
+ * @brief Single-cycle VM with a threaded-dispatch interpreter core
+ */
+
+#include "vm/rvss/rvss_threaded_vm.h"
+
+#include "utils.h"
+#include "globals.h"
+#include "common/instructions.h"
+#include "config.h"
+
+#include <cstdint>
+#include <iostream>
+#include <tuple>
+
+using instruction_set::Instruction;
+using instruction_set::get_instr_encoding;
+
+const RVSSThreadedVM::HandlerFunction RVSSThreadedVM::kHandlers[kHandlerCount] = {
+  &RVSSThreadedVM::HandleGeneric,
+  &RVSSThreadedVM::HandleAlu,
+  &RVSSThreadedVM::HandleLoad,
+  &RVSSThreadedVM::HandleStore,
+  &RVSSThreadedVM::HandleBranch,
+  &RVSSThreadedVM::HandleJal,
+  &RVSSThreadedVM::HandleJalr,
+  &RVSSThreadedVM::HandleLui,
+  &RVSSThreadedVM::HandleAuipc,
+};
+
+void RVSSThreadedVM::Predecode(uint32_t instruction, DecodedInstruction &decoded) {
+  RVSSVM::Predecode(instruction, decoded);
+
+  switch (decoded.execution_class) {
+    case ExecutionClass::kBranch: decoded.handler = kBranchHandler; break;
+    case ExecutionClass::kJal: decoded.handler = kJalHandler; break;
+    case ExecutionClass::kJalr: decoded.handler = kJalrHandler; break;
+    case ExecutionClass::kAuipc: decoded.handler = kAuipcHandler; break;
+    case ExecutionClass::kInteger: {
+      switch (decoded.opcode) {
+        case get_instr_encoding(Instruction::kRtype).opcode:
+        case get_instr_encoding(Instruction::kItype).opcode: decoded.handler = kAluHandler; break;
+        case get_instr_encoding(Instruction::kLoadType).opcode: decoded.handler = kLoadHandler; break;
+        case 0b0100011: decoded.handler = kStoreHandler; break;
+        case get_instr_encoding(Instruction::klui).opcode: decoded.handler = kLuiHandler; break;
+        default: decoded.handler = kGenericHandler; break;
+      }
+      break;
+    }
+    default: decoded.handler = kGenericHandler; break;
+  }
+}
+
+void RVSSThreadedVM::ComputeAluResult(const DecodedInstruction &decoded) {
+  uint64_t reg1_value = registers_.ReadGpr(decoded.rs1);
+  uint64_t reg2_value = decoded.signals.alu_src
+                        ? static_cast<uint64_t>(static_cast<int64_t>(decoded.imm))
+                        : registers_.ReadGpr(decoded.rs2);
+  bool overflow = false;
+  std::tie(execution_result_, overflow) = alu_.execute(decoded.alu_op, reg1_value, reg2_value);
+}
+
+void RVSSThreadedVM::HandleGeneric(const DecodedInstruction &decoded) {
+  decoded_ = decoded;
+  Decode();
+  Execute();
+  WriteMemory();
+  WriteBack();
+}
+
+void RVSSThreadedVM::HandleAlu(const DecodedInstruction &decoded) {
+  ComputeAluResult(decoded);
+  if (decoded.signals.reg_write) {
+    registers_.WriteGpr(decoded.rd, execution_result_);
+  }
+}
+
+void RVSSThreadedVM::HandleLoad(const DecodedInstruction &decoded) {
+  ComputeAluResult(decoded);
+  if (decoded.signals.mem_read) {
+    switch (decoded.funct3) {
+      case 0b000: memory_result_ = static_cast<int8_t>(memory_controller_.ReadByte(execution_result_)); break; // LB
+      case 0b001: memory_result_ = static_cast<int16_t>(memory_controller_.ReadHalfWord(execution_result_)); break; // LH
+      case 0b010: memory_result_ = static_cast<int32_t>(memory_controller_.ReadWord(execution_result_)); break; // LW
+      case 0b011: memory_result_ = memory_controller_.ReadDoubleWord(execution_result_); break; // LD
+      case 0b100: memory_result_ = static_cast<uint8_t>(memory_controller_.ReadByte(execution_result_)); break; // LBU
+      case 0b101: memory_result_ = static_cast<uint16_t>(memory_controller_.ReadHalfWord(execution_result_)); break; // LHU
+      case 0b110: memory_result_ = static_cast<uint32_t>(memory_controller_.ReadWord(execution_result_)); break; // LWU
+      default: break;
+    }
+  }
+  if (decoded.signals.reg_write) {
+    registers_.WriteGpr(decoded.rd, memory_result_);
+  }
+}
+
+void RVSSThreadedVM::HandleStore(const DecodedInstruction &decoded) {
+  ComputeAluResult(decoded);
+  if (!decoded.signals.mem_write) {
+    return;
+  }
+  uint64_t value = registers_.ReadGpr(decoded.rs2);
+  switch (decoded.funct3) {
+    case 0b000: memory_controller_.WriteByte(execution_result_, value & 0xFF); break; // SB
+    case 0b001: memory_controller_.WriteHalfWord(execution_result_, value & 0xFFFF); break; // SH
+    case 0b010: memory_controller_.WriteWord(execution_result_, value & 0xFFFFFFFF); break; // SW
+    case 0b011: memory_controller_.WriteDoubleWord(execution_result_, value); break; // SD
+    default: break;
+  }
+}
+
+void RVSSThreadedVM::HandleBranch(const DecodedInstruction &decoded) {
+  ComputeAluResult(decoded);
+  uint64_t pc = program_counter_ - 4;
+  if (decoded.signals.branch) {
+    switch (decoded.funct3) {
+      case 0b000: branch_flag_ = (execution_result_==0); break; // BEQ
+      case 0b001: branch_flag_ = (execution_result_!=0); break; // BNE
+      case 0b100: branch_flag_ = (execution_result_==1); break; // BLT
+      case 0b101: branch_flag_ = (execution_result_==0); break; // BGE
+      case 0b110: branch_flag_ = (execution_result_==1); break; // BLTU
+      case 0b111: branch_flag_ = (execution_result_==0); break; // BGEU
+      default: break;
+    }
+  }
+  if (branch_flag_) {
+    UpdateProgramCounter(-4);
+    UpdateProgramCounter(decoded.imm);
+  }
+  if (decoded.signals.branch) {
+    ResolveBranch(pc, decoded);
+  }
+}
+
+void RVSSThreadedVM::HandleJal(const DecodedInstruction &decoded) {
+  ComputeAluResult(decoded);
+  if (decoded.signals.branch) {
+    next_pc_ = static_cast<int64_t>(program_counter_);
+    UpdateProgramCounter(-4);
+    return_address_ = program_counter_ + 4;
+    UpdateProgramCounter(decoded.imm);
+    ResolveBranch(next_pc_ - 4, decoded);
+  }
+  if (decoded.signals.reg_write) {
+    registers_.WriteGpr(decoded.rd, next_pc_);
+  }
+}
+
+void RVSSThreadedVM::HandleJalr(const DecodedInstruction &decoded) {
+  ComputeAluResult(decoded);
+  if (decoded.signals.branch) {
+    next_pc_ = static_cast<int64_t>(program_counter_);
+    UpdateProgramCounter(-4);
+    return_address_ = program_counter_ + 4;
+    UpdateProgramCounter(-program_counter_ + (execution_result_));
+    ResolveBranch(next_pc_ - 4, decoded);
+  }
+  if (decoded.signals.reg_write) {
+    registers_.WriteGpr(decoded.rd, next_pc_);
+  }
+}
+
+void RVSSThreadedVM::HandleLui(const DecodedInstruction &decoded) {
+  ComputeAluResult(decoded);
+  if (decoded.signals.reg_write) {
+    registers_.WriteGpr(decoded.rd, (decoded.imm << 12));
+  }
+}
+
+void RVSSThreadedVM::HandleAuipc(const DecodedInstruction &decoded) {
+  ComputeAluResult(decoded);
+  execution_result_ = static_cast<int64_t>(program_counter_) - 4 + (decoded.imm << 12);
+  if (decoded.signals.reg_write) {
+    registers_.WriteGpr(decoded.rd, execution_result_);
+  }
+}
+
+void RVSSThreadedVM::FlushBlocks() {
+  blocks_.clear();
+  blocks_.resize(decode_cache_.GetSize() / 4);
+  blocks_generation_ = decode_cache_.GetGeneration();
+}
+
+RVSSThreadedVM::BasicBlock *RVSSThreadedVM::LookupBlock(uint64_t start_pc) {
+  if (decode_cache_.Find(start_pc) == nullptr) {
+    return nullptr;
+  }
+  std::unique_ptr<BasicBlock> &slot = blocks_[(start_pc - decode_cache_.GetBase()) >> 2];
+  if (slot) {
+    return slot.get();
+  }
+
+  auto block = std::make_unique<BasicBlock>();
+  block->start_pc = start_pc;
+  for (uint64_t pc = start_pc; block->ops.size() < kMaxBlockLength; pc += 4) {
+    DecodedInstruction *entry = decode_cache_.Find(pc);
+    if (entry == nullptr) {
+      break;
+    }
+    if (!entry->valid) {
+      Predecode(memory_controller_.FetchWord(pc), *entry);
+    }
+    block->ops.push_back({kHandlers[entry->handler], *entry});
+
+    ExecutionClass execution_class = entry->execution_class;
+    if (execution_class == ExecutionClass::kBranch || execution_class == ExecutionClass::kJal ||
+        execution_class == ExecutionClass::kJalr || execution_class == ExecutionClass::kSyscall ||
+        execution_class == ExecutionClass::kLdbm || execution_class == ExecutionClass::kBigmul) {
+      break;
+    }
+  }
+  slot = std::move(block);
+  return slot.get();
+}
+
+RVSSThreadedVM::BasicBlock *RVSSThreadedVM::NextBlock(BasicBlock *previous, uint64_t start_pc) {
+  if (blocks_generation_ != decode_cache_.GetGeneration() || blocks_.size() != decode_cache_.GetSize() / 4) {
+    FlushBlocks();
+    previous = nullptr;
+  }
+
+  if (previous != nullptr) {
+    for (BasicBlock *successor : previous->successors) {
+      if (successor != nullptr && successor->start_pc == start_pc) {
+        return successor;
+      }
+    }
+  }
+
+  BasicBlock *block = LookupBlock(start_pc);
+  if (previous != nullptr && block != nullptr) {
+    // A block has at most two successors: taken and fall-through
+    if (previous->successors[0] == nullptr) {
+      previous->successors[0] = block;
+    } else {
+      previous->successors[1] = block;
+    }
+  }
+  return block;
+}
+
+void RVSSThreadedVM::StepInstruction() {
+  DecodedInstruction *decoded = decode_cache_.Find(program_counter_);
+  if (decoded == nullptr || !decoded->valid) {
+    if (decoded == nullptr) {
+      decoded = &decoded_;
+    }
+    Predecode(memory_controller_.FetchWord(program_counter_), *decoded);
+  } else {
+    memory_controller_.ChargeFetch(program_counter_);
+  }
+  current_instruction_ = decoded->instruction;
+  UpdateProgramCounter(4);
+  control_unit_.LoadControlSignals(decoded->signals);
+
+  (this->*kHandlers[decoded->handler])(*decoded);
+}
+
+uint64_t RVSSThreadedVM::RunInstructions(uint64_t count) {
+  uint64_t instruction_executed = 0;
+  BasicBlock *block = nullptr;
+
+  while (!stop_requested_ && program_counter_ < program_size_) {
+    if (instruction_executed >= count) {
+      break;
+    }
+
+    // Custom instruction stall logic, identical to RVSSVM::RunInstructions()
+    if (control_unit_.GetLdbmStart() && !bigmul_unit_.GetLdbmDone()) {
+      WriteMemory();
+      AdvanceCycle();
+      continue;
+    }
+
+    if (control_unit_.GetBigmulStart() && !bigmul_unit_.GetBigmulDone()) {
+      if (!bigmul_unit_.GetWriteDone()) {
+        WriteMemory();
+      } else {
+        bigmul_unit_.executeBigmul();
+      }
+      AdvanceCycle();
+      continue;
+    }
+
+    // Checkpoints land on block boundaries, at least checkpoint_interval instructions apart
+    MaybeCheckpoint();
+    block = NextBlock(block, program_counter_);
+    if (block == nullptr) {
+      StepInstruction();
+      instructions_retired_++;
+      instruction_executed++;
+      AdvanceCycle();
+      if (!silent_run_) {
+        Console() << "Program Counter: " << program_counter_ << std::endl;
+      }
+      continue;
+    }
+
+    for (const MicroOp &op : block->ops) {
+      memory_controller_.ChargeFetch(program_counter_);
+      current_instruction_ = op.decoded.instruction;
+      UpdateProgramCounter(4);
+      control_unit_.LoadControlSignals(op.decoded.signals);
+
+      (this->*op.handler)(op.decoded);
+
+      instructions_retired_++;
+      instruction_executed++;
+      AdvanceCycle();
+      if (!silent_run_) {
+        Console() << "Program Counter: " << program_counter_ << std::endl;
+      }
+
+      // Leave the block early on self-modifying stores, stop requests and the end of the count
+      if (blocks_generation_ != decode_cache_.GetGeneration() || stop_requested_ || instruction_executed >= count) {
+        break;
+      }
+    }
+  }
+  // Running is not undoable; drop whatever the fallback stages recorded
+  current_delta_ = StepDelta();
+  return instruction_executed;
+}
+
+void RVSSThreadedVM::Run() {
+  ClearStop();
+  RunInstructions(RunLimit());
+  FlushSyscallOutput();
+  if (program_counter_ >= program_size_) {
+    Console() << "VM_PROGRAM_END" << std::endl;
+    output_status_ = "VM_PROGRAM_END";
+  }
+  DumpRegisters(output_paths_.registers_dump, registers_);
+  DumpState(output_paths_.vm_state_dump);
+}
+
+void RVSSThreadedVM::Reset() {
+  RVSSVM::Reset();
+  blocks_.clear();
+}
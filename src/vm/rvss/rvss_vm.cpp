@@ -16,7 +16,6 @@
 #include <cstdint>
 #include <iostream>
 #include <tuple>
-#include <stack>  
 #include <algorithm>
 #include <thread>
 #include <mutex>
@@ -26,111 +25,198 @@
 #include <atomic>
 
 #include <iomanip>
+#include <span>
 #include <limits>
+#include <sstream>
+#include <stdexcept>
 
 using instruction_set::Instruction;
 using instruction_set::get_instr_encoding;
 
 
-RVSSVM::RVSSVM() : VmBase() {
-  DumpRegisters(globals::registers_dump_file_path, registers_);
-  DumpState(globals::vm_state_dump_file_path);
+RVSSVM::RVSSVM() : RVSSVM(VmOutputPaths()) {}
+
+RVSSVM::RVSSVM(VmOutputPaths output_paths) : VmBase(std::move(output_paths)) {
+  bigmul_unit_.SetOperandReader([this](uint64_t address, std::span<uint64_t> out) {
+    memory_controller_.ReadDoubleWords(address, out);
+  });
+  ConfigureBigmulUnit();
+  history_.SetCapacity(vm_config::config.getUndoHistorySize());
+  ResetCheckpoints();
+  DumpRegisters(output_paths_.registers_dump, registers_);
+  DumpState(output_paths_.vm_state_dump);
+}
+
+void RVSSVM::LoadProgram(const AssembledProgram &program) {
+  VmBase::LoadProgram(program);
+  // They would restore the previous program's memory
+  ResetCheckpoints();
+}
+
+void RVSSVM::ConfigureBigmulUnit() {
+  bigmul_unit_.SetCacheDwords(vm_config::config.getBigmulCacheDwords());
+  bigmul_unit_.SetAlgorithm(vm_config::config.getBigmulAlgorithm());
+  bigmul_unit_.SetEngine(vm_config::config.getBigmulEngine());
+  bigmul_unit_.SetKaratsubaThreshold(vm_config::config.getBigmulKaratsubaThreshold());
+  bigmul_unit_.reset();
 }
 
 RVSSVM::~RVSSVM() = default;
 
+void RVSSVM::Predecode(uint32_t instruction, DecodedInstruction &decoded) {
+  control_unit_.SetControlSignals(instruction);
+
+  decoded.instruction = instruction;
+  decoded.opcode = instruction & 0b1111111;
+  decoded.funct3 = (instruction >> 12) & 0b111;
+  decoded.funct7 = (instruction >> 25) & 0b1111111;
+  decoded.rd = (instruction >> 7) & 0b11111;
+  decoded.rs1 = (instruction >> 15) & 0b11111;
+  decoded.rs2 = (instruction >> 20) & 0b11111;
+  decoded.rs3 = (instruction >> 27) & 0b11111;
+  decoded.imm = ImmGenerator(instruction);
+  decoded.alu_op = control_unit_.GetAluSignal(instruction, control_unit_.GetAluOp());
+  decoded.signals = control_unit_.GetControlSignals();
+
+  // Same precedence as the stage dispatch: ecall, F, D, CSR, then integer
+  if (decoded.opcode == get_instr_encoding(Instruction::kecall).opcode &&
+      decoded.funct3 == get_instr_encoding(Instruction::kecall).funct3) {
+    decoded.execution_class = ExecutionClass::kSyscall;
+  } else if (instruction_set::isFInstruction(instruction)) {
+    decoded.execution_class = ExecutionClass::kFloat;
+  } else if (instruction_set::isDInstruction(instruction)) {
+    decoded.execution_class = ExecutionClass::kDouble;
+  } else if (decoded.opcode == 0b1110011) {
+    decoded.execution_class = ExecutionClass::kCsr;
+  } else if (decoded.opcode == get_instr_encoding(Instruction::kldbm).opcode) {
+    decoded.execution_class = ExecutionClass::kLdbm;
+  } else if (decoded.opcode == get_instr_encoding(Instruction::kbigmul).opcode) {
+    decoded.execution_class = ExecutionClass::kBigmul;
+  } else if (decoded.opcode == get_instr_encoding(Instruction::kAtomicType).opcode) {
+    decoded.execution_class = ExecutionClass::kAtomic;
+  } else if (decoded.opcode == 0b1100011) {
+    decoded.execution_class = ExecutionClass::kBranch;
+  } else if (decoded.opcode == get_instr_encoding(Instruction::kjal).opcode) {
+    decoded.execution_class = ExecutionClass::kJal;
+  } else if (decoded.opcode == get_instr_encoding(Instruction::kjalr).opcode) {
+    decoded.execution_class = ExecutionClass::kJalr;
+  } else if (decoded.opcode == get_instr_encoding(Instruction::kauipc).opcode) {
+    decoded.execution_class = ExecutionClass::kAuipc;
+  } else {
+    decoded.execution_class = ExecutionClass::kInteger;
+  }
+  decoded.valid = true;
+}
+
 void RVSSVM::Fetch() {
-  current_instruction_ = memory_controller_.ReadWord(program_counter_);
+  DecodedInstruction *cached = decode_cache_.Find(program_counter_);
+  if (cached != nullptr && cached->valid) {
+    decoded_ = *cached;
+    // The decode cache is a simulator shortcut, not a level of the modelled hierarchy
+    memory_controller_.ChargeFetch(program_counter_);
+  } else {
+    Predecode(memory_controller_.FetchWord(program_counter_), decoded_);
+    if (cached != nullptr) {
+      *cached = decoded_;
+    }
+  }
+  current_instruction_ = decoded_.instruction;
   UpdateProgramCounter(4);
 }
 
 void RVSSVM::Decode() {
-  control_unit_.SetControlSignals(current_instruction_);
+  control_unit_.LoadControlSignals(decoded_.signals);
 
   // Control signals for custom instructions
-  uint8_t opcode = current_instruction_ & 0b1111111;
+  ExecutionClass execution_class = decoded_.execution_class;
   // std::cout << "[DECODE] opcode=" << std::hex << (int)opcode  << std::dec << std::endl;
   // std::cout << "[DEBUG START FLAGS] "
   //         << "LDBM_start=" << control_unit_.GetLdbmStart()
-  //         << " LDBM_done="  << bigmul_unit::GetLdbmDone()
+  //         << " LDBM_done="  << bigmul_unit_.GetLdbmDone()
   //         << " | BIGMUL_start=" << control_unit_.GetBigmulStart()
-  //         << " BIGMUL_done="  << bigmul_unit::GetBigmulDone()
+  //         << " BIGMUL_done="  << bigmul_unit_.GetBigmulDone()
   //         << std::endl;
-  // std::cout << "    ldbm_offset=" << bigmul_unit::ldbm_offset
-  //         << " bigmul_write_offset=" << bigmul_unit::write_offset
-  //         << " bigmul_prog=" << bigmul_unit::bigmul_prog
+  // std::cout << "    ldbm_offset=" << bigmul_unit_.ldbm_offset
+  //         << " bigmul_write_offset=" << bigmul_unit_.write_offset
+  //         << " bigmul_prog=" << bigmul_unit_.bigmul_prog
   //         << std::endl;
 
   
   // Control signals for custom instructions
-  if ((opcode == get_instr_encoding(Instruction::kldbm).opcode) && control_unit_.GetLdbmStart() && bigmul_unit::GetLdbmDone()) {
+  if (execution_class == ExecutionClass::kLdbm && control_unit_.GetLdbmStart() && bigmul_unit_.GetLdbmDone()) {
     
     // std::cout << "[DECODE] opcode=" << std::hex << get_instr_encoding(Instruction::kldbm).opcode  << std::dec << std::endl;
     // std::cout << "[LDBM START] Condition met - starting LDBM" << std::endl;
-    uint8_t rs1 = (current_instruction_ >> 15) & 0b1111111;
-    uint8_t rs2 = (current_instruction_ >> 20) & 0b1111111;
+    uint8_t rs1 = decoded_.rs1;
+    uint8_t rs2 = decoded_.rs2;
 
     //  std::cout << "[LDBM DEBUG] rs1=" << std::dec << (int)rs1
     //          << " rs2=" << (int)rs2 << std::hex << std::dec << std::endl;
 
-    bigmul_unit::base_addr_A = registers_.ReadGpr(rs1);
-    bigmul_unit::base_addr_B = registers_.ReadGpr(rs2);
-    bigmul_unit::ldbm_offset = 0;
-    bigmul_unit::ldbm_done_ = false;
+    bigmul_unit_.base_addr_A = registers_.ReadGpr(rs1);
+    bigmul_unit_.base_addr_B = registers_.ReadGpr(rs2);
+    bigmul_unit_.ldbm_offset = 0;
+    bigmul_unit_.ldbm_done_ = false;
+    bigmul_unit_.resident_tile_A = BigmulUnit::kNoTile;
+    bigmul_unit_.resident_tile_B = BigmulUnit::kNoTile;
     
-  // std::cout << "[LDBM] Starting load from A=" << std::hex << bigmul_unit::base_addr_A 
-  //             << " B=" << bigmul_unit::base_addr_B << std::dec << std::endl;
+  // std::cout << "[LDBM] Starting load from A=" << std::hex << bigmul_unit_.base_addr_A 
+  //             << " B=" << bigmul_unit_.base_addr_B << std::dec << std::endl;
   }
-  else if ((opcode == get_instr_encoding(Instruction::kbigmul).opcode) 
-           && control_unit_.GetBigmulStart() && bigmul_unit::GetBigmulDone()) {
+  else if (execution_class == ExecutionClass::kBigmul
+           && control_unit_.GetBigmulStart() && bigmul_unit_.GetBigmulDone()) {
     
     //std::cout << "[BIGMUL START] Condition met - starting BIGMUL" << std::endl;
-    uint8_t rs1 = (current_instruction_ >> 15) & 0b1111111;
-    uint8_t rs2 = (current_instruction_ >> 20) & 0b1111111;
-    if(registers_.ReadGpr(rs2) != 0 && registers_.ReadGpr(rs2) < 512){
-      bigmul_unit::size_of_operand = registers_.ReadGpr(rs2);
+    uint8_t rs1 = decoded_.rs1;
+    uint8_t rs2 = decoded_.rs2;
+    uint64_t operand_dwords = registers_.ReadGpr(rs2);
+    if (operand_dwords != 0 && !bigmul_unit_.SetOperandDwords(operand_dwords)) {
+      std::cerr << "BIGMUL operand size out of range: " << operand_dwords << " doublewords (max "
+                << BigmulUnit::kMaxOperandDwords << "), keeping " << bigmul_unit_.size_of_operand << std::endl;
     }
-    bigmul_unit::base_addr_res = registers_.ReadGpr(rs1);
-    bigmul_unit::bigmul_prog = 0;
-    bigmul_unit::bigmul_done_ = false;
-    bigmul_unit::write_offset = 0;
-    bigmul_unit::write_done = true;
+    bigmul_unit_.base_addr_res = registers_.ReadGpr(rs1);
+    bigmul_unit_.bigmul_prog = 0;
+    bigmul_unit_.bigmul_done_ = false;
+    bigmul_unit_.write_offset = 0;
+    bigmul_unit_.write_done = true;
     
     // std::cout << "[BIGMUL] Starting multiplication, result to: " 
-    //           << std::hex << bigmul_unit::base_addr_res << std::dec << std::endl;
+    //           << std::hex << bigmul_unit_.base_addr_res << std::dec << std::endl;
   }
 }
 
 void RVSSVM::Execute() {
-  uint8_t opcode = current_instruction_ & 0b1111111;
-  uint8_t funct3 = (current_instruction_ >> 12) & 0b111;
+  ExecutionClass execution_class = decoded_.execution_class;
+  uint8_t funct3 = decoded_.funct3;
 
-  if (opcode == get_instr_encoding(Instruction::kecall).opcode && 
-      funct3 == get_instr_encoding(Instruction::kecall).funct3) {
+  if (execution_class == ExecutionClass::kSyscall) {
     HandleSyscall();
     return;
   }
   //custom
   // if (opcode == get_instr_encoding(Instruction::kbigmul).opcode && control_unit_.GetBigmulStart()) {
-  //   bigmul_unit::executeBigmul();   // starts the process
+  //   bigmul_unit_.executeBigmul();   // starts the process
   //   return;
   // }
   // else 
-  if (instruction_set::isFInstruction(current_instruction_)) { // RV64 F
+  if (execution_class == ExecutionClass::kFloat) { // RV64 F
     ExecuteFloat();
     return;
-  } else if (instruction_set::isDInstruction(current_instruction_)) {
+  } else if (execution_class == ExecutionClass::kDouble) {
     ExecuteDouble();
     return;
-  } else if (opcode==0b1110011) {
+  } else if (execution_class == ExecutionClass::kCsr) {
     ExecuteCsr();
     return;
+  } else if (execution_class == ExecutionClass::kAtomic) { // The address is rs1, with no offset
+    execution_result_ = static_cast<int64_t>(registers_.ReadGpr(decoded_.rs1));
+    return;
   }
 
-  uint8_t rs1 = (current_instruction_ >> 15) & 0b11111;
-  uint8_t rs2 = (current_instruction_ >> 20) & 0b11111;
+  uint8_t rs1 = decoded_.rs1;
+  uint8_t rs2 = decoded_.rs2;
 
-  int32_t imm = ImmGenerator(current_instruction_);
+  int32_t imm = decoded_.imm;
 
   uint64_t reg1_value = registers_.ReadGpr(rs1);
   uint64_t reg2_value = registers_.ReadGpr(rs2);
@@ -141,27 +227,23 @@ void RVSSVM::Execute() {
     reg2_value = static_cast<uint64_t>(static_cast<int64_t>(imm));
   }
 
-  alu::AluOp aluOperation = control_unit_.GetAluSignal(current_instruction_, control_unit_.GetAluOp());
+  alu::AluOp aluOperation = decoded_.alu_op;
   std::tie(execution_result_, overflow) = alu_.execute(aluOperation, reg1_value, reg2_value);
 
+  uint64_t pc = program_counter_ - 4; // PC was already updated in Fetch()
 
   if (control_unit_.GetBranch()) {
-    if (opcode==get_instr_encoding(Instruction::kjalr).opcode || 
-        opcode==get_instr_encoding(Instruction::kjal).opcode) {
+    if (execution_class == ExecutionClass::kJalr ||
+        execution_class == ExecutionClass::kJal) {
       next_pc_ = static_cast<int64_t>(program_counter_); // PC was already updated in Fetch()
       UpdateProgramCounter(-4);
       return_address_ = program_counter_ + 4;
-      if (opcode==get_instr_encoding(Instruction::kjalr).opcode) { 
+      if (execution_class == ExecutionClass::kJalr) {
         UpdateProgramCounter(-program_counter_ + (execution_result_));
-      } else if (opcode==get_instr_encoding(Instruction::kjal).opcode) {
+      } else {
         UpdateProgramCounter(imm);
       }
-    } else if (opcode==get_instr_encoding(Instruction::kbeq).opcode ||
-               opcode==get_instr_encoding(Instruction::kbne).opcode ||
-               opcode==get_instr_encoding(Instruction::kblt).opcode ||
-               opcode==get_instr_encoding(Instruction::kbge).opcode ||
-               opcode==get_instr_encoding(Instruction::kbltu).opcode ||
-               opcode==get_instr_encoding(Instruction::kbgeu).opcode) {
+    } else if (execution_class == ExecutionClass::kBranch) {
       switch (funct3) {
         case 0b000: {// BEQ
           branch_flag_ = (execution_result_==0);
@@ -196,30 +278,42 @@ void RVSSVM::Execute() {
   }
 
   
-  if (branch_flag_ && opcode==0b1100011) {
+  if (branch_flag_ && execution_class == ExecutionClass::kBranch) {
     UpdateProgramCounter(-4);
     UpdateProgramCounter(imm);
   }
 
+  if (control_unit_.GetBranch()) {
+    ResolveBranch(pc, decoded_);
+  }
+
 
-  if (opcode==get_instr_encoding(Instruction::kauipc).opcode) { // AUIPC
+  if (execution_class == ExecutionClass::kAuipc) { // AUIPC
     execution_result_ = static_cast<int64_t>(program_counter_) - 4 + (imm << 12);
 
   }
 }
 
+void RVSSVM::ResolveBranch(uint64_t pc, const DecodedInstruction &decoded) {
+  branch_prediction::BranchKind kind = BranchKindOf(decoded);
+  uint64_t direct_target = pc + static_cast<int64_t>(decoded.imm);
+  uint64_t predicted_pc = fetch_prediction_ ? *fetch_prediction_ : branch_predictor_.Predict(pc, kind, direct_target);
+  if (branch_predictor_.Update(pc, kind, direct_target, program_counter_, predicted_pc)) {
+    branch_mispredictions_++;
+  }
+}
+
 void RVSSVM::ExecuteFloat() {
-  uint8_t opcode = current_instruction_ & 0b1111111;
-  uint8_t funct3 = (current_instruction_ >> 12) & 0b111;
-  uint8_t funct7 = (current_instruction_ >> 25) & 0b1111111;
-  uint8_t rm = funct3;
-  uint8_t rs1 = (current_instruction_ >> 15) & 0b11111;
-  uint8_t rs2 = (current_instruction_ >> 20) & 0b11111;
-  uint8_t rs3 = (current_instruction_ >> 27) & 0b11111;
+  uint8_t opcode = decoded_.opcode;
+  uint8_t funct7 = decoded_.funct7;
+  uint8_t rm = decoded_.funct3;
+  uint8_t rs1 = decoded_.rs1;
+  uint8_t rs2 = decoded_.rs2;
+  uint8_t rs3 = decoded_.rs3;
 
   uint8_t fcsr_status = 0;
 
-  int32_t imm = ImmGenerator(current_instruction_);
+  int32_t imm = decoded_.imm;
 
   if (rm==0b111) {
     rm = registers_.ReadCsr(0x002);
@@ -237,7 +331,7 @@ void RVSSVM::ExecuteFloat() {
     reg2_value = static_cast<uint64_t>(static_cast<int64_t>(imm));
   }
 
-  alu::AluOp aluOperation = control_unit_.GetAluSignal(current_instruction_, control_unit_.GetAluOp());
+  alu::AluOp aluOperation = decoded_.alu_op;
   std::tie(execution_result_, fcsr_status) = alu::Alu::fpexecute(aluOperation, reg1_value, reg2_value, reg3_value, rm);
 
   // std::cout << "+++++ Float execution result: " << execution_result_ << std::endl;
@@ -247,17 +341,16 @@ void RVSSVM::ExecuteFloat() {
 }
 
 void RVSSVM::ExecuteDouble() {
-  uint8_t opcode = current_instruction_ & 0b1111111;
-  uint8_t funct3 = (current_instruction_ >> 12) & 0b111;
-  uint8_t funct7 = (current_instruction_ >> 25) & 0b1111111;
-  uint8_t rm = funct3;
-  uint8_t rs1 = (current_instruction_ >> 15) & 0b11111;
-  uint8_t rs2 = (current_instruction_ >> 20) & 0b11111;
-  uint8_t rs3 = (current_instruction_ >> 27) & 0b11111;
+  uint8_t opcode = decoded_.opcode;
+  uint8_t funct7 = decoded_.funct7;
+  uint8_t rm = decoded_.funct3;
+  uint8_t rs1 = decoded_.rs1;
+  uint8_t rs2 = decoded_.rs2;
+  uint8_t rs3 = decoded_.rs3;
 
   uint8_t fcsr_status = 0;
 
-  int32_t imm = ImmGenerator(current_instruction_);
+  int32_t imm = decoded_.imm;
 
   uint64_t reg1_value = registers_.ReadFpr(rs1);
   uint64_t reg2_value = registers_.ReadFpr(rs2);
@@ -271,13 +364,13 @@ void RVSSVM::ExecuteDouble() {
     reg2_value = static_cast<uint64_t>(static_cast<int64_t>(imm));
   }
 
-  alu::AluOp aluOperation = control_unit_.GetAluSignal(current_instruction_, control_unit_.GetAluOp());
+  alu::AluOp aluOperation = decoded_.alu_op;
   std::tie(execution_result_, fcsr_status) = alu::Alu::dfpexecute(aluOperation, reg1_value, reg2_value, reg3_value, rm);
 }
 
 void RVSSVM::ExecuteCsr() {
-  uint8_t rs1 = (current_instruction_ >> 15) & 0b11111;
-  uint16_t csr = (current_instruction_ >> 20) & 0xFFF;
+  uint8_t rs1 = decoded_.rs1;
+  uint16_t csr = (decoded_.instruction >> 20) & 0xFFF;
   uint64_t csr_val = registers_.ReadCsr(csr);
 
   csr_target_address_ = csr;
@@ -292,70 +385,79 @@ void RVSSVM::HandleSyscall() {
   switch (syscall_number) {
     case SYSCALL_PRINT_INT: {
         if (!globals::vm_as_backend) {
-            std::cout << "[Syscall output: ";
+            SyscallOutput() << "[Syscall output: ";
         } else {
-          std::cout << "VM_STDOUT_START";
+          SyscallOutput() << "VM_STDOUT_START";
         }
-        std::cout << static_cast<int64_t>(registers_.ReadGpr(10)); // Print signed integer
+        SyscallOutput() << static_cast<int64_t>(registers_.ReadGpr(10)); // Print signed integer
         if (!globals::vm_as_backend) {
-            std::cout << "]" << std::endl;
+            SyscallOutput() << "]" << std::endl;
         } else {
-          std::cout << "VM_STDOUT_END" << std::endl;
+          SyscallOutput() << "VM_STDOUT_END" << std::endl;
         }
         break;
     }
     case SYSCALL_PRINT_FLOAT: { // print float
         if (!globals::vm_as_backend) {
-            std::cout << "[Syscall output: ";
+            SyscallOutput() << "[Syscall output: ";
         } else {
-          std::cout << "VM_STDOUT_START";
+          SyscallOutput() << "VM_STDOUT_START";
         }
         float float_value;
         uint64_t raw = registers_.ReadGpr(10);
         std::memcpy(&float_value, &raw, sizeof(float_value));
-        std::cout << std::setprecision(std::numeric_limits<float>::max_digits10) << float_value;
+        SyscallOutput() << std::setprecision(std::numeric_limits<float>::max_digits10) << float_value;
         if (!globals::vm_as_backend) {
-            std::cout << "]" << std::endl;
+            SyscallOutput() << "]" << std::endl;
         } else {
-          std::cout << "VM_STDOUT_END" << std::endl;
+          SyscallOutput() << "VM_STDOUT_END" << std::endl;
         }
         break;
     }
     case SYSCALL_PRINT_DOUBLE: { // print double
         if (!globals::vm_as_backend) {
-            std::cout << "[Syscall output: ";
+            SyscallOutput() << "[Syscall output: ";
         } else {
-          std::cout << "VM_STDOUT_START";
+          SyscallOutput() << "VM_STDOUT_START";
         }
         double double_value;
         uint64_t raw = registers_.ReadGpr(10);
         std::memcpy(&double_value, &raw, sizeof(double_value));
-        std::cout << std::setprecision(std::numeric_limits<double>::max_digits10) << double_value;
+        SyscallOutput() << std::setprecision(std::numeric_limits<double>::max_digits10) << double_value;
         if (!globals::vm_as_backend) {
-            std::cout << "]" << std::endl;
+            SyscallOutput() << "]" << std::endl;
         } else {
-          std::cout << "VM_STDOUT_END" << std::endl;
+          SyscallOutput() << "VM_STDOUT_END" << std::endl;
         }
         break;
     }
     case SYSCALL_PRINT_STRING: {
         if (!globals::vm_as_backend) {
-            std::cout << "[Syscall output: ";
+            SyscallOutput() << "[Syscall output: ";
         }
         PrintString(registers_.ReadGpr(10)); // Print string
         if (!globals::vm_as_backend) {
-            std::cout << "]" << std::endl;
+            SyscallOutput() << "]" << std::endl;
         }
         break;
     }
     case SYSCALL_EXIT: {
         stop_requested_ = true; // Stop the VM
         if (!globals::vm_as_backend) {
-            std::cout << "VM_EXIT" << std::endl;
+            SyscallOutput() << "VM_EXIT" << std::endl;
         }
         output_status_ = "VM_EXIT";
-        std::cout << "Exited with exit code: " << registers_.ReadGpr(10) << std::endl;
-        exit(0); // Exit the program
+        SyscallOutput() << "Exited with exit code: " << registers_.ReadGpr(10) << std::endl;
+        guest_exited_ = true;
+        guest_exit_code_ = registers_.ReadGpr(10);
+        if (exit_host_on_guest_exit_) {
+          if (silent_run_) {
+            FlushSyscallOutput();
+            ReportRunThroughput();
+          }
+          exit(0); // Exit the program
+        }
+        // Otherwise the stop request ends the current run
         break;
     }
     case SYSCALL_READ: { // Read
@@ -366,27 +468,38 @@ void RVSSVM::HandleSyscall() {
       if (file_descriptor == 0) {
         // Read from stdin
         std::string input;
-        {
-          std::cout << "VM_STDIN_START" << std::endl;
-          output_status_ = "VM_STDIN_START";
-          std::unique_lock<std::mutex> lock(input_mutex_);
-          input_cv_.wait(lock, [this]() { 
-            return !input_queue_.empty(); 
-          });
-          output_status_ = "VM_STDIN_END";
-          std::cout << "VM_STDIN_END" << std::endl;
-
-          input = input_queue_.front();
-          input_queue_.pop();
+        if (input_log_cursor_ < input_log_.size()) {
+          // Replaying after a rewind: the program reads what it read the first time
+          input = input_log_[input_log_cursor_++];
+        } else {
+          // Whatever the program printed so far must be visible before blocking on input
+          FlushSyscallOutput();
+          {
+            Console() << "VM_STDIN_START" << std::endl;
+            output_status_ = "VM_STDIN_START";
+            std::unique_lock<std::mutex> lock(input_mutex_);
+            input_cv_.wait(lock, [this]() { 
+              return !input_queue_.empty() || input_closed_; 
+            });
+            output_status_ = "VM_STDIN_END";
+            Console() << "VM_STDIN_END" << std::endl;
+
+            if (!input_queue_.empty()) {
+              input = input_queue_.front();
+              input_queue_.pop();
+            }
+          }
+          if (!checkpoints_.empty()) {
+            input_log_.push_back(input);
+            input_log_cursor_ = input_log_.size();
+          }
         }
 
 
         std::vector<uint8_t> old_bytes_vec(length, 0);
         std::vector<uint8_t> new_bytes_vec(length, 0);
 
-        for (size_t i = 0; i < length; ++i) {
-          old_bytes_vec[i] = memory_controller_.ReadByte(buffer_address + i);
-        }
+        memory_controller_.ReadBlock_d(buffer_address, old_bytes_vec);
         
         for (size_t i = 0; i < input.size() && i < length; ++i) {
           memory_controller_.WriteByte(buffer_address + i, static_cast<uint8_t>(input[i]));
@@ -395,9 +508,7 @@ void RVSSVM::HandleSyscall() {
           memory_controller_.WriteByte(buffer_address + input.size(), '\0');
         }
 
-        for (size_t i = 0; i < length; ++i) {
-          new_bytes_vec[i] = memory_controller_.ReadByte(buffer_address + i);
-        }
+        memory_controller_.ReadBlock_d(buffer_address, new_bytes_vec);
 
         current_delta_.memory_changes.push_back({
           buffer_address, 
@@ -425,7 +536,7 @@ void RVSSVM::HandleSyscall() {
         uint64_t length = registers_.ReadGpr(12);
 
         if (file_descriptor == 1) { // stdout
-          std::cout << "VM_STDOUT_START";
+          SyscallOutput() << "VM_STDOUT_START";
           output_status_ = "VM_STDOUT_START";
           uint64_t bytes_printed = 0;
           for (uint64_t i = 0; i < length; ++i) {
@@ -433,12 +544,12 @@ void RVSSVM::HandleSyscall() {
               // if (c == '\0') {
               //     break;
               // }
-              std::cout << c;
+              SyscallOutput() << c;
               bytes_printed++;
           }
-          std::cout << std::flush; 
+          SyscallOutput() << std::flush; 
           output_status_ = "VM_STDOUT_END";
-          std::cout << "VM_STDOUT_END" << std::endl;
+          SyscallOutput() << "VM_STDOUT_END" << std::endl;
 
           uint64_t old_reg = registers_.ReadGpr(10);
           unsigned int reg_index = 10;
@@ -463,7 +574,7 @@ void RVSSVM::HandleSyscall() {
 void RVSSVM::WriteMemory() {
 
   //custom
-    if (control_unit_.GetLdbmStart() && !bigmul_unit::GetLdbmDone()) {
+    if (control_unit_.GetLdbmStart() && !bigmul_unit_.GetLdbmDone()) {
 
         // std::vector<uint8_t> bufA(512);
         // std::vector<uint8_t> bufB(512);
@@ -473,86 +584,84 @@ void RVSSVM::WriteMemory() {
         //     bufB[i] = memory_controller_.ReadByte(base_addr_B + i);
         // }
 
-        // bigmul_unit::loadcache(bufA, bufB);
-        // bigmul_unit::ldbm_done_ = true;
-        // std::cout << "[LDBM] offset=" << bigmul_unit::ldbm_offset
-        //       << " baseA=" << std::hex << bigmul_unit::base_addr_A
-        //       << " baseB=" << bigmul_unit::base_addr_B << std::dec << std::endl;
-
-    // Load 8 doublewords (64 bytes) per cycle
-    if (bigmul_unit::ldbm_offset < 64) {
-      // Load from A (64 doublewords = 512 bytes)
-      for (size_t i = 0; i < 8; i++) {
-        uint64_t current_offset = bigmul_unit::ldbm_offset + i;
-        if (current_offset < 64) { // Safety check
-          uint64_t addr = bigmul_unit::base_addr_A + current_offset * 8;
-          bigmul_unit::cacheA[current_offset] = memory_controller_.ReadDoubleWord(addr);
-        }
-      }
-//       if (bigmul_unit::ldbm_offset == 0) {
+        // bigmul_unit_.loadcache(bufA, bufB);
+        // bigmul_unit_.ldbm_done_ = true;
+        // std::cout << "[LDBM] offset=" << bigmul_unit_.ldbm_offset
+        //       << " baseA=" << std::hex << bigmul_unit_.base_addr_A
+        //       << " baseB=" << bigmul_unit_.base_addr_B << std::dec << std::endl;
+
+    // Load 8 doublewords (64 bytes) per cycle, filling the first tile of both operand caches
+    const uint64_t tile = bigmul_unit_.GetCacheDwords();
+    if (bigmul_unit_.ldbm_offset < tile) {
+      // Load from A (64 doublewords = 512 bytes by default)
+      uint64_t current_offset = bigmul_unit_.ldbm_offset;
+      size_t count = std::min<uint64_t>(BigmulUnit::kTransferDwords, tile - current_offset);
+      memory_controller_.ReadDoubleWords(bigmul_unit_.base_addr_A + current_offset * 8,
+                                         std::span<uint64_t>(bigmul_unit_.cacheA.data() + current_offset, count));
+//       if (bigmul_unit_.ldbm_offset == 0) {
 //     std::cout << "[DEBUG A FIRST 8 QWORDS]\n";
 //     for (int i = 0; i < 8; i++) {
 //         std::cout << "A[" << i << "] = 0x"
-//                   << std::hex << bigmul_unit::cacheA[i]
+//                   << std::hex << bigmul_unit_.cacheA[i]
 //                   << std::dec << "\n";
 //     }
 // }
 
     } 
-    else if (bigmul_unit::ldbm_offset < 128) {
-      // Load from B (64 doublewords = 512 bytes)  
-      for (size_t i = 0; i < 8; i++) {
-        uint64_t current_offset = bigmul_unit::ldbm_offset + i - 64;
-        if (current_offset < 64) { // Safety check
-          uint64_t addr = bigmul_unit::base_addr_B + current_offset * 8;
-          bigmul_unit::cacheB[current_offset] = memory_controller_.ReadDoubleWord(addr);
-        }
-      }
-//       if (bigmul_unit::ldbm_offset == 64) {
+    else if (bigmul_unit_.ldbm_offset < 2 * tile) {
+      // Load from B (64 doublewords = 512 bytes by default)
+      uint64_t current_offset = bigmul_unit_.ldbm_offset - tile;
+      size_t count = std::min<uint64_t>(BigmulUnit::kTransferDwords, tile - current_offset);
+      memory_controller_.ReadDoubleWords(bigmul_unit_.base_addr_B + current_offset * 8,
+                                         std::span<uint64_t>(bigmul_unit_.cacheB.data() + current_offset, count));
+//       if (bigmul_unit_.ldbm_offset == 64) {
 //     std::cout << "[DEBUG B FIRST 8 QWORDS]\n";
 //     for (int i = 0; i < 8; i++) {
 //         std::cout << "B[" << i << "] = 0x"
-//                   << std::hex << bigmul_unit::cacheB[i]
+//                   << std::hex << bigmul_unit_.cacheB[i]
 //                   << std::dec << "\n";
 //     }
 // }
 
     }
     
-    bigmul_unit::ldbm_offset += 8;
+    bigmul_unit_.ldbm_offset += BigmulUnit::kTransferDwords;
 
-    // Check if done (64 for A + 64 for B = 128 total)
-    if (bigmul_unit::ldbm_offset >= 128) {
-      bigmul_unit::ldbm_done_ = true;
+    // Check if done (one tile of A + one tile of B)
+    if (bigmul_unit_.ldbm_offset >= 2 * tile) {
+      bigmul_unit_.LdbmLoaded();
     //   for (int i = 0; i < 64; i++) {
     //     std::cout << "A[" << i << "] = 0x"
-    //               << std::hex << bigmul_unit::cacheA[i]
+    //               << std::hex << bigmul_unit_.cacheA[i]
     //               << std::dec << "\n";
     // }
 
     //   for (int i = 0; i < 64; i++) {
     //     std::cout << "B[" << i << "] = 0x"
-    //               << std::hex << bigmul_unit::cacheB[i]
+    //               << std::hex << bigmul_unit_.cacheB[i]
     //               << std::dec << "\n";
     //   }
     //   std::cout << "[LDBM] Completed loading both operands" << std::endl;
     }
     return;
     }
-  uint8_t opcode = current_instruction_ & 0b1111111;
-  uint8_t rs2 = (current_instruction_ >> 20) & 0b11111;
-  uint8_t funct3 = (current_instruction_ >> 12) & 0b111;
+  ExecutionClass execution_class = decoded_.execution_class;
+  uint8_t rs2 = decoded_.rs2;
+  uint8_t funct3 = decoded_.funct3;
 
-  if (opcode == 0b1110011 && funct3 == 0b000) {
+  if (execution_class == ExecutionClass::kSyscall) {
     return;
   }
 
-  if (instruction_set::isFInstruction(current_instruction_)) { // RV64 F
+  if (execution_class == ExecutionClass::kFloat) { // RV64 F
     WriteMemoryFloat();
     return;
-  } else if (instruction_set::isDInstruction(current_instruction_)) {
+  } else if (execution_class == ExecutionClass::kDouble) {
     WriteMemoryDouble();
     return;
+  } else if (execution_class == ExecutionClass::kAtomic) {
+    WriteMemoryAtomic();
+    return;
   }
 
   if (control_unit_.GetMemRead()) {
@@ -597,67 +706,61 @@ void RVSSVM::WriteMemory() {
 
 
   //custom
-    if (control_unit_.GetBigmulStart() && !bigmul_unit::GetBigmulDone() && !bigmul_unit::GetWriteDone()) {
-      uint64_t size = bigmul_unit::size_of_operand * 2;
-    if (bigmul_unit::write_offset < size) {
+    if (control_unit_.GetBigmulStart() && !bigmul_unit_.GetBigmulDone() && !bigmul_unit_.GetWriteDone()) {
+      uint64_t size = bigmul_unit_.size_of_operand * 2;
+    if (bigmul_unit_.write_offset < size) {
         // Write 8 double-words per cycle
-        for (int k = 0; k < 8 && (bigmul_unit::write_offset + k) < size; ++k) {
-            uint64_t index = bigmul_unit::write_offset + k;
-            uint64_t addr  = bigmul_unit::base_addr_res + index * 8ULL;
-            uint64_t word  = bigmul_unit::resultCache[index];
-
-            // record old bytes
-            for (int b = 0; b < 8; ++b) {
-                old_bytes_vec.push_back(memory_controller_.ReadByte(addr + b));
-            }
-
-            // write double-word
-            memory_controller_.WriteDoubleWord(addr, word);
-
-            // record new bytes
-            for (int b = 0; b < 8; ++b) {
-                new_bytes_vec.push_back(memory_controller_.ReadByte(addr + b));
-            }
-            if (bigmul_unit::write_offset == 0) {
-    // std::cout << "[DEBUG RESULT FIRST 8 QWORDS]\n";
-    // for (int i = 0; i < 8; i++) {
-    //     std::cout << "RES[" << i << "] = 0x"
-    //               << std::hex << bigmul_unit::resultCache[i]
-    //               << std::dec << "\n";
-    // }
-}
-
+        uint64_t count = std::min<uint64_t>(BigmulUnit::kTransferDwords, size - bigmul_unit_.write_offset);
+        uint64_t write_addr = bigmul_unit_.base_addr_res + bigmul_unit_.write_offset * 8ULL;
+        std::span<const uint64_t> words(bigmul_unit_.resultCache.data() + bigmul_unit_.write_offset, count);
+        std::span<const uint8_t> new_bytes(reinterpret_cast<const uint8_t *>(words.data()), words.size_bytes());
+
+        // record the old bytes of the whole range in one copy
+        old_bytes_vec.resize(new_bytes.size());
+        memory_controller_.ReadBlock_d(write_addr, old_bytes_vec);
+        memory_controller_.WriteBlock(write_addr, new_bytes);
+
+        // consecutive writes of one result extend the same change
+        if (!current_delta_.memory_changes.empty()
+            && current_delta_.memory_changes.back().address + current_delta_.memory_changes.back().new_bytes_vec.size()
+               == write_addr) {
+          MemoryChange &change = current_delta_.memory_changes.back();
+          change.old_bytes_vec.insert(change.old_bytes_vec.end(), old_bytes_vec.begin(), old_bytes_vec.end());
+          change.new_bytes_vec.insert(change.new_bytes_vec.end(), new_bytes.begin(), new_bytes.end());
+        } else {
+          current_delta_.memory_changes.push_back({write_addr, old_bytes_vec,
+                                                   std::vector<uint8_t>(new_bytes.begin(), new_bytes.end())});
         }
 
         // Move forward by 8 result words
-        bigmul_unit::write_offset += 8;
+        bigmul_unit_.write_offset += 8;
     }
 
     // check if done
-    if (bigmul_unit::write_offset >= size) {
-        bigmul_unit::write_done = true;
-        bigmul_unit::bigmul_done_  = true;
-        for (int i = 0; i < size; i++) {
-        std::cout << "RES[" << i << "] = 0x"
-                  << std::hex << bigmul_unit::resultCache[i]
+    if (bigmul_unit_.write_offset >= size) {
+        bigmul_unit_.write_done = true;
+        bigmul_unit_.bigmul_done_  = true;
+        for (uint64_t i = 0; i < size; i++) {
+        Console() << "RES[" << i << "] = 0x"
+                  << std::hex << bigmul_unit_.resultCache[i]
                   << std::dec << "\n";
     }
     //     std::cout << "\n====== BIGMUL UNIT STATE ======\n";
 
     // std::cout << "[LDBM]\n";
-    // std::cout << "  ldbm_done     = " << bigmul_unit::ldbm_done_ << "\n";
-    // std::cout << "  ldbm_offset   = " << bigmul_unit::ldbm_offset << "\n";
-    // std::cout << "  base_addr_A   = 0x" << std::hex << bigmul_unit::base_addr_A << std::dec << "\n";
-    // std::cout << "  base_addr_B   = 0x" << std::hex << bigmul_unit::base_addr_B << std::dec << "\n";
+    // std::cout << "  ldbm_done     = " << bigmul_unit_.ldbm_done_ << "\n";
+    // std::cout << "  ldbm_offset   = " << bigmul_unit_.ldbm_offset << "\n";
+    // std::cout << "  base_addr_A   = 0x" << std::hex << bigmul_unit_.base_addr_A << std::dec << "\n";
+    // std::cout << "  base_addr_B   = 0x" << std::hex << bigmul_unit_.base_addr_B << std::dec << "\n";
 
     // std::cout << "\n[BIGMUL COMPUTE]\n";
-    // std::cout << "  bigmul_done   = " << bigmul_unit::bigmul_done_ << "\n";
-    // std::cout << "  bigmul_prog   = " << bigmul_unit::bigmul_prog << "\n";
+    // std::cout << "  bigmul_done   = " << bigmul_unit_.bigmul_done_ << "\n";
+    // std::cout << "  bigmul_prog   = " << bigmul_unit_.bigmul_prog << "\n";
 
     // std::cout << "\n[BIGMUL WRITE]\n";
-    // std::cout << "  write_done    = " << bigmul_unit::write_done << "\n";
-    // std::cout << "  write_offset  = " << bigmul_unit::write_offset << "\n";
-    // std::cout << "  base_addr_res = 0x" << std::hex << bigmul_unit::base_addr_res << std::dec << "\n";
+    // std::cout << "  write_done    = " << bigmul_unit_.write_done << "\n";
+    // std::cout << "  write_offset  = " << bigmul_unit_.write_offset << "\n";
+    // std::cout << "  base_addr_res = 0x" << std::hex << bigmul_unit_.base_addr_res << std::dec << "\n";
 
     // std::cout << "================================\n\n";
     }
@@ -669,41 +772,41 @@ void RVSSVM::WriteMemory() {
       switch (funct3) {
       case 0b000: {// SB
         addr = execution_result_;
-        old_bytes_vec.push_back(memory_controller_.ReadByte(addr));
+        old_bytes_vec.push_back(memory_controller_.ReadByte_d(addr));
         memory_controller_.WriteByte(execution_result_, registers_.ReadGpr(rs2) & 0xFF);
-        new_bytes_vec.push_back(memory_controller_.ReadByte(addr));
+        new_bytes_vec.push_back(memory_controller_.ReadByte_d(addr));
         break;
       }
       case 0b001: {// SH
         addr = execution_result_;
         for (size_t i = 0; i < 2; ++i) {
-          old_bytes_vec.push_back(memory_controller_.ReadByte(addr + i));
+          old_bytes_vec.push_back(memory_controller_.ReadByte_d(addr + i));
         }
         memory_controller_.WriteHalfWord(execution_result_, registers_.ReadGpr(rs2) & 0xFFFF);
         for (size_t i = 0; i < 2; ++i) {
-          new_bytes_vec.push_back(memory_controller_.ReadByte(addr + i));
+          new_bytes_vec.push_back(memory_controller_.ReadByte_d(addr + i));
         }
         break;
       }
       case 0b010: {// SW
         addr = execution_result_;
         for (size_t i = 0; i < 4; ++i) {
-          old_bytes_vec.push_back(memory_controller_.ReadByte(addr + i));
+          old_bytes_vec.push_back(memory_controller_.ReadByte_d(addr + i));
         }
         memory_controller_.WriteWord(execution_result_, registers_.ReadGpr(rs2) & 0xFFFFFFFF);
         for (size_t i = 0; i < 4; ++i) {
-          new_bytes_vec.push_back(memory_controller_.ReadByte(addr + i));
+          new_bytes_vec.push_back(memory_controller_.ReadByte_d(addr + i));
         }
         break;
       }
       case 0b011: {// SD
         addr = execution_result_;
         for (size_t i = 0; i < 8; ++i) {
-          old_bytes_vec.push_back(memory_controller_.ReadByte(addr + i));
+          old_bytes_vec.push_back(memory_controller_.ReadByte_d(addr + i));
         }
         memory_controller_.WriteDoubleWord(execution_result_, registers_.ReadGpr(rs2) & 0xFFFFFFFFFFFFFFFF);
         for (size_t i = 0; i < 8; ++i) {
-          new_bytes_vec.push_back(memory_controller_.ReadByte(addr + i));
+          new_bytes_vec.push_back(memory_controller_.ReadByte_d(addr + i));
         }
         break;
       }
@@ -721,7 +824,7 @@ void RVSSVM::WriteMemory() {
 }
 
 void RVSSVM::WriteMemoryFloat() {
-  uint8_t rs2 = (current_instruction_ >> 20) & 0b11111;
+  uint8_t rs2 = decoded_.rs2;
 
   if (control_unit_.GetMemRead()) { // FLW
     memory_result_ = memory_controller_.ReadWord(execution_result_);
@@ -736,13 +839,13 @@ void RVSSVM::WriteMemoryFloat() {
   if (control_unit_.GetMemWrite()) { // FSW
     addr = execution_result_;
     for (size_t i = 0; i < 4; ++i) {
-      old_bytes_vec.push_back(memory_controller_.ReadByte(addr + i));
+      old_bytes_vec.push_back(memory_controller_.ReadByte_d(addr + i));
     }
     uint32_t val = registers_.ReadFpr(rs2) & 0xFFFFFFFF;
     memory_controller_.WriteWord(execution_result_, val);
-    // new_bytes_vec.push_back(memory_controller_.ReadByte(addr));
+    // new_bytes_vec.push_back(memory_controller_.ReadByte_d(addr));
     for (size_t i = 0; i < 4; ++i) {
-      new_bytes_vec.push_back(memory_controller_.ReadByte(addr + i));
+      new_bytes_vec.push_back(memory_controller_.ReadByte_d(addr + i));
     }
   }
 
@@ -752,7 +855,7 @@ void RVSSVM::WriteMemoryFloat() {
 }
 
 void RVSSVM::WriteMemoryDouble() {
-  uint8_t rs2 = (current_instruction_ >> 20) & 0b11111;
+  uint8_t rs2 = decoded_.rs2;
 
   if (control_unit_.GetMemRead()) {// FLD
     memory_result_ = memory_controller_.ReadDoubleWord(execution_result_);
@@ -765,11 +868,11 @@ void RVSSVM::WriteMemoryDouble() {
   if (control_unit_.GetMemWrite()) {// FSD
     addr = execution_result_;
     for (size_t i = 0; i < 8; ++i) {
-      old_bytes_vec.push_back(memory_controller_.ReadByte(addr + i));
+      old_bytes_vec.push_back(memory_controller_.ReadByte_d(addr + i));
     }
     memory_controller_.WriteDoubleWord(execution_result_, registers_.ReadFpr(rs2));
     for (size_t i = 0; i < 8; ++i) {
-      new_bytes_vec.push_back(memory_controller_.ReadByte(addr + i));
+      new_bytes_vec.push_back(memory_controller_.ReadByte_d(addr + i));
     }
   }
 
@@ -778,24 +881,90 @@ void RVSSVM::WriteMemoryDouble() {
   }
 }
 
+void RVSSVM::ThrowIllegalInstruction() const {
+  std::ostringstream message;
+  message << "Illegal instruction: 0x" << std::hex << std::setw(8) << std::setfill('0') << decoded_.instruction;
+  throw std::runtime_error(message.str());
+}
+
+void RVSSVM::WriteMemoryAtomic() {
+  uint64_t addr = static_cast<uint64_t>(execution_result_);
+  uint64_t operand = registers_.ReadGpr(decoded_.rs2);
+  uint8_t funct5 = decoded_.funct7 >> 2;
+  if (decoded_.funct3 != 0b010 && decoded_.funct3 != 0b011) {
+    ThrowIllegalInstruction();
+  }
+  bool word = decoded_.funct3 == 0b010;
+  uint64_t size = word ? 4 : 8;
+
+  if (funct5 == get_instr_encoding(Instruction::klr_w).funct5) { // LR
+    reservation_.valid = true;
+    reservation_.address = addr;
+    reservation_.size = size;
+    reservation_.value = word ? memory_controller_.LoadReserved<uint32_t>(addr, reservation_.version)
+                              : memory_controller_.LoadReserved<uint64_t>(addr, reservation_.version);
+    memory_result_ = word ? static_cast<int32_t>(reservation_.value) : static_cast<int64_t>(reservation_.value);
+    return;
+  }
+
+  std::vector<uint8_t> old_bytes_vec(size);
+  std::vector<uint8_t> new_bytes_vec(size);
+  memory_controller_.ReadBlock_d(addr, old_bytes_vec);
+
+  if (funct5 == get_instr_encoding(Instruction::ksc_w).funct5) { // SC, which uses up the reservation either way
+    bool matches = reservation_.valid && reservation_.address == addr && reservation_.size == size;
+    bool stored = false;
+    if (matches) {
+      stored = word ? memory_controller_.StoreConditional<uint32_t>(addr, reservation_.version,
+                                                                    static_cast<uint32_t>(reservation_.value),
+                                                                    static_cast<uint32_t>(operand))
+                    : memory_controller_.StoreConditional<uint64_t>(addr, reservation_.version, reservation_.value,
+                                                                    operand);
+    }
+    reservation_.valid = false;
+    memory_result_ = stored ? 0 : 1;
+  } else {
+    AtomicOp op;
+    switch (funct5) {
+      case get_instr_encoding(Instruction::kamoswap_w).funct5: op = AtomicOp::kSwap; break;
+      case get_instr_encoding(Instruction::kamoadd_w).funct5: op = AtomicOp::kAdd; break;
+      case get_instr_encoding(Instruction::kamoxor_w).funct5: op = AtomicOp::kXor; break;
+      case get_instr_encoding(Instruction::kamoand_w).funct5: op = AtomicOp::kAnd; break;
+      case get_instr_encoding(Instruction::kamoor_w).funct5: op = AtomicOp::kOr; break;
+      case get_instr_encoding(Instruction::kamomin_w).funct5: op = AtomicOp::kMin; break;
+      case get_instr_encoding(Instruction::kamomax_w).funct5: op = AtomicOp::kMax; break;
+      case get_instr_encoding(Instruction::kamominu_w).funct5: op = AtomicOp::kMinu; break;
+      case get_instr_encoding(Instruction::kamomaxu_w).funct5: op = AtomicOp::kMaxu; break;
+      default: ThrowIllegalInstruction(); // before WriteBack() can put a stale memory_result_ in rd
+    }
+    memory_result_ = word
+        ? static_cast<int32_t>(memory_controller_.AtomicFetch<uint32_t>(addr, op, static_cast<uint32_t>(operand)))
+        : static_cast<int64_t>(memory_controller_.AtomicFetch<uint64_t>(addr, op, operand));
+  }
+
+  memory_controller_.ReadBlock_d(addr, new_bytes_vec);
+  if (old_bytes_vec != new_bytes_vec) {
+    current_delta_.memory_changes.push_back({addr, old_bytes_vec, new_bytes_vec});
+  }
+}
+
 void RVSSVM::WriteBack() {
-  uint8_t opcode = current_instruction_ & 0b1111111;
-  uint8_t funct3 = (current_instruction_ >> 12) & 0b111;
-  uint8_t rd = (current_instruction_ >> 7) & 0b11111;
-  int32_t imm = ImmGenerator(current_instruction_);
+  ExecutionClass execution_class = decoded_.execution_class;
+  uint8_t opcode = decoded_.opcode;
+  uint8_t rd = decoded_.rd;
+  int32_t imm = decoded_.imm;
 
-  if (opcode == get_instr_encoding(Instruction::kecall).opcode && 
-      funct3 == get_instr_encoding(Instruction::kecall).funct3) { // ecall
+  if (execution_class == ExecutionClass::kSyscall) { // ecall
     return;
   }
 
-  if (instruction_set::isFInstruction(current_instruction_)) { // RV64 F
+  if (execution_class == ExecutionClass::kFloat) { // RV64 F
     WriteBackFloat();
     return;
-  } else if (instruction_set::isDInstruction(current_instruction_)) {
+  } else if (execution_class == ExecutionClass::kDouble) {
     WriteBackDouble();
     return;
-  } else if (opcode==0b1110011) { // CSR opcode
+  } else if (execution_class == ExecutionClass::kCsr) { // CSR opcode
     WriteBackCsr();
     return;
   }
@@ -813,7 +982,8 @@ void RVSSVM::WriteBack() {
         registers_.WriteGpr(rd, execution_result_);
         break;
       }
-      case get_instr_encoding(Instruction::kLoadType).opcode: /* Load */ { 
+      case get_instr_encoding(Instruction::kLoadType).opcode: /* Load */
+      case get_instr_encoding(Instruction::kAtomicType).opcode: /* LR, SC, AMO */ {
         registers_.WriteGpr(rd, memory_result_);
         break;
       }
@@ -846,9 +1016,9 @@ void RVSSVM::WriteBack() {
 }
 
 void RVSSVM::WriteBackFloat() {
-  uint8_t opcode = current_instruction_ & 0b1111111;
-  uint8_t funct7 = (current_instruction_ >> 25) & 0b1111111;
-  uint8_t rd = (current_instruction_ >> 7) & 0b11111;
+  uint8_t opcode = decoded_.opcode;
+  uint8_t funct7 = decoded_.funct7;
+  uint8_t rd = decoded_.rd;
 
   uint64_t old_reg = 0;
   unsigned int reg_index = rd;
@@ -921,9 +1091,9 @@ void RVSSVM::WriteBackFloat() {
 }
 
 void RVSSVM::WriteBackDouble() {
-  uint8_t opcode = current_instruction_ & 0b1111111;
-  uint8_t funct7 = (current_instruction_ >> 25) & 0b1111111;
-  uint8_t rd = (current_instruction_ >> 7) & 0b11111;
+  uint8_t opcode = decoded_.opcode;
+  uint8_t funct7 = decoded_.funct7;
+  uint8_t rd = decoded_.rd;
 
   uint64_t old_reg = 0;
   unsigned int reg_index = rd;
@@ -962,8 +1132,8 @@ void RVSSVM::WriteBackDouble() {
 }
 
 void RVSSVM::WriteBackCsr() {
-  uint8_t rd = (current_instruction_ >> 7) & 0b11111;
-  uint8_t funct3 = (current_instruction_ >> 12) & 0b111;
+  uint8_t rd = decoded_.rd;
+  uint8_t funct3 = decoded_.funct3;
 
   switch (funct3) {
     case get_instr_encoding(Instruction::kcsrrw).funct3: { // CSRRW
@@ -1008,37 +1178,37 @@ void RVSSVM::WriteBackCsr() {
 
 }
 
-void RVSSVM::Run() {
-  ClearStop();
+uint64_t RVSSVM::RunInstructions(uint64_t count) {
   uint64_t instruction_executed = 0;
 
   while (!stop_requested_ && program_counter_ < program_size_) {
-    if (instruction_executed > vm_config::config.getInstructionExecutionLimit()){
+    if (instruction_executed >= count) {
       break;
     }
 
       // Custom instruction stall logic
-    if (control_unit_.GetLdbmStart() && !bigmul_unit::GetLdbmDone()) {
-      //std::cout << "[LDBM Stall] offset=" << bigmul_unit::ldbm_offset << std::endl;
+    if (control_unit_.GetLdbmStart() && !bigmul_unit_.GetLdbmDone()) {
+      //std::cout << "[LDBM Stall] offset=" << bigmul_unit_.ldbm_offset << std::endl;
       WriteMemory(); // Only do LDBM loading
-      cycle_s_++;
+      AdvanceCycle();
       continue; // Stall pipeline
     }
 
-    if (control_unit_.GetBigmulStart() && !bigmul_unit::GetBigmulDone()) {
-      if (!bigmul_unit::GetWriteDone()) {
-        //std::cout << "[BIGMUL Write Stall] write_offset=" << bigmul_unit::write_offset << std::endl;
+    if (control_unit_.GetBigmulStart() && !bigmul_unit_.GetBigmulDone()) {
+      if (!bigmul_unit_.GetWriteDone()) {
+        //std::cout << "[BIGMUL Write Stall] write_offset=" << bigmul_unit_.write_offset << std::endl;
         WriteMemory(); // Only do result writing
-        cycle_s_++;
+        AdvanceCycle();
         continue; // Stall pipeline
       } else {
-        //std::cout << "[BIGMUL Exec Stall] prog=" << bigmul_unit::bigmul_prog << std::endl;
-        bigmul_unit::executeBigmul(); // Advance computation
-        cycle_s_++;
+        //std::cout << "[BIGMUL Exec Stall] prog=" << bigmul_unit_.bigmul_prog << std::endl;
+        bigmul_unit_.executeBigmul(); // Advance computation
+        AdvanceCycle();
         continue; // Stall pipeline
       }
     }
 
+    MaybeCheckpoint();
     Fetch();
     Decode();
     Execute();
@@ -1046,19 +1216,116 @@ void RVSSVM::Run() {
     WriteBack();
     instructions_retired_++;
     instruction_executed++;
-    cycle_s_++;
-    std::cout << "Program Counter: " << program_counter_ << std::endl;
+    AdvanceCycle();
+    if (!silent_run_) {
+      Console() << "Program Counter: " << program_counter_ << std::endl;
+    }
   }
+  // Running is not undoable; drop what the stages recorded
+  current_delta_ = StepDelta();
+  return instruction_executed;
+}
+
+void RVSSVM::Run() {
+  ClearStop();
+  RunInstructions(RunLimit());
+  FlushSyscallOutput();
   if (program_counter_ >= program_size_) {
-    std::cout << "VM_PROGRAM_END" << std::endl;
+    Console() << "VM_PROGRAM_END" << std::endl;
     output_status_ = "VM_PROGRAM_END";
   }
-  DumpRegisters(globals::registers_dump_file_path, registers_);
-  DumpState(globals::vm_state_dump_file_path);
+  DumpRegisters(output_paths_.registers_dump, registers_);
+  DumpState(output_paths_.vm_state_dump);
+}
+
+void RVSSVM::TurboRun() {
+  silent_run_ = true;
+  run_start_time_ = std::chrono::steady_clock::now();
+  run_start_retired_ = instructions_retired_;
+  Run();
+  silent_run_ = false;
+  ReportRunThroughput();
+}
+
+void RVSSVM::ReportRunThroughput() {
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - run_start_time_;
+  unsigned int retired = instructions_retired_ - run_start_retired_;
+  double seconds = elapsed.count();
+  double instructions_per_second = seconds > 0 ? retired / seconds : 0.0;
+  Console() << "VM_RUN_STATS instructions=" << retired
+            << " seconds=" << std::fixed << std::setprecision(6) << seconds
+            << " instructions_per_second=" << std::setprecision(0) << instructions_per_second
+            << std::defaultfloat << std::setprecision(6) << std::endl;
+}
+
+void RVSSVM::ReportHistoryUsage() {
+  UndoHistoryUsage usage = history_.GetUsage();
+  Console() << "VM_HISTORY_STATS undo_steps=" << usage.undo_steps
+            << " redo_steps=" << usage.redo_steps
+            << " capacity=" << usage.capacity
+            << " encoded_bytes=" << usage.encoded_bytes
+            << " reserved_bytes=" << usage.reserved_bytes << std::endl;
+}
+
+void RVSSVM::BeginStepDelta() {
+  uint8_t opcode = memory_controller_.ReadWord_d(program_counter_) & 0x7F;
+  if (opcode == get_instr_encoding(Instruction::kldbm).opcode) {
+    current_delta_.custom_instr_executed = 1; // LDBM
+  } else if (opcode == get_instr_encoding(Instruction::kbigmul).opcode) {
+    current_delta_.custom_instr_executed = 2; // BIGMUL
+  } else {
+    current_delta_.custom_instr_executed = 0;
+  }
+  // Only LDBM and BIGMUL change the unit, so only they need its snapshot for undo/redo
+  if (current_delta_.custom_instr_executed != 0) {
+    current_delta_.bigmul_state = bigmul_unit_.snapshot();
+  }
+  current_delta_.old_pc = program_counter_;
+  // The counts at the start, until EndStepDelta() turns them into what the step took
+  current_delta_.cycles = cycle_s_;
+  current_delta_.stall_cycles = stall_cycles_;
+}
+
+void RVSSVM::EndStepDelta() {
+  current_delta_.new_pc = program_counter_;
+  current_delta_.cycles = cycle_s_ - current_delta_.cycles;
+  current_delta_.stall_cycles = stall_cycles_ - current_delta_.stall_cycles;
+  if (current_delta_.custom_instr_executed != 0) {
+    current_delta_.bigmul_state_after = bigmul_unit_.snapshot();
+  }
+  history_.Push(current_delta_);
+  current_delta_ = StepDelta();
+}
+
+bool RVSSVM::StepWithUndo() {
+  BeginStepDelta();
+  MaybeCheckpoint();
+  Fetch();
+  Decode();
+  Execute();
+  WriteMemory();
+  WriteBack();
+  instructions_retired_++;
+  AdvanceCycle();
+
+  while (control_unit_.GetLdbmStart() && !bigmul_unit_.GetLdbmDone()) {
+    WriteMemory(); // Only do LDBM loading
+    AdvanceCycle();
+  }
+  while (control_unit_.GetBigmulStart() && !bigmul_unit_.GetBigmulDone()) {
+    if (!bigmul_unit_.GetWriteDone()) {
+      WriteMemory(); // Only do result writing
+    } else {
+      bigmul_unit_.executeBigmul(); // Advance computation
+    }
+    AdvanceCycle();
+  }
+  EndStepDelta();
+  return true;
 }
 
 void RVSSVM::DebugRun() {
-  //std::cout << "[LDBM Stall] offset=" << bigmul_unit::ldbm_offset << std::endl;
+  //std::cout << "[LDBM Stall] offset=" << bigmul_unit_.ldbm_offset << std::endl;
   ClearStop();
   uint64_t instruction_executed = 0;
   while (!stop_requested_ && program_counter_ < program_size_) {
@@ -1066,150 +1333,79 @@ void RVSSVM::DebugRun() {
       break;
 
       // Custom instruction stall logic
-    // if (control_unit_.GetLdbmStart() && !bigmul_unit::GetLdbmDone()) {
-    //   std::cout << "[LDBM Stall] offset=" << bigmul_unit::ldbm_offset << std::endl;
+    // if (control_unit_.GetLdbmStart() && !bigmul_unit_.GetLdbmDone()) {
+    //   std::cout << "[LDBM Stall] offset=" << bigmul_unit_.ldbm_offset << std::endl;
     //   WriteMemory(); // Only do LDBM loading
     //   cycle_s_++;
     //   continue; // Stall pipeline
     // }
 
-    // if (control_unit_.GetBigmulStart() && !bigmul_unit::GetBigmulDone()) {
-    //   if (!bigmul_unit::GetWriteDone()) {
-    //     std::cout << "[BIGMUL Write Stall] write_offset=" << bigmul_unit::write_offset << std::endl;
+    // if (control_unit_.GetBigmulStart() && !bigmul_unit_.GetBigmulDone()) {
+    //   if (!bigmul_unit_.GetWriteDone()) {
+    //     std::cout << "[BIGMUL Write Stall] write_offset=" << bigmul_unit_.write_offset << std::endl;
     //     WriteMemory(); // Only do result writing
     //     cycle_s_++;
     //     continue; // Stall pipeline
     //   } else {
-    //     //std::cout << "[BIGMUL Exec Stall] prog=" << bigmul_unit::bigmul_prog << std::endl;
-    //     bigmul_unit::executeBigmul(); // Advance computation
+    //     //std::cout << "[BIGMUL Exec Stall] prog=" << bigmul_unit_.bigmul_prog << std::endl;
+    //     bigmul_unit_.executeBigmul(); // Advance computation
     //     cycle_s_++;
     //     continue; // Stall pipeline
     //   }
     // }
 
-    {
-    // preview instruction at current PC without advancing PC
-    uint32_t instr_preview = memory_controller_.ReadWord(program_counter_);
-    uint8_t op_preview = instr_preview & 0x7F;
-
-    if (op_preview == get_instr_encoding(Instruction::kldbm).opcode) {
-      current_delta_.custom_instr_executed = 1; // LDBM
-    } else if (op_preview == get_instr_encoding(Instruction::kbigmul).opcode) {
-      current_delta_.custom_instr_executed = 2; // BIGMUL
-    } else {
-      current_delta_.custom_instr_executed = 0;
-    }
-
-    // capture entire bigmul unit snapshot (so undo/redo can fully restore)
-    current_delta_.bigmul_state = bigmul_unit::snapshot();
-  }
-
-    current_delta_.old_pc = program_counter_;
-    if (std::find(breakpoints_.begin(), breakpoints_.end(), program_counter_) == breakpoints_.end()) {
-      Fetch();
-      Decode();
-      Execute();
-      WriteMemory();
-      WriteBack();
-      instructions_retired_++;
-      instruction_executed++;
-      cycle_s_++;
-      std::cout << "Program Counter: " << program_counter_ << std::endl;
-
-      while (control_unit_.GetLdbmStart() && !bigmul_unit::GetLdbmDone()) {
-      //std::cout << "[LDBM Stall] offset=" << bigmul_unit::ldbm_offset << std::endl;
-      WriteMemory(); // Only do LDBM loading
-      cycle_s_++;
-      //continue; // Stall pipeline
-    }
-
-    while (control_unit_.GetBigmulStart() && !bigmul_unit::GetBigmulDone()) {
-      if (!bigmul_unit::GetWriteDone()) {
-        //std::cout << "[BIGMUL Write Stall] write_offset=" << bigmul_unit::write_offset << std::endl;
-        WriteMemory(); // Only do result writing
-        cycle_s_++;
-        //continue; // Stall pipeline
-      } else {
-        //std::cout << "[BIGMUL Exec Stall] prog=" << bigmul_unit::bigmul_prog << std::endl;
-        bigmul_unit::executeBigmul(); // Advance computation
-        cycle_s_++;
-        //continue; // Stall pipeline
-      }
-    }
-
-      current_delta_.new_pc = program_counter_;
-      // history_.push(current_delta_);
-      undo_stack_.push(current_delta_);
-      while (!redo_stack_.empty()) {
-        redo_stack_.pop();
-      }
-      current_delta_ = StepDelta();
-      if (program_counter_ < program_size_) {
-        std::cout << "VM_STEP_COMPLETED" << std::endl;
-        output_status_ = "VM_STEP_COMPLETED";
-      } else if (program_counter_ >= program_size_) {
-        std::cout << "VM_LAST_INSTRUCTION_STEPPED" << std::endl;
-        output_status_ = "VM_LAST_INSTRUCTION_STEPPED";
-      }
-      DumpRegisters(globals::registers_dump_file_path, registers_);
-      DumpState(globals::vm_state_dump_file_path);
-
-      unsigned int delay_ms = vm_config::config.getRunStepDelay();
-      std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
-      
-    } else {
+    if (std::find(breakpoints_.begin(), breakpoints_.end(), program_counter_) != breakpoints_.end()) {
       current_delta_ = StepDelta();
-      std::cout << "VM_BREAKPOINT_HIT " << program_counter_ << std::endl;
+      Console() << "VM_BREAKPOINT_HIT " << program_counter_ << std::endl;
       output_status_ = "VM_BREAKPOINT_HIT";
       break;
     }
+    if (!StepWithUndo()) {
+      break;
+    }
+    instruction_executed++;
+    Console() << "Program Counter: " << program_counter_ << std::endl;
+    if (program_counter_ < program_size_) {
+      Console() << "VM_STEP_COMPLETED" << std::endl;
+      output_status_ = "VM_STEP_COMPLETED";
+    } else {
+      Console() << "VM_LAST_INSTRUCTION_STEPPED" << std::endl;
+      output_status_ = "VM_LAST_INSTRUCTION_STEPPED";
+    }
+    DumpRegisters(output_paths_.registers_dump, registers_);
+    DumpState(output_paths_.vm_state_dump);
+
+    unsigned int delay_ms = vm_config::config.getRunStepDelay();
+    std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
   }
   if (program_counter_ >= program_size_) {
-    std::cout << "VM_PROGRAM_END" << std::endl;
+    Console() << "VM_PROGRAM_END" << std::endl;
     output_status_ = "VM_PROGRAM_END";
   }
-  DumpRegisters(globals::registers_dump_file_path, registers_);
-  DumpState(globals::vm_state_dump_file_path);
+  DumpRegisters(output_paths_.registers_dump, registers_);
+  DumpState(output_paths_.vm_state_dump);
 }
 
 void RVSSVM::Step() {
 
 
-  {
-    // preview instruction at current PC without advancing PC
-    uint32_t instr_preview = memory_controller_.ReadWord(program_counter_);
-    uint8_t op_preview = instr_preview & 0x7F;
-
-    if (op_preview == get_instr_encoding(Instruction::kldbm).opcode) {
-      current_delta_.custom_instr_executed = 1; // LDBM
-    } else if (op_preview == get_instr_encoding(Instruction::kbigmul).opcode) {
-      current_delta_.custom_instr_executed = 2; // BIGMUL
-    } else {
-      current_delta_.custom_instr_executed = 0;
-    }
-
-    // capture entire bigmul unit snapshot (so undo/redo can fully restore)
-    current_delta_.bigmul_state = bigmul_unit::snapshot();
-  }
-
-  current_delta_.old_pc = program_counter_;
-
-
   if (program_counter_ < program_size_) {
+    BeginStepDelta();
+    MaybeCheckpoint();
     Fetch();
     Decode();
     Execute();
     WriteMemory();
     WriteBack();
     instructions_retired_++;
-    cycle_s_++;
-    std::cout << "Program Counter: " << std::hex << program_counter_ << std::dec << std::endl;
+    AdvanceCycle();
+    Console() << "Program Counter: " << std::hex << program_counter_ << std::dec << std::endl;
 
     // Custom instruction stall logic
-while(control_unit_.GetLdbmStart() && !bigmul_unit::GetLdbmDone()) {
-    std::cout << "[LDBM Stall] offset=" << bigmul_unit::ldbm_offset << std::endl;
+while(control_unit_.GetLdbmStart() && !bigmul_unit_.GetLdbmDone()) {
+    Console() << "[LDBM Stall] offset=" << bigmul_unit_.ldbm_offset << std::endl;
     WriteMemory(); // Only do LDBM loading
-    cycle_s_++;
+    AdvanceCycle();
     
     // output_status_ = "VM_STEP_STALL";
     // DumpRegisters(globals::registers_dump_file_path, registers_);
@@ -1218,11 +1414,11 @@ while(control_unit_.GetLdbmStart() && !bigmul_unit::GetLdbmDone()) {
     // return; // Return instead of continue
   }
 
-  while(control_unit_.GetBigmulStart() && !bigmul_unit::GetBigmulDone()) {
-    if (!bigmul_unit::GetWriteDone()) {
-      std::cout << "[BIGMUL Write Stall] write_offset=" << bigmul_unit::write_offset << std::endl;
+  while(control_unit_.GetBigmulStart() && !bigmul_unit_.GetBigmulDone()) {
+    if (!bigmul_unit_.GetWriteDone()) {
+      Console() << "[BIGMUL Write Stall] write_offset=" << bigmul_unit_.write_offset << std::endl;
       WriteMemory(); // Only do result writing
-      cycle_s_++;
+      AdvanceCycle();
       
       // output_status_ = "VM_STEP_STALL";
       // DumpRegisters(globals::registers_dump_file_path, registers_);
@@ -1230,9 +1426,9 @@ while(control_unit_.GetLdbmStart() && !bigmul_unit::GetLdbmDone()) {
       // current_delta_ = StepDelta();
       // return; // Return instead of continue
     } else {
-      //std::cout << "[BIGMUL Exec Stall] prog=" << bigmul_unit::bigmul_prog << std::endl;
-      bigmul_unit::executeBigmul(); // Advance computation
-      cycle_s_++;
+      //std::cout << "[BIGMUL Exec Stall] prog=" << bigmul_unit_.bigmul_prog << std::endl;
+      bigmul_unit_.executeBigmul(); // Advance computation
+      AdvanceCycle();
       
       // output_status_ = "VM_STEP_STALL";
       // DumpRegisters(globals::registers_dump_file_path, registers_);
@@ -1242,69 +1438,52 @@ while(control_unit_.GetLdbmStart() && !bigmul_unit::GetLdbmDone()) {
     }
     }
 
-    current_delta_.new_pc = program_counter_;
-
-    // history_.push(current_delta_);
-
-    undo_stack_.push(current_delta_);
-    while (!redo_stack_.empty()) {
-      redo_stack_.pop();
-    }
-
-    current_delta_ = StepDelta();
+    EndStepDelta();
 
 
     if (program_counter_ < program_size_) {
-      std::cout << "VM_STEP_COMPLETED" << std::endl;
+      Console() << "VM_STEP_COMPLETED" << std::endl;
       output_status_ = "VM_STEP_COMPLETED";
     } else if (program_counter_ >= program_size_) {
-      std::cout << "VM_LAST_INSTRUCTION_STEPPED" << std::endl;
+      Console() << "VM_LAST_INSTRUCTION_STEPPED" << std::endl;
       output_status_ = "VM_LAST_INSTRUCTION_STEPPED";
     }
 
   } else if (program_counter_ >= program_size_) {
-    std::cout << "VM_PROGRAM_END" << std::endl;
+    Console() << "VM_PROGRAM_END" << std::endl;
     output_status_ = "VM_PROGRAM_END";
   }
-  DumpRegisters(globals::registers_dump_file_path, registers_);
-  DumpState(globals::vm_state_dump_file_path);
+  DumpRegisters(output_paths_.registers_dump, registers_);
+  DumpState(output_paths_.vm_state_dump);
 }
 
 void RVSSVM::Undo() {
-  if (undo_stack_.empty()) {
-    std::cout << "VM_NO_MORE_UNDO" << std::endl;
+  if (!history_.CanUndo()) {
+    Console() << "VM_NO_MORE_UNDO" << std::endl;
     output_status_ = "VM_NO_MORE_UNDO";
     return;
   }
   //custom
-  // while (control_unit_.GetLdbmStart() && !bigmul_unit::GetLdbmDone()) {
+  // while (control_unit_.GetLdbmStart() && !bigmul_unit_.GetLdbmDone()) {
   //   WriteMemory();
   //   cycle_s_++;
   // }
-  // while (control_unit_.GetBigmulStart() && !bigmul_unit::GetBigmulDone()) {
-  //   if (!bigmul_unit::GetWriteDone()) {
+  // while (control_unit_.GetBigmulStart() && !bigmul_unit_.GetBigmulDone()) {
+  //   if (!bigmul_unit_.GetWriteDone()) {
   //         WriteMemory();
   //         cycle_s_++;
   //   }else{
-  //   bigmul_unit::executeBigmul();
+  //   bigmul_unit_.executeBigmul();
   //   cycle_s_++;
   //   }
   // }
 
-  StepDelta last = undo_stack_.top();
-  undo_stack_.pop();
+  StepDelta last = history_.Undo();
 
   if (last.custom_instr_executed == 1 || last.custom_instr_executed == 2) {
-    bigmul_unit::restore(last.bigmul_state);
+    bigmul_unit_.restore(last.bigmul_state);
 }
 
-  // if (!history_.can_undo()) {
-  //     std::cout << "Nothing to undo.\n";
-  //     return;
-  // }
-
-  // StepDelta last = history_.undo();
-
   for (const auto &change : last.register_changes) {
     switch (change.reg_type) {
       case 0: { // GPR
@@ -1325,59 +1504,49 @@ void RVSSVM::Undo() {
   }
 
   for (const auto &change : last.memory_changes) {
-    for (size_t i = 0; i < change.old_bytes_vec.size(); ++i) {
-      memory_controller_.WriteByte(change.address + i, change.old_bytes_vec[i]);
-    }
+    memory_controller_.WriteBlock_d(change.address, change.old_bytes_vec);
   }
 
   program_counter_ = last.old_pc;
   instructions_retired_--;
-  cycle_s_--;
-  std::cout << "Program Counter: " << program_counter_ << std::endl;
-
-  redo_stack_.push(last);
+  cycle_s_ -= last.cycles;
+  stall_cycles_ -= last.stall_cycles;
+  UpdateCpi();
+  Console() << "Program Counter: " << program_counter_ << std::endl;
 
   output_status_ = "VM_UNDO_COMPLETED";
-  std::cout << "VM_UNDO_COMPLETED" << std::endl;
+  Console() << "VM_UNDO_COMPLETED" << std::endl;
 
-  DumpRegisters(globals::registers_dump_file_path, registers_);
-  DumpState(globals::vm_state_dump_file_path);
+  DumpRegisters(output_paths_.registers_dump, registers_);
+  DumpState(output_paths_.vm_state_dump);
 }
 
 void RVSSVM::Redo() {
-  if (redo_stack_.empty()) {
-    std::cout << "VM_NO_MORE_REDO" << std::endl;
+  if (!history_.CanRedo()) {
+    Console() << "VM_NO_MORE_REDO" << std::endl;
     return;
   }
   //custom
-  // while (control_unit_.GetLdbmStart() && !bigmul_unit::GetLdbmDone()) {
+  // while (control_unit_.GetLdbmStart() && !bigmul_unit_.GetLdbmDone()) {
   //   WriteMemory();
   //   cycle_s_++;
   // }
-  // while (control_unit_.GetBigmulStart() && !bigmul_unit::GetBigmulDone()) {
-  //    if (!bigmul_unit::GetWriteDone()) {
+  // while (control_unit_.GetBigmulStart() && !bigmul_unit_.GetBigmulDone()) {
+  //    if (!bigmul_unit_.GetWriteDone()) {
   //         WriteMemory();
   //         cycle_s_++;
   //   }else{
-  //   bigmul_unit::executeBigmul();
+  //   bigmul_unit_.executeBigmul();
   //   cycle_s_++;
   //   }
   // }
 
-  StepDelta next = redo_stack_.top();
-  redo_stack_.pop();
+  StepDelta next = history_.Redo();
 
   if (next.custom_instr_executed == 1 || next.custom_instr_executed == 2) {
-    bigmul_unit::restore(next.bigmul_state);
+    bigmul_unit_.restore(next.bigmul_state_after);
 }
 
-  // if (!history_.can_redo()) {
-  //       std::cout << "Nothing to redo.\n";
-  //       return;
-  //   }
-
-  //   StepDelta next = history_.redo();
-
   for (const auto &change : next.register_changes) {
     switch (change.reg_type) {
       case 0: { // GPR
@@ -1398,20 +1567,19 @@ void RVSSVM::Redo() {
   }
 
   for (const auto &change : next.memory_changes) {
-    for (size_t i = 0; i < change.new_bytes_vec.size(); ++i) {
-      memory_controller_.WriteByte(change.address + i, change.new_bytes_vec[i]);
-    }
+    memory_controller_.WriteBlock_d(change.address, change.new_bytes_vec);
   }
 
   program_counter_ = next.new_pc;
   instructions_retired_++;
-  cycle_s_++;
-  DumpRegisters(globals::registers_dump_file_path, registers_);
-  DumpState(globals::vm_state_dump_file_path);
-  std::cout << "Program Counter: " << program_counter_ << std::endl;
+  cycle_s_ += next.cycles;
+  stall_cycles_ += next.stall_cycles;
+  UpdateCpi();
+  DumpRegisters(output_paths_.registers_dump, registers_);
+  DumpState(output_paths_.vm_state_dump);
+  Console() << "Program Counter: " << program_counter_ << std::endl;
   output_status_ = "VM_REDO_COMPLETED";
-  std::cout << "VM_REDO_COMPLETED" << std::endl;
-  undo_stack_.push(next);
+  Console() << "VM_REDO_COMPLETED" << std::endl;
 
 }
 
@@ -1419,11 +1587,18 @@ void RVSSVM::Reset() {
   program_counter_ = 0;
   instructions_retired_ = 0;
   cycle_s_ = 0;
+  stall_cycles_ = 0;
+  branch_mispredictions_ = 0;
+  UpdateCpi();
   registers_.Reset();
   memory_controller_.Reset();
+  branch_predictor_ = branch_prediction::BranchPredictor(vm_config::config.getBranchPredictorConfig());
+  decode_cache_.Clear();
   control_unit_.Reset();
   //custom
-  bigmul_unit::reset();
+  ConfigureBigmulUnit();
+  guest_exited_ = false;
+  guest_exit_code_ = 0;
   branch_flag_ = false;
   next_pc_ = 0;
   execution_result_ = 0;
@@ -1434,15 +1609,213 @@ void RVSSVM::Reset() {
   csr_old_value_ = 0;
   csr_write_val_ = 0;
   csr_uimm_ = 0;
+  reservation_ = Reservation();
   current_delta_.register_changes.clear();
   current_delta_.memory_changes.clear();
   current_delta_.old_pc = 0;
   current_delta_.new_pc = 0;
-  undo_stack_ = std::stack<StepDelta>();
-  redo_stack_ = std::stack<StepDelta>();
+  history_.SetCapacity(vm_config::config.getUndoHistorySize());
+  // Memory::Reset() stopped the journal; the checkpoints belong to the run being reset
+  ResetCheckpoints();
+}
+
+
 
+
+
+void RVSSVM::ResetCheckpoints() {
+  memory_controller_.JournalWrites(nullptr);
+  checkpoints_.clear();
+  input_log_.clear();
+  input_log_cursor_ = 0;
+  // A checkpoint's journal would miss what the other harts write to a shared memory
+  bool disabled = vm_config::config.getCheckpointInterval() == 0 || memory_controller_.IsMemoryShared();
+  next_checkpoint_at_ = disabled ? std::numeric_limits<uint64_t>::max() : instructions_retired_;
+}
+
+void RVSSVM::ShareMemory(RVSSVM &other) {
+  memory_controller_.JournalWrites(nullptr);
+  other.memory_controller_.JournalWrites(nullptr);
+  memory_controller_.ShareMemory(other.memory_controller_);
+  ResetCheckpoints();
+  other.ResetCheckpoints();
+}
+
+void RVSSVM::TakeCheckpoint() {
+  // The oldest checkpoint's journal only serves to restore that checkpoint itself
+  while (!checkpoints_.empty() && checkpoints_.size() >= vm_config::config.getCheckpointLimit()) {
+    checkpoints_.pop_front();
+  }
+  Checkpoint &checkpoint = checkpoints_.emplace_back();
+  checkpoint.instructions_retired = instructions_retired_;
+  checkpoint.cycles = cycle_s_;
+  checkpoint.stall_cycles = stall_cycles_;
+  checkpoint.program_counter = program_counter_;
+  checkpoint.registers = registers_;
+  if (const cache::CacheHierarchy *caches = memory_controller_.GetCaches()) {
+    checkpoint.caches = *caches;
+  }
+  checkpoint.branch_predictor = branch_predictor_;
+  checkpoint.branch_mispredictions = branch_mispredictions_;
+  checkpoint.bigmul_state = bigmul_unit_.snapshot();
+  checkpoint.guest_exited = guest_exited_;
+  checkpoint.reservation = reservation_;
+  checkpoint.input_log_position = input_log_cursor_;
+  memory_controller_.JournalWrites(&checkpoint.overwritten);
+  next_checkpoint_at_ = instructions_retired_ + vm_config::config.getCheckpointInterval();
 }
 
+void RVSSVM::RestoreCheckpoint(size_t index) {
+  while (checkpoints_.size() > index + 1) {
+    memory_controller_.RestoreBlocks(checkpoints_.back().overwritten);
+    checkpoints_.pop_back();
+  }
+  Checkpoint &checkpoint = checkpoints_.back();
+  memory_controller_.RestoreBlocks(checkpoint.overwritten);
+  checkpoint.overwritten.clear();
+  memory_controller_.JournalWrites(&checkpoint.overwritten);
+
+  instructions_retired_ = checkpoint.instructions_retired;
+  cycle_s_ = checkpoint.cycles;
+  stall_cycles_ = checkpoint.stall_cycles;
+  UpdateCpi();
+  program_counter_ = checkpoint.program_counter;
+  registers_ = checkpoint.registers;
+  // Replay then meets the lines as the first run did and is charged the same stalls
+  memory_controller_.RestoreCaches(checkpoint.caches);
+  // Replay trains the predictor and counts its branches again, so it starts from what they were here
+  branch_predictor_ = checkpoint.branch_predictor;
+  branch_mispredictions_ = checkpoint.branch_mispredictions;
+  bigmul_unit_.restore(checkpoint.bigmul_state);
+  // Checkpoints are taken with the unit idle; stale LDBM/BIGMUL signals must not restart it
+  control_unit_.Reset();
+  guest_exited_ = checkpoint.guest_exited;
+  // The versions are not rewound; with nothing else sharing the memory, the reservation holds as it did
+  reservation_ = checkpoint.reservation;
+  if (reservation_.valid) {
+    reservation_.version = memory_controller_.ReservationVersion(reservation_.address);
+  }
+  input_log_cursor_ = checkpoint.input_log_position;
+  next_checkpoint_at_ = instructions_retired_ + vm_config::config.getCheckpointInterval();
+
+  // The undo history describes the timeline being rewound
+  history_.Clear();
+  current_delta_ = StepDelta();
+}
+
+VmSnapshot RVSSVM::Snapshot() {
+  VmSnapshot snapshot = VmBase::Snapshot();
+  snapshot.bigmul_state = bigmul_unit_.snapshot();
+  return snapshot;
+}
+
+void RVSSVM::Restore(const VmSnapshot &snapshot) {
+  VmBase::Restore(snapshot);
+  bigmul_unit_.restore(snapshot.bigmul_state);
+  // The control signals are set again by the next decode, including those of an LDBM/BIGMUL in progress
+  control_unit_.Reset();
+  reservation_ = Reservation();
+  history_.Clear();
+  current_delta_ = StepDelta();
+  ResetCheckpoints();
+}
+
+bool RVSSVM::ReplayTo(uint64_t retired, uint64_t *last_breakpoint) {
+  bool hit = false;
+  bool silent = silent_run_;
+  FlushSyscallOutput();
+  silent_run_ = true;
+  while (instructions_retired_ < retired && program_counter_ < program_size_) {
+    if (last_breakpoint != nullptr
+        && std::find(breakpoints_.begin(), breakpoints_.end(), program_counter_) != breakpoints_.end()) {
+      *last_breakpoint = instructions_retired_;
+      hit = true;
+    }
+    // A breakpoint search is always followed by restoring the checkpoint it started from
+    if (last_breakpoint == nullptr) {
+      MaybeCheckpoint();
+    }
+    Fetch();
+    Decode();
+    Execute();
+    WriteMemory();
+    WriteBack();
+    instructions_retired_++;
+    AdvanceCycle();
+
+    while (control_unit_.GetLdbmStart() && !bigmul_unit_.GetLdbmDone()) {
+      WriteMemory();
+      AdvanceCycle();
+    }
+    while (control_unit_.GetBigmulStart() && !bigmul_unit_.GetBigmulDone()) {
+      if (!bigmul_unit_.GetWriteDone()) {
+        WriteMemory();
+      } else {
+        bigmul_unit_.executeBigmul();
+      }
+      AdvanceCycle();
+    }
+  }
+  // What the replayed instructions printed was printed the first time round
+  syscall_output_buffer_.str("");
+  silent_run_ = silent;
+  current_delta_ = StepDelta();
+  return hit;
+}
 
+void RVSSVM::ReverseStep(uint64_t steps) {
+  if (checkpoints_.empty() || checkpoints_.front().instructions_retired > instructions_retired_) {
+    Console() << "VM_NO_CHECKPOINT" << std::endl;
+    output_status_ = "VM_NO_CHECKPOINT";
+    return;
+  }
+  uint64_t target = steps >= instructions_retired_ ? 0 : instructions_retired_ - steps;
+  size_t index = checkpoints_.size() - 1;
+  while (index > 0 && checkpoints_[index].instructions_retired > target) {
+    --index;
+  }
+  target = std::max(target, checkpoints_[index].instructions_retired);
+
+  RestoreCheckpoint(index);
+  ReplayTo(target);
+  Console() << "VM_REVERSE_STEP_COMPLETED" << std::endl;
+  output_status_ = "VM_REVERSE_STEP_COMPLETED";
+  Console() << "Program Counter: " << program_counter_ << std::endl;
+  DumpRegisters(output_paths_.registers_dump, registers_);
+  DumpState(output_paths_.vm_state_dump);
+}
 
+void RVSSVM::ReverseContinue() {
+  if (checkpoints_.empty() || checkpoints_.front().instructions_retired > instructions_retired_) {
+    Console() << "VM_NO_CHECKPOINT" << std::endl;
+    output_status_ = "VM_NO_CHECKPOINT";
+    return;
+  }
+  // Search the intervals between checkpoints newest first for the last breakpoint before now
+  uint64_t end = instructions_retired_;
+  for (size_t index = checkpoints_.size(); index-- > 0;) {
+    if (checkpoints_[index].instructions_retired >= end) {
+      continue;
+    }
+    RestoreCheckpoint(index);
+    uint64_t breakpoint = 0;
+    if (ReplayTo(end, &breakpoint)) {
+      RestoreCheckpoint(index);
+      ReplayTo(breakpoint);
+      Console() << "VM_BREAKPOINT_HIT " << program_counter_ << std::endl;
+      output_status_ = "VM_BREAKPOINT_HIT";
+      DumpRegisters(output_paths_.registers_dump, registers_);
+      DumpState(output_paths_.vm_state_dump);
+      return;
+    }
+    end = checkpoints_[index].instructions_retired;
+  }
 
+  // No breakpoint: stop at the oldest checkpoint
+  RestoreCheckpoint(0);
+  Console() << "VM_REVERSE_CONTINUE_COMPLETED" << std::endl;
+  output_status_ = "VM_REVERSE_CONTINUE_COMPLETED";
+  Console() << "Program Counter: " << program_counter_ << std::endl;
+  DumpRegisters(output_paths_.registers_dump, registers_);
+  DumpState(output_paths_.vm_state_dump);
+}
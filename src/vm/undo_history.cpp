@@ -0,0 +1,242 @@
+/**
+ * @file undo_history.cpp
+ * @brief Bounded undo/redo history storing each step as a compact encoded delta.
+ */
+
+#include "vm/undo_history.h"
+
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+void PutVarint(std::vector<uint8_t> &out, uint64_t value) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<uint8_t>(value) | 0x80);
+    value >>= 7;
+  }
+  out.push_back(static_cast<uint8_t>(value));
+}
+
+uint64_t GetVarint(const uint8_t *&in) {
+  uint64_t value = 0;
+  for (int shift = 0;; shift += 7) {
+    uint8_t byte = *in++;
+    value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      return value;
+    }
+  }
+}
+
+// Small differences of either sign encode to small varints
+uint64_t ZigZag(uint64_t difference) {
+  return (difference << 1) ^ static_cast<uint64_t>(static_cast<int64_t>(difference) >> 63);
+}
+
+uint64_t UnZigZag(uint64_t value) {
+  return (value >> 1) ^ (~(value & 1) + 1);
+}
+
+void PutBytes(std::vector<uint8_t> &out, const void *data, size_t size) {
+  const auto *bytes = static_cast<const uint8_t *>(data);
+  out.insert(out.end(), bytes, bytes + size);
+}
+
+void GetBytes(const uint8_t *&in, void *data, size_t size) {
+  if (size != 0) {
+    std::memcpy(data, in, size);
+  }
+  in += size;
+}
+
+void PutDoubleWords(std::vector<uint8_t> &out, const std::vector<uint64_t> &words) {
+  PutVarint(out, words.size());
+  PutBytes(out, words.data(), words.size() * sizeof(uint64_t));
+}
+
+void GetDoubleWords(const uint8_t *&in, std::vector<uint64_t> &words) {
+  words.resize(GetVarint(in));
+  GetBytes(in, words.data(), words.size() * sizeof(uint64_t));
+}
+
+void PutBigmulState(std::vector<uint8_t> &out, const BigmulUnit::BigmulState &s) {
+  out.push_back(static_cast<uint8_t>(s.bigmul_done | s.ldbm_done << 1 | s.write_done << 2));
+  for (uint64_t value : {uint64_t(s.ldbm_offset), uint64_t(s.bigmul_prog), uint64_t(s.write_offset),
+                         s.base_addr_A, s.base_addr_B, s.base_addr_res, s.size_of_operand}) {
+    PutVarint(out, value);
+  }
+  PutVarint(out, ZigZag(static_cast<uint64_t>(static_cast<int64_t>(s.resident_tile_A))));
+  PutVarint(out, ZigZag(static_cast<uint64_t>(static_cast<int64_t>(s.resident_tile_B))));
+  PutDoubleWords(out, s.cacheA);
+  PutDoubleWords(out, s.cacheB);
+  PutDoubleWords(out, s.resultCache);
+}
+
+void GetBigmulState(const uint8_t *&in, BigmulUnit::BigmulState &s) {
+  uint8_t flags = *in++;
+  s.bigmul_done = flags & 1;
+  s.ldbm_done = flags & 2;
+  s.write_done = flags & 4;
+  s.ldbm_offset = GetVarint(in);
+  s.bigmul_prog = GetVarint(in);
+  s.write_offset = GetVarint(in);
+  s.base_addr_A = GetVarint(in);
+  s.base_addr_B = GetVarint(in);
+  s.base_addr_res = GetVarint(in);
+  s.size_of_operand = GetVarint(in);
+  s.resident_tile_A = static_cast<int>(static_cast<int64_t>(UnZigZag(GetVarint(in))));
+  s.resident_tile_B = static_cast<int>(static_cast<int64_t>(UnZigZag(GetVarint(in))));
+  GetDoubleWords(in, s.cacheA);
+  GetDoubleWords(in, s.cacheB);
+  GetDoubleWords(in, s.resultCache);
+}
+
+void Encode(std::vector<uint8_t> &out, const StepDelta &delta) {
+  out.push_back(delta.custom_instr_executed);
+  PutVarint(out, delta.old_pc);
+  PutVarint(out, ZigZag(delta.new_pc - delta.old_pc));
+  PutVarint(out, delta.cycles);
+  PutVarint(out, delta.stall_cycles);
+
+  PutVarint(out, delta.register_changes.size());
+  for (const RegisterChange &change : delta.register_changes) {
+    PutVarint(out, static_cast<uint64_t>(change.reg_index) << 2 | change.reg_type);
+    PutVarint(out, change.old_value);
+    PutVarint(out, ZigZag(change.new_value - change.old_value));
+  }
+
+  PutVarint(out, delta.memory_changes.size());
+  for (const MemoryChange &change : delta.memory_changes) {
+    PutVarint(out, change.address);
+    PutVarint(out, change.old_bytes_vec.size());
+    PutVarint(out, change.new_bytes_vec.size());
+    PutBytes(out, change.old_bytes_vec.data(), change.old_bytes_vec.size());
+    PutBytes(out, change.new_bytes_vec.data(), change.new_bytes_vec.size());
+  }
+
+  if (delta.custom_instr_executed != 0) {
+    PutBigmulState(out, delta.bigmul_state);
+    PutBigmulState(out, delta.bigmul_state_after);
+  }
+}
+
+StepDelta Decode(const uint8_t *in) {
+  StepDelta delta;
+  delta.custom_instr_executed = *in++;
+  delta.old_pc = GetVarint(in);
+  delta.new_pc = delta.old_pc + UnZigZag(GetVarint(in));
+  delta.cycles = GetVarint(in);
+  delta.stall_cycles = GetVarint(in);
+
+  delta.register_changes.resize(GetVarint(in));
+  for (RegisterChange &change : delta.register_changes) {
+    uint64_t reg = GetVarint(in);
+    change.reg_index = static_cast<unsigned int>(reg >> 2);
+    change.reg_type = static_cast<unsigned int>(reg & 3);
+    change.old_value = GetVarint(in);
+    change.new_value = change.old_value + UnZigZag(GetVarint(in));
+  }
+
+  delta.memory_changes.resize(GetVarint(in));
+  for (MemoryChange &change : delta.memory_changes) {
+    change.address = GetVarint(in);
+    change.old_bytes_vec.resize(GetVarint(in));
+    change.new_bytes_vec.resize(GetVarint(in));
+    GetBytes(in, change.old_bytes_vec.data(), change.old_bytes_vec.size());
+    GetBytes(in, change.new_bytes_vec.data(), change.new_bytes_vec.size());
+  }
+
+  if (delta.custom_instr_executed != 0) {
+    GetBigmulState(in, delta.bigmul_state);
+    GetBigmulState(in, delta.bigmul_state_after);
+  }
+  return delta;
+}
+
+} // namespace
+
+UndoHistory::UndoHistory(size_t capacity) {
+  SetCapacity(capacity);
+}
+
+void UndoHistory::SetCapacity(size_t capacity) {
+  capacity_ = capacity;
+  entries_.assign(capacity, Entry());
+  entries_.shrink_to_fit();
+  Clear();
+}
+
+void UndoHistory::Clear() {
+  first_ = 0;
+  count_ = 0;
+  cursor_ = 0;
+  arena_.clear();
+  arena_.shrink_to_fit();
+  arena_begin_ = 0;
+}
+
+void UndoHistory::Push(const StepDelta &delta) {
+  if (capacity_ == 0) {
+    return;
+  }
+  if (cursor_ < count_) {
+    arena_.resize(EntryAt(cursor_).offset);
+    count_ = cursor_;
+  }
+  if (count_ == capacity_) {
+    arena_begin_ = count_ > 1 ? EntryAt(1).offset : arena_.size();
+    first_ = (first_ + 1) % capacity_;
+    --count_;
+    --cursor_;
+    Compact();
+  }
+  if (count_ == 0) {
+    arena_.clear();
+    arena_begin_ = 0;
+  }
+
+  entries_[(first_ + count_) % capacity_].offset = arena_.size();
+  Encode(arena_, delta);
+  ++count_;
+  cursor_ = count_;
+}
+
+void UndoHistory::Compact() {
+  size_t live = arena_.size() - arena_begin_;
+  if (arena_begin_ < live || arena_begin_ < 4096) {
+    return;
+  }
+  std::memmove(arena_.data(), arena_.data() + arena_begin_, live);
+  arena_.resize(live);
+  for (size_t position = 0; position < count_; ++position) {
+    entries_[(first_ + position) % capacity_].offset -= arena_begin_;
+  }
+  arena_begin_ = 0;
+}
+
+StepDelta UndoHistory::Undo() {
+  if (!CanUndo()) {
+    throw std::logic_error("Nothing to undo");
+  }
+  --cursor_;
+  return Decode(arena_.data() + EntryAt(cursor_).offset);
+}
+
+StepDelta UndoHistory::Redo() {
+  if (!CanRedo()) {
+    throw std::logic_error("Nothing to redo");
+  }
+  ++cursor_;
+  return Decode(arena_.data() + EntryAt(cursor_ - 1).offset);
+}
+
+UndoHistoryUsage UndoHistory::GetUsage() const {
+  UndoHistoryUsage usage;
+  usage.undo_steps = cursor_;
+  usage.redo_steps = count_ - cursor_;
+  usage.capacity = capacity_;
+  usage.encoded_bytes = arena_.size() - arena_begin_;
+  usage.reserved_bytes = arena_.capacity() + entries_.capacity() * sizeof(Entry);
+  return usage;
+}
@@ -19,14 +19,26 @@
 #include <thread>
 
 
+VmOutputPaths VmOutputPaths::InDirectory(const std::filesystem::path &directory) {
+  VmOutputPaths paths;
+  paths.registers_dump = directory / globals::registers_dump_file_path.filename();
+  paths.vm_state_dump = directory / globals::vm_state_dump_file_path.filename();
+  return paths;
+}
+
 void VmBase::LoadProgram(const AssembledProgram &program) {
   program_ = program;
+  memory_controller_.FlushTlb();
   unsigned int counter = 0;
   for (const auto &instruction: program.text_buffer) {
     memory_controller_.WriteWord(counter, instruction);
       counter += 4;
   }
   program_size_ = counter;
+  decode_cache_.Reset(0, program_size_);
+  memory_controller_.WatchWrites(0, program_size_, [this](uint64_t address, uint64_t size) {
+    decode_cache_.Invalidate(address, size);
+  });
   AddBreakpoint(program_size_, false);  // address
 
   unsigned int data_counter = 0;
@@ -77,10 +89,13 @@ void VmBase::LoadProgram(const AssembledProgram &program) {
       }
     }, data);
   }
-  std::cout << "VM_PROGRAM_LOADED" << std::endl;
+  // Start the caches cold: loading the image is not part of the program's accesses
+  memory_controller_.ConfigureCaches();
+  branch_predictor_ = branch_prediction::BranchPredictor(vm_config::config.getBranchPredictorConfig());
+  Console() << "VM_PROGRAM_LOADED" << std::endl;
   output_status_ = "VM_PROGRAM_LOADED";
 
-  DumpState(globals::vm_state_dump_file_path);
+  DumpState(output_paths_.vm_state_dump);
     
 
 }
@@ -199,7 +214,7 @@ void VmBase::AddBreakpoint(uint64_t val, bool is_line) {
         breakpoints_.emplace_back(val);
     }
 
-    DumpState(globals::vm_state_dump_file_path);
+    DumpState(output_paths_.vm_state_dump);
 }
 
 void VmBase::RemoveBreakpoint(uint64_t val, bool is_line) {
@@ -227,7 +242,7 @@ void VmBase::RemoveBreakpoint(uint64_t val, bool is_line) {
         }
         breakpoints_.erase(std::remove(breakpoints_.begin(), breakpoints_.end(), val), breakpoints_.end());
     }
-    DumpState(globals::vm_state_dump_file_path);
+    DumpState(output_paths_.vm_state_dump);
 
 
 }
@@ -241,11 +256,46 @@ void VmBase::PrintString(uint64_t address) {
     while (true) {
         char c = memory_controller_.ReadByte(address);
         if (c == '\0') break;
-        std::cout << c;
+        SyscallOutput() << c;
         address++;
     }
 }
 
+void VmBase::FlushSyscallOutput() {
+    std::string buffered = syscall_output_buffer_.str();
+    if (!buffered.empty()) {
+        Console() << buffered << std::flush;
+        syscall_output_buffer_.str("");
+    }
+}
+
+VmSnapshot VmBase::Snapshot() {
+    VmSnapshot snapshot;
+    snapshot.program_counter = program_counter_;
+    snapshot.cycles = cycle_s_;
+    snapshot.instructions_retired = instructions_retired_;
+    snapshot.stall_cycles = stall_cycles_;
+    snapshot.branch_mispredictions = branch_mispredictions_;
+    snapshot.registers = registers_;
+    snapshot.memory = memory_controller_.Snapshot();
+    snapshot.guest_exited = guest_exited_;
+    snapshot.guest_exit_code = guest_exit_code_;
+    return snapshot;
+}
+
+void VmBase::Restore(const VmSnapshot &snapshot) {
+    program_counter_ = snapshot.program_counter;
+    cycle_s_ = snapshot.cycles;
+    instructions_retired_ = snapshot.instructions_retired;
+    stall_cycles_ = snapshot.stall_cycles;
+    branch_mispredictions_ = snapshot.branch_mispredictions;
+    registers_ = snapshot.registers;
+    memory_controller_.Restore(snapshot.memory);
+    guest_exited_ = snapshot.guest_exited;
+    guest_exit_code_ = snapshot.guest_exit_code;
+    UpdateCpi();
+}
+
 void VmBase::DumpState(const std::filesystem::path &filename) {
     std::ofstream file(filename);
     if (!file.is_open()) {
@@ -275,6 +325,11 @@ void VmBase::DumpState(const std::filesystem::path &filename) {
     file << "    \"ipc\": " << ipc_ << ",\n";
     file << "    \"stall_cycles\": " << stall_cycles_ << ",\n";
     file << "    \"branch_mispredictions\": " << branch_mispredictions_ << ",\n";
+    TlbStats tlb_stats = memory_controller_.GetTlbStats();
+    file << "    \"itlb_hits\": " << tlb_stats.instruction_hits << ",\n";
+    file << "    \"itlb_misses\": " << tlb_stats.instruction_misses << ",\n";
+    file << "    \"dtlb_hits\": " << tlb_stats.data_hits << ",\n";
+    file << "    \"dtlb_misses\": " << tlb_stats.data_misses << ",\n";
     file << "    \"breakpoints\": [";
     for (size_t i = 1; i < breakpoints_.size(); ++i) {
         program_.instruction_number_line_number_mapping[breakpoints_[i] / 4];
@@ -0,0 +1,45 @@
+/**
+ * @file bigmul_test_utils.h
+ * @brief Operands and reference products shared by the BIGMUL tests and benchmarks.
+ */
+
+#ifndef BIGMUL_TEST_UTILS_H
+#define BIGMUL_TEST_UTILS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief n pseudo-random doublewords from a 64-bit LCG, the same for the same seed on every host.
+ */
+inline std::vector<uint64_t> RandomDwords(size_t n, uint64_t seed) {
+  std::vector<uint64_t> dwords(n);
+  for (uint64_t &dword : dwords) {
+    seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    dword = seed;
+  }
+  return dwords;
+}
+
+/**
+ * @brief The full a.size() + b.size() doubleword product of two little-endian multi-word integers.
+ */
+inline std::vector<uint64_t> SchoolbookMultiply(const std::vector<uint64_t> &a, const std::vector<uint64_t> &b) {
+  std::vector<uint64_t> product(a.size() + b.size(), 0);
+  for (size_t i = 0; i < a.size(); ++i) {
+    uint64_t carry = 0;
+    for (size_t j = 0; j < b.size(); ++j) {
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+      unsigned __int128 t = (unsigned __int128)a[i] * b[j] + product[i + j] + carry;
+#pragma GCC diagnostic pop
+      product[i + j] = (uint64_t)t;
+      carry = (uint64_t)(t >> 64);
+    }
+    product[i + b.size()] = carry;
+  }
+  return product;
+}
+
+#endif // BIGMUL_TEST_UTILS_H
@@ -0,0 +1,116 @@
+/**
+ * File Name: test_batch_runner.cpp
+ */
+
+#include <gtest/gtest.h>
+#include "batch_runner.h"
+
+#include <filesystem>
+#include <fstream>
+#include <set>
+
+TEST(BatchRunnerTest, ParallelRunsMatchSerialRuns) {
+  std::filesystem::path output = std::filesystem::temp_directory_path() / "vm_batch_runner_test";
+  std::filesystem::remove_all(output);
+  std::vector<std::filesystem::path> programs = batch_runner::CollectPrograms(EXAMPLES_DIR);
+  ASSERT_FALSE(programs.empty());
+
+  std::vector<batch_runner::BatchResult> serial =
+      batch_runner::RunBatch(programs, output / "serial", 1, vm_config::VmTypes::SINGLE_STAGE);
+  std::vector<batch_runner::BatchResult> parallel =
+      batch_runner::RunBatch(programs, output / "parallel", 4, vm_config::VmTypes::SINGLE_STAGE);
+
+  ASSERT_EQ(serial.size(), programs.size());
+  ASSERT_EQ(parallel.size(), programs.size());
+  for (size_t i = 0; i < programs.size(); ++i) {
+    EXPECT_EQ(serial[i].status, parallel[i].status) << programs[i];
+    EXPECT_EQ(serial[i].instructions_retired, parallel[i].instructions_retired) << programs[i];
+    EXPECT_EQ(serial[i].cycles, parallel[i].cycles) << programs[i];
+    EXPECT_EQ(serial[i].gp_registers, parallel[i].gp_registers) << programs[i];
+    EXPECT_TRUE(std::filesystem::exists(parallel[i].output_directory / "result.json")) << programs[i];
+  }
+  std::filesystem::remove_all(output);
+}
+
+TEST(BatchRunnerTest, RepeatedNamesGetTheirOwnDirectories) {
+  std::filesystem::path output = std::filesystem::temp_directory_path() / "vm_batch_runner_names_test";
+  std::filesystem::remove_all(output);
+  std::vector<std::filesystem::path> programs = {output / "one" / "a.s", output / "x.s", output / "two" / "a.s",
+                                                 output / "a_2.s", output / "three" / "a.s"};
+  for (const std::filesystem::path &program : programs) {
+    std::filesystem::create_directories(program.parent_path());
+    std::ofstream(program) << ".text\n"
+                              "    li t0, 1\n";
+  }
+
+  std::vector<batch_runner::BatchResult> results =
+      batch_runner::RunBatch(programs, output / "out", 2, vm_config::VmTypes::SINGLE_STAGE);
+  ASSERT_EQ(results.size(), programs.size());
+  std::set<std::filesystem::path> directories;
+  for (const batch_runner::BatchResult &result : results) {
+    EXPECT_TRUE(directories.insert(result.output_directory).second) << result.output_directory;
+    EXPECT_TRUE(std::filesystem::exists(result.output_directory / "result.json")) << result.output_directory;
+  }
+  EXPECT_EQ(results[2].output_directory, output / "out" / "a_2");
+  EXPECT_EQ(results[3].output_directory, output / "out" / "a_2_3");
+  std::filesystem::remove_all(output);
+}
+
+TEST(BatchRunnerTest, ExitSyscallEndsOnlyTheRun) {
+  std::filesystem::path output = std::filesystem::temp_directory_path() / "vm_batch_runner_exit_test";
+  std::filesystem::remove_all(output);
+  std::filesystem::create_directories(output);
+  std::filesystem::path program = output / "exit.s";
+  std::ofstream(program) << ".text\n"
+                            "    li a7, 10\n"
+                            "    li a0, 3\n"
+                            "    ecall\n"
+                            "    li t0, 1\n";
+
+  batch_runner::BatchResult result =
+      batch_runner::RunProgram(program, output / "exit", vm_config::VmTypes::SINGLE_STAGE);
+  EXPECT_EQ(result.status, "VM_EXIT");
+  EXPECT_TRUE(result.exited);
+  EXPECT_EQ(result.exit_code, 3u);
+  ASSERT_EQ(result.gp_registers.size(), 32u);
+  EXPECT_EQ(result.gp_registers[5], 0u);
+  std::filesystem::remove_all(output);
+}
+
+TEST(BatchRunnerTest, BigmulEngineReportComparesEveryEngine) {
+  std::filesystem::path output = std::filesystem::temp_directory_path() / "vm_bigmul_report_test";
+  std::filesystem::remove_all(output);
+  std::filesystem::create_directories(output);
+  std::filesystem::path program = output / "bigmul.s";
+  std::ofstream(program) << ".data\n"
+                            "A:\n"
+                            "    udword 0xffffffffffffffff\n"
+                            "    zero 504\n"
+                            "B:\n"
+                            "    udword 0xfedcba9876543210\n"
+                            "    zero 504\n"
+                            "RES:\n"
+                            "    zero 1024\n"
+                            ".text\n"
+                            "    la x3, A\n"
+                            "    la x4, B\n"
+                            "    la x5, RES\n"
+                            "    ldbm x0, x3, x4\n"
+                            "    bigmul x0, 0(x5)\n"
+                            "    nop\n";
+
+  std::vector<batch_runner::BigmulEngineResult> results =
+      batch_runner::RunBigmulEngineReport(program, output / "report", vm_config::VmTypes::SINGLE_STAGE);
+  ASSERT_EQ(results.size(), std::size(batch_runner::kBigmulEngines));
+  for (const batch_runner::BigmulEngineResult &result : results) {
+    std::string engine = vm_config::bigmulEngineName(result.engine);
+    EXPECT_TRUE(result.matches_reference) << engine;
+    EXPECT_EQ(result.run.instructions_retired, 9u) << engine; // la is auipc + addi
+    EXPECT_EQ(result.stall_cycles, result.run.cycles - result.run.instructions_retired) << engine;
+    ASSERT_EQ(result.bigmul_result.size(), 128u) << engine;
+    EXPECT_EQ(result.bigmul_result[0], 0x0123456789abcdf0ULL) << engine;
+    EXPECT_EQ(result.bigmul_result[1], 0xfedcba987654320fULL) << engine;
+    EXPECT_TRUE(std::filesystem::exists(output / "report" / engine / "result.json")) << engine;
+  }
+  std::filesystem::remove_all(output);
+}
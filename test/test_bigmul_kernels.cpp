@@ -0,0 +1,92 @@
+/**
+ * File Name: test_bigmul_kernels.cpp
+ */
+
+#include <gtest/gtest.h>
+#include "vm/bigmul_kernels.h"
+#include "vm/bigmul_unit.h"
+#include "bigmul_test_utils.h"
+
+#include <vector>
+
+namespace {
+
+bigmul_kernels::Sum192 ReferenceSum(const std::vector<uint64_t> &a, const std::vector<uint64_t> &b,
+                                    size_t diagonal, size_t first, size_t count) {
+  uint64_t lo = 0, mid = 0, hi = 0;
+  for (size_t i = first; i < first + count; ++i) {
+    unsigned __int128 p = (unsigned __int128)a[i] * b[diagonal - i];
+    unsigned __int128 t0 = (unsigned __int128)lo + (uint64_t)p;
+    lo = (uint64_t)t0;
+    unsigned __int128 t1 = (unsigned __int128)mid + (uint64_t)(p >> 64) + (uint64_t)(t0 >> 64);
+    mid = (uint64_t)t1;
+    hi += (uint64_t)(t1 >> 64);
+  }
+  return {lo, mid, hi};
+}
+
+} // namespace
+
+TEST(BigmulKernelsTest, EveryKernelMatchesTheScalarSum) {
+  const size_t n = 300;
+  std::vector<uint64_t> random_a = RandomDwords(n, 0x13198a2e03707344ULL);
+  std::vector<uint64_t> random_b = RandomDwords(n, 0x0370734413198a2eULL);
+  // All ones carries out of every column
+  std::vector<uint64_t> ones(n, 0xffffffffffffffffULL);
+
+  for (bigmul_kernels::Kernel kernel : {bigmul_kernels::Kernel::SCALAR, bigmul_kernels::Kernel::AVX2,
+                                        bigmul_kernels::Kernel::AVX512}) {
+    if (!bigmul_kernels::Supported(kernel)) {
+      continue;
+    }
+    SCOPED_TRACE(bigmul_kernels::KernelName(kernel));
+    for (const auto &[a, b] : {std::pair{&random_a, &random_b}, std::pair{&ones, &ones}}) {
+      for (size_t diagonal : {0u, 7u, 25u, 299u, 420u, 598u}) {
+        size_t first = diagonal >= n ? diagonal - (n - 1) : 0;
+        size_t last = diagonal < n ? diagonal : n - 1;
+        // Whole diagonals and every batch length a 25-wide engine issues
+        for (size_t count = 0; count <= last - first + 1; count += (count < 30 ? 1 : 37)) {
+          bigmul_kernels::Sum192 expected = ReferenceSum(*a, *b, diagonal, first, count);
+          bigmul_kernels::Sum192 actual = bigmul_kernels::DiagonalSum(kernel, a->data(), b->data(), diagonal,
+                                                                      first, count);
+          EXPECT_EQ(actual.lo, expected.lo) << diagonal << " " << count;
+          EXPECT_EQ(actual.mid, expected.mid) << diagonal << " " << count;
+          EXPECT_EQ(actual.hi, expected.hi) << diagonal << " " << count;
+        }
+      }
+    }
+  }
+}
+
+TEST(BigmulKernelsTest, KernelDoesNotChangeTheModel) {
+  std::vector<uint64_t> a(64), b(64);
+  for (size_t i = 0; i < a.size(); ++i) {
+    a[i] = 0xfedcba9876543210ULL * (i + 1);
+    b[i] = ~(0x0f1e2d3c4b5a6978ULL * (i + 3));
+  }
+
+  bigmul_kernels::Kernel best = bigmul_kernels::Best();
+  for (vm_config::BigmulEngine engine : {vm_config::BigmulEngine::SINGLECYCLE, vm_config::BigmulEngine::CSA_ONLY,
+                                         vm_config::BigmulEngine::SYSTOLIC}) {
+    std::vector<uint64_t> results[2];
+    uint64_t cycles[2] = {0, 0};
+    bigmul_kernels::Kernel kernels[2] = {bigmul_kernels::Kernel::SCALAR, best};
+    for (int run = 0; run < 2; ++run) {
+      bigmul_kernels::SetKernel(kernels[run]);
+      BigmulUnit unit;
+      unit.SetEngine(engine);
+      unit.cacheA = a;
+      unit.cacheB = b;
+      unit.LdbmLoaded();
+      unit.bigmul_done_ = false;
+      while (unit.GetWriteDone()) {
+        unit.executeBigmul();
+      }
+      results[run] = unit.resultCache;
+      cycles[run] = unit.GetStats().compute_cycles;
+    }
+    EXPECT_EQ(results[0], results[1]) << vm_config::bigmulEngineName(engine);
+    EXPECT_EQ(cycles[0], cycles[1]) << vm_config::bigmulEngineName(engine);
+  }
+  bigmul_kernels::SetKernel(best);
+}
@@ -0,0 +1,93 @@
+/**
+ * File Name: test_branch_predictor.cpp
+ */
+
+#include <gtest/gtest.h>
+#include "vm/branch_prediction/branch_predictor.h"
+#include "config.h"
+
+using branch_prediction::BranchKind;
+using branch_prediction::BranchPredictor;
+using branch_prediction::PredictorConfig;
+using branch_prediction::PredictorType;
+
+namespace {
+
+/**
+ * @brief Runs a loop branch taken seven times out of eight, and returns the mispredictions of the last rounds.
+ */
+uint64_t LoopMispredictions(PredictorType type) {
+  constexpr uint64_t kBranch = 0x40;
+  constexpr uint64_t kLoopStart = 0x20;
+  BranchPredictor predictor(PredictorConfig{.type = type});
+  uint64_t warm = 0;
+  for (int round = 0; round < 200; ++round) {
+    if (round == 100) {
+      warm = predictor.GetMispredictions();
+    }
+    for (int i = 0; i < 8; ++i) {
+      predictor.Resolve(kBranch, BranchKind::Conditional, kLoopStart, i < 7 ? kLoopStart : kBranch + 4);
+    }
+  }
+  return predictor.GetMispredictions() - warm;
+}
+
+} // namespace
+
+TEST(BranchPredictorTest, DirectionPredictorsLearnALoop) {
+  // 100 rounds of 8 executions after warming up
+  EXPECT_EQ(LoopMispredictions(PredictorType::AlwaysNotTaken), 700u);
+  EXPECT_EQ(LoopMispredictions(PredictorType::Btfn), 100u);
+  EXPECT_EQ(LoopMispredictions(PredictorType::Bimodal), 100u);
+  // Eight outcomes of history tell the exit apart
+  EXPECT_EQ(LoopMispredictions(PredictorType::Gshare), 0u);
+  EXPECT_EQ(LoopMispredictions(PredictorType::Tage), 0u);
+}
+
+TEST(BranchPredictorTest, TargetsComeFromTheBtbAndReturnStack) {
+  BranchPredictor predictor(PredictorConfig{.type = PredictorType::Bimodal});
+  constexpr uint64_t kFunction = 0x400;
+  constexpr uint64_t kReturn = 0x40c;
+
+  // The first call misses the BTB; its return is on the stack already
+  EXPECT_TRUE(predictor.Resolve(0x100, BranchKind::Call, kFunction, kFunction));
+  EXPECT_FALSE(predictor.Resolve(kReturn, BranchKind::Return, 0, 0x104));
+  // A second call site: the return goes back there, not where the BTB last saw it go
+  EXPECT_TRUE(predictor.Resolve(0x200, BranchKind::Call, kFunction, kFunction));
+  EXPECT_EQ(predictor.Predict(kReturn, BranchKind::Return, 0), 0x204u);
+  EXPECT_FALSE(predictor.Resolve(kReturn, BranchKind::Return, 0, 0x204));
+  EXPECT_FALSE(predictor.Resolve(0x100, BranchKind::Call, kFunction, kFunction));
+
+  // An indirect jump is predicted to go where it went last
+  EXPECT_TRUE(predictor.Resolve(0x300, BranchKind::Indirect, 0, 0x500));
+  EXPECT_FALSE(predictor.Resolve(0x300, BranchKind::Indirect, 0, 0x500));
+  EXPECT_TRUE(predictor.Resolve(0x300, BranchKind::Indirect, 0, 0x600));
+
+  const branch_prediction::BranchSiteStats *site = predictor.GetSiteStats(0x300);
+  ASSERT_NE(site, nullptr);
+  EXPECT_EQ(site->kind, BranchKind::Indirect);
+  EXPECT_EQ(site->executed, 3u);
+  EXPECT_EQ(site->mispredicted, 2u);
+  EXPECT_EQ(predictor.GetSiteStats(0x304), nullptr);
+  EXPECT_EQ(predictor.GetBranches(), 8u);
+  EXPECT_EQ(predictor.GetMispredictions(), 4u);
+
+  std::ostringstream report;
+  predictor.PrintReport(report, 1000);
+  // Worst first
+  EXPECT_NE(report.str().find("mispredictions=4"), std::string::npos);
+  EXPECT_LT(report.str().find("0x00000300"), report.str().find("0x00000100"));
+}
+
+TEST(BranchPredictorTest, ConfigRejectsBadGeometry) {
+  vm_config::VmConfig config;
+  config.modifyConfig("BranchPrediction", "branch_prediction_type", "tage");
+  config.modifyConfig("BranchPrediction", "btb_size", "64");
+  EXPECT_EQ(config.getBranchPredictorConfig().type, PredictorType::Tage);
+  EXPECT_EQ(config.getBranchPredictorConfig().btb_size, 64u);
+  EXPECT_THROW(config.modifyConfig("BranchPrediction", "branch_prediction_type", "perceptron"), std::invalid_argument);
+  EXPECT_THROW(config.modifyConfig("BranchPrediction", "branch_prediction_table_size", "1000"), std::invalid_argument);
+  EXPECT_THROW(config.modifyConfig("BranchPrediction", "btb_associativity", "3"), std::invalid_argument);
+  EXPECT_THROW(config.modifyConfig("BranchPrediction", "branch_history_bits", "65"), std::invalid_argument);
+  EXPECT_EQ(config.getBranchPredictorConfig().btb_size, 64u);
+}
@@ -0,0 +1,292 @@
+/**
+ * File Name: test_cache.cpp
+ */
+
+#include <gtest/gtest.h>
+#include "vm/cache/cache.h"
+#include "vm/cache/cache_trace.h"
+#include "vm/memory_controller.h"
+#include "config.h"
+#include "vm_runner.h"
+#include "assembler/assembler.h"
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+namespace {
+
+cache::CacheConfig TwoLineSet(cache::ReplacementPolicy policy) {
+  // One set of two 64 byte lines
+  return {.size = 128, .block_size = 64, .associativity = 2, .replacement_policy = policy};
+}
+
+} // namespace
+
+TEST(CacheTest, ReplacementPoliciesPickTheirVictims) {
+  // A, B, A, C: LRU evicts B, FIFO evicts A
+  for (auto [policy, a_survives] : {std::pair{cache::ReplacementPolicy::LRU, true},
+                                    std::pair{cache::ReplacementPolicy::FIFO, false}}) {
+    cache::Cache cache(cache::CacheType::Data, TwoLineSet(policy));
+    cache.Access(0x000, false);
+    cache.Access(0x040, false);
+    EXPECT_TRUE(cache.Access(0x010, false).hit);
+    cache.Access(0x080, false);
+    EXPECT_EQ(cache.Access(0x000, false).hit, a_survives) << cache::replacementPolicyName(policy);
+  }
+
+  cache::Cache random(cache::CacheType::Data, TwoLineSet(cache::ReplacementPolicy::Random));
+  for (uint64_t line = 0; line < 100; ++line) {
+    random.Access(line * 64, false);
+  }
+  EXPECT_EQ(random.GetStats().misses, 100u);
+  EXPECT_EQ(random.GetStats().evictions, 98u);
+}
+
+TEST(CacheTest, WritePolicies) {
+  cache::CacheConfig config = TwoLineSet(cache::ReplacementPolicy::LRU);
+  cache::Cache write_back(cache::CacheType::Data, config);
+  cache::CacheAccess miss = write_back.Access(0x000, true);
+  EXPECT_TRUE(miss.fill);
+  EXPECT_FALSE(miss.write_through);
+  write_back.Access(0x040, false);
+  cache::CacheAccess eviction = write_back.Access(0x080, false);
+  ASSERT_TRUE(eviction.writeback.has_value());
+  EXPECT_EQ(*eviction.writeback, 0x000u);
+  EXPECT_EQ(write_back.GetStats().writebacks, 1u);
+
+  config.write_hit_policy = cache::WriteHitPolicy::WriteThrough;
+  config.write_miss_policy = cache::WriteMissPolicy::NoWriteAllocate;
+  cache::Cache write_through(cache::CacheType::Data, config);
+  cache::CacheAccess no_allocate = write_through.Access(0x000, true);
+  EXPECT_FALSE(no_allocate.fill);
+  EXPECT_TRUE(no_allocate.write_through);
+  EXPECT_FALSE(write_through.Access(0x000, false).hit);
+  EXPECT_TRUE(write_through.Access(0x000, true).write_through);
+  write_through.Access(0x040, false);
+  EXPECT_FALSE(write_through.Access(0x080, false).writeback.has_value());
+  EXPECT_EQ(write_through.GetStats().write_misses, 1u);
+  EXPECT_EQ(write_through.GetStats().read_misses, 3u);
+}
+
+TEST(CacheTest, HierarchyForwardsMissesToTheL2) {
+  cache::CacheConfig l1 = TwoLineSet(cache::ReplacementPolicy::LRU);
+  cache::CacheHierarchy hierarchy(l1, cache::CacheConfig{.size = 1024, .block_size = 64, .associativity = 4});
+  // An unaligned doubleword spans two lines
+  hierarchy.Read(0x03c, 8);
+  EXPECT_EQ(hierarchy.GetL1DataCache().GetStats().misses, 2u);
+  EXPECT_EQ(hierarchy.GetL2Cache()->GetStats().misses, 2u);
+  EXPECT_EQ(hierarchy.GetMemoryReads(), 2u);
+
+  // Evicted from the L1 but still in the L2
+  hierarchy.Read(0x080, 8);
+  hierarchy.Read(0x000, 8);
+  EXPECT_EQ(hierarchy.GetL2Cache()->GetStats().hits, 1u);
+  EXPECT_EQ(hierarchy.GetMemoryReads(), 3u);
+  hierarchy.Fetch(0x000, 4);
+  EXPECT_EQ(hierarchy.GetL1InstructionCache().GetStats().misses, 1u);
+  EXPECT_EQ(hierarchy.GetL2Cache()->GetStats().hits, 2u);
+
+  EXPECT_THROW(cache::CacheHierarchy(cache::CacheConfig{.size = 192, .block_size = 64, .associativity = 1},
+                                     std::nullopt),
+               std::invalid_argument);
+}
+
+TEST(CacheTest, MemoryControllerBypassesCachesForDebuggerReads) {
+  vm_config::VmConfig saved = vm_config::config;
+  vm_config::config.modifyConfig("Cache", "cache_enabled", "true");
+  vm_config::config.modifyConfig("Cache", "cache_size", "1024");
+  vm_config::config.modifyConfig("Cache", "l2_cache_enabled", "true");
+  EXPECT_THROW(vm_config::config.modifyConfig("Cache", "cache_block_size", "48"), std::invalid_argument);
+  EXPECT_THROW(vm_config::config.modifyConfig("Cache", "cache_replacement_policy", "MRU"), std::invalid_argument);
+
+  MemoryController controller;
+  controller.Reset();
+  ASSERT_NE(controller.GetCaches(), nullptr);
+  controller.WriteDoubleWord(0x1000, 42);
+  EXPECT_EQ(controller.ReadDoubleWord(0x1000), 42u);
+  EXPECT_EQ(controller.ReadDoubleWord_d(0x2000), 0u);
+  EXPECT_EQ(controller.FetchWord(0x0), 0u);
+
+  const cache::CacheHierarchy &caches = *controller.GetCaches();
+  EXPECT_EQ(caches.GetL1DataCache().GetStats().accesses, 2u);
+  EXPECT_EQ(caches.GetL1DataCache().GetStats().hits, 1u);
+  EXPECT_EQ(caches.GetL1InstructionCache().GetStats().accesses, 1u);
+  EXPECT_EQ(caches.GetL2Cache()->GetStats().accesses, 2u);
+
+  vm_config::config = saved;
+  controller.Reset();
+  EXPECT_EQ(controller.GetCaches(), nullptr);
+}
+
+TEST(CacheTest, LatencyAddsUpTheLevelsAnAccessReaches) {
+  cache::CacheConfig l1 = TwoLineSet(cache::ReplacementPolicy::LRU);
+  cache::CacheConfig l2{.size = 1024, .block_size = 64, .associativity = 4, .hit_latency = 10};
+  cache::CacheHierarchy hierarchy(l1, l2, 100);
+  EXPECT_EQ(hierarchy.Read(0x000, 8), 111u);
+  EXPECT_EQ(hierarchy.Read(0x008, 8), 1u);
+  // Both lines of an unaligned access pay their way
+  EXPECT_EQ(hierarchy.Read(0x03c, 8), 1u + 111u);
+  hierarchy.Read(0x080, 8);
+  EXPECT_EQ(hierarchy.Read(0x000, 8), 11u);
+  // The writeback of a dirty victim drains through a write buffer
+  hierarchy.Write(0x000, 8);
+  hierarchy.Read(0x040, 8);
+  EXPECT_EQ(hierarchy.Read(0x100, 8), 111u);
+
+  cache::CacheHierarchy l1_only(l1, std::nullopt, 50);
+  EXPECT_EQ(l1_only.Fetch(0x000, 4), 51u);
+  EXPECT_EQ(l1_only.Fetch(0x004, 4), 1u);
+}
+
+TEST(CacheTest, TracesRoundTripAndSweepLikeTheLiveCaches) {
+  std::filesystem::path path = std::filesystem::temp_directory_path() / "cache_trace_test.bin";
+  cache::CacheConfig l1 = TwoLineSet(cache::ReplacementPolicy::LRU);
+  cache::CacheHierarchy live(l1, std::nullopt, 50);
+  uint64_t live_latency = 0;
+  {
+    vm_config::VmConfig saved = vm_config::config;
+    vm_config::config.modifyConfig("Cache", "cache_enabled", "false");
+    MemoryController controller;
+    controller.Reset();
+    cache::TraceWriter writer(path);
+    controller.TraceAccesses(&writer);
+    for (uint64_t i = 0; i < 4; ++i) {
+      controller.ChargeFetch(0x100 + 4 * i);
+      controller.WriteDoubleWord(0x2000 - 64 * i, i);
+      EXPECT_EQ(controller.ReadWord(0x2000 - 64 * i), i);
+    }
+    std::vector<uint8_t> block(100);
+    controller.ReadBlock(0x3003, block);
+    EXPECT_EQ(controller.ReadWord_d(0x4000), 0u);
+    controller.TraceAccesses(nullptr);
+    EXPECT_EQ(controller.ReadWord(0x5000), 0u);
+    EXPECT_EQ(writer.GetRecordCount(), 13u);
+    vm_config::config = saved;
+  }
+  for (uint64_t i = 0; i < 4; ++i) {
+    live_latency += live.Fetch(0x100 + 4 * i, 4);
+    live_latency += live.Write(0x2000 - 64 * i, 8);
+    live_latency += live.Read(0x2000 - 64 * i, 4);
+  }
+  live_latency += live.Read(0x3003, 100);
+
+  std::vector<uint8_t> trace = cache::LoadTrace(path);
+  // Header plus a few bytes per record
+  EXPECT_LT(trace.size(), 8u + 13u * 4u);
+  cache::TraceReader reader(trace);
+  cache::TraceRecord record;
+  ASSERT_TRUE(reader.Next(record));
+  EXPECT_EQ(record.kind, cache::AccessKind::Fetch);
+  EXPECT_EQ(record.address, 0x100u);
+  ASSERT_TRUE(reader.Next(record));
+  EXPECT_EQ(record.kind, cache::AccessKind::Write);
+  EXPECT_EQ(record.pc, 0x100u);
+  EXPECT_EQ(record.address, 0x2000u);
+  EXPECT_EQ(record.size, 8u);
+  for (int i = 0; i < 11; ++i) {
+    ASSERT_TRUE(reader.Next(record));
+  }
+  EXPECT_EQ(record.kind, cache::AccessKind::Read);
+  EXPECT_EQ(record.pc, 0x10cu);
+  EXPECT_EQ(record.address, 0x3003u);
+  EXPECT_EQ(record.size, 100u);
+  EXPECT_FALSE(reader.Next(record));
+
+  std::vector<cache::SweepPoint> points(3);
+  points[0].l1 = l1;
+  points[0].memory_latency = 50;
+  points[1].l1 = cache::CacheConfig{.size = 1024, .block_size = 32, .associativity = 1};
+  points[2].l1 = l1;
+  points[2].l2 = cache::CacheConfig{.size = 1024, .block_size = 64, .associativity = 4, .hit_latency = 10};
+  std::vector<cache::SweepResult> results = cache::SweepTrace(trace, points, 2);
+  ASSERT_EQ(results.size(), 3u);
+  EXPECT_EQ(results[0].accesses, 13u);
+  EXPECT_EQ(results[0].total_latency, live_latency);
+  EXPECT_EQ(results[0].l1d.misses, live.GetL1DataCache().GetStats().misses);
+  EXPECT_EQ(results[0].l1i.misses, 1u);
+  EXPECT_DOUBLE_EQ(results[0].Amat(), static_cast<double>(live_latency) / 13.0);
+  EXPECT_FALSE(results[1].l2.has_value());
+  ASSERT_TRUE(results[2].l2.has_value());
+  EXPECT_GT(results[2].l2->accesses, 0u);
+
+  std::filesystem::remove(path);
+  EXPECT_THROW(cache::TraceReader(std::vector<uint8_t>{'n', 'o', 'p', 'e'}), std::runtime_error);
+}
+
+TEST(CacheTest, TracesAttributeDataAccessesToTheirInstruction) {
+  std::filesystem::path dir = std::filesystem::temp_directory_path() / "vm_cache_trace_pc_test";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir / "out");
+  // The load is at 0xc and the store at 0x14; the pipeline fetches past both before they execute
+  std::ofstream(dir / "loop.s") << ".data\n"
+                                   "buf: .dword 1, 2, 3, 4\n"
+                                   ".text\n"
+                                   "    la a1, buf\n"
+                                   "    li t2, 4\n"
+                                   "loop:\n"
+                                   "    ld t0, 0(a1)\n"
+                                   "    addi t0, t0, 1\n"
+                                   "    sd t0, 0(a1)\n"
+                                   "    addi a1, a1, 8\n"
+                                   "    addi t2, t2, -1\n"
+                                   "    bne t2, x0, loop\n";
+  AssembledProgram program = assemble((dir / "loop.s").string());
+
+  for (vm_config::VmTypes vm_type : {vm_config::VmTypes::SINGLE_STAGE, vm_config::VmTypes::SINGLE_STAGE_THREADED,
+                                     vm_config::VmTypes::MULTI_STAGE, vm_config::VmTypes::OUT_OF_ORDER}) {
+    std::ostringstream console;
+    std::unique_ptr<RVSSVM> vm = createVM(vm_type, VmOutputPaths::InDirectory(dir / "out"));
+    vm->console_ = &console;
+    vm->silent_run_ = true;
+    vm->LoadProgram(program);
+    {
+      cache::TraceWriter writer(dir / "loop.trace");
+      vm->memory_controller_.TraceAccesses(&writer);
+      vm->Run();
+      vm->memory_controller_.TraceAccesses(nullptr);
+    }
+
+    std::string context = std::to_string(static_cast<int>(vm_type));
+    std::vector<uint8_t> trace = cache::LoadTrace(dir / "loop.trace");
+    cache::TraceReader reader(trace);
+    cache::TraceRecord record;
+    uint64_t reads = 0;
+    uint64_t writes = 0;
+    while (reader.Next(record)) {
+      if (record.kind == cache::AccessKind::Read) {
+        EXPECT_EQ(record.pc, 0xcu) << context;
+        reads++;
+      } else if (record.kind == cache::AccessKind::Write) {
+        EXPECT_EQ(record.pc, 0x14u) << context;
+        writes++;
+      } else {
+        EXPECT_EQ(record.pc, record.address) << context;
+      }
+    }
+    EXPECT_EQ(reads, 4u) << context;
+    EXPECT_EQ(writes, 4u) << context;
+  }
+  std::filesystem::remove_all(dir);
+}
+
+TEST(CacheTest, SweepFilesLayerCacheKeysOverTheConfig) {
+  std::filesystem::path path = std::filesystem::temp_directory_path() / "cache_sweep_test.txt";
+  std::ofstream(path) << "# size sweep\n"
+                         "cache_size=4096\n"
+                         "\n"
+                         "cache_size=8192 cache_associativity=8 l2_cache_enabled=true memory_latency=200\n";
+  std::vector<cache::SweepPoint> points = cache::ReadSweepFile(path);
+  ASSERT_EQ(points.size(), 2u);
+  EXPECT_EQ(points[0].l1.size, 4096u);
+  EXPECT_EQ(points[0].l1.associativity, vm_config::config.getL1CacheConfig().associativity);
+  EXPECT_FALSE(points[0].l2.has_value());
+  EXPECT_EQ(points[1].l1.associativity, 8u);
+  EXPECT_TRUE(points[1].l2.has_value());
+  EXPECT_EQ(points[1].memory_latency, 200u);
+  EXPECT_EQ(points[1].label, "cache_size=8192 cache_associativity=8 l2_cache_enabled=true memory_latency=200");
+
+  std::ofstream(path) << "cache_block_size=48\n";
+  EXPECT_THROW(cache::ReadSweepFile(path), std::invalid_argument);
+  std::filesystem::remove(path);
+}
@@ -5,7 +5,10 @@
  */
 
 #include <gtest/gtest.h>
-#include "../src/vm/main_memory.h"
+#include "vm/main_memory.h"
+
+#include <algorithm>
+#include <vector>
 
 TEST(MemoryTest, ReadWriteTest) {
   Memory memory;
@@ -88,3 +91,235 @@ TEST(MemoryTest, ReadWriteLargeDoubleTest) {
 }
 
 
+TEST(MemoryTest, ReadWriteAcrossBlockBoundaryTest) {
+  Memory memory;
+
+  memory.WriteDoubleWord(1020, 0x1122334455667788);
+  memory.WriteWord(2046, 0xdeadbeef);
+
+  EXPECT_EQ(memory.ReadDoubleWord(1020), 0x1122334455667788);
+  EXPECT_EQ(memory.ReadByte(1020), 0x88);
+  EXPECT_EQ(memory.ReadByte(1027), 0x11);
+  EXPECT_EQ(memory.ReadWord(2046), 0xdeadbeef);
+  EXPECT_EQ(memory.ReadHalfWord(2048), 0xdead);
+}
+
+TEST(MemoryTest, SparseHighAddressTest) {
+  Memory memory;
+
+  EXPECT_EQ(memory.ReadDoubleWord(0x7ffffffffffffff0), 0);
+  EXPECT_EQ(memory.GetBlockCount(), 0);
+
+  memory.WriteDoubleWord(0x7ffffffffffffff0, 0xcafef00d);
+  memory.WriteDoubleWord(0xfffffffffffff000, 42);
+  memory.WriteByte(0x10000000, 7);
+
+  EXPECT_EQ(memory.ReadDoubleWord(0x7ffffffffffffff0), 0xcafef00d);
+  EXPECT_EQ(memory.ReadDoubleWord(0xfffffffffffff000), 42);
+  EXPECT_EQ(memory.ReadByte(0x10000000), 7);
+  EXPECT_EQ(memory.GetBlockCount(), 3);
+}
+
+TEST(MemoryTest, ResetTest) {
+  Memory memory;
+  memory.WriteDoubleWord(0, 0xffffffffffffffff);
+  memory.WriteDoubleWord(0x10000000, 0xffffffffffffffff);
+  memory.Reset();
+
+  EXPECT_EQ(memory.GetBlockCount(), 0);
+  EXPECT_EQ(memory.ReadDoubleWord(0), 0);
+  EXPECT_EQ(memory.ReadDoubleWord(0x10000000), 0);
+}
+
+TEST(MemoryTest, TlbTest) {
+  Memory memory;
+
+  EXPECT_EQ(memory.ReadDoubleWord(0x2000), 0); // caches the missing block
+  memory.WriteDoubleWord(0x2000, 0x1234);
+  EXPECT_EQ(memory.ReadDoubleWord(0x2000), 0x1234);
+
+  memory.WriteWord(0x0, 0x00b50633);
+  EXPECT_EQ(memory.FetchWord(0x0), 0x00b50633);
+  EXPECT_EQ(memory.FetchWord(0x4), 0);
+
+  TlbStats stats = memory.GetTlbStats();
+  EXPECT_EQ(stats.instruction_misses, 1);
+  EXPECT_EQ(stats.instruction_hits, 1);
+  EXPECT_EQ(stats.data_misses, 2);
+  EXPECT_EQ(stats.data_hits, 2);
+
+  memory.Reset();
+  EXPECT_EQ(memory.ReadDoubleWord(0x2000), 0);
+  stats = memory.GetTlbStats();
+  EXPECT_EQ(stats.data_misses, 1);
+  EXPECT_EQ(stats.data_hits, 0);
+}
+
+TEST(MemoryTest, BlockCopiesSpanMemoryBlocks) {
+  Memory memory;
+  const uint64_t base = 1024 - 13; // straddles two blocks and ends inside a third
+  std::vector<uint8_t> data(2100);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = static_cast<uint8_t>(i * 7 + 1);
+  }
+  memory.WriteBlock(base, data);
+  for (size_t i = 0; i < data.size(); i += 97) {
+    EXPECT_EQ(memory.ReadByte(base + i), data[i]) << i;
+  }
+
+  std::vector<uint8_t> read(data.size() + 40);
+  memory.ReadBlock(base - 20, read);
+  for (size_t i = 0; i < read.size(); ++i) {
+    uint8_t expected = (i < 20 || i >= 20 + data.size()) ? 0 : data[i - 20];
+    EXPECT_EQ(read[i], expected) << i;
+  }
+
+  // Never written memory reads as zero without being allocated
+  size_t blocks = memory.GetBlockCount();
+  std::vector<uint8_t> untouched(3000, 0xff);
+  memory.ReadBlock(0x40000000, untouched);
+  EXPECT_EQ(std::count(untouched.begin(), untouched.end(), 0), 3000);
+  EXPECT_EQ(memory.GetBlockCount(), blocks);
+}
+
+TEST(MemoryTest, RestoringTheJournalUndoesEveryWrite) {
+  Memory memory;
+  memory.WriteDoubleWord(0x1000, 0x1111111111111111ULL);
+  std::vector<BlockImage> journal;
+  memory.JournalWrites(&journal);
+  memory.WriteDoubleWord(0x1000, 0x2222222222222222ULL);
+  memory.WriteDoubleWord(0x1008, 0x3333333333333333ULL);
+  memory.WriteByte(0x50000, 0x44);
+  std::vector<uint8_t> spanning(3000, 0x55);
+  memory.WriteBlock(0x1ff0, spanning);
+  memory.JournalWrites(nullptr);
+  memory.WriteDoubleWord(0x1010, 0x6666666666666666ULL);
+
+  // One image per block, taken before its first write
+  EXPECT_EQ(journal.size(), 6u);
+  memory.RestoreBlocks(journal);
+  EXPECT_EQ(memory.ReadDoubleWord(0x1000), 0x1111111111111111ULL);
+  EXPECT_EQ(memory.ReadDoubleWord(0x1008), 0u);
+  EXPECT_EQ(memory.ReadByte(0x50000), 0u);
+  EXPECT_EQ(memory.ReadByte(0x2500), 0u);
+  // Written after journaling stopped, and in a restored block
+  EXPECT_EQ(memory.ReadDoubleWord(0x1010), 0u);
+}
+
+TEST(MemoryTest, SnapshotsAreUnchangedByLaterWrites) {
+  Memory memory;
+  memory.WriteWord(0x0, 0x00000013);
+  memory.WriteDoubleWord(0x1000, 0x1111111111111111ULL);
+  EXPECT_EQ(memory.FetchWord(0x0), 0x00000013u);
+
+  Memory::Image image = memory.Snapshot();
+  EXPECT_EQ(image.GetBlockCount(), 2u);
+  memory.WriteWord(0x0, 0x00100093);
+  memory.WriteDoubleWord(0x1000, 0x2222222222222222ULL);
+  memory.WriteByte(0x80000, 0x33);
+  // Both TLBs follow the block to its private copy
+  EXPECT_EQ(memory.FetchWord(0x0), 0x00100093u);
+  EXPECT_EQ(memory.ReadDoubleWord(0x1000), 0x2222222222222222ULL);
+  EXPECT_EQ(memory.GetBlockCount(), 3u);
+
+  for (int restore = 0; restore < 2; ++restore) {
+    memory.Restore(image);
+    EXPECT_EQ(memory.GetBlockCount(), 2u);
+    EXPECT_EQ(memory.FetchWord(0x0), 0x00000013u);
+    EXPECT_EQ(memory.ReadDoubleWord(0x1000), 0x1111111111111111ULL);
+    EXPECT_EQ(memory.ReadByte(0x80000), 0u);
+    // Writes after a restore go to a copy too, so the image can be restored again
+    memory.WriteDoubleWord(0x1000, 0x4444444444444444ULL);
+    EXPECT_EQ(memory.ReadDoubleWord(0x1000), 0x4444444444444444ULL);
+  }
+
+  std::vector<BlockImage> journal;
+  memory.Restore(image);
+  memory.JournalWrites(&journal);
+  memory.WriteDoubleWord(0x1000, 0x5555555555555555ULL);
+  memory.JournalWrites(nullptr);
+  memory.RestoreBlocks(journal);
+  EXPECT_EQ(memory.ReadDoubleWord(0x1000), 0x1111111111111111ULL);
+}
+
+TEST(MemoryTest, SharedMemoriesSeeEachOthersWrites) {
+  Memory first;
+  first.WriteDoubleWord(0x1000, 0x1111111111111111ULL);
+  Memory::Image image = first.Snapshot();
+  first.WriteDoubleWord(0x1000, 0x2222222222222222ULL);
+
+  Memory second;
+  second.WriteByte(0x0, 0x77);
+  EXPECT_EQ(second.ReadByte(0x5000), 0u); // the TLB caches the absent block
+  second.Share(first);
+  EXPECT_TRUE(first.IsShared());
+  EXPECT_TRUE(second.IsShared());
+  EXPECT_EQ(second.ReadByte(0x0), 0u);
+  EXPECT_EQ(second.ReadDoubleWord(0x1000), 0x2222222222222222ULL);
+
+  first.WriteByte(0x5000, 0x42);
+  EXPECT_EQ(second.ReadByte(0x5000), 0x42u);
+  second.WriteDoubleWord(0x1000, 0x3333333333333333ULL);
+  EXPECT_EQ(first.ReadDoubleWord(0x1000), 0x3333333333333333ULL);
+  EXPECT_EQ(first.GetBlockCount(), 2u);
+  EXPECT_EQ(image.GetBlockCount(), 1u);
+
+  std::vector<BlockImage> journal;
+  EXPECT_THROW(first.Snapshot(), std::logic_error);
+  EXPECT_THROW(second.Restore(image), std::logic_error);
+  EXPECT_THROW(first.JournalWrites(&journal), std::logic_error);
+
+  // Reset leaves the contents to the other sharer
+  second.Reset();
+  EXPECT_FALSE(second.IsShared());
+  EXPECT_EQ(second.ReadDoubleWord(0x1000), 0u);
+  EXPECT_EQ(first.ReadDoubleWord(0x1000), 0x3333333333333333ULL);
+}
+
+TEST(MemoryTest, ReservationsBreakOnOtherHartsAtomics) {
+  Memory first;
+  Memory second;
+  second.Share(first);
+  first.WriteDoubleWord(0x1000, 5);
+
+  uint32_t version = 0;
+  EXPECT_EQ(first.LoadReserved<uint64_t>(0x1000, version), 5u);
+  EXPECT_TRUE(first.StoreConditional<uint64_t>(0x1000, version, 5, 6));
+  EXPECT_EQ(second.ReadDoubleWord(0x1000), 6u);
+  // The reservation is used up by the successful SC
+  EXPECT_FALSE(first.StoreConditional<uint64_t>(0x1000, version, 6, 7));
+
+  // Another hart's AMO on the same set breaks it, even if the value ends up the same
+  EXPECT_EQ(first.LoadReserved<uint64_t>(0x1000, version), 6u);
+  EXPECT_EQ(second.AtomicFetch<uint64_t>(0x1000, AtomicOp::kAdd, 0), 6u);
+  EXPECT_FALSE(first.StoreConditional<uint64_t>(0x1000, version, 6, 7));
+  // Another hart's plain store breaks it when it changes the value
+  EXPECT_EQ(first.LoadReserved<uint64_t>(0x1000, version), 6u);
+  second.WriteDoubleWord(0x1000, 8);
+  EXPECT_FALSE(first.StoreConditional<uint64_t>(0x1000, version, 6, 7));
+  EXPECT_EQ(first.ReadDoubleWord(0x1000), 8u);
+  // and also when it stores the value back before the SC
+  EXPECT_EQ(first.LoadReserved<uint64_t>(0x1000, version), 8u);
+  second.WriteDoubleWord(0x1000, 9);
+  second.WriteDoubleWord(0x1000, 8);
+  EXPECT_FALSE(first.StoreConditional<uint64_t>(0x1000, version, 8, 7));
+  EXPECT_EQ(first.LoadReserved<uint64_t>(0x1000, version), 8u);
+  second.WriteByte(0x1003, 0);
+  EXPECT_FALSE(first.StoreConditional<uint64_t>(0x1000, version, 8, 7));
+  // Stores to other sets leave it alone
+  EXPECT_EQ(first.LoadReserved<uint64_t>(0x1000, version), 8u);
+  second.WriteDoubleWord(0x1008, 1);
+  EXPECT_TRUE(first.StoreConditional<uint64_t>(0x1000, version, 8, 7));
+
+  first.WriteWord(0x2000, 0xFFFFFFFEu); // -2
+  EXPECT_EQ(first.AtomicFetch<uint32_t>(0x2000, AtomicOp::kMax, 3), 0xFFFFFFFEu);
+  EXPECT_EQ(first.AtomicFetch<uint32_t>(0x2000, AtomicOp::kMinu, 0xFFFFFFF0u), 3u);
+  EXPECT_EQ(first.AtomicFetch<uint32_t>(0x2000, AtomicOp::kSwap, 0x10), 3u);
+  EXPECT_EQ(first.AtomicFetch<uint32_t>(0x2000, AtomicOp::kMin, 0xFFFFFFFFu), 0x10u);
+  EXPECT_EQ(first.ReadWord(0x2000), 0xFFFFFFFFu);
+  // The bytes next to a word AMO are left alone
+  EXPECT_EQ(first.ReadWord(0x2004), 0u);
+
+  EXPECT_THROW(first.AtomicFetch<uint64_t>(0x2004, AtomicOp::kAdd, 1), std::invalid_argument);
+  EXPECT_THROW(first.LoadReserved<uint32_t>(0x2002, version), std::invalid_argument);
+}
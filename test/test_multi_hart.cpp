@@ -0,0 +1,206 @@
+/**
+ * File Name: test_multi_hart.cpp
+ */
+
+#include <gtest/gtest.h>
+#include "multi_hart.h"
+#include "assembler/assembler.h"
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+namespace {
+
+// Each hart sums 1..100*(4-mhartid) into its own slot, then counts itself into the shared tally
+// under a turn taken from hart 0 upwards, which the later harts, with less to sum, spin waiting for
+AssembledProgram AssembleHartsProgram(const std::filesystem::path &path) {
+  std::ofstream(path) << ".data\n"
+                         "sums: .dword 0, 0, 0, 0\n"
+                         "turn: .dword 0\n"
+                         "tally: .dword 0\n"
+                         ".text\n"
+                         "    csrrs s0, mhartid, x0\n"
+                         "    li t4, 4\n"
+                         "    sub t4, t4, s0\n"
+                         "    li t0, 100\n"
+                         "    mul t4, t4, t0\n"
+                         "    li t3, 0\n"
+                         "    li t5, 0\n"
+                         "sum:\n"
+                         "    addi t3, t3, 1\n"
+                         "    add t5, t5, t3\n"
+                         "    blt t3, t4, sum\n"
+                         "    la t1, sums\n"
+                         "    slli t2, s0, 3\n"
+                         "    add t1, t1, t2\n"
+                         "    sd t5, 0(t1)\n"
+                         "    la t1, turn\n"
+                         "wait:\n"
+                         "    ld t2, 0(t1)\n"
+                         "    bne t2, s0, wait\n"
+                         "    la t6, tally\n"
+                         "    ld t0, 0(t6)\n"
+                         "    addi t0, t0, 1\n"
+                         "    sd t0, 0(t6)\n"
+                         "    addi t2, t2, 1\n"
+                         "    sd t2, 0(t1)\n"
+                         "    mv a0, s0\n"
+                         "    li a7, 1\n"
+                         "    ecall\n";
+  return assemble(path.string());
+}
+
+uint64_t Slot(multi_hart::Machine &machine, uint64_t offset) {
+  return machine.GetHart(0).memory_controller_.ReadDoubleWord_d(vm_config::config.getDataSectionStart() + offset);
+}
+
+} // namespace
+
+TEST(MultiHartTest, HartsShareMemoryAndKeepTheirOwnRegisters) {
+  std::filesystem::path dir = std::filesystem::temp_directory_path() / "vm_multi_hart_test";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+  AssembledProgram program = AssembleHartsProgram(dir / "harts.s");
+
+  for (vm_config::HartSchedule schedule : {vm_config::HartSchedule::ROUND_ROBIN, vm_config::HartSchedule::PARALLEL}) {
+    for (vm_config::VmTypes vm_type : {vm_config::VmTypes::SINGLE_STAGE, vm_config::VmTypes::SINGLE_STAGE_THREADED,
+                                       vm_config::VmTypes::MULTI_STAGE, vm_config::VmTypes::OUT_OF_ORDER}) {
+      std::ostringstream console;
+      multi_hart::Machine machine(vm_type, 4, dir / "out", console);
+      machine.LoadProgram(program);
+      machine.Run(7, schedule);
+
+      std::string context = vm_config::hartScheduleName(schedule) + " " + std::to_string(static_cast<int>(vm_type));
+      for (uint64_t hart = 0; hart < 4; ++hart) {
+        uint64_t n = 100 * (4 - hart);
+        EXPECT_EQ(Slot(machine, hart * 8), n * (n + 1) / 2) << context;
+        EXPECT_EQ(machine.GetHart(hart).registers_.ReadGpr(8), hart) << context;
+        EXPECT_EQ(multi_hart::HartStatus(machine.GetHart(hart)), "VM_PROGRAM_END") << context;
+      }
+      EXPECT_EQ(Slot(machine, 32), 4u) << context;
+      EXPECT_EQ(Slot(machine, 40), 4u) << context;
+      // Output comes in hart order at the end of each quantum, and hart 0 counts itself in first
+      EXPECT_LT(console.str().find("[Syscall output: 0]"), console.str().find("[Syscall output: 1]")) << context;
+      EXPECT_NE(console.str().find("VM_HART_STATS hart=3 status=VM_PROGRAM_END"), std::string::npos) << context;
+      EXPECT_TRUE(std::filesystem::exists(dir / "out" / "hart3" / "registers_dump.json")) << context;
+    }
+  }
+  std::filesystem::remove_all(dir);
+}
+
+TEST(MultiHartTest, RoundRobinRunsAreReproducible) {
+  std::filesystem::path dir = std::filesystem::temp_directory_path() / "vm_multi_hart_round_robin_test";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+  AssembledProgram program = AssembleHartsProgram(dir / "harts.s");
+
+  auto run = [&](uint64_t quantum) {
+    std::ostringstream console;
+    multi_hart::Machine machine(vm_config::VmTypes::SINGLE_STAGE, 3, dir / "out", console);
+    machine.LoadProgram(program);
+    machine.Run(quantum, vm_config::HartSchedule::ROUND_ROBIN);
+    std::vector<unsigned int> retired;
+    for (size_t hart = 0; hart < machine.GetHartCount(); ++hart) {
+      retired.push_back(machine.GetHart(hart).instructions_retired_);
+    }
+    return std::make_pair(console.str(), retired);
+  };
+  // The harts spin a schedule-dependent number of times waiting for their turn
+  EXPECT_EQ(run(5), run(5));
+  EXPECT_EQ(run(1000), run(1000));
+  EXPECT_NE(run(5).second, run(1000).second);
+  std::filesystem::remove_all(dir);
+}
+
+TEST(MultiHartTest, AtomicsKeepSharedCountersExact) {
+  std::filesystem::path dir = std::filesystem::temp_directory_path() / "vm_multi_hart_atomic_test";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+  // Each hart bumps one counter with amoadd and another under an lr/sc spinlock, 300 times each
+  std::ofstream(dir / "atomic.s") << ".data\n"
+                                     "counter: .dword 0\n"
+                                     "lock: .dword 0\n"
+                                     "guarded: .dword 0\n"
+                                     "highest: .word -1\n"
+                                     ".text\n"
+                                     "    csrrs s0, mhartid, x0\n"
+                                     "    la a1, counter\n"
+                                     "    la a2, lock\n"
+                                     "    la a3, guarded\n"
+                                     "    li s1, 300\n"
+                                     "    li t6, 1\n"
+                                     "loop:\n"
+                                     "    amoadd.d x0, t6, (a1)\n"
+                                     "acquire:\n"
+                                     "    lr.d.aq t0, (a2)\n"
+                                     "    bne t0, x0, acquire\n"
+                                     "    sc.d t0, t6, (a2)\n"
+                                     "    bne t0, x0, acquire\n"
+                                     "    ld t1, 0(a3)\n"
+                                     "    addi t1, t1, 1\n"
+                                     "    sd t1, 0(a3)\n"
+                                     "    amoswap.d.rl x0, x0, (a2)\n"
+                                     "    addi s1, s1, -1\n"
+                                     "    bne s1, x0, loop\n"
+                                     "    la a4, highest\n"
+                                     "    amomax.w x0, s0, (a4)\n"
+                                     "    sc.w s2, t6, (a4)\n";
+  AssembledProgram program = assemble((dir / "atomic.s").string());
+
+  for (vm_config::HartSchedule schedule : {vm_config::HartSchedule::ROUND_ROBIN, vm_config::HartSchedule::PARALLEL}) {
+    for (vm_config::VmTypes vm_type : {vm_config::VmTypes::SINGLE_STAGE, vm_config::VmTypes::SINGLE_STAGE_THREADED,
+                                       vm_config::VmTypes::MULTI_STAGE, vm_config::VmTypes::OUT_OF_ORDER}) {
+      std::ostringstream console;
+      multi_hart::Machine machine(vm_type, 4, dir / "out", console);
+      machine.LoadProgram(program);
+      machine.Run(3, schedule);
+
+      std::string context = vm_config::hartScheduleName(schedule) + " " + std::to_string(static_cast<int>(vm_type));
+      EXPECT_EQ(Slot(machine, 0), 1200u) << context;
+      EXPECT_EQ(Slot(machine, 8), 0u) << context;
+      EXPECT_EQ(Slot(machine, 16), 1200u) << context;
+      EXPECT_EQ(machine.GetHart(0).memory_controller_.ReadWord_d(vm_config::config.getDataSectionStart() + 24), 3u)
+          << context;
+      for (uint64_t hart = 0; hart < 4; ++hart) {
+        // An sc without a reservation fails and stores nothing
+        EXPECT_EQ(machine.GetHart(hart).registers_.ReadGpr(18), 1u) << context;
+        EXPECT_EQ(multi_hart::HartStatus(machine.GetHart(hart)), "VM_PROGRAM_END") << context;
+      }
+    }
+  }
+  std::filesystem::remove_all(dir);
+}
+
+TEST(MultiHartTest, ExitEndsOnlyItsHartAndMhartidIsReadOnly) {
+  std::filesystem::path dir = std::filesystem::temp_directory_path() / "vm_multi_hart_exit_test";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+  std::ofstream(dir / "exit.s") << ".text\n"
+                                   "    li t0, 9\n"
+                                   "    csrrw x0, mhartid, t0\n"
+                                   "    csrrs s0, mhartid, x0\n"
+                                   "    bne s0, x0, done\n"
+                                   "    li a0, 5\n"
+                                   "    li a7, 10\n"
+                                   "    ecall\n"
+                                   "done:\n"
+                                   "    li s1, 1\n";
+  AssembledProgram program = assemble((dir / "exit.s").string());
+
+  std::ostringstream console;
+  multi_hart::Machine machine(vm_config::VmTypes::SINGLE_STAGE, 2, dir / "out", console);
+  machine.LoadProgram(program);
+  machine.Run(1, vm_config::HartSchedule::PARALLEL);
+  EXPECT_EQ(multi_hart::HartStatus(machine.GetHart(0)), "VM_EXIT");
+  EXPECT_EQ(machine.GetHart(0).guest_exit_code_, 5u);
+  EXPECT_EQ(multi_hart::HartStatus(machine.GetHart(1)), "VM_PROGRAM_END");
+  EXPECT_EQ(machine.GetHart(1).registers_.ReadGpr(8), 1u);
+  EXPECT_EQ(machine.GetHart(1).registers_.ReadGpr(9), 1u);
+
+  // Reset keeps the hart id
+  machine.GetHart(1).Reset();
+  EXPECT_EQ(machine.GetHart(1).registers_.GetHartId(), 1u);
+  EXPECT_THROW(machine.Run(0, vm_config::HartSchedule::ROUND_ROBIN), std::invalid_argument);
+  std::filesystem::remove_all(dir);
+}
@@ -0,0 +1,172 @@
+/**
+ * File Name: test_ooo_core.cpp
+ */
+
+#include <gtest/gtest.h>
+#include "vm/ooo/ooo_core.h"
+#include "config.h"
+
+#include <sstream>
+
+using ooo::Core;
+using ooo::CoreConfig;
+using ooo::FuClass;
+using ooo::InstructionRecord;
+using ooo::StallCause;
+
+namespace {
+
+InstructionRecord Op(uint64_t pc, FuClass fu, uint8_t destination = ooo::kNoRegister,
+                     uint8_t source = ooo::kNoRegister) {
+  InstructionRecord record;
+  record.pc = pc;
+  record.fu = fu;
+  record.destination = destination;
+  record.sources[0] = source;
+  return record;
+}
+
+InstructionRecord Memory(uint64_t pc, FuClass fu, uint64_t address, uint8_t register_index) {
+  InstructionRecord record = Op(pc, fu);
+  record.address = address;
+  record.size = 8;
+  if (fu == FuClass::Load) {
+    record.destination = register_index;
+  } else {
+    record.sources[1] = register_index;
+  }
+  return record;
+}
+
+uint64_t Stalls(const Core &core, StallCause cause) {
+  return core.GetStats().stalls[static_cast<size_t>(cause)];
+}
+
+} // namespace
+
+TEST(OooCoreTest, IndependentInstructionsCommitAtFullWidth) {
+  Core core(CoreConfig{.width = 4});
+  for (uint64_t i = 0; i < 4000; ++i) {
+    core.Feed(Op(i * 4, FuClass::Alu, static_cast<uint8_t>(1 + i % 31)));
+  }
+  // Four a cycle once the front end has filled
+  EXPECT_EQ(core.GetStats().instructions, 4000u);
+  EXPECT_GE(core.GetCycles(), 1000u);
+  EXPECT_LE(core.GetCycles(), 1000u + 8u);
+  EXPECT_GT(core.GetStats().Ipc(), 3.9);
+  EXPECT_EQ(core.GetStats().StallCycles(), Stalls(core, StallCause::Frontend) + Stalls(core, StallCause::Alu));
+}
+
+TEST(OooCoreTest, DividesHoldTheirUnit) {
+  CoreConfig config{.muldiv_units = 2, .div_latency = 20};
+  Core chained(config);
+  Core independent(config);
+  for (uint64_t i = 0; i < 100; ++i) {
+    chained.Feed(Op(i * 4, FuClass::Div, 5, 5));
+    independent.Feed(Op(i * 4, FuClass::Div, static_cast<uint8_t>(1 + i % 31)));
+  }
+  // A chain waits for each result; independent divides share two unpipelined dividers
+  EXPECT_GE(chained.GetCycles(), 100u * 20u);
+  EXPECT_GE(independent.GetCycles(), 50u * 20u);
+  EXPECT_LT(independent.GetCycles(), 50u * 20u + 40u);
+  EXPECT_GT(Stalls(chained, StallCause::Div), 100u * 19u);
+
+  // The multiplies behind a divide wait for a free unit, not for its result
+  Core mixed(CoreConfig{.muldiv_units = 1, .mul_latency = 3, .div_latency = 20});
+  mixed.Feed(Op(0, FuClass::Div, 5));
+  mixed.Feed(Op(4, FuClass::Mul, 6));
+  EXPECT_GE(mixed.GetCycles(), 20u + 3u);
+}
+
+TEST(OooCoreTest, MispredictionsHoldFetchUntilTheBranchExecutes) {
+  auto run = [](bool mispredicted) {
+    Core core(CoreConfig{.redirect_penalty = 2});
+    for (uint64_t iteration = 0; iteration < 100; ++iteration) {
+      for (uint64_t i = 0; i < 4; ++i) {
+        core.Feed(Op(i * 4, FuClass::Alu, static_cast<uint8_t>(1 + i)));
+      }
+      InstructionRecord branch = Op(16, FuClass::Alu);
+      branch.taken = true;
+      branch.mispredicted = mispredicted;
+      core.Feed(branch);
+    }
+    return core;
+  };
+  Core predicted = run(false);
+  Core mispredicted = run(true);
+  EXPECT_EQ(predicted.GetStats().mispredictions, 0u);
+  EXPECT_EQ(mispredicted.GetStats().mispredictions, 100u);
+  EXPECT_EQ(Stalls(predicted, StallCause::Mispredict), 0u);
+  // Each redirect refills the front end and waits out the penalty
+  EXPECT_GE(Stalls(mispredicted, StallCause::Mispredict), 99u * 4u);
+  EXPECT_GT(mispredicted.GetCycles(), predicted.GetCycles() + 99u * 4u);
+}
+
+TEST(OooCoreTest, LoadsWaitOnlyForOlderStoresToTheSameBytes) {
+  auto run = [](uint64_t load_address) {
+    Core core(CoreConfig{.muldiv_units = 2});
+    core.Feed(Op(0, FuClass::Div, 5)); // the store data arrives late
+    core.Feed(Memory(4, FuClass::Store, 0x100, 5));
+    core.Feed(Memory(8, FuClass::Load, load_address, 6));
+    core.Feed(Op(12, FuClass::Div, 7, 6)); // starts as soon as the load has its value
+    return core;
+  };
+  Core independent = run(0x200);
+  Core overlapping = run(0x104);
+  EXPECT_EQ(independent.GetStats().store_forwards, 0u);
+  EXPECT_EQ(overlapping.GetStats().store_forwards, 1u);
+  // The independent load runs alongside the first divide; the overlapping one waits for the store
+  uint64_t div_latency = CoreConfig().div_latency;
+  EXPECT_LT(independent.GetCycles(), 2u * div_latency);
+  EXPECT_GT(overlapping.GetCycles(), 2u * div_latency);
+}
+
+TEST(OooCoreTest, FullBuffersHoldDispatch) {
+  Core core(CoreConfig{.rob_size = 16, .rs_size = 64});
+  core.Feed(Op(0, FuClass::Div, 5));
+  for (uint64_t i = 1; i < 64; ++i) {
+    core.Feed(Op(i * 4, FuClass::Alu, static_cast<uint8_t>(6 + i % 20)));
+  }
+  // Nothing commits behind the divide, so the ROB fills and dispatch waits for it
+  EXPECT_GT(core.GetStats().rob_full, 0u);
+  EXPECT_EQ(core.GetStats().rs_full, 0u);
+
+  Core small_rs(CoreConfig{.rs_size = 4});
+  small_rs.Feed(Op(0, FuClass::Div, 5));
+  for (uint64_t i = 1; i < 16; ++i) {
+    small_rs.Feed(Op(i * 4, FuClass::Alu, 6, 5)); // every one waits for the divide
+  }
+  EXPECT_GT(small_rs.GetStats().rs_full, 0u);
+
+  std::ostringstream stats;
+  small_rs.PrintStats(stats);
+  EXPECT_NE(stats.str().find("VM_OOO_STATS cycles="), std::string::npos);
+  EXPECT_NE(stats.str().find(" stall_div="), std::string::npos);
+}
+
+TEST(OooCoreTest, RestartKeepsTheClock) {
+  Core core;
+  for (uint64_t i = 0; i < 8; ++i) {
+    core.Feed(Op(i * 4, FuClass::Div, 5, 5));
+  }
+  uint64_t cycles = core.GetCycles();
+  core.Restart();
+  EXPECT_EQ(core.GetCycles(), cycles);
+  // The register the chain used is ready again: only the front end stands in the way
+  core.Feed(Op(0, FuClass::Alu, 6, 5));
+  EXPECT_LE(core.GetCycles(), cycles + core.GetConfig().frontend_depth + 3u);
+}
+
+TEST(OooCoreTest, ConfigRejectsBadValues) {
+  vm_config::VmConfig config;
+  config.modifyConfig("OutOfOrder", "width", "8");
+  config.modifyConfig("OutOfOrder", "redirect_penalty", "0");
+  EXPECT_EQ(config.getOooCoreConfig().width, 8u);
+  EXPECT_EQ(config.getOooCoreConfig().redirect_penalty, 0u);
+  EXPECT_THROW(config.modifyConfig("OutOfOrder", "rob_size", "0"), std::invalid_argument);
+  EXPECT_THROW(config.modifyConfig("OutOfOrder", "div_latency", "100000"), std::invalid_argument);
+  EXPECT_THROW(config.modifyConfig("OutOfOrder", "issue_width", "2"), std::invalid_argument);
+  EXPECT_EQ(config.getOooCoreConfig().rob_size, CoreConfig().rob_size);
+  config.modifyConfig("Execution", "processor_type", "out_of_order");
+  EXPECT_EQ(config.getVmType(), vm_config::VmTypes::OUT_OF_ORDER);
+}
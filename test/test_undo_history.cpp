@@ -0,0 +1,133 @@
+/**
+ * File Name: test_undo_history.cpp
+ */
+
+#include <gtest/gtest.h>
+#include "vm/undo_history.h"
+
+#include <vector>
+
+namespace {
+
+StepDelta PlainStep(uint64_t pc) {
+  StepDelta delta;
+  delta.old_pc = pc;
+  delta.new_pc = pc + 4;
+  delta.cycles = 1;
+  delta.register_changes.push_back({2, 0, 0x7ffffff0, 0x7fffffe0}); // addi sp, sp, -16
+  return delta;
+}
+
+} // namespace
+
+TEST(UndoHistoryTest, RoundTripsEveryField) {
+  StepDelta delta;
+  delta.old_pc = 0x40;
+  delta.new_pc = 0x20; // backward branch
+  delta.cycles = 342;
+  delta.stall_cycles = 300;
+  delta.register_changes.push_back({5, 0, 0xffffffffffffffffULL, 0});
+  delta.register_changes.push_back({0x300, 1, 0, 0x8000000000000000ULL});
+  delta.register_changes.push_back({31, 2, 0x3ff0000000000000ULL, 0xbff0000000000000ULL});
+  delta.memory_changes.push_back({0x10000008, {1, 2, 3, 4}, {5, 6, 7, 8}});
+  delta.memory_changes.push_back({0xfffffffffffffff0ULL, {}, {}});
+  delta.custom_instr_executed = 2;
+  delta.bigmul_state.ldbm_done = true;
+  delta.bigmul_state.resident_tile_A = -1;
+  delta.bigmul_state.resident_tile_B = 3;
+  delta.bigmul_state.base_addr_res = 0x10000400;
+  delta.bigmul_state.cacheA = {1, 0xffffffffffffffffULL};
+  delta.bigmul_state_after.bigmul_done = true;
+  delta.bigmul_state_after.write_done = true;
+  delta.bigmul_state_after.write_offset = 128;
+  delta.bigmul_state_after.resultCache = {7, 8, 9};
+
+  UndoHistory history(4);
+  history.Push(delta);
+  for (int pass = 0; pass < 2; ++pass) {
+    StepDelta decoded = pass == 0 ? history.Undo() : history.Redo();
+    EXPECT_EQ(decoded.old_pc, delta.old_pc);
+    EXPECT_EQ(decoded.new_pc, delta.new_pc);
+    EXPECT_EQ(decoded.cycles, delta.cycles);
+    EXPECT_EQ(decoded.stall_cycles, delta.stall_cycles);
+    ASSERT_EQ(decoded.register_changes.size(), delta.register_changes.size());
+    for (size_t i = 0; i < delta.register_changes.size(); ++i) {
+      EXPECT_EQ(decoded.register_changes[i].reg_index, delta.register_changes[i].reg_index);
+      EXPECT_EQ(decoded.register_changes[i].reg_type, delta.register_changes[i].reg_type);
+      EXPECT_EQ(decoded.register_changes[i].old_value, delta.register_changes[i].old_value);
+      EXPECT_EQ(decoded.register_changes[i].new_value, delta.register_changes[i].new_value);
+    }
+    ASSERT_EQ(decoded.memory_changes.size(), delta.memory_changes.size());
+    for (size_t i = 0; i < delta.memory_changes.size(); ++i) {
+      EXPECT_EQ(decoded.memory_changes[i].address, delta.memory_changes[i].address);
+      EXPECT_EQ(decoded.memory_changes[i].old_bytes_vec, delta.memory_changes[i].old_bytes_vec);
+      EXPECT_EQ(decoded.memory_changes[i].new_bytes_vec, delta.memory_changes[i].new_bytes_vec);
+    }
+    EXPECT_EQ(decoded.custom_instr_executed, 2);
+    EXPECT_TRUE(decoded.bigmul_state.ldbm_done);
+    EXPECT_FALSE(decoded.bigmul_state.bigmul_done);
+    EXPECT_EQ(decoded.bigmul_state.resident_tile_A, -1);
+    EXPECT_EQ(decoded.bigmul_state.resident_tile_B, 3);
+    EXPECT_EQ(decoded.bigmul_state.base_addr_res, 0x10000400u);
+    EXPECT_EQ(decoded.bigmul_state.cacheA, delta.bigmul_state.cacheA);
+    EXPECT_TRUE(decoded.bigmul_state_after.bigmul_done);
+    EXPECT_TRUE(decoded.bigmul_state_after.write_done);
+    EXPECT_EQ(decoded.bigmul_state_after.write_offset, 128u);
+    EXPECT_EQ(decoded.bigmul_state_after.resultCache, delta.bigmul_state_after.resultCache);
+  }
+}
+
+TEST(UndoHistoryTest, KeepsOnlyTheLastCapacitySteps) {
+  UndoHistory history(3);
+  for (uint64_t step = 0; step < 5; ++step) {
+    history.Push(PlainStep(step * 4));
+  }
+  EXPECT_EQ(history.GetUsage().undo_steps, 3u);
+  for (uint64_t pc : {16u, 12u, 8u}) {
+    ASSERT_TRUE(history.CanUndo());
+    EXPECT_EQ(history.Undo().old_pc, pc);
+  }
+  EXPECT_FALSE(history.CanUndo());
+  EXPECT_THROW(history.Undo(), std::logic_error);
+
+  // Pushing after an undo drops what could have been redone
+  EXPECT_EQ(history.Redo().old_pc, 8u);
+  history.Push(PlainStep(0x100));
+  EXPECT_FALSE(history.CanRedo());
+  EXPECT_EQ(history.Undo().old_pc, 0x100u);
+  EXPECT_EQ(history.Undo().old_pc, 8u);
+  EXPECT_FALSE(history.CanUndo());
+
+  UndoHistory disabled(0);
+  disabled.Push(PlainStep(0));
+  EXPECT_FALSE(disabled.CanUndo());
+}
+
+TEST(UndoHistoryTest, StaysBoundedOverLongSessions) {
+  UndoHistory history(100);
+  history.Push(PlainStep(0));
+  // A plain instruction is a handful of bytes, not a StepDelta with a BIGMUL snapshot
+  EXPECT_LT(history.GetUsage().encoded_bytes, 16u);
+
+  size_t peak_reserved = 0;
+  for (uint64_t step = 1; step <= 20000; ++step) {
+    StepDelta delta = PlainStep(step * 4);
+    delta.memory_changes.push_back({step * 8, std::vector<uint8_t>(8, 0), std::vector<uint8_t>(8, uint8_t(step))});
+    history.Push(delta);
+    if (step == 1000) {
+      peak_reserved = history.GetUsage().reserved_bytes;
+    }
+  }
+  UndoHistoryUsage usage = history.GetUsage();
+  EXPECT_EQ(usage.undo_steps, 100u);
+  EXPECT_LE(usage.reserved_bytes, peak_reserved * 2);
+
+  for (uint64_t step = 20000; step > 19900; --step) {
+    StepDelta delta = history.Undo();
+    EXPECT_EQ(delta.old_pc, step * 4);
+    ASSERT_EQ(delta.memory_changes.size(), 1u);
+    EXPECT_EQ(delta.memory_changes[0].address, step * 8);
+    EXPECT_EQ(delta.memory_changes[0].new_bytes_vec, std::vector<uint8_t>(8, uint8_t(step)));
+  }
+  EXPECT_FALSE(history.CanUndo());
+}
@@ -5,8 +5,21 @@
  */
 
 #include <gtest/gtest.h>
-#include "../src/vm/rvss/rvss_vm.h"
-#include "../src/assembler/assembler.h"
+#include "vm/rvss/rvss_vm.h"
+#include "vm/rvss/rvss_threaded_vm.h"
+#include "vm/rv5s/rv5s_vm.h"
+#include "vm/ooo/ooo_vm.h"
+#include "assembler/assembler.h"
+#include "utils.h"
+#include "vm_runner.h"
+#include "bigmul_test_utils.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <thread>
 
 TEST(VmTest, ImmGenTest1) {
   RVSSVM vm;
@@ -104,7 +117,7 @@ TEST(VmTest, ExecutionTest3) {
 }
 
 TEST(VmTest, ExecutionTest4) {
-  AssembledProgram program = assemble("/home/vis/Desk/codes/assembler/examples/branch_test.s");
+  AssembledProgram program = assemble(EXAMPLES_DIR "/branch_test.s");
   RVSSVM vm;
     vm.LoadProgram(program);
   vm.Step();
@@ -121,7 +134,7 @@ TEST(VmTest, ExecutionTest4) {
 }
 
 TEST(VmTest, ExecutionTest5) {
-  AssembledProgram program = assemble("/home/vis/Desk/codes/assembler/examples/load_test.s");
+  AssembledProgram program = assemble(EXAMPLES_DIR "/load_test.s");
   RVSSVM vm;
     vm.LoadProgram(program);
   vm.Fetch();
@@ -136,7 +149,7 @@ TEST(VmTest, ExecutionTest5) {
 }
 
 TEST(VmTest, ExecutionTest6) {
-  AssembledProgram program = assemble("/home/vis/Desk/codes/assembler/examples/load_store_test_1.s");
+  AssembledProgram program = assemble(EXAMPLES_DIR "/load_store_test_1.s");
   RVSSVM vm;
     vm.LoadProgram(program);
   vm.Step();
@@ -150,7 +163,7 @@ TEST(VmTest, ExecutionTest6) {
 }
 
 TEST(VmTest, ExecutionTest7) {
-  AssembledProgram program = assemble("/home/vis/Desk/codes/assembler/examples/load_store_test_2.s");
+  AssembledProgram program = assemble(EXAMPLES_DIR "/load_store_test_2.s");
   RVSSVM vm;
     vm.LoadProgram(program);
   vm.Step();
@@ -168,7 +181,7 @@ TEST(VmTest, ExecutionTest7) {
 }
 
 TEST(VmTest, ExecutionTest8) {
-  AssembledProgram program = assemble("/home/vis/Desk/codes/assembler/examples/load_test_2.s");
+  AssembledProgram program = assemble(EXAMPLES_DIR "/load_test_2.s");
   RVSSVM vm;
     vm.LoadProgram(program);
   vm.registers_.WriteGpr(3, 0x10000000); // set the data section address
@@ -177,7 +190,7 @@ TEST(VmTest, ExecutionTest8) {
 }
 
 TEST(VmTest, ExecutionTest9) {
-  AssembledProgram program = assemble("/home/vis/Desk/codes/assembler/examples/branch_test.s");
+  AssembledProgram program = assemble(EXAMPLES_DIR "/branch_test.s");
   RVSSVM vm;
     vm.LoadProgram(program);
 
@@ -190,7 +203,7 @@ TEST(VmTest, ExecutionTest9) {
 }
 
 // TEST(VmTest, ExecutionTest10) {
-//     AssembledProgram program = assemble("/home/vis/Desk/codes/assembler/examples/jal_test.s");
+//     AssembledProgram program = assemble(EXAMPLES_DIR "/jal_test.s");
 //     RVSSVM vm;
 //     vm.LoadProgram(program);
 //     vm.registers_.WriteGpr(3, 0x10000000); // set the data section address
@@ -202,11 +215,955 @@ TEST(VmTest, ExecutionTest9) {
 // }
 
 TEST(VmTest, ExecutionTest11) {
-  AssembledProgram program = assemble("/home/vis/Desk/codes/assembler/examples/lui_auipc_test.s");
+  AssembledProgram program = assemble(EXAMPLES_DIR "/lui_auipc_test.s");
   RVSSVM vm;
     vm.LoadProgram(program);
   vm.Step();
   ASSERT_EQ(vm.registers_.ReadGpr(3), 0x0000000000100000);
   vm.Step();
   ASSERT_EQ(vm.registers_.ReadGpr(4), 0x0000000000100004);
-}
\ No newline at end of file
+}
+TEST(VmTest, DecodeCacheInvalidationTest) {
+  RVSSVM vm;
+  AssembledProgram program;
+  program.text_buffer.push_back(0x01700513); // addi x10, x0, 23
+  vm.LoadProgram(program);
+  vm.Step();
+  ASSERT_EQ(vm.registers_.ReadGpr(10), 23);
+  ASSERT_TRUE(vm.decode_cache_.Find(0)->valid);
+
+  // Overwriting the text must drop the stale decoded entry
+  vm.memory_controller_.WriteWord(0, 0x01b00513); // addi x10, x0, 27
+  ASSERT_FALSE(vm.decode_cache_.Find(0)->valid);
+  vm.program_counter_ = 0;
+  vm.Step();
+  ASSERT_EQ(vm.registers_.ReadGpr(10), 27);
+}
+
+static std::string RunAndDumpRegisters(RVSSVM &vm, const AssembledProgram &program,
+                                       const std::filesystem::path &dump_path) {
+  vm.LoadProgram(program);
+  vm.PushInput("differential");
+  vm.Run();
+  DumpRegisters(dump_path, vm.registers_);
+  std::ifstream dump(dump_path);
+  std::stringstream contents;
+  contents << dump.rdbuf();
+  return contents.str();
+}
+
+TEST(VmTest, EnginesMatchSingleCycle) {
+  std::filesystem::path dir = std::filesystem::temp_directory_path() / "vm_engine_differential_test";
+  std::filesystem::remove_all(dir);
+  const std::pair<std::string, vm_config::VmTypes> engines[] = {
+      {"threaded", vm_config::VmTypes::SINGLE_STAGE_THREADED},
+      {"pipelined", vm_config::VmTypes::MULTI_STAGE},
+      {"out_of_order", vm_config::VmTypes::OUT_OF_ORDER},
+  };
+  for (const auto &[engine, vm_type] : engines) {
+    std::filesystem::create_directories(dir / engine);
+  }
+  std::filesystem::create_directories(dir / "reference");
+
+  unsigned int programs_compared = 0;
+  for (const auto &entry : std::filesystem::directory_iterator(EXAMPLES_DIR)) {
+    if (entry.path().extension() != ".s") {
+      continue;
+    }
+    AssembledProgram program;
+    try {
+      program = assemble(entry.path().string());
+    } catch (const std::exception &) {
+      continue; // examples that intentionally fail to assemble
+    }
+
+    std::ostringstream console;
+    RVSSVM reference(VmOutputPaths::InDirectory(dir / "reference"));
+    reference.console_ = &console;
+    std::string expected = RunAndDumpRegisters(reference, program, dir / "reference" / "registers.json");
+    for (const auto &[engine, vm_type] : engines) {
+      std::string context = entry.path().filename().string() + " on " + engine;
+      std::unique_ptr<RVSSVM> vm = createVM(vm_type, VmOutputPaths::InDirectory(dir / engine));
+      vm->console_ = &console;
+      std::string actual = RunAndDumpRegisters(*vm, program, dir / engine / "registers.json");
+
+      EXPECT_EQ(expected, actual) << context;
+      EXPECT_EQ(reference.program_counter_, vm->program_counter_) << context;
+      EXPECT_EQ(reference.instructions_retired_, vm->instructions_retired_) << context;
+      if (vm_type == vm_config::VmTypes::SINGLE_STAGE_THREADED) {
+        EXPECT_EQ(reference.cycle_s_, vm->cycle_s_) << context;
+      } else if (auto *pipelined = dynamic_cast<RV5SVM *>(vm.get())) {
+        if (pipelined->program_counter_ >= pipelined->program_size_) {
+          EXPECT_TRUE(pipelined->PipelineEmpty()) << context; // drained, unless it hit the execution limit
+        }
+      } else if (auto *out_of_order = dynamic_cast<OooVM *>(vm.get())) {
+        EXPECT_EQ(out_of_order->cycle_s_, out_of_order->GetCore().GetCycles()) << context;
+      }
+    }
+    programs_compared++;
+  }
+  EXPECT_GT(programs_compared, 0u);
+  std::filesystem::remove_all(dir);
+}
+
+TEST(VmTest, ThreadedEngineSelfModifyingBlockTest) {
+  RVSSThreadedVM vm;
+  AssembledProgram program;
+  program.text_buffer.push_back(0x01b00337); // lui x6, 0x01b00
+  program.text_buffer.push_back(0x51330313); // addi x6, x6, 0x513   (x6 = addi x10, x0, 27)
+  program.text_buffer.push_back(0x00602823); // sw x6, 16(x0)
+  program.text_buffer.push_back(0x00000013); // nop
+  program.text_buffer.push_back(0x01700513); // addi x10, x0, 23, overwritten inside the same block
+  vm.LoadProgram(program);
+  vm.Run();
+  ASSERT_EQ(vm.registers_.ReadGpr(10), 27);
+  ASSERT_EQ(vm.instructions_retired_, 5u);
+}
+
+namespace {
+
+AssembledProgram AssembleBigmulProgram(const std::filesystem::path &path, const std::vector<uint64_t> &a,
+                                       const std::vector<uint64_t> &b, uint64_t operand_dwords) {
+  std::ofstream file(path);
+  file << std::hex << std::showbase << ".data\n";
+  for (const auto &[label, operand] : {std::pair{"A", &a}, std::pair{"B", &b}}) {
+    file << label << ":\n";
+    for (uint64_t word : *operand) {
+      file << "    udword " << word << "\n";
+    }
+    if (operand->size() < operand_dwords) {
+      file << std::dec << "    zero " << (operand_dwords - operand->size()) * 8 << std::hex << "\n";
+    }
+  }
+  file << std::dec << "RES:\n"
+       << "    zero " << operand_dwords * 16 << "\n"
+       << ".text\n"
+          "    la x3, A\n"
+          "    la x4, B\n"
+          "    la x5, RES\n"
+          "    ldbm x0, x3, x4\n"
+          "    li x8, " << operand_dwords << "\n"
+          "    bigmul x8, 0(x5)\n"
+          "    nop\n";
+  file.close();
+  return assemble(path.string());
+}
+
+void ExpectBigmulResult(RVSSVM &vm, const std::vector<uint64_t> &expected, uint64_t operand_dwords) {
+  uint64_t result = vm.registers_.ReadGpr(5);
+  for (uint64_t i = 0; i < operand_dwords * 2; ++i) {
+    EXPECT_EQ(vm.memory_controller_.ReadDoubleWord(result + i * 8), i < expected.size() ? expected[i] : 0) << i;
+  }
+}
+
+} // namespace
+
+TEST(VmTest, ConcurrentBigmulUnitsAreIndependent) {
+  std::filesystem::path dir = std::filesystem::temp_directory_path() / "vm_concurrent_bigmul_test";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir / "first");
+  std::filesystem::create_directories(dir / "second");
+  const std::vector<uint64_t> first_a = {0xffffffffffffffffULL, 0x0123456789abcdefULL};
+  const std::vector<uint64_t> first_b = {0xfedcba9876543210ULL};
+  const std::vector<uint64_t> second_a = {0x1111111111111111ULL, 7};
+  const std::vector<uint64_t> second_b = {0x8000000000000001ULL};
+  AssembledProgram first_program = AssembleBigmulProgram(dir / "first.s", first_a, first_b, 64);
+  AssembledProgram second_program = AssembleBigmulProgram(dir / "second.s", second_a, second_b, 64);
+
+  RVSSVM first(VmOutputPaths::InDirectory(dir / "first"));
+  RVSSVM second(VmOutputPaths::InDirectory(dir / "second"));
+  first.silent_run_ = true;
+  second.silent_run_ = true;
+  first.LoadProgram(first_program);
+  second.LoadProgram(second_program);
+  std::thread first_thread([&first]() { first.Run(); });
+  std::thread second_thread([&second]() { second.Run(); });
+  first_thread.join();
+  second_thread.join();
+
+  ExpectBigmulResult(first, SchoolbookMultiply(first_a, first_b), 64);
+  ExpectBigmulResult(second, SchoolbookMultiply(second_a, second_b), 64);
+  std::filesystem::remove_all(dir);
+}
+
+TEST(VmTest, BigmulOperandsLongerThanTheCache) {
+  std::filesystem::path dir = std::filesystem::temp_directory_path() / "vm_tiled_bigmul_test";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+  uint64_t previous_cycles = 0;
+  for (uint64_t operand_dwords : {64u, 150u, 256u}) {
+    std::vector<uint64_t> a = RandomDwords(operand_dwords, 0x9e3779b97f4a7c15ULL);
+    std::vector<uint64_t> b = RandomDwords(operand_dwords, 0x7f4a7c159e3779b9ULL);
+    AssembledProgram program = AssembleBigmulProgram(dir / "tiled.s", a, b, operand_dwords);
+
+    RVSSVM vm(VmOutputPaths::InDirectory(dir));
+    vm.silent_run_ = true;
+    vm.LoadProgram(program);
+    vm.Run();
+
+    ExpectBigmulResult(vm, SchoolbookMultiply(a, b), operand_dwords);
+    uint64_t tiles = (operand_dwords + BigmulUnit::kDefaultCacheDwords - 1) / BigmulUnit::kDefaultCacheDwords;
+    EXPECT_EQ(vm.bigmul_unit_.GetStats().tiles, tiles * tiles) << operand_dwords;
+    EXPECT_EQ(vm.bigmul_unit_.GetStats().tile_fill_cycles == 0, tiles == 1) << operand_dwords;
+    EXPECT_GT(vm.cycle_s_, previous_cycles) << operand_dwords;
+    previous_cycles = vm.cycle_s_;
+  }
+  std::filesystem::remove_all(dir);
+}
+
+TEST(VmTest, UndoRestoresTheBigmulResult) {
+  std::filesystem::path dir = std::filesystem::temp_directory_path() / "vm_bigmul_undo_test";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+  const std::vector<uint64_t> a = {0xffffffffffffffffULL, 0x0123456789abcdefULL};
+  const std::vector<uint64_t> b = {0xfedcba9876543210ULL, 3};
+  AssembledProgram program = AssembleBigmulProgram(dir / "undo.s", a, b, 64);
+
+  RVSSVM vm(VmOutputPaths::InDirectory(dir));
+  vm.silent_run_ = true;
+  vm.LoadProgram(program);
+  // Three la pairs, ldbm, li and bigmul
+  for (int i = 0; i < 9; ++i) {
+    vm.Step();
+  }
+  std::vector<uint64_t> expected = SchoolbookMultiply(a, b);
+  ExpectBigmulResult(vm, expected, 64);
+
+  vm.Undo();
+  ExpectBigmulResult(vm, {}, 64);
+  vm.Redo();
+  ExpectBigmulResult(vm, expected, 64);
+  std::filesystem::remove_all(dir);
+}
+
+TEST(VmTest, EveryBigmulEngineComputesTheSameProduct) {
+  std::filesystem::path dir = std::filesystem::temp_directory_path() / "vm_bigmul_engine_test";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+  for (uint64_t operand_dwords : {64u, 150u}) {
+    std::vector<uint64_t> a = RandomDwords(operand_dwords, 0x452821e638d01377ULL);
+    std::vector<uint64_t> b = RandomDwords(operand_dwords, 0x38d01377452821e6ULL);
+    AssembledProgram program = AssembleBigmulProgram(dir / "engine.s", a, b, operand_dwords);
+    std::vector<uint64_t> expected = SchoolbookMultiply(a, b);
+
+    std::map<vm_config::BigmulEngine, uint64_t> compute_cycles;
+    for (vm_config::BigmulEngine engine : {vm_config::BigmulEngine::SINGLECYCLE, vm_config::BigmulEngine::CSA_ONLY,
+                                           vm_config::BigmulEngine::STAGED3, vm_config::BigmulEngine::STAGED7,
+                                           vm_config::BigmulEngine::SYSTOLIC}) {
+      RVSSVM vm(VmOutputPaths::InDirectory(dir));
+      vm.silent_run_ = true;
+      vm.bigmul_unit_.SetEngine(engine);
+      vm.LoadProgram(program);
+      vm.Run();
+
+      SCOPED_TRACE(vm_config::bigmulEngineName(engine) + " " + std::to_string(operand_dwords));
+      ExpectBigmulResult(vm, expected, operand_dwords);
+      compute_cycles[engine] = vm.bigmul_unit_.GetStats().compute_cycles;
+    }
+    // Deeper pipelines pay fill and drain latency on every diagonal, the systolic array takes one cycle per diagonal
+    EXPECT_LT(compute_cycles[vm_config::BigmulEngine::SINGLECYCLE], compute_cycles[vm_config::BigmulEngine::STAGED3]);
+    EXPECT_LT(compute_cycles[vm_config::BigmulEngine::STAGED3], compute_cycles[vm_config::BigmulEngine::STAGED7]);
+    EXPECT_LT(compute_cycles[vm_config::BigmulEngine::SYSTOLIC], compute_cycles[vm_config::BigmulEngine::SINGLECYCLE]);
+  }
+  std::filesystem::remove_all(dir);
+}
+
+TEST(VmTest, StagedBigmulPipelinesReportStageOccupancy) {
+  std::filesystem::path dir = std::filesystem::temp_directory_path() / "vm_bigmul_stage_test";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+  std::vector<uint64_t> a(64, 0x7fffffffffffffffULL), b(64, 0x0123456789abcdefULL);
+  AssembledProgram program = AssembleBigmulProgram(dir / "stages.s", a, b, 64);
+
+  std::map<vm_config::BigmulEngine, BigmulUnit::BigmulStats> stats;
+  for (vm_config::BigmulEngine engine : {vm_config::BigmulEngine::SINGLECYCLE, vm_config::BigmulEngine::STAGED3,
+                                         vm_config::BigmulEngine::STAGED7}) {
+    RVSSVM vm(VmOutputPaths::InDirectory(dir));
+    vm.silent_run_ = true;
+    vm.bigmul_unit_.SetEngine(engine);
+    vm.LoadProgram(program);
+    vm.Run();
+    ExpectBigmulResult(vm, SchoolbookMultiply(a, b), 64);
+    stats[engine] = vm.bigmul_unit_.GetStats();
+  }
+
+  // Every batch passes each front-end stage once, so GEN, LOAD and MUL are busy for one cycle per batch
+  const uint64_t batches = BigmulUnit::SchoolbookCycles(64);
+  EXPECT_TRUE(stats[vm_config::BigmulEngine::SINGLECYCLE].stages.empty());
+  ASSERT_EQ(stats[vm_config::BigmulEngine::STAGED3].stages.size(), 3u);
+  ASSERT_EQ(stats[vm_config::BigmulEngine::STAGED7].stages.size(), 7u);
+  for (vm_config::BigmulEngine engine : {vm_config::BigmulEngine::STAGED3, vm_config::BigmulEngine::STAGED7}) {
+    const BigmulUnit::BigmulStats &engine_stats = stats[engine];
+    SCOPED_TRACE(vm_config::bigmulEngineName(engine));
+    EXPECT_EQ(engine_stats.partial_products, 64u * 64u);
+    for (size_t stage = 0; stage < engine_stats.stages.size(); ++stage) {
+      EXPECT_EQ(engine_stats.stages[stage].busy_cycles + engine_stats.stages[stage].bubble_cycles,
+                engine_stats.compute_cycles) << engine_stats.stages[stage].name;
+    }
+    for (size_t stage = 0; stage < 3; ++stage) {
+      EXPECT_EQ(engine_stats.stages[stage].busy_cycles, batches) << engine_stats.stages[stage].name;
+    }
+  }
+  // Full batches go through all four CSA levels
+  for (size_t stage = 3; stage < 7; ++stage) {
+    EXPECT_GT(stats[vm_config::BigmulEngine::STAGED7].stages[stage].busy_cycles, 0u) << stage;
+  }
+
+  // Deeper pipelines drain between diagonals, so they form fewer products per cycle
+  EXPECT_EQ(stats[vm_config::BigmulEngine::SINGLECYCLE].partial_products, 64u * 64u);
+  EXPECT_GT(stats[vm_config::BigmulEngine::SINGLECYCLE].Throughput(),
+            stats[vm_config::BigmulEngine::STAGED3].Throughput());
+  EXPECT_GT(stats[vm_config::BigmulEngine::STAGED3].Throughput(),
+            stats[vm_config::BigmulEngine::STAGED7].Throughput());
+  std::filesystem::remove_all(dir);
+}
+
+TEST(VmTest, KaratsubaBigmulMatchesSchoolbook) {
+  std::filesystem::path dir = std::filesystem::temp_directory_path() / "vm_karatsuba_bigmul_test";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+  // Cycles of the recursion down to pieces of 8 doublewords: 25-product schoolbook batches for the
+  // pieces, plus one 8-doubleword adder pass per cycle for the two half sums and three combines per level
+  const std::map<uint64_t, uint64_t> expected_cycles = {{17, 100}, {150, 3827}, {1024, 81538}};
+  for (const auto &[operand_dwords, cycles] : expected_cycles) {
+    std::vector<uint64_t> a = RandomDwords(operand_dwords, 0x243f6a8885a308d3ULL);
+    std::vector<uint64_t> b = RandomDwords(operand_dwords, 0x85a308d3243f6a88ULL);
+    AssembledProgram program = AssembleBigmulProgram(dir / "karatsuba.s", a, b, operand_dwords);
+
+    RVSSVM schoolbook(VmOutputPaths::InDirectory(dir));
+    schoolbook.silent_run_ = true;
+    schoolbook.LoadProgram(program);
+    schoolbook.Run();
+
+    RVSSVM karatsuba(VmOutputPaths::InDirectory(dir));
+    karatsuba.silent_run_ = true;
+    karatsuba.bigmul_unit_.SetAlgorithm(vm_config::BigmulAlgorithm::KARATSUBA);
+    karatsuba.bigmul_unit_.SetKaratsubaThreshold(8);
+    karatsuba.LoadProgram(program);
+    karatsuba.Run();
+
+    std::vector<uint64_t> expected = SchoolbookMultiply(a, b);
+    ExpectBigmulResult(schoolbook, expected, operand_dwords);
+    ExpectBigmulResult(karatsuba, expected, operand_dwords);
+    EXPECT_EQ(karatsuba.bigmul_unit_.GetStats().compute_cycles, cycles) << operand_dwords;
+  }
+  // Such small pieces cost more adder passes than they save; with whole tiles as the base case the
+  // recursion pays off once operands are long enough
+  EXPECT_EQ(BigmulUnit::SchoolbookCycles(1024), 42927u);
+  BigmulUnit unit;
+  EXPECT_EQ(unit.KaratsubaCycles(64), 231u);
+  EXPECT_EQ(unit.KaratsubaCycles(64), BigmulUnit::SchoolbookCycles(64));
+  EXPECT_EQ(unit.KaratsubaCycles(1024), 25197u);
+  std::filesystem::remove_all(dir);
+}
+
+namespace {
+
+AssembledProgram AssembleSquaresProgram(const std::filesystem::path &path) {
+  std::ofstream file(path);
+  file << ".data\n"
+          "ARR:\n"
+          "    zero 64\n"
+          ".text\n"
+          "    la x5, ARR\n"
+          "    li x6, 0\n"
+          "    li x7, 8\n"
+          "loop:\n"
+          "    slli x8, x6, 3\n"
+          "    add x9, x5, x8\n"
+          "    mul x10, x6, x6\n"
+          "    sd x10, 0(x9)\n"
+          "    addi x6, x6, 1\n"
+          "    blt x6, x7, loop\n"
+          "    nop\n";
+  file.close();
+  return assemble(path.string());
+}
+
+struct ObservedState {
+  uint64_t program_counter = 0;
+  std::vector<uint64_t> gprs;
+  std::vector<uint64_t> squares;
+};
+
+ObservedState Observe(RVSSVM &vm) {
+  ObservedState state;
+  state.program_counter = vm.program_counter_;
+  for (unsigned int reg = 5; reg <= 10; ++reg) {
+    state.gprs.push_back(vm.registers_.ReadGpr(reg));
+  }
+  for (uint64_t i = 0; i < 8; ++i) {
+    state.squares.push_back(vm.memory_controller_.ReadDoubleWord(vm_config::config.getDataSectionStart() + i * 8));
+  }
+  return state;
+}
+
+void ExpectSameState(const ObservedState &actual, const ObservedState &expected) {
+  EXPECT_EQ(actual.program_counter, expected.program_counter);
+  EXPECT_EQ(actual.gprs, expected.gprs);
+  EXPECT_EQ(actual.squares, expected.squares);
+}
+
+} // namespace
+
+TEST(VmTest, ReverseStepMatchesTheSteppedState) {
+  std::filesystem::path dir = std::filesystem::temp_directory_path() / "vm_reverse_step_test";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+  AssembledProgram program = AssembleSquaresProgram(dir / "squares.s");
+  uint64_t interval = vm_config::config.getCheckpointInterval();
+  vm_config::config.setCheckpointInterval(5);
+
+  // The state after every instruction, stepped one at a time
+  std::vector<ObservedState> stepped;
+  RVSSVM reference(VmOutputPaths::InDirectory(dir));
+  reference.LoadProgram(program);
+  stepped.push_back(Observe(reference));
+  while (reference.program_counter_ < reference.program_size_) {
+    reference.Step();
+    stepped.push_back(Observe(reference));
+  }
+
+  RVSSVM vm(VmOutputPaths::InDirectory(dir));
+  vm.silent_run_ = true;
+  vm.LoadProgram(program);
+  vm.Run();
+  ASSERT_EQ(vm.instructions_retired_ + 1, stepped.size());
+  EXPECT_GT(vm.checkpoints_.size(), 1u);
+
+  for (uint64_t steps : {1u, 7u, 3u, 20u}) {
+    uint64_t target = vm.instructions_retired_ - steps;
+    vm.ReverseStep(steps);
+    ASSERT_EQ(vm.instructions_retired_, target);
+    SCOPED_TRACE(target);
+    ExpectSameState(Observe(vm), stepped[target]);
+  }
+
+  // Going forward again from the rewound state ends where the first run did
+  vm.Run();
+  ExpectSameState(Observe(vm), stepped.back());
+
+  vm.ReverseStep(1000);
+  EXPECT_EQ(vm.instructions_retired_, 0u);
+  ExpectSameState(Observe(vm), stepped.front());
+  vm_config::config.setCheckpointInterval(interval);
+  std::filesystem::remove_all(dir);
+}
+
+TEST(VmTest, ReverseContinueStopsBeforeTheLastBreakpoint) {
+  std::filesystem::path dir = std::filesystem::temp_directory_path() / "vm_reverse_continue_test";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+  AssembledProgram program = AssembleSquaresProgram(dir / "squares.s");
+  uint64_t interval = vm_config::config.getCheckpointInterval();
+  vm_config::config.setCheckpointInterval(4);
+
+  RVSSVM vm(VmOutputPaths::InDirectory(dir));
+  vm.silent_run_ = true;
+  vm.LoadProgram(program);
+  uint64_t store_address = 0;
+  while ((program.text_buffer[store_address / 4] & 0x7f) != 0x23) {
+    store_address += 4;
+  }
+  vm.AddBreakpoint(store_address, false);
+  vm.Run();
+
+  // Before the last store of i * i, then before the one before it
+  for (uint64_t i : {7u, 6u}) {
+    vm.ReverseContinue();
+    EXPECT_EQ(vm.output_status_, "VM_BREAKPOINT_HIT");
+    EXPECT_EQ(vm.program_counter_, store_address);
+    EXPECT_EQ(vm.registers_.ReadGpr(6), i);
+    ObservedState state = Observe(vm);
+    for (uint64_t j = 0; j < 8; ++j) {
+      EXPECT_EQ(state.squares[j], j < i ? j * j : 0) << j;
+    }
+  }
+  vm_config::config.setCheckpointInterval(interval);
+  std::filesystem::remove_all(dir);
+}
+
+TEST(VmTest, ReverseStepAfterResetStaysInTheNewProgram) {
+  std::filesystem::path dir = std::filesystem::temp_directory_path() / "vm_reverse_reset_test";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+  for (const auto &[name, value] : {std::pair{"a.s", 111}, std::pair{"b.s", 222}}) {
+    std::ofstream file(dir / name);
+    file << ".data\n"
+            "buf: .dword " << value << "\n"
+            ".text\n"
+            "    la x5, buf\n"
+            "    ld x6, 0(x5)\n"
+            "    addi x7, x6, 1\n"
+            "    sd x7, 0(x5)\n"
+            "    nop\n";
+  }
+  AssembledProgram a = assemble((dir / "a.s").string());
+  AssembledProgram b = assemble((dir / "b.s").string());
+  uint64_t interval = vm_config::config.getCheckpointInterval();
+  vm_config::config.setCheckpointInterval(2);
+
+  RVSSVM vm(VmOutputPaths::InDirectory(dir));
+  vm.silent_run_ = true;
+  vm.LoadProgram(a);
+  for (int i = 0; i < 5; ++i) {
+    vm.Step();
+  }
+  ASSERT_FALSE(vm.checkpoints_.empty());
+
+  vm.Reset();
+  EXPECT_TRUE(vm.checkpoints_.empty());
+  vm.LoadProgram(b);
+  for (int i = 0; i < 3; ++i) {
+    vm.Step();
+  }
+  // Rewinding must not bring back a.s's data
+  vm.ReverseStep(1);
+  EXPECT_EQ(vm.instructions_retired_, 2u);
+  for (int i = 0; i < 3; ++i) {
+    vm.Step();
+  }
+  EXPECT_EQ(vm.registers_.ReadGpr(6), 222u);
+  EXPECT_EQ(vm.memory_controller_.ReadDoubleWord(vm.registers_.ReadGpr(5)), 223u);
+
+  // Loading without a reset drops the checkpoints too
+  vm.LoadProgram(a);
+  EXPECT_TRUE(vm.checkpoints_.empty());
+  vm_config::config.setCheckpointInterval(interval);
+  std::filesystem::remove_all(dir);
+}
+
+TEST(VmTest, RestoredSnapshotsFanOutOverInputs) {
+  std::filesystem::path dir = std::filesystem::temp_directory_path() / "vm_snapshot_test";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+  std::ofstream file(dir / "echo.s");
+  file << ".data\n"
+          "BUF:\n"
+          "    zero 16\n"
+          ".text\n"
+          "    li x5, 3\n"
+          "    li x6, 4\n"
+          "    mul x7, x5, x6\n"
+          "    li a0, 0\n"
+          "    la a1, BUF\n"
+          "    li a2, 8\n"
+          "    li a7, 63\n"
+          "    ecall\n"
+          "    la x9, BUF\n"
+          "    lb x10, 0(x9)\n"
+          "    add x10, x10, x7\n"
+          "    sd x10, 8(x9)\n";
+  file.close();
+  AssembledProgram program = assemble((dir / "echo.s").string());
+  uint64_t buffer = vm_config::config.getDataSectionStart();
+
+  RVSSVM vm(VmOutputPaths::InDirectory(dir));
+  std::ostringstream console;
+  vm.console_ = &console;
+  vm.silent_run_ = true;
+  vm.LoadProgram(program);
+  for (int i = 0; i < 3; ++i) {
+    vm.Step();
+  }
+  VmSnapshot prefix = vm.Snapshot();
+
+  for (char input : {'A', 'B', 'A'}) {
+    SCOPED_TRACE(input);
+    vm.Restore(prefix);
+    EXPECT_EQ(vm.program_counter_, 12u);
+    EXPECT_EQ(vm.instructions_retired_, 3u);
+    EXPECT_EQ(vm.memory_controller_.ReadByte(buffer), 0u);
+    vm.PushInput(std::string(1, input));
+    vm.Run();
+    EXPECT_EQ(vm.program_counter_, vm.program_size_);
+    EXPECT_EQ(vm.registers_.ReadGpr(10), uint64_t(input) + 12);
+    EXPECT_EQ(vm.memory_controller_.ReadDoubleWord(buffer + 8), uint64_t(input) + 12);
+  }
+  std::filesystem::remove_all(dir);
+}
+
+TEST(VmTest, CacheMissesStallTheVm) {
+  std::filesystem::path dir = std::filesystem::temp_directory_path() / "vm_cache_stall_test";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+  std::ofstream file(dir / "sum.s");
+  // Sums one doubleword from each of eight lines, twice: the second pass hits
+  file << ".data\n"
+          "ARR:\n"
+          "    zero 512\n"
+          ".text\n"
+          "    li x7, 2\n"
+          "outer:\n"
+          "    la x5, ARR\n"
+          "    li x6, 8\n"
+          "inner:\n"
+          "    ld x8, 0(x5)\n"
+          "    add x9, x9, x8\n"
+          "    addi x5, x5, 64\n"
+          "    addi x6, x6, -1\n"
+          "    bne x6, x0, inner\n"
+          "    addi x7, x7, -1\n"
+          "    bne x7, x0, outer\n";
+  file.close();
+  AssembledProgram program = assemble((dir / "sum.s").string());
+
+  vm_config::VmConfig saved = vm_config::config;
+  std::ostringstream console;
+  RVSSVM uncached(VmOutputPaths::InDirectory(dir));
+  uncached.console_ = &console;
+  uncached.silent_run_ = true;
+  uncached.LoadProgram(program);
+  uncached.Run();
+  EXPECT_EQ(uncached.stall_cycles_, 0u);
+  EXPECT_EQ(uncached.cycle_s_, uncached.instructions_retired_);
+  EXPECT_FLOAT_EQ(uncached.cpi_, 1.0f);
+
+  vm_config::config.modifyConfig("Cache", "cache_enabled", "true");
+  vm_config::config.modifyConfig("Cache", "memory_latency", "100");
+  RVSSVM vm(VmOutputPaths::InDirectory(dir));
+  vm.console_ = &console;
+  vm.silent_run_ = true;
+  vm.LoadProgram(program);
+  vm.Run();
+  // The eight data lines and the text's one line each miss once, to memory
+  EXPECT_EQ(vm.stall_cycles_, 9u * 100u);
+  EXPECT_EQ(vm.instructions_retired_, uncached.instructions_retired_);
+  EXPECT_EQ(vm.cycle_s_, vm.instructions_retired_ + vm.stall_cycles_);
+  EXPECT_GT(vm.cpi_, 1.0f);
+  EXPECT_FLOAT_EQ(vm.cpi_ * vm.ipc_, 1.0f);
+
+  vm_config::config = saved;
+  std::filesystem::remove_all(dir);
+}
+
+TEST(VmTest, UndoAndReverseStepGiveBackTheCyclesOfEachStep) {
+  std::filesystem::path dir = std::filesystem::temp_directory_path() / "vm_reverse_cycles_test";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+  std::ofstream file(dir / "sum.s");
+  // The first pass misses on every line, the second hits
+  file << ".data\n"
+          "ARR:\n"
+          "    zero 512\n"
+          ".text\n"
+          "    li x7, 2\n"
+          "outer:\n"
+          "    la x5, ARR\n"
+          "    li x6, 8\n"
+          "inner:\n"
+          "    ld x8, 0(x5)\n"
+          "    add x9, x9, x8\n"
+          "    addi x5, x5, 64\n"
+          "    addi x6, x6, -1\n"
+          "    bne x6, x0, inner\n"
+          "    addi x7, x7, -1\n"
+          "    bne x7, x0, outer\n";
+  file.close();
+  AssembledProgram program = assemble((dir / "sum.s").string());
+
+  vm_config::VmConfig saved = vm_config::config;
+  vm_config::config.modifyConfig("Cache", "cache_enabled", "true");
+  vm_config::config.modifyConfig("Cache", "memory_latency", "100");
+  vm_config::config.setCheckpointInterval(4);
+  std::ostringstream console;
+  RVSSVM vm(VmOutputPaths::InDirectory(dir));
+  vm.console_ = &console;
+  vm.LoadProgram(program);
+  auto counts = [](const RVSSVM &vm) { return std::pair<uint64_t, uint64_t>(vm.cycle_s_, vm.stall_cycles_); };
+  std::vector<std::pair<uint64_t, uint64_t>> cycles = {{0, 0}};
+  while (vm.program_counter_ < vm.program_size_) {
+    vm.Step();
+    cycles.push_back(counts(vm));
+  }
+  ASSERT_EQ(vm.stall_cycles_, 9u * 100u);
+
+  // Undo takes back the misses along with the instructions, redo charges them again
+  for (uint64_t retired = vm.instructions_retired_; retired-- > 0;) {
+    vm.Undo();
+    ASSERT_EQ(counts(vm), cycles[retired]) << retired;
+  }
+  while (vm.instructions_retired_ + 1 < cycles.size()) {
+    vm.Redo();
+    ASSERT_EQ(counts(vm), cycles[vm.instructions_retired_]);
+  }
+
+  // Replay from a checkpoint finds the caches as they were there, not as the run left them
+  RVSSVM rewound(VmOutputPaths::InDirectory(dir));
+  rewound.console_ = &console;
+  rewound.silent_run_ = true;
+  rewound.LoadProgram(program);
+  rewound.Run();
+  for (uint64_t steps : {1u, 30u, 5u, 1000u}) {
+    rewound.ReverseStep(steps);
+    ASSERT_EQ(counts(rewound), cycles[rewound.instructions_retired_]) << steps;
+    rewound.Run();
+    EXPECT_EQ(counts(rewound), cycles.back()) << steps;
+  }
+
+  vm_config::config = saved;
+  std::filesystem::remove_all(dir);
+}
+
+TEST(VmTest, PipelineCountsHazards) {
+  std::filesystem::path dir = std::filesystem::temp_directory_path() / "vm_pipeline_test";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+  std::ofstream file(dir / "sum.s");
+  // Every ld feeds the add right behind it, and every taken bne squashes the two instructions after it
+  file << ".data\n"
+          "ARR:\n"
+          "    .dword 1, 2, 3, 4, 5, 6, 7, 8\n"
+          ".text\n"
+          "    la x5, ARR\n"
+          "    li x6, 8\n"
+          "loop:\n"
+          "    ld x8, 0(x5)\n"
+          "    add x9, x9, x8\n"
+          "    addi x5, x5, 8\n"
+          "    addi x6, x6, -1\n"
+          "    bne x6, x0, loop\n"
+          "    addi x10, x9, 0\n"
+          "    addi x11, x0, 1\n";
+  file.close();
+  AssembledProgram program = assemble((dir / "sum.s").string());
+
+  std::ostringstream console;
+  RV5SVM vm(VmOutputPaths::InDirectory(dir));
+  vm.console_ = &console;
+  vm.silent_run_ = true;
+  vm.LoadProgram(program);
+  vm.Run();
+
+  EXPECT_EQ(vm.registers_.ReadGpr(10), 36u);
+  EXPECT_EQ(vm.instructions_retired_, 3u + 8u * 5u + 2u);
+  EXPECT_EQ(vm.pipeline_stats_.load_use_stalls, 8u);
+  EXPECT_EQ(vm.pipeline_stats_.flushes, 7u);
+  EXPECT_EQ(vm.pipeline_stats_.squashed, 14u);
+  EXPECT_EQ(vm.branch_mispredictions_, 7u);
+  EXPECT_EQ(vm.stall_cycles_, 8u + 14u);
+  // Four cycles to fill the pipeline, then one instruction a cycle but for the stalls
+  EXPECT_EQ(vm.cycle_s_, vm.instructions_retired_ + 4u + vm.stall_cycles_);
+  EXPECT_NE(console.str().find("VM_PIPELINE_STATS"), std::string::npos);
+
+  // Stepping clocks the same pipeline, one instruction at a time, and undo rewinds it
+  RV5SVM stepped(VmOutputPaths::InDirectory(dir));
+  stepped.console_ = &console;
+  stepped.LoadProgram(program);
+  std::vector<uint64_t> cycles = {0};
+  while (stepped.program_counter_ < stepped.program_size_) {
+    stepped.Step();
+    cycles.push_back(stepped.cycle_s_);
+  }
+  EXPECT_EQ(stepped.registers_.ReadGpr(10), 36u);
+  EXPECT_EQ(stepped.cycle_s_, vm.cycle_s_);
+  EXPECT_EQ(stepped.instructions_retired_, vm.instructions_retired_);
+
+  for (int i = 0; i < 10; ++i) {
+    stepped.Undo();
+  }
+  EXPECT_EQ(stepped.instructions_retired_, vm.instructions_retired_ - 10u);
+  // A step takes back the cycles it spent in stalls and flushes, not just one
+  EXPECT_EQ(stepped.cycle_s_, cycles[stepped.instructions_retired_]);
+  stepped.Run();
+  EXPECT_EQ(stepped.registers_.ReadGpr(10), 36u);
+  EXPECT_EQ(stepped.instructions_retired_, vm.instructions_retired_);
+  std::filesystem::remove_all(dir);
+}
+
+TEST(VmTest, BranchPredictorCutsPipelineFlushes) {
+  std::filesystem::path dir = std::filesystem::temp_directory_path() / "vm_branch_predictor_test";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+  std::ofstream file(dir / "count.s");
+  file << "    li x6, 8\n"
+          "loop:\n"
+          "    addi x9, x9, 3\n"
+          "    addi x6, x6, -1\n"
+          "    bne x6, x0, loop\n"
+          "    addi x10, x9, 0\n"
+          "    addi x11, x0, 1\n";
+  file.close();
+  AssembledProgram program = assemble((dir / "count.s").string());
+
+  vm_config::VmConfig saved = vm_config::config;
+  vm_config::config.modifyConfig("BranchPrediction", "branch_prediction_type", "bimodal");
+  std::ostringstream console;
+  RV5SVM pipelined(VmOutputPaths::InDirectory(dir));
+  pipelined.console_ = &console;
+  pipelined.silent_run_ = true;
+  pipelined.LoadProgram(program);
+  pipelined.Run();
+  RVSSVM single_cycle(VmOutputPaths::InDirectory(dir));
+  single_cycle.console_ = &console;
+  single_cycle.silent_run_ = true;
+  single_cycle.LoadProgram(program);
+  single_cycle.Run();
+  vm_config::config = saved;
+
+  // The first taken bne misses the counter and the BTB, the last one falls through
+  EXPECT_EQ(pipelined.registers_.ReadGpr(10), 24u);
+  EXPECT_EQ(pipelined.branch_mispredictions_, 2u);
+  EXPECT_EQ(pipelined.pipeline_stats_.flushes, 2u);
+  EXPECT_EQ(pipelined.pipeline_stats_.squashed, 4u);
+  EXPECT_EQ(pipelined.cycle_s_, pipelined.instructions_retired_ + 4u + 4u);
+  EXPECT_EQ(single_cycle.branch_mispredictions_, 2u);
+  const branch_prediction::BranchSiteStats *site = single_cycle.branch_predictor_.GetSiteStats(12);
+  ASSERT_NE(site, nullptr);
+  EXPECT_EQ(site->executed, 8u);
+  EXPECT_EQ(site->taken, 7u);
+  EXPECT_EQ(site->mispredicted, 2u);
+  std::filesystem::remove_all(dir);
+}
+
+TEST(VmTest, ReverseStepKeepsTheBranchStatistics) {
+  std::filesystem::path dir = std::filesystem::temp_directory_path() / "vm_reverse_branch_test";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+  std::ofstream file(dir / "count.s");
+  file << "    li x6, 40\n"
+          "loop:\n"
+          "    addi x9, x9, 3\n"
+          "    addi x6, x6, -1\n"
+          "    bne x6, x0, loop\n";
+  file.close();
+  AssembledProgram program = assemble((dir / "count.s").string());
+
+  vm_config::VmConfig saved = vm_config::config;
+  vm_config::config.modifyConfig("BranchPrediction", "branch_prediction_type", "bimodal");
+  vm_config::config.setCheckpointInterval(4);
+  std::ostringstream console;
+  RVSSVM vm(VmOutputPaths::InDirectory(dir));
+  vm.console_ = &console;
+  vm.LoadProgram(program);
+  for (int i = 0; i < 30; ++i) {
+    vm.Step();
+  }
+
+  // Rewinding twice ends up where stepping straight there does, predictor included
+  for (uint64_t retired : {20u, 10u}) {
+    vm.ReverseStep(10);
+    ASSERT_EQ(vm.instructions_retired_, retired);
+    RVSSVM stepped(VmOutputPaths::InDirectory(dir));
+    stepped.console_ = &console;
+    stepped.LoadProgram(program);
+    while (stepped.instructions_retired_ < retired) {
+      stepped.Step();
+    }
+    SCOPED_TRACE(retired);
+    EXPECT_EQ(vm.branch_predictor_.GetBranches(), stepped.branch_predictor_.GetBranches());
+    EXPECT_EQ(vm.branch_predictor_.GetMispredictions(), stepped.branch_predictor_.GetMispredictions());
+    EXPECT_EQ(vm.branch_mispredictions_, stepped.branch_mispredictions_);
+    const branch_prediction::BranchSiteStats *site = vm.branch_predictor_.GetSiteStats(12);
+    ASSERT_NE(site, nullptr);
+    EXPECT_EQ(site->executed, (retired - 1) / 3);
+    EXPECT_EQ(site->mispredicted, stepped.branch_predictor_.GetSiteStats(12)->mispredicted);
+  }
+
+  // Running on from there mispredicts as the first run did, not as a predictor trained twice would
+  vm.Run();
+  RVSSVM straight(VmOutputPaths::InDirectory(dir));
+  straight.console_ = &console;
+  straight.silent_run_ = true;
+  straight.LoadProgram(program);
+  straight.Run();
+  EXPECT_EQ(vm.branch_predictor_.GetBranches(), 40u);
+  EXPECT_EQ(vm.branch_mispredictions_, straight.branch_mispredictions_);
+
+  vm_config::config = saved;
+  std::filesystem::remove_all(dir);
+}
+
+TEST(VmTest, OutOfOrderVmOverlapsIndependentWork) {
+  std::filesystem::path dir = std::filesystem::temp_directory_path() / "vm_ooo_test";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+  std::ofstream file(dir / "divide.s");
+  // Each div needs the last one's result; the addis around it do not
+  file << "    li x5, 1000000\n"
+          "    li x6, 3\n"
+          "    li x7, 8\n"
+          "loop:\n"
+          "    div x5, x5, x6\n"
+          "    addi x9, x9, 1\n"
+          "    addi x10, x10, 2\n"
+          "    addi x11, x11, 3\n"
+          "    addi x7, x7, -1\n"
+          "    bne x7, x0, loop\n";
+  file.close();
+  AssembledProgram program = assemble((dir / "divide.s").string());
+
+  vm_config::VmConfig saved = vm_config::config;
+  vm_config::config.modifyConfig("BranchPrediction", "branch_prediction_type", "bimodal");
+  std::ostringstream console;
+  OooVM vm(VmOutputPaths::InDirectory(dir));
+  vm.console_ = &console;
+  vm.silent_run_ = true;
+  vm.LoadProgram(program);
+  vm.Run();
+
+  // Stepping times the same core, one instruction at a time, and undo restarts it
+  OooVM stepped(VmOutputPaths::InDirectory(dir));
+  stepped.console_ = &console;
+  stepped.LoadProgram(program);
+  while (stepped.program_counter_ < stepped.program_size_) {
+    stepped.Step();
+  }
+  vm_config::config = saved;
+
+  const ooo::CoreStats &stats = vm.GetCore().GetStats();
+  EXPECT_EQ(vm.registers_.ReadGpr(5), 1000000u / 6561u);
+  EXPECT_EQ(stats.instructions, vm.instructions_retired_);
+  // The chain of eight divides sets the pace; everything else fits around it
+  uint64_t div_latency = vm_config::config.getOooCoreConfig().div_latency;
+  EXPECT_GE(vm.cycle_s_, 8u * div_latency);
+  EXPECT_LT(vm.cycle_s_, 8u * div_latency + 20u);
+  EXPECT_GT(stats.stalls[static_cast<size_t>(ooo::StallCause::Div)], 7u * (div_latency - 2u));
+  EXPECT_EQ(vm.stall_cycles_, stats.StallCycles());
+  EXPECT_FLOAT_EQ(vm.cpi_ * vm.ipc_, 1.0f);
+  EXPECT_NE(console.str().find("VM_OOO_STATS"), std::string::npos);
+
+  EXPECT_EQ(stepped.registers_.ReadGpr(5), vm.registers_.ReadGpr(5));
+  EXPECT_EQ(stepped.cycle_s_, vm.cycle_s_);
+  for (int i = 0; i < 10; ++i) {
+    stepped.Undo();
+  }
+  EXPECT_EQ(stepped.instructions_retired_, vm.instructions_retired_ - 10u);
+  stepped.Run();
+  EXPECT_EQ(stepped.registers_.ReadGpr(5), vm.registers_.ReadGpr(5));
+  EXPECT_EQ(stepped.instructions_retired_, vm.instructions_retired_);
+  std::filesystem::remove_all(dir);
+}
+
+TEST(VmTest, UndefinedAtomicsAreIllegal) {
+  std::filesystem::path dir = std::filesystem::temp_directory_path() / "vm_illegal_atomic_test";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+  std::ofstream file(dir / "amo.s");
+  file << ".data\n"
+          "counter: .dword 5\n"
+          ".text\n"
+          "    la a1, counter\n"
+          "    li t1, 1\n"
+          "    li t0, 77\n"
+          "    amoadd.d t0, t1, (a1)\n";
+  file.close();
+  AssembledProgram program = assemble((dir / "amo.s").string());
+  size_t amo = program.text_buffer.size() - 1;
+
+  // funct5 0b00111 is no A extension instruction, and neither is a byte-wide amoadd
+  for (uint32_t instruction : {(program.text_buffer[amo] & ~(0x1fu << 27)) | (0b00111u << 27),
+                               program.text_buffer[amo] & ~(0b111u << 12)}) {
+    AssembledProgram patched = program;
+    patched.text_buffer[amo] = instruction;
+    std::ostringstream console;
+    RVSSVM vm(VmOutputPaths::InDirectory(dir));
+    vm.console_ = &console;
+    vm.silent_run_ = true;
+    vm.LoadProgram(patched);
+    EXPECT_THROW(vm.Run(), std::runtime_error) << std::hex << instruction;
+    EXPECT_EQ(vm.registers_.ReadGpr(5), 77u);
+    EXPECT_EQ(vm.memory_controller_.ReadDoubleWord(vm_config::config.getDataSectionStart()), 5u);
+  }
+  std::filesystem::remove_all(dir);
+}